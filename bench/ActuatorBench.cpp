@@ -0,0 +1,121 @@
+#include <Actuator.h>
+#include <DeviceManager.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include "Bench.h"
+
+namespace {
+
+const size_t DEVICES = 64;
+const size_t OPS = 1000;
+const size_t BATCH = 16;
+const size_t PRODUCERS = 4;
+const uint32_t TIMEOUT_MS = 1000;
+
+void populate(DeviceManager& manager) {
+    char title[20];
+    for (size_t i = 1; i <= DEVICES; i++) {
+        snprintf(title, sizeof(title), "Device %zu", i);
+        manager.addDevice(static_cast<int>(i), title, "LED", static_cast<int>(i % 40), false);
+    }
+}
+
+// Submits, retrying while the queue is full, and waits for the result. A
+// waiter descheduled for long enough can find its result recycled; the
+// command was still applied, which the final state checks.
+void submitAndWait(Actuator& actuator, const DeviceCommand* commands, size_t count) {
+    uint32_t ticket;
+    while ((ticket = actuator.submit(commands, count)) == 0) std::this_thread::yield();
+    Actuator::Result result;
+    bool known = actuator.wait(ticket, TIMEOUT_MS, result);
+    if (known ? !result.applied : !actuator.isDone(ticket)) {
+        printf("actuator: ticket %u not applied\n", static_cast<unsigned int>(ticket));
+        abort();
+    }
+}
+
+void reportLatency(const Actuator& actuator) {
+    Actuator::LatencyStats stats = actuator.latency();
+    printf("%-40s %8s   -> enqueue-to-GPIO avg %.1f us, max %u us over %u commands\n", "", "",
+           stats.count ? double(stats.totalUs) / stats.count : 0.0, static_cast<unsigned int>(stats.maxUs),
+           static_cast<unsigned int>(stats.count));
+}
+
+} // namespace
+
+void benchActuator() {
+    bench::printHeader("Actuator");
+
+    // Each case gets its own actuator so the latency figures are its own;
+    // actuator tasks never exit, so neither the manager nor the actuator is freed
+    {
+        DeviceManager* manager = new DeviceManager();
+        populate(*manager);
+        Actuator* actuator = new Actuator();
+        actuator->begin(*manager);
+
+        bench::run("submit + wait (1 output)", DEVICES, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) {
+                           DeviceCommand command = {static_cast<int>(i % DEVICES) + 1, (i / DEVICES) % 2 == 0};
+                           submitAndWait(*actuator, &command, 1);
+                       }
+                   });
+        reportLatency(*actuator);
+    }
+
+    {
+        DeviceManager* manager = new DeviceManager();
+        populate(*manager);
+        Actuator* actuator = new Actuator();
+        actuator->begin(*manager);
+
+        DeviceCommand commands[BATCH];
+        bench::run("submit + wait (16 outputs)", DEVICES, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) {
+                           for (size_t c = 0; c < BATCH; c++) {
+                               commands[c].id = static_cast<int>(c) + 1;
+                               commands[c].status = ((i + c) & 1) != 0;
+                           }
+                           submitAndWait(*actuator, commands, BATCH);
+                       }
+                   });
+        reportLatency(*actuator);
+    }
+
+    {
+        DeviceManager* manager = new DeviceManager();
+        populate(*manager);
+        Actuator* actuator = new Actuator();
+        actuator->begin(*manager);
+
+        // Producer p owns devices p+1, p+1+PRODUCERS, ... and finishes with
+        // them all on, so the final state shows whether any command was lost
+        bench::run("submit + wait (4 producers)", DEVICES, OPS * PRODUCERS,
+                   [&] {
+                       std::vector<std::thread> producers;
+                       for (size_t p = 0; p < PRODUCERS; p++) {
+                           producers.emplace_back([&, p] {
+                               for (size_t i = 0; i < OPS; i++) {
+                                   size_t slot = (i * PRODUCERS + p) % DEVICES;
+                                   DeviceCommand command = {static_cast<int>(slot) + 1, i >= OPS - DEVICES / PRODUCERS};
+                                   submitAndWait(*actuator, &command, 1);
+                               }
+                           });
+                       }
+                       for (std::thread& producer : producers) producer.join();
+                   });
+        reportLatency(*actuator);
+
+        Device device;
+        for (size_t i = 0; i < DEVICES; i++) {
+            if (!manager->readDevice(i, device) || !device.status) {
+                printf("actuator: device %d lost its final command\n", device.id);
+                abort();
+            }
+        }
+    }
+}
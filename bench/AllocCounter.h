@@ -0,0 +1,17 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Process-wide heap counters, fed by the malloc family overrides in
+// AllocCounter.cpp (glibc only). operator new and the String/ArduinoJson
+// allocators all go through malloc, so every heap allocation is seen.
+struct AllocSnapshot {
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+AllocSnapshot allocSnapshot();
+
+#endif // ALLOC_COUNTER_H
@@ -0,0 +1,96 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "AllocCounter.h"
+
+// Tiny benchmark runner. Each round runs an untimed setup step followed by a
+// timed body that performs `ops` operations; rounds repeat until the timed
+// total passes minDuration. Results are reported per operation.
+namespace bench {
+
+const std::chrono::milliseconds MIN_DURATION(200);
+
+inline void printHeader(const char* suite) {
+    printf("\n== %s\n", suite);
+    printf("%-40s %8s %12s %10s %12s\n", "benchmark", "devices", "ns/op", "allocs/op", "bytes/op");
+}
+
+template <typename Setup, typename Body>
+void run(const char* name, size_t devices, size_t ops, Setup setup, Body body) {
+    typedef std::chrono::steady_clock Clock;
+    Clock::duration elapsed(0);
+    uint64_t totalOps = 0;
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+
+    while (elapsed < MIN_DURATION || totalOps == 0) {
+        setup();
+        AllocSnapshot before = allocSnapshot();
+        Clock::time_point start = Clock::now();
+        body();
+        elapsed += Clock::now() - start;
+        AllocSnapshot after = allocSnapshot();
+        allocations += after.allocations - before.allocations;
+        bytes += after.bytes - before.bytes;
+        totalOps += ops;
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    printf("%-40s %8zu %12.1f %10.2f %12.1f\n", name, devices, ns / totalOps,
+           double(allocations) / totalOps, double(bytes) / totalOps);
+}
+
+template <typename Body>
+void run(const char* name, size_t devices, size_t ops, Body body) {
+    run(name, devices, ops, [] {}, body);
+}
+
+// A check that did not hold: names the suite and what went wrong, then stops
+inline void fail(const char* suite, const char* what) {
+    printf("%s: %s\n", suite, what);
+    abort();
+}
+
+// Deterministic permutation of 1..n used as device ids / lookup order
+inline std::vector<int> shuffledIds(size_t n, uint32_t seed) {
+    std::vector<int> ids(n);
+    for (size_t i = 0; i < n; i++) ids[i] = static_cast<int>(i) + 1;
+    for (size_t i = n; i > 1; i--) {
+        seed = seed * 1664525u + 1013904223u;
+        size_t j = seed % i;
+        int tmp = ids[i - 1];
+        ids[i - 1] = ids[j];
+        ids[j] = tmp;
+    }
+    return ids;
+}
+
+} // namespace bench
+
+// Suites, one per translation unit
+void benchBoot();
+void benchDeviceManager();
+void benchHandlers();
+void benchActuator();
+void benchEncoding();
+void benchStore();
+void benchSettings();
+void benchScheduler();
+void benchPwm();
+void benchSampler();
+void benchAdmission();
+void benchMetrics();
+void benchBody();
+void benchQuery();
+void benchRouter();
+void benchSocket();
+void benchTrace();
+void benchFleet();
+
+#endif // BENCH_H
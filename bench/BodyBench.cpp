@@ -0,0 +1,80 @@
+#include <BodyAccumulator.h>
+#include <ESPAsyncWebServer.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Bench.h"
+
+// Firmware handler from src/main.cpp
+void handleConnect(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+
+namespace {
+
+typedef void (*BodyHandler)(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+
+const char CONNECT_BODY[] = "{\"password\":\"not the password\"}";
+const size_t BATCH = 100;
+
+std::vector<uint8_t> pattern(size_t len) {
+    std::vector<uint8_t> body(len);
+    for (size_t i = 0; i < len; i++) body[i] = static_cast<uint8_t>('a' + i * 7 % 26);
+    return body;
+}
+
+// Calls a body handler the way the server does, chunk bytes at a time
+void deliver(BodyHandler handler, AsyncWebServerRequest& request, const uint8_t* body, size_t len, size_t chunk) {
+    std::vector<uint8_t> segment;
+    for (size_t index = 0; index < len; index += chunk) {
+        size_t n = len - index < chunk ? len - index : chunk;
+        segment.assign(body + index, body + index + n);
+        handler(&request, segment.data(), n, index, len);
+    }
+}
+
+// What a second chunk costs: one buffer of the body's size and a copy
+void benchCost() {
+    std::vector<uint8_t> body = pattern(1200);
+    char* out;
+    const size_t sizes[] = {1200, 536, 64};
+    const char* names[] = {"feed(), 1200 B in 1 chunk", "feed(), 1200 B in 536 B chunks", "feed(), 1200 B in 64 B chunks"};
+    for (size_t i = 0; i < 3; i++) {
+        size_t chunk = sizes[i];
+        bench::run(names[i], 1, BATCH,
+                   [&] {
+                       for (size_t n = 0; n < BATCH; n++) {
+                           void* storage = nullptr;
+                           for (size_t index = 0; index < body.size(); index += chunk) {
+                               size_t len = body.size() - index < chunk ? body.size() - index : chunk;
+                               BodyAccumulator::feed(storage, body.data() + index, len, index, body.size(), out);
+                           }
+                           free(storage);
+                       }
+                   });
+    }
+
+    const uint8_t* connect = reinterpret_cast<const uint8_t*>(CONNECT_BODY);
+    size_t connectLen = strlen(CONNECT_BODY);
+    std::vector<std::unique_ptr<AsyncWebServerRequest>> requests;
+    auto fresh = [&] {
+        requests.clear();
+        for (size_t i = 0; i < BATCH; i++) requests.emplace_back(new AsyncWebServerRequest(HTTP_POST, "/api/connect"));
+    };
+    bench::run("POST /api/connect, 1 chunk", 1, BATCH, fresh,
+               [&] {
+                   for (auto& request : requests) deliver(handleConnect, *request, connect, connectLen, connectLen);
+               });
+    bench::run("POST /api/connect, 8 B chunks", 1, BATCH, fresh,
+               [&] {
+                   for (auto& request : requests) deliver(handleConnect, *request, connect, connectLen, 8);
+               });
+    requests.clear();
+}
+
+} // namespace
+
+void benchBody() {
+    bench::printHeader("Body");
+    benchCost();
+}
@@ -0,0 +1,107 @@
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <HostControl.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <WiFiLink.h>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include "Bench.h"
+
+// Firmware entry points and globals from src/main.cpp
+void setup();
+void loop();
+extern AsyncWebServer server;
+extern WiFiLink wifiLink;
+extern std::atomic<uint32_t> firstResponseMs;
+
+namespace {
+
+// Scaled-down but proportionate to a real access point
+const uint32_t ASSOCIATE_MS = 150;
+const uint32_t DHCP_MS = 400;
+const uint32_t GIVE_UP_MS = 5000;
+
+typedef std::chrono::steady_clock Clock;
+
+double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Runs loop() until the link is up, returning the longest single call
+double loopUntilConnected(Clock::time_point start) {
+    double longest = 0;
+    while (!wifiLink.connected()) {
+        if (msSince(start) > GIVE_UP_MS) bench::fail("boot", "station never connected");
+        Clock::time_point call = Clock::now();
+        loop();
+        double took = msSince(call);
+        if (took > longest) longest = took;
+    }
+    return longest;
+}
+
+void report(const char* name, double ms, const char* detail) {
+    printf("%-40s %8s   -> %.1f ms, %s\n", name, "", ms, detail);
+}
+
+} // namespace
+
+void benchBoot() {
+    bench::printHeader("Boot (mock WiFi: 150 ms association, 400 ms DHCP)");
+
+    host::clearPreferences();
+    host::setWiFiTiming(ASSOCIATE_MS, DHCP_MS);
+    Preferences prefs;
+    prefs.begin("wifi", false);
+    prefs.putString("ssid", "HomeNet");
+    prefs.putString("password", "hunter22");
+    prefs.putBool("configured", true);
+    prefs.putUInt("mode", 1);
+    prefs.end();
+
+    // First boot: nothing cached, so DHCP, then the static address in place
+    uint32_t associations = host::wifiAssociationCount();
+    Clock::time_point boot = Clock::now();
+    setup();
+    report("setup() returns", msSince(boot), "server listening");
+
+    AsyncWebServerRequest request(HTTP_OPTIONS, "/api/devices");
+    server.dispatch(&request);
+    if (firstResponseMs == 0 || !request.response()) bench::fail("boot", "no response before the link was up");
+    char detail[64];
+    snprintf(detail, sizeof(detail), "%d, link %s", request.response()->code(),
+             wifiLink.connected() ? "up" : "still associating");
+    report("boot to first response", msSince(boot), detail);
+
+    double longest = loopUntilConnected(boot);
+    snprintf(detail, sizeof(detail), "%u association(s), longest loop() %.1f ms",
+             static_cast<unsigned int>(host::wifiAssociationCount() - associations), longest);
+    report("boot to IP (DHCP, first boot)", msSince(boot), detail);
+    if (WiFi.localIP()[3] != WiFiLink::STATIC_HOST) bench::fail("boot", "static address not applied");
+
+    // Later boot: the cached config goes out with the only association
+    WiFi.disconnect();
+    wifiLink = WiFiLink();
+    associations = host::wifiAssociationCount();
+    boot = Clock::now();
+    wifiLink.begin("HomeNet", "hunter22", millis());
+    loopUntilConnected(boot);
+    snprintf(detail, sizeof(detail), "%u association(s)",
+             static_cast<unsigned int>(host::wifiAssociationCount() - associations));
+    report("boot to IP (cached static)", msSince(boot), detail);
+    if (!wifiLink.staticFromCache() || host::wifiAssociationCount() - associations != 1)
+        bench::fail("boot", "cached config did not connect in one association");
+
+    // Access point drops out: loop() keeps running while it reconnects
+    Clock::time_point lost = Clock::now();
+    host::dropWiFi();
+    while (wifiLink.connected()) loop();
+    if (wifiLink.state() != WiFiLink::CONNECTING) bench::fail("boot", "loss not noticed");
+    longest = loopUntilConnected(lost);
+    if (host::wifiAssociationCount() - associations != 2) bench::fail("boot", "reconnect took more than one association");
+    snprintf(detail, sizeof(detail), "longest loop() %.1f ms", longest);
+    report("link lost to IP again", msSince(lost), detail);
+}
@@ -0,0 +1,227 @@
+#include <DeviceManager.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Bench.h"
+
+namespace {
+
+const size_t FLEET_SIZES[] = {6, 64, 1000, 10000};
+const uint8_t OUTPUT_PINS[] = {2, 4, 5, 18, 19, 21, 22, 23};
+const size_t MIN_LOOKUPS = 4096;
+
+volatile int sink;
+
+template <typename Manager>
+void populate(Manager& manager, const std::vector<int>& ids) {
+    char title[20];
+    for (int id : ids) {
+        snprintf(title, sizeof(title), "Device %d", id);
+        manager.addDevice(id, title, "LED", OUTPUT_PINS[id % sizeof(OUTPUT_PINS)], false);
+    }
+}
+
+// Runs every operation on one fleet size; names get the suffix, e.g.
+// " (fixed)", to tell the storage kinds apart
+template <typename Manager>
+void benchFleet(size_t n, const char* suffix) {
+    char name[48];
+    auto named = [&](const char* what) {
+        snprintf(name, sizeof(name), "%s%s", what, suffix);
+        return name;
+    };
+    std::vector<int> ids = bench::shuffledIds(n, 1);
+    std::vector<int> order = bench::shuffledIds(n, 2);
+    size_t reps = n >= MIN_LOOKUPS ? 1 : MIN_LOOKUPS / n;
+    Manager manager;
+
+    bench::run(named("addDevice"), n, n,
+               [&] { manager = Manager(); },
+               [&] { populate(manager, ids); });
+
+    Device device;
+    bench::run(named("copyDevice"), n, n * reps,
+               [&] {
+                   for (size_t r = 0; r < reps; r++) {
+                       for (int id : order) {
+                           manager.copyDevice(id, device);
+                           sink = device.gpioPin;
+                       }
+                   }
+               });
+
+    bool status = false;
+    bench::run(named("updateDeviceStatus"), n, n * reps,
+               [&] {
+                   status = !status;
+                   for (size_t r = 0; r < reps; r++) {
+                       for (int id : order) manager.updateDeviceStatus(id, status);
+                   }
+               });
+
+    bench::run(named("copyDevice (miss)"), n, MIN_LOOKUPS,
+               [&] {
+                   for (size_t i = 0; i < MIN_LOOKUPS; i++) {
+                       sink = manager.copyDevice(static_cast<int>(n + 1 + i), device);
+                   }
+               });
+
+    bench::run(named("deleteDevice"), n, n,
+               [&] {
+                   manager = Manager();
+                   populate(manager, ids);
+               },
+               [&] {
+                   for (int id : order) manager.deleteDevice(id);
+               });
+
+    // Steady-state churn: replace the oldest device with a fresh id, then
+    // check lookups have not degraded from the index deletions
+    manager = Manager();
+    populate(manager, ids);
+    std::vector<int> live = ids;
+    int nextId = static_cast<int>(n) + 1;
+    size_t cursor = 0;
+    bench::run(named("deleteDevice+addDevice (churn)"), n, MIN_LOOKUPS,
+               [&] {
+                   for (size_t i = 0; i < MIN_LOOKUPS; i++) {
+                       manager.deleteDevice(live[cursor]);
+                       manager.addDevice(nextId, "Churn", "LED", OUTPUT_PINS[nextId % sizeof(OUTPUT_PINS)], false);
+                       live[cursor] = nextId++;
+                       cursor = (cursor + 1) % n;
+                   }
+               });
+
+    bench::run(named("copyDevice (after churn)"), n, n * reps,
+               [&] {
+                   for (size_t r = 0; r < reps; r++) {
+                       for (int id : live) {
+                           manager.copyDevice(id, device);
+                           sink = device.gpioPin;
+                       }
+                   }
+               });
+}
+
+// The column layout against the array of whole Devices it replaced: a scan
+// for the devices that are on, a status snapshot, and a diff of two
+// snapshots n / 16 toggles apart
+void benchLayout(size_t n) {
+    std::vector<int> ids = bench::shuffledIds(n, 1);
+    BasicDeviceManager<0> manager;
+    populate(manager, ids);
+    std::vector<Device> aos;
+    for (const Device& device : manager.getAllDevices()) aos.push_back(device);
+    if (aos.size() != n || strcmp(aos[0].type, "LED") != 0) bench::fail("devicemanager", "getAllDevices view incomplete");
+    for (size_t i = 0; i < n; i += 3) {
+        manager.updateDeviceStatus(aos[i].id, true);
+        aos[i].status = true;
+    }
+    size_t reps = n >= MIN_LOOKUPS ? 1 : MIN_LOOKUPS / n;
+
+    bench::run("scan ids on, AoS vector", n, n * reps,
+               [&] {
+                   for (size_t r = 0; r < reps; r++) {
+                       for (const Device& device : aos) {
+                           if (device.status) sink = device.id;
+                       }
+                   }
+               });
+    const DeviceTable<0>& table = manager.getAllDevices();
+    bench::run("scan ids on, columns", n, n * reps,
+               [&] {
+                   for (size_t r = 0; r < reps; r++) {
+                       table.getStatuses().forEachSet([&](size_t slot) { sink = table.id(slot); });
+                   }
+               });
+
+    std::vector<uint8_t> aosBefore(n);
+    std::vector<uint8_t> aosAfter(n);
+    bench::run("snapshot, AoS vector", n, n * reps,
+               [&] {
+                   for (size_t r = 0; r < reps; r++) {
+                       for (size_t i = 0; i < n; i++) aosBefore[i] = aos[i].status;
+                   }
+               });
+    BasicDeviceManager<0>::Snapshot before;
+    BasicDeviceManager<0>::Snapshot after;
+    manager.takeSnapshot(before);
+    bench::run("snapshot, columns", n, n * reps,
+               [&] {
+                   for (size_t r = 0; r < reps; r++) manager.takeSnapshot(before);
+               });
+
+    for (size_t i = 0; i < n; i += 16) {
+        manager.updateDeviceStatus(aos[i].id, !aos[i].status);
+        aos[i].status = !aos[i].status;
+    }
+    for (size_t i = 0; i < n; i++) aosAfter[i] = aos[i].status;
+    manager.takeSnapshot(after);
+    size_t expected = (n + 15) / 16;
+    size_t changed = 0;
+    bench::run("diff, AoS vector", n, n * reps,
+               [&] {
+                   for (size_t r = 0; r < reps; r++) {
+                       changed = 0;
+                       for (size_t i = 0; i < n; i++) {
+                           if (aosBefore[i] != aosAfter[i]) {
+                               sink = aos[i].id;
+                               changed++;
+                           }
+                       }
+                   }
+               });
+    if (changed != expected) bench::fail("devicemanager", "AoS diff miscounted");
+    DeviceBits<0> toggled;
+    bench::run("diff, columns", n, n * reps,
+               [&] {
+                   for (size_t r = 0; r < reps; r++) {
+                       changed = 0;
+                       before.diff(after, toggled);
+                       toggled.forEachSet([&](size_t slot) {
+                           sink = table.id(slot);
+                           changed++;
+                       });
+                   }
+               });
+    if (changed != expected) bench::fail("devicemanager", "column diff miscounted");
+    manager.deleteDevice(ids[0]);
+    manager.takeSnapshot(after);
+    if (before.diff(after, toggled)) bench::fail("devicemanager", "snapshots across a delete compared");
+}
+
+// Ids a multiple of the index size apart, as when ids encode a group in
+// their high bits; each must still find its device in a probe or two
+void benchStrided(size_t n) {
+    BasicDeviceManager<0> manager;
+    std::vector<int> ids(n);
+    for (size_t i = 0; i < n; i++) ids[i] = static_cast<int>((i + 1) * deviceIndexTableSize(n));
+    populate(manager, ids);
+    size_t reps = n >= MIN_LOOKUPS ? 1 : MIN_LOOKUPS / n;
+
+    Device device;
+    bench::run("copyDevice (strided ids)", n, n * reps,
+               [&] {
+                   for (size_t r = 0; r < reps; r++) {
+                       for (int id : ids) {
+                           if (!manager.copyDevice(id, device)) bench::fail("devicemanager", "strided id lost");
+                           sink = device.gpioPin;
+                       }
+                   }
+               });
+}
+
+} // namespace
+
+void benchDeviceManager() {
+    bench::printHeader("DeviceManager");
+
+    // The growable registry at every size, then the build's fixed one up to
+    // DEVICE_CAPACITY
+    for (size_t n : FLEET_SIZES) {
+        benchFleet<BasicDeviceManager<0>>(n, "");
+        if (n <= DEVICE_CAPACITY) benchFleet<DeviceManager>(n, " (fixed)");
+    }
+    for (size_t n : FLEET_SIZES) benchLayout(n);
+    for (size_t n : FLEET_SIZES) benchStrided(n);
+}
@@ -0,0 +1,107 @@
+#include <ArduinoJson.h>
+#include <DeviceListJson.h>
+#include <DeviceListMsgPack.h>
+#include <DeviceManager.h>
+#include <stdio.h>
+#include <vector>
+#include "Bench.h"
+
+// JSON vs MessagePack for the same documents: the hand-written device list
+// writers the firmware streams from, ArduinoJson's serializers over a built
+// document, and decoding as a client or the control handlers would
+namespace {
+
+const size_t FLEET_SIZES[] = {6, 64, 1000};
+const size_t OPS = 100;
+
+void populate(DeviceManager& manager, size_t n) {
+    char title[20];
+    for (size_t i = 1; i <= n; i++) {
+        snprintf(title, sizeof(title), "Device %zu", i);
+        manager.addDevice(static_cast<int>(i), title, i % 2 ? "LED" : "FAN", static_cast<int>(i % 40), i % 3 == 0);
+    }
+}
+
+template <typename Writer>
+std::vector<uint8_t> render(const DeviceManager& manager) {
+    std::vector<uint8_t> out;
+    Writer writer(manager);
+    uint8_t chunk[256];
+    size_t n;
+    while ((n = writer.read(chunk, sizeof(chunk))) > 0) out.insert(out.end(), chunk, chunk + n);
+    return out;
+}
+
+void reportSize(size_t bytes) {
+    printf("%-40s %8s   -> %zu bytes\n", "", "", bytes);
+}
+
+} // namespace
+
+void benchEncoding() {
+    bench::printHeader("Encoding");
+
+    for (size_t n : FLEET_SIZES) {
+        DeviceManager manager;
+        populate(manager, n);
+        std::vector<uint8_t> json = render<DeviceListJson>(manager);
+        std::vector<uint8_t> msgPack = render<DeviceListMsgPack>(manager);
+        std::vector<uint8_t> sink(json.size());
+
+        bench::run("DeviceListJson (device list)", n, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) {
+                           DeviceListJson writer(manager);
+                           writer.read(sink.data(), sink.size());
+                       }
+                   });
+        reportSize(json.size());
+        bench::run("DeviceListMsgPack (device list)", n, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) {
+                           DeviceListMsgPack writer(manager);
+                           writer.read(sink.data(), sink.size());
+                       }
+                   });
+        reportSize(msgPack.size());
+
+        // Big enough for the parsed list, strings included
+        const size_t capacity = JSON_OBJECT_SIZE(3) + JSON_ARRAY_SIZE(n) + n * (JSON_OBJECT_SIZE(5) + 32) + 256;
+        DynamicJsonDocument doc(capacity);
+        deserializeJson(doc, json.data(), json.size());
+
+        bench::run("serializeJson (device list)", n, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) serializeJson(doc, sink.data(), sink.size());
+                   });
+        bench::run("serializeMsgPack (device list)", n, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) serializeMsgPack(doc, sink.data(), sink.size());
+                   });
+        bench::run("deserializeJson (device list)", n, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) deserializeJson(doc, json.data(), json.size());
+                   });
+        bench::run("deserializeMsgPack (device list)", n, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) deserializeMsgPack(doc, msgPack.data(), msgPack.size());
+                   });
+    }
+
+    // One /api/control body: {"device":42,"status":true}
+    const char controlJson[] = "{\"device\":42,\"status\":true}";
+    const uint8_t controlMsgPack[] = {0x82, 0xa6, 'd', 'e', 'v', 'i', 'c', 'e', 0x2a, 0xa6, 's', 't', 'a', 't', 'u', 's', 0xc3};
+    StaticJsonDocument<JSON_OBJECT_SIZE(2)> command;
+    const size_t CONTROL_OPS = 1000;
+
+    bench::run("deserializeJson (control body)", 1, CONTROL_OPS,
+               [&] {
+                   for (size_t i = 0; i < CONTROL_OPS; i++) deserializeJson(command, controlJson, sizeof(controlJson) - 1);
+               });
+    reportSize(sizeof(controlJson) - 1);
+    bench::run("deserializeMsgPack (control body)", 1, CONTROL_OPS,
+               [&] {
+                   for (size_t i = 0; i < CONTROL_OPS; i++) deserializeMsgPack(command, controlMsgPack, sizeof(controlMsgPack));
+               });
+    reportSize(sizeof(controlMsgPack));
+}
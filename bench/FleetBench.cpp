@@ -0,0 +1,127 @@
+#include <Arduino.h>
+#include <DeviceManager.h>
+#include <FleetJson.h>
+#include <Gateway.h>
+#include <JsonScanner.h>
+#include <chrono>
+#include <initializer_list>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "Bench.h"
+#include "StandIn.h"
+
+namespace {
+
+const size_t OPS = 20;
+// Devices per stand-in board
+const size_t BOARD_SIZE = Gateway::PEER_DEVICES <= 100 ? Gateway::PEER_DEVICES - 1 : 100;
+static_assert(3 * BOARD_SIZE <= FleetCache::CAPACITY, "the stand-ins' devices do not fit the merged list");
+
+typedef std::chrono::steady_clock Clock;
+
+double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Polls until done() or timeoutMs has passed
+template <typename Done>
+bool waitFor(Done done, uint32_t timeoutMs) {
+    Clock::time_point start = Clock::now();
+    while (!done()) {
+        if (msSince(start) > timeoutMs) return false;
+        usleep(1000);
+    }
+    return true;
+}
+
+// A peer's list read without a document
+void benchScanner() {
+    static DeviceManager manager;
+    for (int i = 1; i <= 50; i++) manager.addDevice(i, "Scanned", "LED", 2, i % 2 == 0);
+    std::string whole = StandIn::listOf(manager);
+    bench::run("JsonScanner, peer device list", manager.size(), 1, [&] {
+        JsonScanner scanner;
+        size_t at = 0;
+        size_t used;
+        while (at < whole.size()) {
+            scanner.next(whole.data() + at, whole.size() - at, used);
+            at += used;
+        }
+        if (!scanner.finished()) bench::fail("fleet", "list not finished");
+    });
+}
+
+Gateway::Command command(int id, bool status) {
+    Gateway::Command out = {};
+    out.command.id = id;
+    out.command.status = status;
+    return out;
+}
+
+// Submits and waits; anything but 200 for every command stops the bench
+void control(Gateway& gateway, std::initializer_list<Gateway::Command> commands) {
+    std::vector<Gateway::Command> list(commands);
+    Gateway::Result result;
+    uint32_t ticket = gateway.submit(list.data(), list.size());
+    if (ticket == 0 || !gateway.wait(ticket, 2000, result)) bench::fail("fleet", "command not answered");
+    for (size_t i = 0; i < result.count; i++) {
+        if (result.codes[i] != 200) bench::fail("fleet", "round trip failed");
+    }
+}
+
+Gateway::PeerConfig peerConfig(const char* name, uint16_t port) {
+    Gateway::PeerConfig config = {};
+    strcpy(config.name, name);
+    config.address = IPAddress(127, 0, 0, 1);
+    config.port = port;
+    strcpy(config.password, StandIn::PASSWORD);
+    return config;
+}
+
+// Round trips through a gateway fronting three stand-in boards, one peer
+// and three at once, and the merged list they make
+void benchGateway() {
+    StandIn alpha(1, BOARD_SIZE, 0xa1);
+    StandIn beta(101, BOARD_SIZE, 0xb2);
+    StandIn gamma(201, BOARD_SIZE, 0xc3);
+    if (!alpha.serving() || !beta.serving() || !gamma.serving()) bench::fail("fleet", "stand-in cannot listen");
+
+    static Gateway gateway("fleet-bench");
+    Gateway::Timing timing;
+    timing.refreshMs = 40;
+    timing.timeoutMs = 250;
+    gateway.begin(timing);
+    if (gateway.addPeer(peerConfig("alpha", alpha.port())) != Gateway::ADDED ||
+        gateway.addPeer(peerConfig("beta", beta.port())) != Gateway::ADDED ||
+        gateway.addPeer(peerConfig("gamma", gamma.port())) != Gateway::ADDED)
+        bench::fail("fleet", "peers not registered");
+    if (!waitFor([&] { return gateway.cache().size() == 3 * BOARD_SIZE; }, 3000)) bench::fail("fleet", "peer lists not merged");
+
+    bool toggle = false;
+    bench::run("Gateway control, 1 peer", gateway.cache().size(), OPS, [&] {
+        for (size_t i = 0; i < OPS; i++) control(gateway, {command(10, toggle = !toggle)});
+    });
+    bench::run("Gateway control, 3 peers at once", gateway.cache().size(), OPS, [&] {
+        for (size_t i = 0; i < OPS; i++) {
+            toggle = !toggle;
+            control(gateway, {command(11, toggle), command(111, toggle), command(211, toggle)});
+        }
+    });
+    bench::run("FleetJson::read(), merged list", gateway.cache().size(), 1, [&] {
+        FleetJson writer(gateway.cache());
+        uint8_t buffer[1436];
+        while (writer.read(buffer, sizeof(buffer)) > 0) {
+        }
+    });
+}
+
+} // namespace
+
+void benchFleet() {
+    bench::printHeader("Fleet gateway (3 stand-in peers over loopback)");
+    benchScanner();
+    benchGateway();
+}
@@ -0,0 +1,262 @@
+#include <Actuator.h>
+#include <AsyncEventSource.h>
+#include <DeviceManager.h>
+#include <ESPAsyncWebServer.h>
+#include <SessionTable.h>
+#include <stdio.h>
+#include <string.h>
+#include "Bench.h"
+
+// Firmware globals and handlers from src/main.cpp
+extern DeviceManager deviceManager;
+extern Actuator actuator;
+extern SessionTable sessions;
+extern AsyncEventSource events;
+bool checkAuthorization(AsyncWebServerRequest *request);
+bool isAuthorizedEventStream(AsyncWebServerRequest *request);
+void replayDeviceChanges(AsyncEventSourceClient *client);
+void publishDeviceChanges();
+void handleGetDevices(AsyncWebServerRequest *request);
+void handleControl(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleControlBatch(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+
+namespace {
+
+const size_t FLEET_SIZES[] = {6, 64, 1000};
+const size_t OPS = 1000;
+const size_t BATCH = 16;
+
+void populate(size_t n) {
+    char title[20];
+    deviceManager = DeviceManager();
+    for (size_t i = 1; i <= n; i++) {
+        snprintf(title, sizeof(title), "Device %zu", i);
+        deviceManager.addDevice(static_cast<int>(i), title, "LED", 2, false);
+    }
+}
+
+char token[SessionTable::TOKEN_LENGTH + 1];
+
+void authorize(AsyncWebServerRequest &request) {
+    request.addHeader("Authorization", String("Bearer ") + token);
+}
+
+// Pull the response body out the way AsyncTCP would, one MSS at a time
+size_t drain(AsyncWebServerRequest &request) {
+    AsyncWebServerResponse *resp = request.response();
+    return resp ? resp->drain() : 0;
+}
+
+void reportPayload(AsyncWebServerRequest &request, size_t bodyLength) {
+    AsyncWebServerResponse *resp = request.response();
+    if (resp) printf("%-40s %8s   -> %d, %zu byte body\n", "", "", resp->code(), bodyLength);
+}
+
+void benchAuthorization() {
+    bench::printHeader("Authorization");
+
+    // A full session table, so lookups probe as far as they ever will
+    for (size_t i = 0; i < SessionTable::CAPACITY; i++) sessions.issue(millis(), 3600000, token);
+
+    struct Case {
+        const char *name;
+        const char *header;
+    };
+    String valid = String("Bearer ") + token;
+    const Case cases[] = {
+        {"checkAuthorization (valid)", valid.c_str()},
+        {"checkAuthorization (wrong token)", "Bearer 0123456789abcdef0123456789abcdef"},
+        {"checkAuthorization (garbage token)", "Bearer eyJzdWIiOiIxMjM0NTY3ODkwIiwibmFtZSI6IkpvaG4gRG9lIn0"},
+        {"checkAuthorization (not Bearer)", "Basic dXNlcjpwYXNz"},
+        {"checkAuthorization (missing)", nullptr},
+    };
+
+    for (const Case &c : cases) {
+        AsyncWebServerRequest request(HTTP_GET, "/api/devices");
+        if (c.header) request.addHeader("Authorization", c.header);
+        bench::run(c.name, 0, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) {
+                           checkAuthorization(&request);
+                           drain(request);
+                       }
+                   });
+    }
+}
+
+// Events of the stream's client from the first'th on, as "event@id" lines
+String eventsOf(const AsyncEventSourceClient &client, size_t first = 0) {
+    String out;
+    for (size_t i = first; i < client.messages().size(); i++) {
+        const char *frame = client.messages()[i].c_str();
+        const char *id = strstr(frame, "id: ");
+        const char *event = strstr(frame, "event: ");
+        if (!event) continue;
+        out += String(event + 7).substring(0, strcspn(event + 7, "\r"));
+        out += "@";
+        out += id ? String(id + 4).substring(0, strcspn(id + 4, "\r")) : String("-");
+        out += "\n";
+    }
+    return out;
+}
+
+// /api/events resumes a Last-Event-ID of this boot, resyncs one from
+// another boot, and holds live events back from a stream still opening
+void checkEvents() {
+    deviceManager = DeviceManager();
+    deviceManager.startJournal(1000);
+    deviceManager.addDevice(1, "Lamp", "LED", 2, false);
+    deviceManager.addDevice(2, "Fan", "FAN", 4, false);
+    deviceManager.addDevice(3, "Heater", "HEATER", 5, false);
+    publishDeviceChanges();
+
+    AsyncWebServerRequest request(HTTP_GET, "/api/events");
+    authorize(request);
+    AsyncEventSourceClient *resumed = events.connect(&request, 1001);
+    AsyncEventSourceClient *earlierBoot = events.connect(&request, 7);
+    AsyncEventSourceClient *ahead = events.connect(&request, 5000);
+    if (!resumed || !earlierBoot || !ahead) bench::fail("handlers", "event stream refused");
+    if (eventsOf(*resumed) != "added@1002\nadded@1003\n") bench::fail("handlers", "Last-Event-ID not resumed");
+    if (eventsOf(*earlierBoot) != "resync@1003\n" || eventsOf(*ahead) != "resync@1003\n")
+        bench::fail("handlers", "id from another boot not resynced");
+
+    // The filter has let a stream through; its client is not replayed yet
+    size_t seen = resumed->messages().size();
+    if (!isAuthorizedEventStream(&request)) bench::fail("handlers", "event stream refused");
+    deviceManager.updateDeviceStatus(2, true);
+    publishDeviceChanges();
+    if (resumed->messages().size() != seen) bench::fail("handlers", "live event sent ahead of a replay");
+    AsyncEventSourceClient opened(1003);
+    replayDeviceChanges(&opened);
+    publishDeviceChanges();
+    if (eventsOf(*resumed, seen) != "status@1004\n") bench::fail("handlers", "held event not sent after the replay");
+    events.disconnectAll();
+    printf("%-40s %8s   -> ok, resume, resync across boots, held for replay\n", "/api/events", "");
+}
+
+} // namespace
+
+void benchHandlers() {
+    benchAuthorization();
+
+    // Control requests are applied on the actuator task, as on the device
+    actuator.begin(deviceManager);
+
+    bench::printHeader("Handlers");
+    checkEvents();
+
+    for (size_t n : FLEET_SIZES) {
+        populate(n);
+        size_t bodyLength = 0;
+
+        AsyncWebServerRequest getRequest(HTTP_GET, "/api/devices");
+        authorize(getRequest);
+        bench::run("handleGetDevices", n, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) {
+                           handleGetDevices(&getRequest);
+                           bodyLength = drain(getRequest);
+                       }
+                   });
+        reportPayload(getRequest, bodyLength);
+
+        AsyncWebServerRequest msgPackRequest(HTTP_GET, "/api/devices");
+        authorize(msgPackRequest);
+        msgPackRequest.addHeader("Accept", "application/msgpack");
+        bench::run("handleGetDevices (msgpack)", n, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) {
+                           handleGetDevices(&msgPackRequest);
+                           bodyLength = drain(msgPackRequest);
+                       }
+                   });
+        reportPayload(msgPackRequest, bodyLength);
+
+        // Poll with the ETag from the previous response: answered with 304
+        AsyncWebServerRequest pollRequest(HTTP_GET, "/api/devices");
+        authorize(pollRequest);
+        pollRequest.addHeader("If-None-Match", getRequest.response()->header("ETag")->value());
+        bench::run("handleGetDevices (If-None-Match)", n, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) {
+                           handleGetDevices(&pollRequest);
+                           bodyLength = drain(pollRequest);
+                       }
+                   });
+        reportPayload(pollRequest, bodyLength);
+
+        // Every poll follows a status change, so the cache is always rebuilt
+        bool toggle = false;
+        bench::run("handleGetDevices (after each update)", n, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) {
+                           toggle = !toggle;
+                           deviceManager.updateDeviceStatus(1, toggle);
+                           handleGetDevices(&getRequest);
+                           bodyLength = drain(getRequest);
+                       }
+                   });
+
+        AsyncWebServerRequest controlRequest(HTTP_PUT, "/api/control");
+        authorize(controlRequest);
+        char body[2][48];
+        size_t len[2];
+        for (int s = 0; s < 2; s++) {
+            len[s] = static_cast<size_t>(snprintf(body[s], sizeof(body[s]), "{\"device\":%zu,\"status\":%s}", n / 2 + 1, s ? "true" : "false"));
+        }
+        char scratch[48];
+        bench::run("handleControl", n, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) {
+                           // The parser may write into the body, so hand it a fresh copy
+                           memcpy(scratch, body[i & 1], len[i & 1] + 1);
+                           handleControl(&controlRequest, reinterpret_cast<uint8_t *>(scratch), len[i & 1], 0, len[i & 1]);
+                           bodyLength = drain(controlRequest);
+                       }
+                   });
+        reportPayload(controlRequest, bodyLength);
+
+        // BATCH outputs switched as one batch request vs one request each
+        char batchBody[2][BATCH * 32];
+        size_t batchLen[2];
+        char singleBody[2][BATCH][48];
+        size_t singleLen[2][BATCH];
+        for (int s = 0; s < 2; s++) {
+            size_t pos = 0;
+            batchBody[s][pos++] = '[';
+            for (size_t i = 0; i < BATCH; i++) {
+                size_t id = i % n + 1;
+                const char *status = ((i + s) & 1) ? "true" : "false";
+                pos += snprintf(batchBody[s] + pos, sizeof(batchBody[s]) - pos, "%s{\"device\":%zu,\"status\":%s}", i ? "," : "", id, status);
+                singleLen[s][i] = static_cast<size_t>(snprintf(singleBody[s][i], sizeof(singleBody[s][i]), "{\"device\":%zu,\"status\":%s}", id, status));
+            }
+            batchBody[s][pos++] = ']';
+            batchBody[s][pos] = 0;
+            batchLen[s] = pos;
+        }
+
+        char batchScratch[BATCH * 32];
+        AsyncWebServerRequest batchRequest(HTTP_PUT, "/api/control/batch");
+        authorize(batchRequest);
+        bench::run("handleControlBatch (16 outputs)", n, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) {
+                           memcpy(batchScratch, batchBody[i & 1], batchLen[i & 1] + 1);
+                           handleControlBatch(&batchRequest, reinterpret_cast<uint8_t *>(batchScratch), batchLen[i & 1], 0, batchLen[i & 1]);
+                           bodyLength = drain(batchRequest);
+                       }
+                   });
+        reportPayload(batchRequest, bodyLength);
+
+        bench::run("handleControl x16 (16 outputs)", n, OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) {
+                           for (size_t c = 0; c < BATCH; c++) {
+                               memcpy(scratch, singleBody[i & 1][c], singleLen[i & 1][c] + 1);
+                               handleControl(&controlRequest, reinterpret_cast<uint8_t *>(scratch), singleLen[i & 1][c], 0, singleLen[i & 1][c]);
+                               drain(controlRequest);
+                           }
+                       }
+                   });
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef LOOPBACK_CLIENT_H
+#define LOOPBACK_CLIENT_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// A blocking HTTP/1.1 client for SocketServer, shared by the socket bench
+// and tests. Each connects from its own loopback address so admission
+// control counts them apart. A failed connection or a response cut short
+// reads as code 0.
+struct LoopbackResponse {
+    int code = 0;
+    std::string head;
+    std::string body;
+    bool chunked = false;
+};
+
+class LoopbackClient {
+private:
+    int fd;
+    bool open;
+    std::string input;
+
+    bool fill() {
+        char buffer[16384];
+        ssize_t n = open ? recv(fd, buffer, sizeof(buffer), 0) : 0;
+        if (n <= 0) {
+            open = false;
+            return false;
+        }
+        input.append(buffer, n);
+        return true;
+    }
+
+    // Waits for n bytes of input
+    bool need(size_t n) {
+        while (input.size() < n) {
+            if (!fill()) return false;
+        }
+        return true;
+    }
+
+public:
+    explicit LoopbackClient(uint16_t port) {
+        static uint32_t next = 0;
+        next++;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(0x7f020000 | (next / 250 % 250) << 8 | (1 + next % 250));
+        sockaddr_in remote = {};
+        remote.sin_family = AF_INET;
+        remote.sin_port = htons(port);
+        remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        open = bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) == 0 &&
+               connect(fd, reinterpret_cast<sockaddr*>(&remote), sizeof(remote)) == 0;
+    }
+    ~LoopbackClient() { close(fd); }
+
+    bool connected() const { return open; }
+
+    bool write(const std::string& text) {
+        return open && send(fd, text.data(), text.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(text.size());
+    }
+
+    LoopbackResponse read() {
+        LoopbackResponse response;
+        size_t blank;
+        while ((blank = input.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill()) return response;
+        }
+        std::string head = input.substr(0, blank + 2);
+        input.erase(0, blank + 4);
+
+        size_t at = head.find("Content-Length: ");
+        if (head.find("Transfer-Encoding: chunked") != std::string::npos) {
+            response.chunked = true;
+            for (;;) {
+                size_t eol;
+                while ((eol = input.find("\r\n")) == std::string::npos) {
+                    if (!fill()) return response;
+                }
+                size_t size = strtoul(input.c_str(), nullptr, 16);
+                if (!need(eol + 2 + size + 2)) return response;
+                response.body.append(input, eol + 2, size);
+                input.erase(0, eol + 2 + size + 2);
+                if (size == 0) break;
+            }
+        } else if (at != std::string::npos) {
+            size_t length = strtoul(head.c_str() + at + 16, nullptr, 10);
+            if (!need(length)) return response;
+            response.body = input.substr(0, length);
+            input.erase(0, length);
+        }
+        response.head = head;
+        response.code = atoi(head.c_str() + 9);
+        return response;
+    }
+
+    // True once the server has closed its end, after what was read
+    bool closedByServer() {
+        char byte;
+        return input.empty() && recv(fd, &byte, 1, 0) == 0;
+    }
+};
+
+#endif // LOOPBACK_CLIENT_H
@@ -0,0 +1,195 @@
+#include <ESPAsyncWebServer.h>
+#include <HostControl.h>
+#include <Metrics.h>
+#include <MetricsText.h>
+#include <SessionTable.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Bench.h"
+
+// Firmware globals and handlers from src/main.cpp
+extern AsyncWebServer server;
+extern Metrics metrics;
+extern SessionTable sessions;
+void loop();
+void sendPreflight(AsyncWebServerRequest *request, uint8_t allowed);
+void handleGetMetrics(AsyncWebServerRequest *request);
+ArRequestHandlerFunction metered(const char *method, const char *route, ArRequestHandlerFunction onRequest);
+
+namespace {
+
+const size_t BATCH = 100;
+
+void preflightDevices(AsyncWebServerRequest* request) {
+    sendPreflight(request, HTTP_GET | HTTP_OPTIONS);
+}
+
+size_t countOf(const String& text, const char* needle) {
+    size_t count = 0;
+    for (const char* at = strstr(text.c_str(), needle); at; at = strstr(at + 1, needle)) count++;
+    return count;
+}
+
+// Durations land in the bucket of the next power of two, from 32 us
+void benchBuckets() {
+    Metrics::Histogram h = {};
+    const uint32_t samples[] = {0, 32, 33, 64, 1500, 262144, 262145, 4000000};
+    const size_t expected[] = {0, 0, 1, 1, 6, 13, 14, 14};
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        Metrics::Histogram one = {};
+        one.record(samples[i]);
+        if (one.buckets[expected[i]] != 1) bench::fail("metrics", "duration in the wrong bucket");
+        h.record(samples[i]);
+    }
+    if (h.count != 8 || h.sumUs != 4525918) bench::fail("metrics", "histogram count or sum wrong");
+    printf("%-40s %8s   -> ok, 32 us .. %u ms, then +Inf\n", "log2 buckets", "",
+           static_cast<unsigned int>(Metrics::Histogram::boundUs(Metrics::BUCKETS - 2) / 1000));
+}
+
+// Cost of the instrumentation itself: record() with every series taken,
+// and a metered handler against the same handler called directly
+void benchOverhead() {
+    Metrics full;
+    char paths[Metrics::MAX_ROUTES][16];
+    for (size_t i = 0; i < Metrics::MAX_ROUTES; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "/route/%u", static_cast<unsigned int>(i));
+        full.addRoute("GET", paths[i]);
+    }
+    for (size_t i = 0; i < Metrics::MAX_SERIES; i++) {
+        int code = 200 + static_cast<int>(i / Metrics::MAX_ROUTES);
+        full.record(static_cast<int>(i % Metrics::MAX_ROUTES), code, 100, 0, 10);
+    }
+    const int lastRoute = static_cast<int>((Metrics::MAX_SERIES - 1) % Metrics::MAX_ROUTES);
+    const int lastCode = 200 + static_cast<int>((Metrics::MAX_SERIES - 1) / Metrics::MAX_ROUTES);
+    uint32_t us = 0;
+    bench::run("Metrics::record(), last series", Metrics::MAX_SERIES, 1000,
+               [&] {
+                   for (int i = 0; i < 1000; i++) full.record(lastRoute, lastCode, us++ & 0xffff, 20, 300);
+               });
+    if (full.droppedSeries() != 0) bench::fail("metrics", "series dropped");
+
+    std::vector<std::unique_ptr<AsyncWebServerRequest>> requests;
+    auto fresh = [&] {
+        requests.clear();
+        for (size_t i = 0; i < BATCH; i++) requests.emplace_back(new AsyncWebServerRequest(HTTP_OPTIONS, "/api/devices"));
+    };
+    bench::run("OPTIONS handler, direct", 1, BATCH, fresh,
+               [&] {
+                   for (auto& request : requests) preflightDevices(request.get());
+               });
+    ArRequestHandlerFunction preflight = metered("OPTIONS", "*", preflightDevices);
+    bench::run("OPTIONS handler, metered", 1, BATCH, fresh,
+               [&] {
+                   for (auto& request : requests) preflight(request.get());
+               });
+    requests.clear();
+}
+
+// loop() on the host sleeps with real time; lateness is what the OS adds
+void benchLoop() {
+    // The first wake-up includes the time since loop() last ran, in another suite
+    loop();
+    Metrics::LoopStats before = metrics.getLoopStats();
+    for (int i = 0; i < 10; i++) loop();
+    Metrics::LoopStats after = metrics.getLoopStats();
+    uint32_t iterations = after.iterations - before.iterations;
+    if (iterations != 10) bench::fail("metrics", "loop() wake-ups not recorded");
+    size_t worst = 0;
+    for (size_t i = 0; i < Metrics::BUCKETS; i++) {
+        if (after.lateness.buckets[i] != before.lateness.buckets[i]) worst = i;
+    }
+    printf("%-40s %8s   -> %.1f us late on average, all within %u us\n", "loop() x 10", "",
+           double(after.lateness.sumUs - before.lateness.sumUs) / iterations,
+           static_cast<unsigned int>(Metrics::Histogram::boundUs(worst)));
+}
+
+// Every histogram is cumulative and ends at its count
+void checkHistograms(const String& body) {
+    const char* at = body.c_str();
+    uint32_t previous = 0;
+    bool inHistogram = false;
+    size_t checked = 0;
+    while (*at) {
+        const char* end = strchr(at, '\n');
+        if (!end) bench::fail("metrics", "last line not terminated");
+        String line = body.substring(at - body.c_str(), end - body.c_str());
+        const char* value = strrchr(line.c_str(), ' ');
+        if (strstr(line.c_str(), "_bucket{")) {
+            uint32_t cumulative = strtoul(value + 1, nullptr, 10);
+            if (inHistogram && cumulative < previous) bench::fail("metrics", "buckets not cumulative");
+            previous = cumulative;
+            inHistogram = !strstr(line.c_str(), "le=\"+Inf\"");
+        } else if (strstr(line.c_str(), "_count")) {
+            if (strtoul(value + 1, nullptr, 10) != previous) bench::fail("metrics", "+Inf bucket differs from _count");
+            checked++;
+        }
+        at = end + 1;
+    }
+    if (checked == 0) bench::fail("metrics", "no histograms");
+}
+
+// GET /api/metrics after the other suites have sent their requests
+void benchScrape() {
+    char token[SessionTable::TOKEN_LENGTH + 1];
+    sessions.issue(millis(), 3600000, token);
+    String bearer = String("Bearer ") + token;
+    host::setHeap(176000, 141000, 108000);
+
+    // A few requests through the server, as a client would send them
+    const char* urls[] = {"/api/devices", "/api/devices", "/api/nowhere"};
+    for (const char* url : urls) {
+        AsyncWebServerRequest sent(HTTP_GET, url);
+        sent.addHeader("Authorization", bearer);
+        server.dispatch(&sent);
+        if (sent.response()) sent.response()->drain();
+    }
+
+    AsyncWebServerRequest request(HTTP_GET, "/api/metrics");
+    request.addHeader("Authorization", bearer);
+    metered("GET", "/api/metrics", handleGetMetrics)(&request);
+    if (!request.response() || request.response()->code() != 200) bench::fail("metrics", "scrape refused");
+    String body = request.response()->readAll();
+
+    const char* expected[] = {
+        "# TYPE http_request_duration_seconds histogram\n",
+        "http_requests_total{method=\"OPTIONS\",route=\"*\",code=\"204\"}",
+        "http_request_duration_seconds_bucket{method=\"GET\",route=\"/api/devices\",code=\"200\",le=\"0.000032\"}",
+        "http_response_body_bytes_total{method=\"GET\",route=\"/api/devices\"}",
+        "loop_lateness_seconds_bucket{le=\"+Inf\"}",
+        "esp_heap_min_free_bytes 141000\n",
+        "esp_heap_largest_free_block_bytes 108000\n",
+        "\nadmission_rate_limited_total ",
+        "metrics_dropped_series_total 0\n",
+    };
+    for (const char* line : expected) {
+        if (countOf(body, line) != 1) {
+            printf("missing: %s\n", line);
+            bench::fail("metrics", "scrape incomplete");
+        }
+    }
+    checkHistograms(body);
+    printf("%-40s %8s   -> ok, %u bytes, %zu lines, %u series\n", "GET /api/metrics", "",
+           static_cast<unsigned int>(body.length()), countOf(body, "\n"),
+           static_cast<unsigned int>(metrics.seriesSize()));
+
+    bench::run("GET /api/metrics (scrape)", metrics.seriesSize(), 1,
+               [&] {
+                   AsyncWebServerRequest timed(HTTP_GET, "/api/metrics");
+                   timed.addHeader("Authorization", bearer);
+                   handleGetMetrics(&timed);
+                   timed.response()->drain();
+               });
+}
+
+} // namespace
+
+void benchMetrics() {
+    bench::printHeader("Metrics");
+    benchBuckets();
+    benchOverhead();
+    benchLoop();
+    benchScrape();
+}
@@ -0,0 +1,256 @@
+#include <Arduino.h>
+#include <DeviceManager.h>
+#include <DeviceStore.h>
+#include <HostControl.h>
+#include <Preferences.h>
+#include <PwmPort.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Bench.h"
+
+namespace {
+
+const int LAMP = 1;
+const int LAMP_PIN = 25;
+const uint32_t FADE_MS = 1000;
+
+DeviceCommand levelCommand(int id, int16_t level, uint32_t fadeMs) {
+    DeviceCommand command;
+    command.id = id;
+    command.status = level > 0;
+    command.level = level;
+    command.fadeMs = fadeMs;
+    return command;
+}
+
+void expectDuty(int8_t channel, uint32_t duty, const char* what) {
+    if (host::ledcDuty(static_cast<uint8_t>(channel)) != duty) bench::fail("pwm", what);
+}
+
+// Copy of a device the bench just added
+Device deviceOf(const DeviceManager& manager, int id) {
+    Device device;
+    if (!manager.copyDevice(id, device)) bench::fail("pwm", "device missing");
+    return device;
+}
+
+void removeAll(DeviceManager& manager) {
+    Device device;
+    while (manager.readDevice(0, device)) manager.deleteDevice(device.id);
+}
+
+// Fade curves as the mock recorded them, on the virtual clock
+void benchCurves() {
+    DeviceManager manager;
+    if (!manager.addDevice(LAMP, "Desk Lamp", DIMMER_TYPE, LAMP_PIN, false, 200)) bench::fail("pwm", "dimmer not added");
+    int8_t channel = deviceOf(manager, LAMP).channel;
+    if (channel < 0 || host::ledcPin(channel) != LAMP_PIN) bench::fail("pwm", "dimmer not routed to its pin");
+    expectDuty(channel, 0, "dimmer added off but driven");
+    host::clearLedcFades();
+
+    // Switching on fades up to the stored level
+    DeviceCommand on;
+    on.id = LAMP;
+    on.status = true;
+    on.fadeMs = FADE_MS;
+    manager.updateDevice(on);
+    uint32_t quarter[3];
+    for (uint32_t& duty : quarter) {
+        host::advanceClock(FADE_MS / 4);
+        duty = host::ledcDuty(channel);
+    }
+    if (quarter[0] != 50 || quarter[1] != 100 || quarter[2] != 150) bench::fail("pwm", "fade up is not linear");
+    printf("%-40s %8s   -> duty %u/%u/%u at 1/4, 1/2, 3/4\n", "fade 0->200 over 1 s", "", quarter[0], quarter[1],
+           quarter[2]);
+
+    // A new level mid-fade is held until the running fade ends, since the
+    // driver cannot stop it, and then fades from where the output is
+    manager.updateDevice(levelCommand(LAMP, 40, FADE_MS));
+    if (host::ledcFadeCount() != 1 || pwmPoll(millis()) != FADE_MS / 4) bench::fail("pwm", "retarget not held behind the fade");
+    host::advanceClock(FADE_MS / 4);
+    expectDuty(channel, 200, "held retarget cut the fade short");
+    if (pwmPoll(millis()) != PWM_IDLE) bench::fail("pwm", "held retarget not made when the fade ended");
+    host::LedcFade fade;
+    if (!host::ledcFade(1, fade) || fade.fromDuty != 200 || fade.toDuty != 40 || fade.durationMs != FADE_MS)
+        bench::fail("pwm", "retarget did not start from the current duty");
+    host::advanceClock(FADE_MS);
+    expectDuty(channel, 40, "retarget did not settle");
+    if (deviceOf(manager, LAMP).level != 40 || !deviceOf(manager, LAMP).status) bench::fail("pwm", "level not stored");
+
+    DeviceChange change;
+    const ChangeJournal& journal = manager.getJournal();
+    if (!journal.get(journal.latest(), change) || change.kind != DeviceChange::LEVEL || change.level != 40)
+        bench::fail("pwm", "level change not journaled");
+
+    // Level 0 fades out but keeps the level for the next switch-on
+    manager.updateDevice(levelCommand(LAMP, 0, FADE_MS));
+    host::advanceClock(FADE_MS);
+    expectDuty(channel, 0, "level 0 did not fade out");
+    if (deviceOf(manager, LAMP).status || deviceOf(manager, LAMP).level != 40) bench::fail("pwm", "level 0 lost the level");
+    manager.updateDeviceStatus(LAMP, true);
+    expectDuty(channel, 40, "switch-on without a fade did not step");
+
+    size_t recorded = host::ledcFadeCount();
+    for (size_t i = 0; i < recorded; i++) {
+        if (!host::ledcFade(i, fade) || fade.pin != LAMP_PIN || fade.channel != channel) bench::fail("pwm", "fade on the wrong pin");
+    }
+    printf("%-40s %8s   -> ok, %zu steps/fades recorded\n", "retarget, fade out, switch on", "", recorded);
+
+    // Deleted mid-fade: the pin goes low at once and the channel is handed
+    // out again only after the fade
+    manager.updateDevice(levelCommand(LAMP, 255, FADE_MS));
+    host::advanceClock(FADE_MS / 2);
+    manager.deleteDevice(LAMP);
+    if (host::pinMode(LAMP_PIN) != OUTPUT || host::pinLevel(LAMP_PIN) != LOW) bench::fail("pwm", "deleted dimmer's pin left fading");
+    if (!manager.addDevice(2, "Spare Lamp", DIMMER_TYPE, LAMP_PIN + 1, true, 10) || deviceOf(manager, 2).channel == channel)
+        bench::fail("pwm", "channel handed out mid-fade");
+    host::advanceClock(FADE_MS / 2);
+    pwmPoll(millis());
+    if (host::ledcPin(channel) != -1) bench::fail("pwm", "channel not stopped after its fade");
+    if (host::ledcBlockedCalls() != 0) bench::fail("pwm", "a call would have blocked behind a fade");
+    printf("%-40s %8s   -> ok, retarget held, delete mid-fade, no call blocked\n", "writes during a fade", "");
+    removeAll(manager);
+}
+
+// Channels come from a pool of PWM_CHANNELS and go back on delete
+void benchChannels() {
+    DeviceManager manager;
+    uint8_t inUse = pwmChannelsInUse();
+    char title[20];
+    int id = 1;
+    for (; pwmChannelsInUse() < PWM_CHANNELS; id++) {
+        snprintf(title, sizeof(title), "Dimmer %d", id);
+        if (!manager.addDevice(id, title, DIMMER_TYPE, 10 + id, true, 128)) bench::fail("pwm", "free channel not handed out");
+    }
+    if (manager.addDevice(id, "One Too Many", DIMMER_TYPE, 40, true)) bench::fail("pwm", "dimmer added with no channel free");
+    Device device;
+    if (manager.copyDevice(id, device)) bench::fail("pwm", "failed dimmer left in the registry");
+    if (!manager.addDevice(100, "Porch Light", "LED", 40, true) || deviceOf(manager, 100).channel != -1)
+        bench::fail("pwm", "on/off device took a channel");
+
+    int8_t freed = deviceOf(manager, 3).channel;
+    manager.deleteDevice(3);
+    if (!manager.addDevice(id, "Late Dimmer", DIMMER_TYPE, 41, true) || deviceOf(manager, id).channel != freed)
+        bench::fail("pwm", "deleted dimmer's channel not reused");
+    printf("%-40s %8u   -> ok, dimmer %u refused, channel %d reused\n", "channel allocation",
+           static_cast<unsigned int>(PWM_CHANNELS - inUse), static_cast<unsigned int>(PWM_CHANNELS - inUse + 1),
+           freed);
+    removeAll(manager);
+    if (pwmChannelsInUse() != inUse) bench::fail("pwm", "channels not returned on delete");
+}
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+    }
+    return ~crc;
+}
+
+void putU32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+// A registry saved before dimmers existed: version 1, 39-byte records
+void writeV1Blob() {
+    const size_t RECORD = 4 + sizeof(Device::title) + sizeof(Device::type) + 4 + 1;
+    std::vector<uint8_t> blob(16 + RECORD, 0);
+    memcpy(blob.data(), "DREG", 4);
+    blob[4] = 1;
+    blob[6] = 1;
+    putU32(&blob[8], 1);
+    uint8_t* record = &blob[16];
+    putU32(record, LAMP);
+    strcpy(reinterpret_cast<char*>(record + 4), "Desk Lamp");
+    strcpy(reinterpret_cast<char*>(record + 4 + sizeof(Device::title)), DIMMER_TYPE);
+    putU32(record + 4 + sizeof(Device::title) + sizeof(Device::type), LAMP_PIN);
+    record[RECORD - 1] = 1;
+    putU32(&blob[12], crc32(crc32(0, blob.data(), 12), blob.data() + 16, RECORD));
+
+    Preferences prefs;
+    prefs.begin("devices", false);
+    prefs.putBytes("reg0", blob.data(), blob.size());
+    prefs.end();
+}
+
+// Levels survive a reboot; a level change is written as a new blob
+void benchPersistence() {
+    host::clearPreferences();
+    {
+        DeviceManager manager;
+        manager.addDevice(LAMP, "Desk Lamp", DIMMER_TYPE, LAMP_PIN, true, 120);
+        manager.addDevice(2, "Hall Light", "LED", 4, false);
+        DeviceStore store;
+        store.save(manager);
+        manager.updateDevice(levelCommand(LAMP, 90, 0));
+        store.sync(manager);
+        if (store.getStats().blobWrites != 2 || store.getStats().logWrites != 0) bench::fail("pwm", "level change not saved as a blob");
+        removeAll(manager);
+    }
+
+    DeviceManager restored;
+    DeviceStore store;
+    if (!store.restore(restored)) bench::fail("pwm", "registry with a dimmer not restored");
+    Device lamp;
+    if (!restored.copyDevice(LAMP, lamp) || lamp.level != 90 || !lamp.status || lamp.channel < 0)
+        bench::fail("pwm", "dimmer level not restored");
+    expectDuty(lamp.channel, 90, "restored dimmer not driven at its level");
+    if (deviceOf(restored, 2).level != 255) bench::fail("pwm", "on/off device restored with a level");
+    removeAll(restored);
+
+    host::clearPreferences();
+    writeV1Blob();
+    DeviceManager upgraded;
+    DeviceStore oldStore;
+    if (!oldStore.restore(upgraded) || !upgraded.copyDevice(LAMP, lamp) || lamp.level != 255)
+        bench::fail("pwm", "version 1 blob not restored at full level");
+    removeAll(upgraded);
+    host::clearPreferences();
+    printf("%-40s %8s   -> ok, level kept; v1 blob loads at 255\n", "persistence", "");
+}
+
+// What the offload saves: one call per fade against stepping it in software
+void benchCost() {
+    DeviceManager manager;
+    manager.addDevice(LAMP, "Desk Lamp", DIMMER_TYPE, LAMP_PIN, false);
+    int8_t channel = deviceOf(manager, LAMP).channel;
+    bool up = true;
+
+    // Each round starts with the last fade over, as no call may wait for one
+    auto settle = [] {
+        host::advanceClock(FADE_MS);
+        pwmPoll(millis());
+        host::clearLedcFades();
+    };
+    bench::run("fade 1 s, LEDC fade engine (per fade)", 1, 1, settle,
+               [&] {
+                   manager.updateDevice(levelCommand(LAMP, up ? 255 : 1, FADE_MS));
+                   up = !up;
+               });
+    bench::run("fade 1 s, stepped every ms (per fade)", 1, 1, settle,
+               [&] {
+                   for (uint32_t ms = 1; ms <= FADE_MS; ms++) {
+                       uint32_t duty = up ? 255 * ms / FADE_MS : 255 - 255 * ms / FADE_MS;
+                       pwmWrite(channel, static_cast<uint8_t>(duty), 0);
+                   }
+                   up = !up;
+               });
+    host::clearLedcFades();
+    removeAll(manager);
+}
+
+} // namespace
+
+void benchPwm() {
+    bench::printHeader("PwmPort");
+
+    host::setVirtualClock(true);
+    benchCurves();
+    benchChannels();
+    benchPersistence();
+    benchCost();
+    host::setVirtualClock(false);
+}
@@ -0,0 +1,312 @@
+#include <DeviceListJson.h>
+#include <DeviceListMsgPack.h>
+#include <DeviceManager.h>
+#include <DeviceSelection.h>
+#include <ESPAsyncWebServer.h>
+#include <SessionTable.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "Bench.h"
+
+// Firmware globals and handlers from src/main.cpp
+extern DeviceManager deviceManager;
+extern SessionTable sessions;
+void handleGetDevices(AsyncWebServerRequest *request);
+
+namespace {
+
+const char* const TYPES[] = {"LED", "FAN", "DOOR", "HEATER"};
+const size_t TYPE_COUNT = sizeof(TYPES) / sizeof(TYPES[0]);
+const size_t OPS = 200;
+
+// Types cycle, every third device is on
+template <typename Manager>
+void populate(Manager& manager, size_t n) {
+    char title[20];
+    for (size_t i = 1; i <= n; i++) {
+        snprintf(title, sizeof(title), "Device %zu", i);
+        manager.addDevice(static_cast<int>(i), title, TYPES[i % TYPE_COUNT], 2, i % 3 == 0);
+    }
+}
+
+template <typename Manager>
+bool matches(const Manager& manager, size_t slot, const DeviceFilter& filter) {
+    Device device;
+    manager.readDevice(slot, device);
+    if (filter.type && strcmp(device.type, filter.type) != 0) return false;
+    return filter.status == DeviceFilter::ANY || device.status == (filter.status == DeviceFilter::ON);
+}
+
+// select() against a scan of every device, for each type and status
+template <typename Manager>
+void expectIndexed(const Manager& manager, const char* what) {
+    typename Manager::Selection selected;
+    const char* types[] = {nullptr, "LED", "FAN", "DOOR", "HEATER", "NONE"};
+    const DeviceFilter::Status statuses[] = {DeviceFilter::ANY, DeviceFilter::ON, DeviceFilter::OFF};
+    for (const char* type : types) {
+        for (DeviceFilter::Status status : statuses) {
+            DeviceFilter filter;
+            filter.type = type;
+            filter.status = status;
+            size_t count = manager.select(filter, selected);
+            size_t scanned = 0;
+            for (size_t slot = 0; slot < manager.size(); slot++) {
+                bool match = matches(manager, slot, filter);
+                if (match != selected.test(slot)) bench::fail("query", what);
+                scanned += match;
+            }
+            if (count != scanned) bench::fail("query", what);
+        }
+    }
+}
+
+// The indexes follow adds, deletes (which move devices between slots),
+// switches and types that come and go
+void checkIndexes() {
+    BasicDeviceManager<0> manager;
+    populate(manager, 200);
+    expectIndexed(manager, "indexes wrong after adds");
+
+    uint32_t seed = 7;
+    int nextId = 201;
+    std::vector<int> live;
+    for (int id = 1; id <= 200; id++) live.push_back(id);
+    for (int round = 0; round < 2000; round++) {
+        seed = seed * 1664525u + 1013904223u;
+        size_t pick = (seed >> 8) % live.size();
+        switch (seed % 4) {
+        case 0:
+            manager.deleteDevice(live[pick]);
+            live[pick] = live.back();
+            live.pop_back();
+            break;
+        case 1:
+            manager.addDevice(nextId, "Late", TYPES[(seed >> 4) % TYPE_COUNT], 2, seed & 16);
+            live.push_back(nextId++);
+            break;
+        default:
+            manager.updateDeviceStatus(live[pick], seed & 32);
+            break;
+        }
+        if (round % 50 == 0) expectIndexed(manager, "indexes wrong after changes");
+    }
+    expectIndexed(manager, "indexes wrong after changes");
+    printf("%-40s %8zu   -> ok, 2000 adds, deletes and switches\n", "type and status indexes", manager.size());
+}
+
+// What the writers should produce for a query, from a scan of every device
+String expectedJson(const DeviceListQuery& query) {
+    String body = "{\"message\":\"Devices retrieved\",\"status\":true,\"total\":";
+    String data;
+    size_t total = 0;
+    size_t listed = 0;
+    char entry[DeviceListJson::MAX_ENTRY_SIZE + 1];
+    for (size_t slot = 0; slot < deviceManager.size(); slot++) {
+        if (!matches(deviceManager, slot, query.filter)) continue;
+        if (total++ < query.offset || listed == query.limit) continue;
+        Device device;
+        deviceManager.readDevice(slot, device);
+        if (listed++ > 0) data += ",";
+        entry[writeDeviceJson(entry, device, query.fields)] = '\0';
+        data += entry;
+    }
+    body += String(static_cast<unsigned int>(total));
+    body += ",\"data\":[";
+    body += data;
+    body += "]}";
+    return body;
+}
+
+String get(const String& url, const String& bearer, bool msgPack = false) {
+    AsyncWebServerRequest request(HTTP_GET, url);
+    request.addHeader("Authorization", bearer);
+    if (msgPack) request.addHeader("Accept", "application/msgpack");
+    handleGetDevices(&request);
+    if (!request.response()) bench::fail("query", "no response");
+    if (request.response()->code() != 200) return String(request.response()->code());
+    return request.response()->readAll();
+}
+
+void checkResponses(const String& bearer) {
+    struct Case {
+        const char* params;
+        const char* type;
+        DeviceFilter::Status status;
+        uint8_t fields;
+        size_t offset;
+        size_t limit;
+    };
+    const uint8_t ID_STATUS = DeviceListQuery::ID | DeviceListQuery::STATUS;
+    const Case cases[] = {
+        {"type=FAN", "FAN", DeviceFilter::ANY, DeviceListQuery::ALL_FIELDS, 0, SIZE_MAX},
+        {"status=true", nullptr, DeviceFilter::ON, DeviceListQuery::ALL_FIELDS, 0, SIZE_MAX},
+        {"type=DOOR&status=false&fields=id,status", "DOOR", DeviceFilter::OFF, ID_STATUS, 0, SIZE_MAX},
+        {"fields=level,title", nullptr, DeviceFilter::ANY, DeviceListQuery::TITLE | DeviceListQuery::LEVEL, 0, SIZE_MAX},
+        {"offset=10&limit=5", nullptr, DeviceFilter::ANY, DeviceListQuery::ALL_FIELDS, 10, 5},
+        {"type=LED&offset=3&limit=4&fields=id", "LED", DeviceFilter::ANY, DeviceListQuery::ID, 3, 4},
+        {"status=true&offset=1000", nullptr, DeviceFilter::ON, DeviceListQuery::ALL_FIELDS, 1000, SIZE_MAX},
+        {"limit=0", nullptr, DeviceFilter::ANY, DeviceListQuery::ALL_FIELDS, 0, 0},
+        {"type=NONE", "NONE", DeviceFilter::ANY, DeviceListQuery::ALL_FIELDS, 0, SIZE_MAX},
+    };
+    for (const Case& c : cases) {
+        DeviceListQuery query;
+        query.filter.type = c.type;
+        query.filter.status = c.status;
+        query.fields = c.fields;
+        query.offset = c.offset;
+        query.limit = c.limit;
+        if (get(String("/api/devices?") + c.params, bearer) != expectedJson(query)) {
+            printf("?%s\n", c.params);
+            bench::fail("query", "filtered list differs from a scan");
+        }
+
+        // Same devices and fields in MessagePack
+        DeviceListMsgPack writer(deviceManager, query);
+        uint8_t chunk[512];
+        String direct;
+        for (size_t n; (n = writer.read(chunk, sizeof(chunk))) > 0;) direct.concat(reinterpret_cast<const char*>(chunk), n);
+        if (get(String("/api/devices?") + c.params, bearer, true) != direct) bench::fail("query", "msgpack list differs");
+    }
+
+    const char* malformed[] = {"status=on", "fields=id,colour", "fields=", "offset=-1", "limit=ten"};
+    for (const char* params : malformed) {
+        if (get(String("/api/devices?") + params, bearer) != "400") bench::fail("query", "malformed query not refused");
+    }
+    printf("%-40s %8zu   -> ok, %zu queries, %zu refused\n", "filtered responses", deviceManager.size(),
+           sizeof(cases) / sizeof(cases[0]), sizeof(malformed) / sizeof(malformed[0]));
+}
+
+// The devices on a query's page, from a scan of every device
+std::vector<Device> pageOf(const DeviceListQuery& query) {
+    std::vector<Device> page;
+    size_t total = 0;
+    for (size_t slot = 0; slot < deviceManager.size(); slot++) {
+        if (!matches(deviceManager, slot, query.filter)) continue;
+        if (total++ < query.offset || page.size() == query.limit) continue;
+        Device device;
+        deviceManager.readDevice(slot, device);
+        page.push_back(device);
+    }
+    return page;
+}
+
+// Reads a chunk, deletes a device already sent, which moves the last one
+// into its slot, then reads the rest; the device is added back after
+template <typename Writer>
+std::string readAcrossDelete(const DeviceListQuery& query, const Device& gone) {
+    Writer writer(deviceManager, query);
+    uint8_t chunk[512];
+    size_t n = writer.read(chunk, sizeof(chunk));
+    std::string body(reinterpret_cast<const char*>(chunk), n);
+    if (!deviceManager.deleteDevice(gone.id)) bench::fail("query", "device not deleted");
+    while ((n = writer.read(chunk, sizeof(chunk))) > 0) body.append(reinterpret_cast<const char*>(chunk), n);
+    deviceManager.addDevice(gone.id, gone.title, gone.type, gone.gpioPin, gone.status);
+    return body;
+}
+
+// How many of the page's devices body lists before it is cut: it must be
+// head, the first k entries, then the rest of the document for k
+template <typename Rest>
+size_t listedBeforeCut(const std::string& body, const std::string& head, const std::vector<std::string>& entries, Rest rest) {
+    std::string listed = head;
+    for (size_t k = 0; k <= entries.size(); k++) {
+        if (body == listed + rest(k)) return k;
+        if (k < entries.size()) listed += entries[k];
+    }
+    return SIZE_MAX;
+}
+
+// A page cut short by a delete: the devices before the cut, none twice or
+// from the moved slots, and a document that still holds together
+void checkInterrupted() {
+    DeviceListQuery query;
+    query.filter.type = "FAN";
+    query.limit = 50;
+    std::vector<Device> page = pageOf(query);
+
+    std::vector<std::string> entries;
+    char entry[DeviceListJson::MAX_ENTRY_SIZE + 1];
+    for (size_t k = 0; k < page.size(); k++) {
+        entry[0] = ',';
+        entries.push_back(std::string(entry + (k == 0), writeDeviceJson(entry + 1, page[k], query.fields) + (k > 0)));
+    }
+    std::string expected = expectedJson(query).c_str();
+    std::string head = expected.substr(0, expected.find("\"data\":[") + 8);
+    size_t cut = listedBeforeCut(readAcrossDelete<DeviceListJson>(query, page[1]), head, entries,
+                                 [](size_t) { return std::string("]}"); });
+    if (cut < 2 || cut >= page.size()) bench::fail("query", "json page not cut cleanly");
+
+    // Added back at the end, so the page has changed
+    page = pageOf(query);
+    entries.clear();
+    size_t entriesLength = 0;
+    uint8_t packed[DeviceListMsgPack::MAX_ENTRY_SIZE];
+    for (const Device& device : page) {
+        entries.push_back(std::string(reinterpret_cast<const char*>(packed), writeDeviceMsgPack(packed, device, query.fields)));
+        entriesLength += entries.back().size();
+    }
+    DeviceListMsgPack full(deviceManager, query);
+    uint8_t chunk[512];
+    std::string direct;
+    for (size_t n; (n = full.read(chunk, sizeof(chunk))) > 0;) direct.append(reinterpret_cast<const char*>(chunk), n);
+    size_t kept = listedBeforeCut(readAcrossDelete<DeviceListMsgPack>(query, page[1]), direct.substr(0, direct.size() - entriesLength),
+                                  entries, [&](size_t k) { return std::string(page.size() - k, '\xc0'); });
+    if (kept < 2 || kept >= page.size()) bench::fail("query", "msgpack page not padded to its length");
+    printf("%-40s %8zu   -> ok, json cut after %zu of %zu, msgpack padded with %zu nils\n", "delete mid-page",
+           deviceManager.size(), cut, page.size(), page.size() - kept);
+}
+
+// Cost against the size of the fleet and of the result
+void benchCost(const String& bearer) {
+    const char* urls[] = {
+        "/api/devices",
+        "/api/devices?type=FAN",
+        "/api/devices?type=FAN&status=true&limit=10",
+        "/api/devices?fields=id,status&limit=10",
+        "/api/devices?offset=990&limit=10",
+    };
+    for (const char* url : urls) {
+        AsyncWebServerRequest request(HTTP_GET, url);
+        request.addHeader("Authorization", bearer);
+        size_t bodyLength = 0;
+        const char* params = url + strlen("/api/devices");
+        bench::run(*params ? params : "(every device)", deviceManager.size(), OPS,
+                   [&] {
+                       for (size_t i = 0; i < OPS; i++) {
+                           handleGetDevices(&request);
+                           bodyLength = request.response()->drain();
+                       }
+                   });
+        printf("%-40s %8s   -> %zu byte body\n", "", "", bodyLength);
+    }
+
+    BasicDeviceManager<0> large;
+    populate(large, 10000);
+    BasicDeviceManager<0>::Selection selected;
+    DeviceFilter filter;
+    filter.type = "FAN";
+    filter.status = DeviceFilter::ON;
+    bench::run("select(), type and status", large.size(), OPS,
+               [&] {
+                   for (size_t i = 0; i < OPS; i++) large.select(filter, selected);
+               });
+}
+
+} // namespace
+
+void benchQuery() {
+    bench::printHeader("Query");
+    char token[SessionTable::TOKEN_LENGTH + 1];
+    sessions.issue(millis(), 3600000, token);
+    String bearer = String("Bearer ") + token;
+
+    checkIndexes();
+    deviceManager = DeviceManager();
+    populate(deviceManager, 1000);
+    checkResponses(bearer);
+    checkInterrupted();
+    benchCost(bearer);
+}
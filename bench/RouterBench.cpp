@@ -0,0 +1,126 @@
+#include <ESPAsyncWebServer.h>
+#include <Router.h>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "Bench.h"
+
+namespace {
+
+const size_t BATCH = 100;
+
+// The setup() registrations before the router: OPTIONS and the method for
+// every path, tried in this order
+struct LegacyRoute {
+    const char* uri;
+    WebRequestMethod method;
+};
+
+const LegacyRoute LEGACY[] = {
+    {"/api/wifi/setup", HTTP_OPTIONS}, {"/api/wifi/setup", HTTP_POST}, {"/api/wifi/mode", HTTP_OPTIONS},
+    {"/api/wifi/mode", HTTP_POST},     {"/api/connect", HTTP_OPTIONS}, {"/api/connect", HTTP_POST},
+    {"/api/devices", HTTP_OPTIONS},    {"/api/devices", HTTP_GET},     {"/api/control/batch", HTTP_OPTIONS},
+    {"/api/control/batch", HTTP_PUT},  {"/api/control", HTTP_OPTIONS}, {"/api/control", HTTP_PUT},
+    {"/api/schedules", HTTP_OPTIONS},  {"/api/schedules", HTTP_POST},  {"/api/schedules", HTTP_GET},
+    {"/api/schedules", HTTP_DELETE},   {"/api/validate", HTTP_OPTIONS}, {"/api/validate", HTTP_POST},
+    {"/api/admission", HTTP_OPTIONS},  {"/api/admission", HTTP_GET},   {"/api/metrics", HTTP_OPTIONS},
+    {"/api/metrics", HTTP_GET},        {"/api/events", HTTP_GET},
+};
+
+size_t answeredRequests = 0;
+
+void answer(AsyncWebServerRequest*) {
+    answeredRequests++;
+}
+
+// The firmware's router on its own: one trie walk, then a table lookup
+class TrieHandler : public AsyncWebHandler {
+private:
+    RouteTrie trie;
+    bool routed[RouteTrie::MAX_PATTERNS][7] = {};
+
+public:
+    TrieHandler() {
+        for (const LegacyRoute& route : LEGACY) routed[trie.add(route.uri)][__builtin_ctz(route.method)] = true;
+        const char* devicePaths[] = {"/api/devices/{id}", "/api/devices/{id}/status", "/api/devices/{id}/samples"};
+        for (const char* path : devicePaths) routed[trie.add(path)][__builtin_ctz(HTTP_GET)] = true;
+    }
+
+    bool canHandle(AsyncWebServerRequest* request) override {
+        PathParams params;
+        return trie.match(request->url().c_str(), request->url().length(), params) != RouteTrie::NO_MATCH;
+    }
+
+    void handleRequest(AsyncWebServerRequest* request) override {
+        PathParams params;
+        int pattern = trie.match(request->url().c_str(), request->url().length(), params);
+        if (pattern != RouteTrie::NO_MATCH && routed[pattern][__builtin_ctz(request->method())]) answer(request);
+    }
+};
+
+// Per-request dispatch with handlers that do nothing, so what is timed is
+// finding them: down the server.on() chain, which builds a String for each
+// prefix test, against one walk of the trie
+void benchDispatch() {
+    AsyncWebServer chain(80);
+    for (const LegacyRoute& route : LEGACY) chain.on(route.uri, route.method, answer);
+    chain.onNotFound(answer);
+    AsyncWebServer routed(80);
+    TrieHandler router;
+    routed.addHandler(&router);
+    routed.onNotFound(answer);
+
+    struct Case {
+        const char* name;
+        WebRequestMethodComposite method;
+        const char* url;
+    };
+    const Case cases[] = {
+        {"POST /api/wifi/setup (first)", HTTP_POST, "/api/wifi/setup"},
+        {"GET /api/devices", HTTP_GET, "/api/devices"},
+        {"GET /api/metrics (last)", HTTP_GET, "/api/metrics"},
+        {"GET /api/nowhere (404)", HTTP_GET, "/api/nowhere"},
+    };
+    std::vector<std::unique_ptr<AsyncWebServerRequest>> requests;
+    for (const Case& c : cases) {
+        auto fresh = [&] {
+            requests.clear();
+            for (size_t i = 0; i < BATCH; i++) requests.emplace_back(new AsyncWebServerRequest(c.method, c.url));
+        };
+        char name[64];
+        snprintf(name, sizeof(name), "server.on(), %s", c.name);
+        bench::run(name, sizeof(LEGACY) / sizeof(LEGACY[0]), BATCH, fresh,
+                   [&] {
+                       for (auto& request : requests) chain.dispatch(request.get());
+                   });
+        snprintf(name, sizeof(name), "router, %s", c.name);
+        bench::run(name, sizeof(LEGACY) / sizeof(LEGACY[0]), BATCH, fresh,
+                   [&] {
+                       for (auto& request : requests) routed.dispatch(request.get());
+                   });
+    }
+    requests.clear();
+    if (answeredRequests == 0) bench::fail("router", "nothing dispatched");
+
+    // The walk alone, for the deepest device route
+    RouteTrie trie;
+    for (const LegacyRoute& route : LEGACY) trie.add(route.uri);
+    trie.add("/api/devices/{id}/status");
+    const char* path = "/api/devices/42/status";
+    size_t len = strlen(path);
+    int sink = 0;
+    bench::run("RouteTrie::match(), /api/devices/{id}/status", trie.size(), 1000,
+               [&] {
+                   PathParams params;
+                   for (int i = 0; i < 1000; i++) sink += trie.match(path, len, params);
+               });
+    if (sink == 0) bench::fail("router", "match optimized away");
+}
+
+} // namespace
+
+void benchRouter() {
+    bench::printHeader("Router");
+    benchDispatch();
+}
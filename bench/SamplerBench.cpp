@@ -0,0 +1,226 @@
+#include <DeviceManager.h>
+#include <ESPAsyncWebServer.h>
+#include <HostControl.h>
+#include <SampleStream.h>
+#include <Sampler.h>
+#include <SessionTable.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "Bench.h"
+
+// Firmware globals and handlers from src/main.cpp
+extern Sampler sampler;
+extern SessionTable sessions;
+void handleGetSamples(AsyncWebServerRequest *request);
+
+namespace {
+
+const uint8_t CONTACT_PIN = 32;
+const uint8_t SENSOR_PIN = 33;
+const size_t PASSES = 1000;
+
+String readStream(SampleStream& stream, size_t chunk) {
+    String body;
+    uint8_t buffer[64];
+    size_t n;
+    while ((n = stream.read(buffer, chunk < sizeof(buffer) ? chunk : sizeof(buffer))) > 0) {
+        for (size_t i = 0; i < n; i++) body += static_cast<char>(buffer[i]);
+    }
+    return body;
+}
+
+size_t countOf(const String& text, const char* needle) {
+    size_t count = 0;
+    for (const char* at = strstr(text.c_str(), needle); at; at = strstr(at + 1, needle)) count++;
+    return count;
+}
+
+// Bounces are filtered out and readings are averaged, on a driven clock
+void benchFiltering() {
+    Sampler inputs;
+    inputs.addInput(1, CONTACT_PIN, false);
+    const SampleRing& contact = *inputs.ring(1);
+
+    uint32_t now = 0;
+    host::setPinLevel(CONTACT_PIN, HIGH);
+    inputs.sample(now++);
+
+    // A contact closing with 15 ms of chatter, then held
+    for (int i = 0; i < 15; i++) {
+        host::setPinLevel(CONTACT_PIN, i % 2 ? LOW : HIGH);
+        inputs.sample(now++);
+    }
+    host::setPinLevel(CONTACT_PIN, LOW);
+    uint32_t settled = now;
+    for (int i = 0; i < 100; i++) inputs.sample(now++);
+
+    Sample edge;
+    if (contact.latest() != 2 || !contact.get(2, edge) || edge.value != LOW ||
+        edge.timeMs != settled + Sampler::DEBOUNCE_SAMPLES - 1)
+        bench::fail("sampler", "chatter not debounced into one edge");
+    printf("%-40s %8s   -> ok, 1 edge stored %u ms after it settled\n", "contact, 15 ms of chatter", "",
+           static_cast<unsigned int>(edge.timeMs - settled));
+
+    // A ramp 0..999 over a second: each stored sample is its tenth's mean
+    Sampler ramp;
+    ramp.addInput(2, SENSOR_PIN, true);
+    for (uint32_t ms = 0; ms < 1000; ms++) {
+        host::setAnalogValue(SENSOR_PIN, static_cast<uint16_t>(ms));
+        ramp.sample(ms);
+    }
+    const SampleRing& averaged = *ramp.ring(2);
+    Sample first;
+    Sample last;
+    if (averaged.latest() != 1000 / Sampler::SENSOR_AVERAGE || !averaged.get(1, first) ||
+        !averaged.get(averaged.latest(), last) || first.value != 50 || last.value != 950)
+        bench::fail("sampler", "sensor readings not averaged");
+    printf("%-40s %8s   -> ok, %u samples, first %u, last %u\n", "sensor, 1000 readings", "",
+           static_cast<unsigned int>(averaged.latest()), first.value, last.value);
+}
+
+// What a client gets back for various `since` values, and for samples lost
+// to the writer while the response was still going out
+void benchStream() {
+    SampleRing ring;
+    ring.push(1000, 1);
+    ring.push(1020, 0);
+    SampleStream stream(ring, 7, 0);
+    String body = readStream(stream, 7);
+    const char* expected = "{\"message\":\"Samples retrieved\",\"status\":true,\"data\":{\"device\":7,\"from\":1,"
+                           "\"next\":2,\"dropped\":0,\"samples\":[[1000,1],[1020,0]]}}";
+    if (body != expected) bench::fail("sampler", "unexpected JSON body");
+
+    SampleStream caughtUp(ring, 7, 2);
+    if (countOf(readStream(caughtUp, 64), "\"samples\":[]") != 1) bench::fail("sampler", "caught-up client got samples");
+
+    for (uint32_t i = 0; i < SampleRing::CAPACITY * 2; i++) ring.push(2000 + i, static_cast<uint16_t>(i));
+    SampleStream behind(ring, 7, 2);
+    SampleStream restarted(ring, 7, 100000);
+    if (behind.first() != ring.oldest() || restarted.first() != ring.oldest()) bench::fail("sampler", "stale since not clamped");
+    char dropped[24];
+    snprintf(dropped, sizeof(dropped), "\"dropped\":%u,", static_cast<unsigned int>(ring.oldest() - 3));
+    if (countOf(readStream(behind, 64), dropped) != 1) bench::fail("sampler", "dropped samples not counted");
+
+    // The writer laps a slow response: what it overwrote goes out as null
+    SampleStream slow(ring, 7, 0);
+    uint8_t buffer[256];
+    slow.read(buffer, sizeof(buffer));
+    for (uint32_t i = 0; i < 100; i++) ring.push(9000 + i, 0);
+    String rest = readStream(slow, 64);
+    size_t lost = countOf(rest, "null");
+    if (lost == 0) bench::fail("sampler", "overwritten samples were sent");
+    printf("%-40s %8s   -> ok, %zu of %u went out as null\n", "stream lapped by the writer", "", lost,
+           static_cast<unsigned int>(SampleRing::CAPACITY - 1));
+
+    bench::run("SampleStream (255 samples, JSON)", 1, 1,
+               [&] {
+                   SampleStream full(ring, 7, 0);
+                   while (full.read(buffer, sizeof(buffer)) > 0) {
+                   }
+               });
+    bench::run("SampleStream (255 samples, MessagePack)", 1, 1,
+               [&] {
+                   SampleStream full(ring, 7, 0, SampleStream::MSGPACK);
+                   while (full.read(buffer, sizeof(buffer)) > 0) {
+                   }
+               });
+}
+
+// Cost of one pass over 8 inputs, as the task runs it every millisecond
+void benchCost() {
+    struct Mix {
+        const char* name;
+        size_t sensors;
+    };
+    const Mix mixes[] = {
+        {"sample() pass, 8 contacts", 0},
+        {"sample() pass, 4 contacts + 4 sensors", 4},
+        {"sample() pass, 8 sensors", 8},
+    };
+    for (const Mix& mix : mixes) {
+        Sampler inputs;
+        for (size_t i = 0; i < Sampler::MAX_INPUTS; i++) {
+            uint8_t pin = static_cast<uint8_t>(34 + i);
+            host::setAnalogValue(pin, static_cast<uint16_t>(100 * i));
+            inputs.addInput(static_cast<int>(i + 1), pin, i < mix.sensors);
+        }
+        uint32_t now = 0;
+        bench::run(mix.name, Sampler::MAX_INPUTS, PASSES,
+                   [&] {
+                       for (size_t i = 0; i < PASSES; i++) {
+                           host::setPinLevel(34, (now / 50) & 1);
+                           inputs.sample(now++);
+                       }
+                   });
+    }
+}
+
+// The real task for half a second: periods kept and time spent per pass
+void benchTask() {
+    DeviceManager inputs;
+    char title[20];
+    for (int i = 1; i <= static_cast<int>(Sampler::MAX_INPUTS); i++) {
+        snprintf(title, sizeof(title), "Input %d", i);
+        inputs.addDevice(i, title, i % 2 ? CONTACT_TYPE : SENSOR_TYPE, 40 + i, false);
+    }
+
+    // The task never ends, so neither may its sampler
+    static Sampler running;
+    running.begin(inputs);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    Sampler::Stats stats = running.getStats();
+    if (stats.passes == 0) bench::fail("sampler", "task did not run");
+    printf("%-40s %8zu   -> %u passes, %u missed, %.2f us/pass (max %u us)\n", "task at 1 kHz for 500 ms",
+           running.size(), static_cast<unsigned int>(stats.passes), static_cast<unsigned int>(stats.missed),
+           double(stats.busyUs) / stats.passes, static_cast<unsigned int>(stats.maxBusyUs));
+}
+
+// GET /api/devices/{id}/samples through the firmware handler
+void benchEndpoint() {
+    char token[SessionTable::TOKEN_LENGTH + 1];
+    sessions.issue(millis(), 3600000, token);
+    String bearer = String("Bearer ") + token;
+
+    const int INPUT_ID = 50;
+    if (!sampler.ring(INPUT_ID) && !sampler.addInput(INPUT_ID, CONTACT_PIN, false)) bench::fail("sampler", "no room for an input");
+    host::setPinLevel(CONTACT_PIN, HIGH);
+    for (uint32_t ms = 0; ms < 100; ms++) {
+        if (ms == 40) host::setPinLevel(CONTACT_PIN, LOW);
+        sampler.sample(5000 + ms);
+    }
+
+    AsyncWebServerRequest request(HTTP_GET, "/api/devices/50/samples?since=0");
+    request.addHeader("Authorization", bearer);
+    handleGetSamples(&request);
+    String body = request.response() ? request.response()->readAll() : String();
+    if (request.response()->code() != 200 || countOf(body, "\"samples\":[[5000,1],[5059,0]]") != 1)
+        bench::fail("sampler", "endpoint did not stream the samples");
+
+    AsyncWebServerRequest unknown(HTTP_GET, "/api/devices/1/samples");
+    unknown.addHeader("Authorization", bearer);
+    handleGetSamples(&unknown);
+    if (!unknown.response() || unknown.response()->code() != 404) bench::fail("sampler", "non-input device not refused");
+
+    printf("%-40s %8s   -> ok, %u byte body\n", "GET /api/devices/50/samples", "",
+           static_cast<unsigned int>(body.length()));
+    bench::run("GET /api/devices/{id}/samples", 1, 1,
+               [&] {
+                   AsyncWebServerRequest timed(HTTP_GET, "/api/devices/50/samples");
+                   timed.addHeader("Authorization", bearer);
+                   handleGetSamples(&timed);
+                   timed.response()->drain();
+               });
+}
+
+} // namespace
+
+void benchSampler() {
+    bench::printHeader("Sampler");
+    benchFiltering();
+    benchStream();
+    benchCost();
+    benchEndpoint();
+    benchTask();
+}
@@ -0,0 +1,225 @@
+#include <Actuator.h>
+#include <Arduino.h>
+#include <DeviceManager.h>
+#include <HostControl.h>
+#include <Scheduler.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include "Bench.h"
+
+// Firmware globals and entry points from src/main.cpp
+extern DeviceManager deviceManager;
+extern Actuator actuator;
+extern Scheduler scheduler;
+void loop();
+void runSchedules();
+
+namespace {
+
+const size_t PENDING[] = {100, 1000, 10000};
+const size_t BATCH = 32;
+
+const int HEATER = 4;
+const int DOOR = 5;
+
+typedef std::chrono::steady_clock Clock;
+
+void benchHeap() {
+    for (size_t n : PENDING) {
+        std::vector<int> order = bench::shuffledIds(n, 7);
+        std::unique_ptr<Scheduler> timers;
+        std::vector<uint32_t> ids(n);
+
+        bench::run("arm", n, n,
+                   [&] { timers.reset(new Scheduler(n)); },
+                   [&] {
+                       for (size_t i = 0; i < n; i++) ids[i] = timers->arm(1, Scheduler::ON, 0, order[i]);
+                   });
+
+        bench::run("cancel (random order)", n, n,
+                   [&] {
+                       timers.reset(new Scheduler(n));
+                       for (size_t i = 0; i < n; i++) ids[order[i] - 1] = timers->arm(1, Scheduler::ON, 0, order[i]);
+                   },
+                   [&] {
+                       for (size_t i = 0; i < n; i++) timers->cancel(ids[i]);
+                   });
+
+        bench::run("poll (all due, 32 per call)", n, n,
+                   [&] {
+                       timers.reset(new Scheduler(n));
+                       for (size_t i = 0; i < n; i++) timers->arm(1, Scheduler::ON, 0, order[i]);
+                   },
+                   [&] {
+                       Scheduler::Timer fired[BATCH];
+                       while (timers->poll(static_cast<uint32_t>(n), fired, BATCH) > 0) {
+                       }
+                   });
+
+        // Steady state: a full table with timers coming and going
+        timers.reset(new Scheduler(n));
+        for (size_t i = 0; i + 1 < n; i++) timers->arm(1, Scheduler::ON, 0, order[i] + 1000);
+        bench::run("arm + cancel (table full)", n, 1000, [&] {
+            for (size_t i = 0; i < 1000; i++) timers->cancel(timers->arm(1, Scheduler::OFF, 0, order[i % n]));
+        });
+        if (timers->size() != n - 1) bench::fail("scheduler", "arm/cancel leaked slots");
+    }
+}
+
+void populate() {
+    deviceManager = DeviceManager();
+    deviceManager.addDevice(1, "Main Room Light", "LED", 2, false);
+    deviceManager.addDevice(HEATER, "Kitchen Heater", "HEATER", 18, true);
+    deviceManager.addDevice(DOOR, "Garage Door", "DOOR", 19, false);
+}
+
+// Waits, in real time, for the actuator to catch up with what loop() fired
+void expectStatus(int id, bool status, const char* what) {
+    Device device;
+    for (int i = 0; i < 1000; i++) {
+        if (deviceManager.copyDevice(id, device) && device.status == status) return;
+        vTaskDelay(1);
+    }
+    bench::fail("scheduler", what);
+}
+
+void report(const char* name, const Scheduler::Stats& stats) {
+    printf("%-40s %8s   -> %u fired, mean %.2f ms late, max %.2f ms\n", name, "",
+           static_cast<unsigned int>(stats.fired), stats.fired ? stats.totalLateUs / 1000.0 / stats.fired : 0.0,
+           stats.maxLateUs / 1000.0);
+}
+
+// Real clock: how late timers fire through the firmware's loop()
+void benchAccuracy() {
+    populate();
+    const size_t TIMERS = 100;
+    std::vector<int> order = bench::shuffledIds(TIMERS, 11);
+
+    // The old fixed 20 ms sleep, for comparison
+    scheduler.resetStats();
+    uint32_t now = millis();
+    for (size_t i = 0; i < TIMERS; i++) scheduler.arm(1, Scheduler::TOGGLE, now, order[i] * 7);
+    while (scheduler.size() > 0) {
+        runSchedules();
+        delay(20);
+    }
+    report("lateness, loop() sleeping 20 ms", scheduler.getStats());
+
+    scheduler.resetStats();
+    now = millis();
+    for (size_t i = 0; i < TIMERS; i++) scheduler.arm(1, Scheduler::TOGGLE, now, order[i] * 7);
+    while (scheduler.size() > 0) loop();
+    report("lateness, loop() (sleeps to next due)", scheduler.getStats());
+}
+
+// Virtual clock: half an hour of heater auto-off and door pulses in a moment
+void benchVirtualClock() {
+    populate();
+    host::setVirtualClock(true);
+    scheduler.resetStats();
+
+    uint32_t start = millis();
+    const uint32_t HALF_HOUR = 30UL * 60 * 1000;
+    scheduler.arm(HEATER, Scheduler::OFF, start, HALF_HOUR);
+    uint32_t door = scheduler.arm(DOOR, Scheduler::PULSE, start, 10000, 10000, 500);
+
+    // Just inside the pulse that starts at 20 s
+    while (millis() - start < 20100) loop();
+    expectStatus(DOOR, true, "door not open during its pulse");
+    while (millis() - start < 20600) loop();
+    expectStatus(DOOR, false, "door pulse did not end");
+    expectStatus(HEATER, true, "heater switched off early");
+
+    Clock::time_point begin = Clock::now();
+    while (millis() - start < HALF_HOUR + 600) loop();
+    double realMs = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    expectStatus(HEATER, false, "heater not switched off after 30 minutes");
+    scheduler.cancel(door);
+    host::setVirtualClock(false);
+
+    Scheduler::Stats stats = scheduler.getStats();
+    // 180 pulses, each an on and an off, plus the heater
+    if (stats.fired != 361 || stats.maxLateUs != 0) bench::fail("scheduler", "virtual clock run fired off schedule");
+    report("30 min virtual (heater off, door pulses)", stats);
+    printf("%-40s %8s   -> simulated in %.0f ms\n", "", "", realMs);
+}
+
+// True if the journal since seq shows id switched on and then off again
+bool pulsedSince(uint32_t seq, int id) {
+    const ChangeJournal& journal = deviceManager.getJournal();
+    DeviceChange change;
+    bool on = false;
+    for (seq++; seq <= journal.latest(); seq++) {
+        if (!journal.get(seq, change) || change.id != id) continue;
+        if (change.status) on = true;
+        else if (on) return true;
+    }
+    return false;
+}
+
+// A pulse never leaves its device on: with no timer free for its off half
+// it is skipped, and one shorter than the retry interval still ends after
+// it began
+void checkPulses() {
+    populate();
+    uint32_t now = millis();
+    uint32_t door = scheduler.arm(DOOR, Scheduler::PULSE, now, 0, 1000, 500);
+    std::vector<uint32_t> fillers;
+    for (uint32_t id; (id = scheduler.arm(1, Scheduler::OFF, now, Scheduler::MAX_DELAY_MS)) != 0;) fillers.push_back(id);
+    runSchedules();
+    vTaskDelay(20);
+    expectStatus(DOOR, false, "pulse fired with no timer free for its end");
+    for (uint32_t id : fillers) scheduler.cancel(id);
+    scheduler.cancel(door);
+
+    uint32_t seq = deviceManager.getJournal().latest();
+    scheduler.arm(DOOR, Scheduler::PULSE, millis(), 0, 0, 3);
+    while (scheduler.size() > 0) loop();
+    expectStatus(DOOR, false, "short pulse left the door open");
+    if (!pulsedSince(seq, DOOR)) bench::fail("scheduler", "short pulse did not switch on, then off");
+    printf("%-40s %8s   -> ok, skipped when the pool is full, 3 ms pulse\n", "pulse", "");
+}
+
+// With the actuator's queue full, due schedules wait SCHEDULE_RETRY_MS and
+// go again, even with no timer free: a recurring one is still pending, and
+// a one-shot takes back the slot it gave up
+void checkRetries() {
+    populate();
+    uint32_t now = millis();
+    uint32_t heater = scheduler.arm(HEATER, Scheduler::OFF, now, 0, 60000);
+    scheduler.arm(DOOR, Scheduler::ON, now, 0);
+    std::vector<uint32_t> fillers;
+    for (uint32_t id; (id = scheduler.arm(1, Scheduler::OFF, now, Scheduler::MAX_DELAY_MS)) != 0;) fillers.push_back(id);
+    size_t pending = scheduler.size();
+
+    host::holdNotifiedTasks(true);
+    DeviceCommand command;
+    command.id = 1;
+    command.status = false;
+    while (actuator.submit(&command, 1) != 0) {
+    }
+    runSchedules();
+    host::holdNotifiedTasks(false);
+    if (scheduler.size() != pending) bench::fail("scheduler", "schedule dropped while the actuator was busy");
+
+    for (uint32_t id : fillers) scheduler.cancel(id);
+    uint32_t until = millis() + 50;
+    while (static_cast<int32_t>(millis() - until) < 0) loop();
+    expectStatus(HEATER, false, "recurring schedule not retried");
+    expectStatus(DOOR, true, "one-shot schedule not retried");
+    scheduler.cancel(heater);
+    if (scheduler.size() != 0) bench::fail("scheduler", "retried schedules left behind");
+    printf("%-40s %8s   -> ok, recurring and one-shot retried with the pool full\n", "actuator busy", "");
+}
+
+} // namespace
+
+void benchScheduler() {
+    bench::printHeader("Scheduler");
+    benchHeap();
+    benchAccuracy();
+    checkPulses();
+    checkRetries();
+    benchVirtualClock();
+}
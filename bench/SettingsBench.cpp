@@ -0,0 +1,79 @@
+#include <HostControl.h>
+#include <Preferences.h>
+#include <Settings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Bench.h"
+
+namespace {
+
+const size_t OPS = 1000;
+
+void writeLegacyKeys() {
+    Preferences prefs;
+    prefs.begin("wifi", false);
+    prefs.putString("ssid", "HomeNet");
+    prefs.putString("password", "hunter22");
+    prefs.putBool("configured", true);
+    prefs.putUInt("mode", 1);
+    prefs.end();
+}
+
+void expect(bool ok, const char* what) {
+    if (!ok) {
+        printf("settings: %s\n", what);
+        abort();
+    }
+}
+
+void reportNvs(const char* name, uint32_t opens, uint32_t writes) {
+    printf("%-40s %8s   -> %u NVS opens, %u NVS writes\n", name, "", static_cast<unsigned int>(opens),
+           static_cast<unsigned int>(writes));
+}
+
+} // namespace
+
+void benchSettings() {
+    bench::printHeader("Settings");
+
+    // Old per-key layout: read once, then moved to the blob in one write
+    host::clearPreferences();
+    writeLegacyKeys();
+    Settings settings;
+    uint32_t writes = host::preferenceWriteCount();
+    expect(settings.load(), "legacy keys not found");
+    expect(settings.get().wifiMode == 1 && strcmp(settings.get().ssid, "HomeNet") == 0, "legacy values lost");
+    expect(settings.commit(), "migration commit failed");
+    reportNvs("load + migrate (legacy keys)", settings.getStats().nvsOpens, host::preferenceWriteCount() - writes);
+
+    Settings booted;
+    expect(booted.load() && booted.dirtyFields() == 0, "blob not loaded clean");
+    expect(strcmp(booted.get().password, "hunter22") == 0, "blob values lost");
+    reportNvs("load (blob)", booted.getStats().nvsOpens, 0);
+
+    // Two fields changed by one request: a single write
+    writes = host::preferenceWriteCount();
+    booted.setWiFiCredentials("OfficeNet", "correct horse");
+    booted.setWiFiMode(0);
+    uint32_t opens = booted.getStats().nvsOpens;
+    expect(booted.commit(), "commit failed");
+    reportNvs("commit (credentials + mode)", booted.getStats().nvsOpens - opens, host::preferenceWriteCount() - writes);
+
+    // Setting what is already stored costs nothing
+    writes = host::preferenceWriteCount();
+    booted.setWiFiMode(0);
+    booted.setWiFiCredentials("OfficeNet", "correct horse");
+    opens = booted.getStats().nvsOpens;
+    expect(booted.commit(), "no-op commit failed");
+    reportNvs("commit (unchanged)", booted.getStats().nvsOpens - opens, host::preferenceWriteCount() - writes);
+
+    bench::run("load (blob)", 0, OPS, [&] {
+        for (size_t i = 0; i < OPS; i++) booted.load();
+    });
+    bench::run("get().ssid (RAM)", 0, OPS, [&] {
+        size_t total = 0;
+        for (size_t i = 0; i < OPS; i++) total += strlen(booted.get().ssid);
+        if (total == 0) abort();
+    });
+}
@@ -0,0 +1,65 @@
+#include <DeviceManager.h>
+#include <ESPAsyncWebServer.h>
+#include <SessionTable.h>
+#include <SocketServer.h>
+#include <memory>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include "Bench.h"
+#include "LoopbackClient.h"
+
+// Firmware globals from src/main.cpp
+extern AsyncWebServer server;
+extern DeviceManager deviceManager;
+extern SessionTable sessions;
+
+namespace {
+
+const size_t OPS = 16; // under the admission burst of one address
+
+// A request's round trip through the transport, next to the handler alone
+void benchRoundTrip(uint16_t port, const std::string& bearer) {
+    Device device;
+    deviceManager.readDevice(0, device);
+    std::string request = "GET /api/devices/" + std::to_string(device.id) + " HTTP/1.1\r\nAuthorization: " + bearer + "\r\n\r\n";
+    std::unique_ptr<LoopbackClient> client;
+    auto reconnect = [&] {
+        client.reset();
+        client.reset(new LoopbackClient(port));
+    };
+    bench::run("GET /api/devices/{id}, one at a time", deviceManager.size(), OPS, reconnect,
+               [&] {
+                   for (size_t i = 0; i < OPS; i++) {
+                       client->write(request);
+                       if (client->read().code != 200) bench::fail("socket", "round trip failed");
+                   }
+               });
+
+    std::string pipelined;
+    for (size_t i = 0; i < OPS; i++) pipelined += request;
+    bench::run("GET /api/devices/{id}, pipelined", deviceManager.size(), OPS, reconnect,
+               [&] {
+                   client->write(pipelined);
+                   for (size_t i = 0; i < OPS; i++) {
+                       if (client->read().code != 200) bench::fail("socket", "pipelined round trip failed");
+                   }
+               });
+    client.reset();
+}
+
+} // namespace
+
+void benchSocket() {
+    bench::printHeader("Socket transport");
+    char token[SessionTable::TOKEN_LENGTH + 1];
+    sessions.issue(millis(), 3600000, token);
+    std::string bearer = std::string("Bearer ") + token;
+
+    SocketServer transport(server);
+    if (!transport.listen(0)) bench::fail("socket", "cannot listen");
+    std::thread tcpTask([&transport] { transport.run(); });
+    benchRoundTrip(transport.port(), bearer);
+    transport.stop();
+    tcpTask.join();
+}
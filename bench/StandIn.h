@@ -0,0 +1,229 @@
+#ifndef STAND_IN_H
+#define STAND_IN_H
+
+#include <DeviceListJson.h>
+#include <DeviceManager.h>
+#include <ESPAsyncWebServer.h>
+#include <SocketServer.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// A peer board: the firmware's /api/connect, /api/devices and control
+// endpoints as far as the gateway uses them, served by a SocketServer of
+// its own on a loopback port. Everything runs on its server thread; other
+// threads change its devices through change(). Control requests can be
+// slowed by delayMs, and stop() takes the board off the network. Shared by
+// the fleet bench and test/test_fleet.
+class StandIn {
+private:
+    AsyncWebServer web{80};
+    std::unique_ptr<SocketServer> transport;
+    std::thread thread;
+    uint16_t boundPort = 0;
+    uint32_t salt;
+    std::string body;  // of the request being dispatched
+    std::string token; // the one session, "" until a login
+    uint32_t tokens = 0;
+
+    std::mutex lock;
+    std::vector<DeviceCommand> queued;
+    bool forgetting = false;
+
+    // Reads {device, status, level} as the gateway writes it; the stand-ins
+    // never see anything else
+    static bool parseCommand(const std::string& text, DeviceCommand& command) {
+        const char* device = strstr(text.c_str(), "\"device\":");
+        if (!device) return false;
+        command = DeviceCommand();
+        command.id = atoi(device + 9);
+        command.status = strstr(text.c_str(), "\"status\":true") != nullptr;
+        const char* level = strstr(text.c_str(), "\"level\":");
+        if (level) {
+            command.level = static_cast<int16_t>(atoi(level + 8));
+            command.status = command.level > 0;
+        }
+        return true;
+    }
+
+    void send(AsyncWebServerRequest* request, int code, const std::string& json) {
+        request->send(code, "application/json", String(json.c_str()));
+    }
+
+    // Takes what other threads asked for
+    void catchUp() {
+        std::lock_guard<std::mutex> guard(lock);
+        for (const DeviceCommand& command : queued) devices->updateDevice(command);
+        queued.clear();
+        if (forgetting) token.clear();
+        forgetting = false;
+    }
+
+    bool authorized(AsyncWebServerRequest* request) {
+        catchUp();
+        const AsyncWebHeader* header = request->getHeader("Authorization");
+        if (!token.empty() && header && header->value() == String(("Bearer " + token).c_str())) return true;
+        send(request, 401, "{\"message\":\"Invalid token\",\"status\":false}");
+        body.clear();
+        return false;
+    }
+
+    void handleConnect(AsyncWebServerRequest* request) {
+        catchUp();
+        logins++;
+        if (body.find(std::string("\"password\":\"") + PASSWORD + "\"") == std::string::npos) {
+            send(request, 401, "{\"message\":\"Invalid password\",\"status\":false}");
+        } else {
+            token = "peer" + std::to_string(boundPort) + "-" + std::to_string(++tokens);
+            send(request, 200, "{\"message\":\"Authentication successful\",\"status\":true,\"data\":{\"token\":\"" + token +
+                                   "\",\"expiresIn\":43200}}");
+        }
+        body.clear();
+    }
+
+    void handleDevices(AsyncWebServerRequest* request) {
+        if (!authorized(request)) return;
+        char etag[28];
+        snprintf(etag, sizeof(etag), "\"%08x-%u\"", static_cast<unsigned int>(salt), static_cast<unsigned int>(devices->getGeneration()));
+        const AsyncWebHeader* ifNoneMatch = request->getHeader("If-None-Match");
+        AsyncWebServerResponse* response;
+        if (ifNoneMatch && ifNoneMatch->value() == String(etag)) {
+            unchanged++;
+            response = request->beginResponse(304);
+        } else {
+            lists++;
+            DeviceListJson writer(*devices);
+            response = request->beginChunkedResponse("application/json", [writer](uint8_t* buffer, size_t maxLen, size_t index) mutable -> size_t {
+                return writer.read(buffer, maxLen);
+            });
+        }
+        response->addHeader("ETag", etag);
+        request->send(response);
+    }
+
+    void handleControl(AsyncWebServerRequest* request) {
+        if (!authorized(request)) return;
+        controls++;
+        usleep(delayMs * 1000);
+        DeviceCommand command;
+        if (!parseCommand(body, command)) {
+            send(request, 400, "{\"message\":\"Invalid JSON\",\"status\":false}");
+        } else if (devices->updateDevice(command)) {
+            send(request, 200, "{\"message\":\"Device updated\",\"status\":true}");
+        } else {
+            send(request, 404, "{\"message\":\"Device not found\",\"status\":false}");
+        }
+        body.clear();
+    }
+
+    // All or none, as the firmware's batch is
+    void handleBatch(AsyncWebServerRequest* request) {
+        if (!authorized(request)) return;
+        batches++;
+        usleep(delayMs * 1000);
+        std::vector<DeviceCommand> commands;
+        for (size_t open = body.find('{'); open != std::string::npos; open = body.find('{', open + 1)) {
+            DeviceCommand command;
+            if (parseCommand(body.substr(open, body.find('}', open) - open), command)) commands.push_back(command);
+        }
+        std::vector<uint8_t> found(commands.size());
+        bool all = true;
+        for (size_t i = 0; i < commands.size(); i++) {
+            Device device;
+            found[i] = devices->copyDevice(commands[i].id, device);
+            all = all && found[i];
+        }
+        std::string out = all ? "{\"message\":\"Devices updated\",\"status\":true,\"data\":["
+                              : "{\"message\":\"Device not found\",\"status\":false,\"data\":[";
+        for (size_t i = 0; i < commands.size(); i++) {
+            if (all) devices->updateDevice(commands[i]);
+            out += i ? ",{\"device\":" : "{\"device\":";
+            out += std::to_string(commands[i].id) + ",\"result\":\"";
+            out += all ? "updated" : found[i] ? "not_applied" : "not_found";
+            out += "\"}";
+        }
+        send(request, all ? 200 : 404, out + "]}");
+        body.clear();
+    }
+
+public:
+    static constexpr const char* PASSWORD = "Esp32SecurePass";
+
+    // The device list a board sends, as DeviceListJson writes it
+    static std::string listOf(const DeviceManager& manager) {
+        DeviceListJson writer(manager);
+        std::string out;
+        uint8_t buffer[256];
+        size_t n;
+        while ((n = writer.read(buffer, sizeof(buffer))) > 0) out.append(reinterpret_cast<char*>(buffer), n);
+        return out;
+    }
+
+    std::unique_ptr<DeviceManager> devices{new DeviceManager()};
+    std::atomic<uint32_t> delayMs{0};
+    std::atomic<uint32_t> logins{0};
+    std::atomic<uint32_t> lists{0};
+    std::atomic<uint32_t> unchanged{0};
+    std::atomic<uint32_t> controls{0};
+    std::atomic<uint32_t> batches{0};
+
+    StandIn(int firstId, size_t count, uint32_t seed) : salt(seed) {
+        for (size_t i = 0; i < count; i++) {
+            char title[sizeof(Device::title)];
+            snprintf(title, sizeof(title), "Light %x-%u", static_cast<unsigned int>(seed), static_cast<unsigned int>(i));
+            devices->addDevice(firstId + static_cast<int>(i), title, "LED", 2, false);
+        }
+        auto collect = [this](AsyncWebServerRequest*, uint8_t* data, size_t len, size_t, size_t) {
+            body.append(reinterpret_cast<char*>(data), len);
+        };
+        // The first match wins, and /api/control also matches its batch
+        web.on("/api/connect", HTTP_POST, [this](AsyncWebServerRequest* r) { handleConnect(r); }, nullptr, collect);
+        web.on("/api/devices", HTTP_GET, [this](AsyncWebServerRequest* r) { handleDevices(r); });
+        web.on("/api/control/batch", HTTP_PUT, [this](AsyncWebServerRequest* r) { handleBatch(r); }, nullptr, collect);
+        web.on("/api/control", HTTP_PUT, [this](AsyncWebServerRequest* r) { handleControl(r); }, nullptr, collect);
+        start();
+    }
+    ~StandIn() {
+        if (transport) stop();
+    }
+
+    // Serving again after stop(), on the same port; false if it cannot
+    bool start() {
+        transport.reset(new SocketServer(web));
+        if (!transport->listen(boundPort)) {
+            transport.reset();
+            return false;
+        }
+        boundPort = transport->port();
+        thread = std::thread([this] { transport->run(); });
+        return true;
+    }
+    bool serving() const { return transport != nullptr; }
+    void stop() {
+        transport->stop();
+        thread.join();
+        transport.reset();
+    }
+
+    uint16_t port() const { return boundPort; }
+    // Connections accepted since the last start()
+    uint64_t accepted() const { return transport->getStats().accepted; }
+    void change(const DeviceCommand& command) {
+        std::lock_guard<std::mutex> guard(lock);
+        queued.push_back(command);
+    }
+    // Drops the session, as a restarted board would
+    void forgetSession() {
+        std::lock_guard<std::mutex> guard(lock);
+        forgetting = true;
+    }
+};
+
+#endif // STAND_IN_H
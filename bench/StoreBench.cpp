@@ -0,0 +1,135 @@
+#include <DeviceManager.h>
+#include <DeviceStore.h>
+#include <HostControl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "Bench.h"
+
+namespace {
+
+const size_t FLEET_SIZES[] = {6, 64, 300};
+const size_t TOGGLES = 1000;
+
+void populate(DeviceManager& manager, size_t n) {
+    char title[20];
+    for (size_t i = 1; i <= n; i++) {
+        snprintf(title, sizeof(title), "Device %zu", i);
+        manager.addDevice(static_cast<int>(i), title, "LED", static_cast<int>(i % 40), false);
+    }
+}
+
+bool isOn(const DeviceManager& manager, int id) {
+    Device device;
+    return manager.copyDevice(id, device) && device.status;
+}
+
+std::vector<bool> statuses(const DeviceManager& manager) {
+    std::vector<bool> out;
+    Device device;
+    for (size_t slot = 0; manager.readDevice(slot, device); slot++) out.push_back(device.status);
+    return out;
+}
+
+// Reboots into a fresh manager and checks it came back in the expected state
+void expectRestored(const char* name, const std::vector<bool>& expected) {
+    DeviceManager restored;
+    DeviceStore store;
+    if (!store.restore(restored) || statuses(restored) != expected) {
+        printf("store: %s did not restore the expected state\n", name);
+        abort();
+    }
+    printf("%-40s %8zu   -> ok, %u log records replayed\n", name, expected.size(),
+           static_cast<unsigned int>(store.getStats().logReplayed));
+}
+
+} // namespace
+
+void benchStore() {
+    bench::printHeader("DeviceStore");
+
+    for (size_t n : FLEET_SIZES) {
+        host::clearPreferences();
+        DeviceManager manager;
+        populate(manager, n);
+        DeviceStore store;
+        store.save(manager);
+
+        // Every toggle is synced on its own, the worst case for flash wear
+        std::vector<int> order = bench::shuffledIds(n, 3);
+        size_t next = 0;
+        uint32_t writesBefore = host::preferenceWriteCount();
+        DeviceStore::Stats before = store.getStats();
+        size_t toggled = 0;
+        bench::run("sync (one toggle)", n, TOGGLES,
+                   [&] {
+                       for (size_t i = 0; i < TOGGLES; i++) {
+                           int id = order[next++ % n];
+                           manager.updateDeviceStatus(id, !isOn(manager, id));
+                           store.sync(manager);
+                       }
+                       toggled += TOGGLES;
+                   });
+        DeviceStore::Stats after = store.getStats();
+        printf("%-40s %8s   -> %.3f NVS writes/toggle, %u blob writes for %zu toggles\n", "", "",
+               double(host::preferenceWriteCount() - writesBefore) / toggled,
+               static_cast<unsigned int>(after.blobWrites - before.blobWrites), toggled);
+
+        // Boot with a half-full log, as after a typical day
+        for (size_t i = 0; i < DeviceStore::LOG_SLOTS / 2; i++) {
+            int id = order[next++ % n];
+            manager.updateDeviceStatus(id, !isOn(manager, id));
+            store.sync(manager);
+        }
+        DeviceManager restored;
+        bench::run("restore (boot)", n, 1,
+                   [&] { restored = DeviceManager(); },
+                   [&] {
+                       DeviceStore bootStore;
+                       bootStore.restore(restored);
+                   });
+        if (statuses(restored) != statuses(manager)) {
+            printf("store: restore lost statuses\n");
+            abort();
+        }
+    }
+
+    // Power fails while a log record is written: that toggle is lost, the
+    // ones before it are not
+    {
+        host::clearPreferences();
+        DeviceManager manager;
+        populate(manager, 16);
+        DeviceStore store;
+        store.save(manager);
+        for (int id = 1; id <= 5; id++) {
+            manager.updateDeviceStatus(id, true);
+            store.sync(manager);
+        }
+        std::vector<bool> expected = statuses(manager);
+        host::tearNextPreferenceWrite(3);
+        manager.updateDeviceStatus(6, true);
+        store.sync(manager);
+        expectRestored("torn log record", expected);
+    }
+
+    // Power fails while compaction writes the next blob: boot falls back to
+    // the previous blob and its complete log
+    {
+        host::clearPreferences();
+        DeviceManager manager;
+        populate(manager, 16);
+        DeviceStore store;
+        store.save(manager);
+        for (size_t i = 0; i < DeviceStore::LOG_SLOTS; i++) {
+            int id = static_cast<int>(i % 16) + 1;
+            manager.updateDeviceStatus(id, !isOn(manager, id));
+            store.sync(manager);
+        }
+        std::vector<bool> expected = statuses(manager);
+        host::tearNextPreferenceWrite(100);
+        manager.updateDeviceStatus(1, !isOn(manager, 1));
+        store.sync(manager);
+        expectRestored("torn blob during compaction", expected);
+    }
+}
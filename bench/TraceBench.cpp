@@ -0,0 +1,40 @@
+#include <Trace.h>
+#include <TraceJson.h>
+#include <stdio.h>
+#include <vector>
+#include "Bench.h"
+
+namespace {
+
+const size_t OPS = 1000;
+
+// The cost a span adds to the code it times
+void benchRecord() {
+    static TraceRing ring;
+    bench::run("TraceRing::record", 0, OPS, [&] {
+        for (size_t i = 0; i < OPS; i++) ring.record("span", static_cast<uint32_t>(i), static_cast<uint32_t>(i) + 5);
+    });
+    bench::run("TraceScope, micros() at both ends", 0, OPS, [&] {
+        for (size_t i = 0; i < OPS; i++) {
+            TraceScope scope(ring, "span");
+        }
+    });
+    bench::run("TraceScope under its minimum", 0, OPS, [&] {
+        for (size_t i = 0; i < OPS; i++) {
+            TraceScope scope(ring, "span", 1000);
+        }
+    });
+    std::vector<uint8_t> buffer(1436);
+    bench::run("TraceJson, full ring", 0, 1, [&] {
+        TraceJson writer(ring, micros());
+        while (writer.read(buffer.data(), buffer.size()) > 0) {
+        }
+    });
+}
+
+} // namespace
+
+void benchTrace() {
+    bench::printHeader("Tracing");
+    benchRecord();
+}
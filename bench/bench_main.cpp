@@ -0,0 +1,34 @@
+#include <HostControl.h>
+#include <stdio.h>
+#include "Bench.h"
+
+// Entry point of the native build: `pio run -e native -t exec`. Test builds
+// link the firmware and bench/ too, with an entry point of their own
+#ifndef PIO_UNIT_TESTING
+int main() {
+    host::setSerialEnabled(false);
+
+    // First, while the firmware globals are still fresh
+    benchBoot();
+    benchDeviceManager();
+    benchHandlers();
+    benchActuator();
+    benchEncoding();
+    benchStore();
+    benchSettings();
+    benchScheduler();
+    benchPwm();
+    benchSampler();
+    benchAdmission();
+    benchMetrics();
+    benchBody();
+    benchQuery();
+    benchRouter();
+    benchSocket();
+    benchTrace();
+    benchFleet();
+
+    printf("\n");
+    return 0;
+}
+#endif
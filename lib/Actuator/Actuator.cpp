@@ -0,0 +1,132 @@
+#include "Actuator.h"
+#include <Arduino.h>
+#include <PwmPort.h>
+#include <Trace.h>
+#include <string.h>
+
+namespace {
+
+// How long wait() yields before falling back to sleeping a tick at a time.
+// The task normally finishes well inside this.
+const uint32_t SPIN_US = 1000;
+
+} // namespace
+
+void Actuator::begin(DeviceManager& deviceManager) {
+    if (task) return;
+    manager = &deviceManager;
+    xTaskCreatePinnedToCore(taskMain, "actuator", 4096, this, TASK_PRIORITY, &task, 1);
+}
+
+uint32_t Actuator::submit(const DeviceCommand* commands, size_t count) {
+    if (!task || count == 0 || count > MAX_COMMANDS) return 0;
+
+    Command command;
+    command.count = static_cast<uint8_t>(count);
+    command.removal = false;
+    memcpy(command.commands, commands, count * sizeof(DeviceCommand));
+    return enqueue(command);
+}
+
+uint32_t Actuator::submitRemoval(int id) {
+    if (!task) return 0;
+
+    Command command;
+    command.count = 1;
+    command.removal = true;
+    command.commands[0] = DeviceCommand();
+    command.commands[0].id = id;
+    return enqueue(command);
+}
+
+uint32_t Actuator::enqueue(Command& command) {
+    command.enqueuedAt = micros();
+    uint32_t ticket;
+    if (!queue.push(command, ticket)) return 0;
+    xTaskNotifyGive(task);
+    return ticket;
+}
+
+bool Actuator::wait(uint32_t ticket, uint32_t timeoutMs, Result& result) const {
+    TRACE_SPAN("Actuator::wait");
+    uint32_t start = micros();
+    while (!isDone(ticket)) {
+        uint32_t waited = micros() - start;
+        if (waited >= timeoutMs * 1000) return false;
+        if (waited < SPIN_US) {
+            taskYIELD();
+        } else {
+            vTaskDelay(1);
+        }
+    }
+
+    // Same check-copy-recheck as the change journal, in case the slot is
+    // reused while it is being read
+    const Completion& completion = completions[ticket % COMPLETIONS];
+    if (completion.ticket.load(std::memory_order_acquire) != ticket) return false;
+    result = completion.result;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return completion.ticket.load(std::memory_order_relaxed) == ticket;
+}
+
+Actuator::LatencyStats Actuator::latency() const {
+    LatencyStats copy;
+    uint32_t start;
+    do {
+        start = statsLock.readBegin();
+        copy = stats;
+    } while (statsLock.readRetry(start));
+    return copy;
+}
+
+void Actuator::taskMain(void* self) {
+    static_cast<Actuator*>(self)->run();
+}
+
+void Actuator::run() {
+    Command command;
+    uint32_t ticket;
+    TRACE_THREAD("actuator");
+    for (;;) {
+        // Also wakes when a dimmer write held behind a running fade is due
+        uint32_t untilMs = pwmPoll(millis());
+        ulTaskNotifyTake(pdTRUE, untilMs == PWM_IDLE ? portMAX_DELAY : pdMS_TO_TICKS(untilMs));
+        while (queue.pop(command, ticket)) apply(command, ticket);
+    }
+}
+
+void Actuator::apply(const Command& command, uint32_t ticket) {
+    // Time spent in the queue, then applying
+    TRACE_RECORD("Actuator queue", command.enqueuedAt, micros());
+    TRACE_SPAN("Actuator::apply");
+    Result result = {};
+    bool found[MAX_COMMANDS];
+    if (command.removal) {
+        result.applied = manager->deleteDevice(command.commands[0].id);
+        found[0] = result.applied;
+    } else if (command.count == 1) {
+        // A single device is written directly, like before the batch API
+        result.applied = manager->updateDevice(command.commands[0]);
+        found[0] = result.applied;
+    } else {
+        result.applied = manager->updateDeviceStatuses(command.commands, command.count, found);
+    }
+    uint32_t elapsed = micros() - command.enqueuedAt;
+
+    for (size_t i = 0; i < command.count; i++) {
+        if (found[i]) result.found |= 1UL << i;
+    }
+
+    statsLock.writeBegin();
+    stats.count++;
+    stats.totalUs += elapsed;
+    if (elapsed > stats.maxUs) stats.maxUs = elapsed;
+    statsLock.writeEnd();
+
+    Completion& completion = completions[ticket % COMPLETIONS];
+    completion.ticket.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    completion.result = result;
+    completion.ticket.store(ticket, std::memory_order_release);
+    completed.store(ticket, std::memory_order_release);
+}
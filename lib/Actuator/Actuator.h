@@ -0,0 +1,89 @@
+#ifndef ACTUATOR_H
+#define ACTUATOR_H
+
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <DeviceManager.h>
+#include <SeqLock.h>
+#include "CommandQueue.h"
+
+// Owns every output change once begin() has run. Request handlers submit
+// status commands from any task and get a ticket back; a dedicated task
+// applies them in ticket order, drives the pins, and is the only writer of
+// device state (deletions included), so network callbacks never touch a GPIO. Submitting never
+// blocks: it fails when the queue is full.
+class Actuator {
+public:
+    static const size_t MAX_COMMANDS = 32;
+    static const size_t QUEUE_DEPTH = 8;
+    // Above the AsyncTCP task (3) and loop (1): a reader never preempts the
+    // writer halfway through a seqlock section on the same core
+    static const UBaseType_t TASK_PRIORITY = 4;
+
+    struct Result {
+        bool applied;   // every device was known and has been switched
+        uint32_t found; // bit i set when commands[i] named a known device
+    };
+
+    // Time from submit() until the pins were written
+    struct LatencyStats {
+        uint32_t count;
+        uint64_t totalUs;
+        uint32_t maxUs;
+    };
+
+private:
+    struct Command {
+        uint32_t enqueuedAt;
+        uint8_t count;
+        bool removal; // commands[0] names a device to delete instead
+        DeviceCommand commands[MAX_COMMANDS];
+    };
+
+    // Results of the most recent tickets, found by ticket % COMPLETIONS
+    static const size_t COMPLETIONS = QUEUE_DEPTH * 4;
+    struct Completion {
+        std::atomic<uint32_t> ticket{0};
+        Result result = {};
+    };
+
+    DeviceManager* manager = nullptr;
+    TaskHandle_t task = nullptr;
+    CommandQueue<Command, QUEUE_DEPTH> queue;
+    Completion completions[COMPLETIONS];
+    std::atomic<uint32_t> completed{0};
+    LatencyStats stats = {};
+    SeqLock statsLock;
+
+    static void taskMain(void* self);
+    // Stamps and queues a command; its ticket, or 0 with the queue full
+    uint32_t enqueue(Command& command);
+    void run();
+    void apply(const Command& command, uint32_t ticket);
+
+public:
+    // Starts the task; from here on only it may change device status. Later
+    // calls do nothing.
+    void begin(DeviceManager& deviceManager);
+
+    // Queues up to MAX_COMMANDS status changes, applied together as with
+    // DeviceManager::updateDeviceStatuses. Returns the ticket, or 0 if the
+    // queue is full, the count is out of range or begin() has not run.
+    uint32_t submit(const DeviceCommand* commands, size_t count);
+    // Queues the deletion of a device, in the same order as status changes;
+    // the result is applied if the device existed. Returns the ticket, or 0
+    // as submit() does.
+    uint32_t submitRemoval(int id);
+    // Waits up to timeoutMs for a ticket to be applied. False on timeout, or
+    // if the ticket finished so long ago its result has been recycled.
+    bool wait(uint32_t ticket, uint32_t timeoutMs, Result& result) const;
+    // True once a ticket has been applied
+    bool isDone(uint32_t ticket) const {
+        return static_cast<int32_t>(completed.load(std::memory_order_acquire) - ticket) >= 0;
+    }
+
+    LatencyStats latency() const;
+};
+
+#endif // ACTUATOR_H
@@ -0,0 +1,68 @@
+#ifndef COMMANDQUEUE_H
+#define COMMANDQUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded lock-free queue for many producers and one consumer, after Dmitry
+// Vyukov's ring: every cell carries a sequence number saying whose turn it
+// is, producers claim a position with one compare-and-swap, and the consumer
+// hands the cell back by advancing its sequence a lap. Positions are a total
+// order, so they double as tickets. N must be a power of two so positions can
+// wrap around uint32_t.
+template <typename T, size_t N>
+class CommandQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "CommandQueue size must be a power of two");
+
+private:
+    struct Cell {
+        std::atomic<uint32_t> sequence;
+        T item;
+    };
+
+    Cell cells[N];
+    std::atomic<uint32_t> enqueuePos{0};
+    uint32_t dequeuePos = 0;
+
+public:
+    CommandQueue() {
+        for (size_t i = 0; i < N; i++) cells[i].sequence.store(static_cast<uint32_t>(i), std::memory_order_relaxed);
+    }
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    // Copies item in; position receives its 1-based place in the queue's
+    // order. False, without waiting, when the queue is full.
+    bool push(const T& item, uint32_t& position) {
+        uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells[pos % N];
+            int32_t lag = static_cast<int32_t>(cell->sequence.load(std::memory_order_acquire) - pos);
+            if (lag == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (lag < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->item = item;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        position = pos + 1;
+        return true;
+    }
+
+    // Consumer only: takes the oldest item; false when empty
+    bool pop(T& item, uint32_t& position) {
+        Cell& cell = cells[dequeuePos % N];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1) return false;
+        item = cell.item;
+        cell.sequence.store(dequeuePos + static_cast<uint32_t>(N), std::memory_order_release);
+        position = ++dequeuePos;
+        return true;
+    }
+};
+
+#endif // COMMANDQUEUE_H
@@ -0,0 +1,64 @@
+#include "AdmissionControl.h"
+
+AdmissionControl::Bucket& AdmissionControl::bucketFor(uint32_t ip, uint32_t nowMs) {
+    Bucket* oldest = &buckets[0];
+    for (Bucket& bucket : buckets) {
+        if (bucket.used && bucket.ip == ip) {
+            // Refill for the time since the last request, up to BURST
+            uint32_t elapsed = nowMs - bucket.updatedMs;
+            uint32_t room = BURST * SCALE - bucket.tokens;
+            bucket.tokens += elapsed >= room / REFILL_PER_SEC ? room : elapsed * REFILL_PER_SEC;
+            bucket.updatedMs = nowMs;
+            return bucket;
+        }
+        if (!bucket.used) {
+            if (oldest->used) oldest = &bucket;
+        } else if (oldest->used && static_cast<int32_t>(bucket.updatedMs - oldest->updatedMs) < 0) {
+            oldest = &bucket;
+        }
+    }
+
+    if (oldest->used) evicted.fetch_add(1, std::memory_order_relaxed);
+    oldest->ip = ip;
+    oldest->tokens = BURST * SCALE;
+    oldest->updatedMs = nowMs;
+    oldest->used = true;
+    return *oldest;
+}
+
+AdmissionControl::Verdict AdmissionControl::admit(uint32_t ip, uint32_t nowMs, uint32_t cost, bool tracked) {
+    Bucket& bucket = bucketFor(ip, nowMs);
+    if (bucket.tokens < cost * SCALE) {
+        rateLimited.fetch_add(1, std::memory_order_relaxed);
+        return RATE_LIMITED;
+    }
+    if (tracked && inFlight.fetch_add(1, std::memory_order_relaxed) >= MAX_IN_FLIGHT) {
+        inFlight.fetch_sub(1, std::memory_order_relaxed);
+        shed.fetch_add(1, std::memory_order_relaxed);
+        return SHED;
+    }
+    bucket.tokens -= cost * SCALE;
+    admitted.fetch_add(1, std::memory_order_relaxed);
+    return ADMIT;
+}
+
+void AdmissionControl::release() {
+    inFlight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+uint32_t AdmissionControl::retryAfterSec(uint32_t ip, uint32_t nowMs, uint32_t cost) {
+    const Bucket& bucket = bucketFor(ip, nowMs);
+    if (bucket.tokens >= cost * SCALE) return 0;
+    uint32_t waitMs = (cost * SCALE - bucket.tokens + REFILL_PER_SEC - 1) / REFILL_PER_SEC;
+    return (waitMs + 999) / 1000;
+}
+
+AdmissionControl::Stats AdmissionControl::getStats() const {
+    Stats stats;
+    stats.admitted = admitted.load(std::memory_order_relaxed);
+    stats.rateLimited = rateLimited.load(std::memory_order_relaxed);
+    stats.shed = shed.load(std::memory_order_relaxed);
+    stats.evicted = evicted.load(std::memory_order_relaxed);
+    stats.inFlight = inFlight.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,79 @@
+#ifndef ADMISSIONCONTROL_H
+#define ADMISSIONCONTROL_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Tokens a client regains a second. The loadtest env raises it so each of
+// its connections can stand in for many clients.
+#ifndef ADMISSION_REFILL_PER_SEC
+#define ADMISSION_REFILL_PER_SEC 10
+#endif
+
+// Decides whether a request may go on to auth and body parsing, as soon as
+// its headers are in. Each client IPv4 address has a token bucket holding up
+// to BURST tokens and regaining REFILL_PER_SEC a second; a request spends
+// `cost` of them. Buckets live in a fixed table of CLIENTS slots: an unknown
+// address takes the slot seen longest ago, which is as good as full again
+// by then unless CLIENTS addresses are all busy. Separately, at most
+// MAX_IN_FLIGHT admitted requests may be open at once; past that new ones
+// are shed so the heap is not spent on requests that cannot be served soon.
+//
+// admit() and the table are for one task (the AsyncTCP task); release()
+// and getStats() may be called from any.
+class AdmissionControl {
+public:
+    static const size_t CLIENTS = 32;
+    static const uint32_t BURST = 20;
+    static const uint32_t REFILL_PER_SEC = ADMISSION_REFILL_PER_SEC;
+    static const uint32_t MAX_IN_FLIGHT = 8;
+
+    enum Verdict {
+        ADMIT,
+        RATE_LIMITED, // the client's bucket is empty
+        SHED          // too many requests in flight
+    };
+
+    struct Stats {
+        uint32_t admitted;
+        uint32_t rateLimited;
+        uint32_t shed;
+        uint32_t evicted;  // buckets handed to a new address
+        uint32_t inFlight;
+    };
+
+private:
+    // Tokens are kept in thousandths, so a millisecond of refill at
+    // REFILL_PER_SEC is REFILL_PER_SEC of them
+    static const uint32_t SCALE = 1000;
+
+    struct Bucket {
+        uint32_t ip;
+        uint32_t tokens;
+        uint32_t updatedMs;
+        bool used;
+    };
+
+    Bucket buckets[CLIENTS] = {};
+    std::atomic<uint32_t> inFlight{0};
+    std::atomic<uint32_t> admitted{0};
+    std::atomic<uint32_t> rateLimited{0};
+    std::atomic<uint32_t> shed{0};
+    std::atomic<uint32_t> evicted{0};
+
+    Bucket& bucketFor(uint32_t ip, uint32_t nowMs);
+
+public:
+    // Spends cost tokens of ip's bucket and, if tracked, takes an in-flight
+    // slot that release() gives back. Nothing is spent or taken unless the
+    // verdict is ADMIT. Long-lived streams should pass tracked = false.
+    Verdict admit(uint32_t ip, uint32_t nowMs, uint32_t cost = 1, bool tracked = true);
+    void release();
+    // Whole seconds until ip's bucket holds cost tokens again; 0 if it does
+    uint32_t retryAfterSec(uint32_t ip, uint32_t nowMs, uint32_t cost = 1);
+
+    Stats getStats() const;
+};
+
+#endif // ADMISSIONCONTROL_H
@@ -0,0 +1,111 @@
+#include "SessionTable.h"
+#include <Arduino.h>
+#include <string.h>
+
+namespace {
+
+const char HEX_DIGITS[] = "0123456789abcdef";
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Decodes a token in place of the caller's header buffer; false if malformed
+bool decodeToken(const char* text, size_t len, uint8_t* out) {
+    if (len != SessionTable::TOKEN_LENGTH) return false;
+    for (size_t i = 0; i < SessionTable::TOKEN_BYTES; i++) {
+        int hi = hexValue(text[2 * i]);
+        int lo = hexValue(text[2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out[i] = static_cast<uint8_t>((hi << 4) | lo);
+    }
+    return true;
+}
+
+bool tokensEqual(const uint8_t* a, const uint8_t* b) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < SessionTable::TOKEN_BYTES; i++) diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+} // namespace
+
+bool SessionTable::expired(const Slot& slot, uint32_t now) {
+    return !slot.live || static_cast<int32_t>(slot.expiresAt - now) <= 0;
+}
+
+size_t SessionTable::home(const uint8_t* token) {
+    // Tokens are uniformly random, so their first bytes are already a hash
+    uint32_t h;
+    memcpy(&h, token, sizeof(h));
+    return h & (SLOTS - 1);
+}
+
+const SessionTable::Slot* SessionTable::find(const uint8_t* token, uint32_t now) const {
+    size_t pos = home(token);
+    for (size_t probes = 0; probes < SLOTS && slots[pos].used; probes++) {
+        const Slot& slot = slots[pos];
+        if (tokensEqual(slot.token, token) && !expired(slot, now)) return &slot;
+        pos = (pos + 1) & (SLOTS - 1);
+    }
+    return nullptr;
+}
+
+void SessionTable::issue(uint32_t now, uint32_t ttlMs, char* tokenOut) {
+    uint8_t token[TOKEN_BYTES];
+    for (size_t i = 0; i < TOKEN_BYTES; i += 4) {
+        uint32_t r = esp_random();
+        memcpy(token + i, &r, 4);
+    }
+
+    // At most CAPACITY sessions stay live, evicting the one closest to
+    // expiry, so the probe run always reaches a free slot
+    if (active(now) >= CAPACITY) {
+        Slot* soonest = nullptr;
+        for (Slot& slot : slots) {
+            if (!expired(slot, now) && (!soonest || static_cast<int32_t>(slot.expiresAt - soonest->expiresAt) < 0)) soonest = &slot;
+        }
+        soonest->live = false;
+    }
+
+    size_t pos = home(token);
+    while (!expired(slots[pos], now)) pos = (pos + 1) & (SLOTS - 1);
+    Slot* target = &slots[pos];
+
+    memcpy(target->token, token, TOKEN_BYTES);
+    target->expiresAt = now + ttlMs;
+    target->used = true;
+    target->live = true;
+
+    for (size_t i = 0; i < TOKEN_BYTES; i++) {
+        tokenOut[2 * i] = HEX_DIGITS[token[i] >> 4];
+        tokenOut[2 * i + 1] = HEX_DIGITS[token[i] & 0x0f];
+    }
+    tokenOut[TOKEN_LENGTH] = '\0';
+}
+
+bool SessionTable::validate(const char* token, size_t len, uint32_t now) const {
+    uint8_t decoded[TOKEN_BYTES];
+    return decodeToken(token, len, decoded) && find(decoded, now) != nullptr;
+}
+
+void SessionTable::revoke(const char* token, size_t len) {
+    uint8_t decoded[TOKEN_BYTES];
+    if (!decodeToken(token, len, decoded)) return;
+    size_t pos = home(decoded);
+    for (size_t probes = 0; probes < SLOTS && slots[pos].used; probes++) {
+        if (tokensEqual(slots[pos].token, decoded)) slots[pos].live = false;
+        pos = (pos + 1) & (SLOTS - 1);
+    }
+}
+
+size_t SessionTable::active(uint32_t now) const {
+    size_t count = 0;
+    for (const Slot& slot : slots) {
+        if (!expired(slot, now)) count++;
+    }
+    return count;
+}
@@ -0,0 +1,45 @@
+#ifndef SESSIONTABLE_H
+#define SESSIONTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bearer tokens issued by /api/connect, one per client, each with its own
+// expiry. Tokens are 128 random bits written as 32 lowercase hex characters.
+// The table is a fixed array of slots addressed by open addressing on the
+// token's leading bytes; expired slots are reused and, when every slot is
+// live, the session closest to expiry is evicted. Nothing here allocates,
+// and token bytes are compared in constant time.
+class SessionTable {
+public:
+    static const size_t CAPACITY = 16;
+    static const size_t TOKEN_BYTES = 16;
+    static const size_t TOKEN_LENGTH = 2 * TOKEN_BYTES;
+
+private:
+    static const size_t SLOTS = 2 * CAPACITY;
+
+    struct Slot {
+        uint8_t token[TOKEN_BYTES];
+        uint32_t expiresAt;
+        bool used;  // ever held a session; ends a probe run when false
+        bool live;
+    };
+
+    Slot slots[SLOTS] = {};
+
+    static bool expired(const Slot& slot, uint32_t now);
+    static size_t home(const uint8_t* token);
+    const Slot* find(const uint8_t* token, uint32_t now) const;
+
+public:
+    // Writes a new NUL-terminated token (TOKEN_LENGTH + 1 bytes) to tokenOut,
+    // valid for ttlMs from now
+    void issue(uint32_t now, uint32_t ttlMs, char* tokenOut);
+    // True if token (not NUL-terminated, len bytes) is live at now
+    bool validate(const char* token, size_t len, uint32_t now) const;
+    void revoke(const char* token, size_t len);
+    size_t active(uint32_t now) const;
+};
+
+#endif // SESSIONTABLE_H
@@ -0,0 +1,27 @@
+#include "BodyAccumulator.h"
+#include <stdlib.h>
+#include <string.h>
+
+BodyAccumulator::State BodyAccumulator::feed(void*& storage, uint8_t* data, size_t len, size_t index, size_t total,
+                                             char*& body) {
+    body = nullptr;
+    if (index == 0) {
+        if (total > MAX_SIZE) return TOO_LARGE;
+        if (len == total) {
+            body = reinterpret_cast<char*>(data);
+            return COMPLETE;
+        }
+        storage = malloc(total);
+        if (!storage) return NO_MEMORY;
+    } else if (!storage) {
+        return IGNORED;
+    }
+
+    // The server never hands over more than total, but a bad index must not
+    // write past the buffer either
+    if (index > total || len > total - index) return IGNORED;
+    memcpy(static_cast<uint8_t*>(storage) + index, data, len);
+    if (index + len != total) return PENDING;
+    body = static_cast<char*>(storage);
+    return COMPLETE;
+}
@@ -0,0 +1,32 @@
+#ifndef BODYACCUMULATOR_H
+#define BODYACCUMULATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Puts together a request body that ESPAsyncWebServer hands over in chunks,
+// one per TCP segment, so it can be parsed whole. A body that arrives in one
+// chunk is used where it lies; a longer one is copied into a buffer of
+// exactly its size, at most MAX_SIZE, kept in the request's `storage`
+// pointer (its _tempObject, which the server free()s with the request).
+// Either way the body is writable, so ArduinoJson can parse it in place.
+class BodyAccumulator {
+public:
+    // Above a full /api/control/batch body with room to spare
+    static const size_t MAX_SIZE = 4096;
+
+    enum State {
+        PENDING,   // more chunks to come
+        COMPLETE,  // body points at all `total` bytes
+        TOO_LARGE, // total is over MAX_SIZE; answer 413 and ignore the rest
+        NO_MEMORY, // no buffer could be had; answer 503 and ignore the rest
+        IGNORED    // a later chunk of a body already refused
+    };
+
+    // Feeds one chunk with the server's index and total. Chunks after the
+    // first are only taken if the first one was; a handler that answers at
+    // the first chunk (e.g. 401) leaves storage empty and so ignores the rest.
+    static State feed(void*& storage, uint8_t* data, size_t len, size_t index, size_t total, char*& body);
+};
+
+#endif // BODYACCUMULATOR_H
@@ -1,12 +1,25 @@
 #ifndef DEVICE_H
 #define DEVICE_H
 
+#include <stdint.h>
+
+// Devices of this type are dimmed through an LEDC PWM channel
+const char DIMMER_TYPE[] = "DIMMER";
+// Inputs, read by the sampler and never driven: a debounced digital contact
+// (internal pull-up, so closed reads 0) and an averaged ADC reading
+const char CONTACT_TYPE[] = "CONTACT";
+const char SENSOR_TYPE[] = "SENSOR";
+
+// A device as readers get it; DeviceManager stores the fields as columns
 struct Device {
     int id;
     char title[20];
     char type[10];
     int gpioPin;
     bool status;
+    uint8_t level;   // 0-255, output level while on; always 255 unless a dimmer
+    int8_t channel;  // LEDC channel of a dimmer, -1 otherwise
+    bool input;      // CONTACT or SENSOR; commands treat it as unknown
 };
 
-#endif // DEVICE_H
\ No newline at end of file
+#endif // DEVICE_H
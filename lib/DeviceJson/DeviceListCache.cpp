@@ -0,0 +1,53 @@
+#include "DeviceListCache.h"
+#include "DeviceListJson.h"
+#include "DeviceListMsgPack.h"
+#include <Trace.h>
+
+namespace {
+
+// Appends the writer's whole document to out; false once it passes limit
+template <typename Writer>
+bool render(Writer& writer, String& out, size_t limit) {
+    uint8_t chunk[256];
+    size_t n;
+    while ((n = writer.read(chunk, sizeof(chunk))) > 0) {
+        if (out.length() + n > limit) return false;
+        out.concat(reinterpret_cast<const char*>(chunk), n);
+    }
+    return true;
+}
+
+} // namespace
+
+std::shared_ptr<const String> DeviceListCache::get(const DeviceManager& manager) {
+    if (valid && generation == manager.getGeneration()) return body;
+    TRACE_SPAN("DeviceListCache rebuild");
+
+    // Taken before rendering: if a status changes mid-render the body is
+    // newer than its generation and is simply rebuilt on the next call
+    generation = manager.getGeneration();
+    valid = true;
+    body.reset();
+
+    std::shared_ptr<String> rendered = std::make_shared<String>();
+    size_t estimate = manager.size() * 80 + 64;
+    rendered->reserve(estimate < MAX_CACHED_SIZE ? estimate : MAX_CACHED_SIZE);
+
+    // A device added or deleted mid-render cuts the list short; nothing has
+    // been sent yet, so it is rendered again
+    bool fits;
+    uint32_t layout;
+    do {
+        layout = manager.getLayout();
+        *rendered = "";
+        if (format == MSGPACK) {
+            DeviceListMsgPack writer(manager);
+            fits = render(writer, *rendered, MAX_CACHED_SIZE);
+        } else {
+            DeviceListJson writer(manager);
+            fits = render(writer, *rendered, MAX_CACHED_SIZE);
+        }
+    } while (fits && manager.getLayout() != layout);
+    if (fits) body = rendered;
+    return body;
+}
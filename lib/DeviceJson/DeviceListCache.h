@@ -0,0 +1,36 @@
+#ifndef DEVICELISTCACHE_H
+#define DEVICELISTCACHE_H
+
+#include <Arduino.h>
+#include <memory>
+#include "DeviceManager.h"
+
+// Serialized GET /api/devices body, kept until the DeviceManager generation
+// changes. Bodies are handed out as shared, immutable snapshots so a response
+// still being sent keeps its buffer alive after the cache moves on. Lists
+// that serialize to more than MAX_CACHED_SIZE are not cached; callers stream
+// those with DeviceListJson or DeviceListMsgPack instead. Each cache holds one
+// encoding.
+class DeviceListCache {
+public:
+    static const size_t MAX_CACHED_SIZE = 4096;
+
+    enum Format {
+        JSON,
+        MSGPACK
+    };
+
+private:
+    Format format;
+    std::shared_ptr<const String> body;
+    uint32_t generation = 0;
+    bool valid = false;
+
+public:
+    explicit DeviceListCache(Format bodyFormat = JSON) : format(bodyFormat) {}
+
+    // Body for the manager's current generation, or null if it is too large
+    std::shared_ptr<const String> get(const DeviceManager& manager);
+};
+
+#endif // DEVICELISTCACHE_H
@@ -0,0 +1,143 @@
+#include "DeviceListJson.h"
+#include <string.h>
+
+namespace {
+
+const char HEAD_JSON[] = "{\"message\":\"Devices retrieved\",\"status\":true,";
+const char DATA_JSON[] = "\"data\":[";
+const char TAIL_JSON[] = "]}";
+
+// Same escapes as ArduinoJson's TextFormatter; other bytes pass through
+size_t writeEscaped(char* out, const char* text, size_t maxLen) {
+    size_t n = 0;
+    for (size_t i = 0; i < maxLen && text[i]; i++) {
+        char escaped = 0;
+        switch (text[i]) {
+        case '"': escaped = '"'; break;
+        case '\\': escaped = '\\'; break;
+        case '\b': escaped = 'b'; break;
+        case '\f': escaped = 'f'; break;
+        case '\n': escaped = 'n'; break;
+        case '\r': escaped = 'r'; break;
+        case '\t': escaped = 't'; break;
+        }
+        if (escaped) {
+            out[n++] = '\\';
+            out[n++] = escaped;
+        } else {
+            out[n++] = text[i];
+        }
+    }
+    return n;
+}
+
+size_t writeLiteral(char* out, const char* text) {
+    size_t n = strlen(text);
+    memcpy(out, text, n);
+    return n;
+}
+
+size_t writeInt(char* out, int value) {
+    char digits[10];
+    size_t count = 0;
+    size_t n = 0;
+    unsigned int magnitude = static_cast<unsigned int>(value);
+    if (value < 0) {
+        out[n++] = '-';
+        magnitude = 0u - magnitude;
+    }
+    do {
+        digits[count++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    while (count) out[n++] = digits[--count];
+    return n;
+}
+
+} // namespace
+
+size_t writeDeviceJson(char* out, const Device& device, uint8_t fields) {
+    size_t n = 0;
+    // Each member's key, starting with the comma the first one drops
+    auto key = [&](const char* separatedKey) { n += writeLiteral(out + n, separatedKey + (n == 1)); };
+    out[n++] = '{';
+    if (fields & DeviceListQuery::ID) {
+        key(",\"id\":");
+        n += writeInt(out + n, device.id);
+    }
+    if (fields & DeviceListQuery::TITLE) {
+        key(",\"title\":\"");
+        n += writeEscaped(out + n, device.title, sizeof(device.title));
+        out[n++] = '"';
+    }
+    if (fields & DeviceListQuery::TYPE) {
+        key(",\"type\":\"");
+        n += writeEscaped(out + n, device.type, sizeof(device.type));
+        out[n++] = '"';
+    }
+    if (fields & DeviceListQuery::GPIO_PIN) {
+        key(",\"gpioPin\":");
+        n += writeInt(out + n, device.gpioPin);
+    }
+    if (fields & DeviceListQuery::STATUS) {
+        key(",\"status\":");
+        n += writeLiteral(out + n, device.status ? "true" : "false");
+    }
+    if (fields & DeviceListQuery::LEVEL) {
+        key(",\"level\":");
+        n += writeInt(out + n, device.level);
+    }
+    out[n++] = '}';
+    return n;
+}
+
+void DeviceListJson::produce() {
+    pendingPos = 0;
+    pendingLen = 0;
+
+    switch (stage) {
+    case HEAD:
+        selection.take(*manager);
+        pendingLen = writeLiteral(pending, HEAD_JSON);
+        if (withTotal) {
+            pendingLen += writeLiteral(pending + pendingLen, "\"total\":");
+            pendingLen += writeInt(pending + pendingLen, static_cast<int>(selection.getTotal()));
+            pending[pendingLen++] = ',';
+        }
+        pendingLen += writeLiteral(pending + pendingLen, DATA_JSON);
+        stage = DEVICES;
+        break;
+    case DEVICES: {
+        Device device;
+        if (!selection.next(*manager, device)) {
+            pendingLen = writeLiteral(pending, TAIL_JSON);
+            stage = TAIL;
+            break;
+        }
+        if (next > 0) pending[pendingLen++] = ',';
+        pendingLen += writeDeviceJson(pending + pendingLen, device, fields);
+        next++;
+        break;
+    }
+    case TAIL:
+    case DONE:
+        stage = DONE;
+        break;
+    }
+}
+
+size_t DeviceListJson::read(uint8_t* buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+        if (pendingPos == pendingLen) {
+            produce();
+            if (pendingLen == 0) break;
+        }
+        size_t n = pendingLen - pendingPos;
+        if (n > maxLen - written) n = maxLen - written;
+        memcpy(buffer + written, pending + pendingPos, n);
+        pendingPos += n;
+        written += n;
+    }
+    return written;
+}
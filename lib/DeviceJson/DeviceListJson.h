@@ -0,0 +1,61 @@
+#ifndef DEVICELISTJSON_H
+#define DEVICELISTJSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DeviceManager.h"
+#include "DeviceSelection.h"
+
+// Resumable writer for the GET /api/devices body. It produces exactly what
+// serializeJson emits for {"message","status","data":[{id,title,type,gpioPin,
+// status,level}...]}, but one device at a time into the caller's buffer, so memory
+// use is fixed however many devices there are. Meant to back a chunked
+// response filler; the position in the device list is kept between calls.
+// Given a DeviceListQuery it writes only the page and fields asked for, and
+// the number of matching devices as "total" ahead of "data". A page cut
+// short by an add or delete (see DeviceSelection) closes the array early.
+class DeviceListJson {
+public:
+    // Longest single device entry: separating comma, keys and punctuation,
+    // two ints of up to 11 characters, a level of up to 3, and every
+    // title/type byte escaped
+    static const size_t MAX_ENTRY_SIZE =
+        sizeof(",{\"id\":,\"title\":\"\",\"type\":\"\",\"gpioPin\":,\"status\":false,\"level\":}") + 2 * 11 + 3 +
+        2 * (sizeof(Device::title) + sizeof(Device::type));
+
+private:
+    enum Stage {
+        HEAD,
+        DEVICES,
+        TAIL,
+        DONE
+    };
+
+    const DeviceManager* manager;
+    DeviceSelection selection;
+    uint8_t fields = DeviceListQuery::ALL_FIELDS;
+    bool withTotal = false;
+    Stage stage = HEAD;
+    size_t next = 0;
+    char pending[MAX_ENTRY_SIZE] = {};
+    size_t pendingLen = 0;
+    size_t pendingPos = 0;
+
+    void produce();
+
+public:
+    explicit DeviceListJson(const DeviceManager& deviceManager) : manager(&deviceManager) {}
+    DeviceListJson(const DeviceManager& deviceManager, const DeviceListQuery& query)
+        : manager(&deviceManager), selection(query), fields(query.fields), withTotal(true) {}
+
+    // Copies up to maxLen further bytes of the document into buffer. Returns
+    // 0 once the whole document has been written.
+    size_t read(uint8_t* buffer, size_t maxLen);
+};
+
+// Writes one device object, with the DeviceListQuery::Field members in
+// fields, as serializeJson would, returning its length. out must hold
+// DeviceListJson::MAX_ENTRY_SIZE bytes.
+size_t writeDeviceJson(char* out, const Device& device, uint8_t fields = DeviceListQuery::ALL_FIELDS);
+
+#endif // DEVICELISTJSON_H
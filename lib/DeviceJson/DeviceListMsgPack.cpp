@@ -0,0 +1,168 @@
+#include "DeviceListMsgPack.h"
+#include <string.h>
+
+namespace {
+
+// {"message":"Devices retrieved","status":true,"data":
+const uint8_t HEAD_MSGPACK[] = {0x83, 0xa7, 'm', 'e', 's', 's', 'a', 'g', 'e', 0xb1, 'D', 'e', 'v', 'i', 'c', 'e',
+                                's', ' ', 'r', 'e', 't', 'r', 'i', 'e', 'v', 'e', 'd', 0xa6, 's', 't', 'a', 't',
+                                'u', 's', 0xc3, 0xa4, 'd', 'a', 't', 'a'};
+
+size_t writeBigEndian(uint8_t* out, uint32_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) out[i] = static_cast<uint8_t>(value >> (8 * (bytes - 1 - i)));
+    return bytes;
+}
+
+// Smallest encoding, as ArduinoJson picks it
+size_t writeInt(uint8_t* out, int value) {
+    if (value >= 0) {
+        uint32_t magnitude = static_cast<uint32_t>(value);
+        if (magnitude <= 0x7f) {
+            out[0] = static_cast<uint8_t>(magnitude);
+            return 1;
+        }
+        if (magnitude <= 0xff) {
+            out[0] = 0xcc;
+            return 1 + writeBigEndian(out + 1, magnitude, 1);
+        }
+        if (magnitude <= 0xffff) {
+            out[0] = 0xcd;
+            return 1 + writeBigEndian(out + 1, magnitude, 2);
+        }
+        out[0] = 0xce;
+        return 1 + writeBigEndian(out + 1, magnitude, 4);
+    }
+    if (value >= -32) {
+        out[0] = static_cast<uint8_t>(value);
+        return 1;
+    }
+    if (value >= -128) {
+        out[0] = 0xd0;
+        return 1 + writeBigEndian(out + 1, static_cast<uint32_t>(value), 1);
+    }
+    if (value >= -32768) {
+        out[0] = 0xd1;
+        return 1 + writeBigEndian(out + 1, static_cast<uint32_t>(value), 2);
+    }
+    out[0] = 0xd2;
+    return 1 + writeBigEndian(out + 1, static_cast<uint32_t>(value), 4);
+}
+
+// Titles and types are shorter than 32 bytes, so always a fixstr
+size_t writeString(uint8_t* out, const char* text, size_t maxLen) {
+    size_t len = strnlen(text, maxLen);
+    out[0] = static_cast<uint8_t>(0xa0 | len);
+    memcpy(out + 1, text, len);
+    return 1 + len;
+}
+
+size_t writeKey(uint8_t* out, const char* key) {
+    return writeString(out, key, 31);
+}
+
+size_t writeArrayHeader(uint8_t* out, size_t count) {
+    if (count < 16) {
+        out[0] = static_cast<uint8_t>(0x90 | count);
+        return 1;
+    }
+    if (count <= 0xffff) {
+        out[0] = 0xdc;
+        return 1 + writeBigEndian(out + 1, static_cast<uint32_t>(count), 2);
+    }
+    out[0] = 0xdd;
+    return 1 + writeBigEndian(out + 1, static_cast<uint32_t>(count), 4);
+}
+
+} // namespace
+
+size_t writeDeviceMsgPack(uint8_t* out, const Device& device, uint8_t fields) {
+    static_assert(sizeof(Device::title) <= 32 && sizeof(Device::type) <= 32, "device strings must fit a fixstr");
+
+    size_t n = 0;
+    out[n++] = static_cast<uint8_t>(0x80 | __builtin_popcount(fields & DeviceListQuery::ALL_FIELDS));
+    if (fields & DeviceListQuery::ID) {
+        n += writeKey(out + n, "id");
+        n += writeInt(out + n, device.id);
+    }
+    if (fields & DeviceListQuery::TITLE) {
+        n += writeKey(out + n, "title");
+        n += writeString(out + n, device.title, sizeof(device.title));
+    }
+    if (fields & DeviceListQuery::TYPE) {
+        n += writeKey(out + n, "type");
+        n += writeString(out + n, device.type, sizeof(device.type));
+    }
+    if (fields & DeviceListQuery::GPIO_PIN) {
+        n += writeKey(out + n, "gpioPin");
+        n += writeInt(out + n, device.gpioPin);
+    }
+    if (fields & DeviceListQuery::STATUS) {
+        n += writeKey(out + n, "status");
+        out[n++] = device.status ? 0xc3 : 0xc2;
+    }
+    if (fields & DeviceListQuery::LEVEL) {
+        n += writeKey(out + n, "level");
+        n += writeInt(out + n, device.level);
+    }
+    return n;
+}
+
+void DeviceListMsgPack::produce() {
+    pendingPos = 0;
+    pendingLen = 0;
+
+    switch (stage) {
+    case HEAD:
+        static_assert(sizeof(HEAD_MSGPACK) + 6 + 5 + 5 <= MAX_ENTRY_SIZE, "head must fit the pending buffer");
+        selection.take(*manager);
+        // "total", when there is one, goes in ahead of the closing "data" key
+        pendingLen = sizeof(HEAD_MSGPACK) - 5;
+        memcpy(pending, HEAD_MSGPACK, pendingLen);
+        if (withTotal) {
+            pending[0] = 0x84;
+            pendingLen += writeKey(pending + pendingLen, "total");
+            pendingLen += writeInt(pending + pendingLen, static_cast<int>(selection.getTotal()));
+        }
+        memcpy(pending + pendingLen, HEAD_MSGPACK + sizeof(HEAD_MSGPACK) - 5, 5);
+        pendingLen += 5;
+        pendingLen += writeArrayHeader(pending + pendingLen, selection.remaining());
+        stage = DEVICES;
+        break;
+    case DEVICES: {
+        Device device;
+        if (selection.next(*manager, device)) {
+            pendingLen = writeDeviceMsgPack(pending, device, fields);
+            break;
+        }
+        // The array's length is out already: a page cut short by an add or
+        // delete is made up with nils
+        missing = selection.remaining();
+        stage = PADDING;
+    }
+    // fall through
+    case PADDING:
+        pendingLen = missing < MAX_ENTRY_SIZE ? missing : MAX_ENTRY_SIZE;
+        memset(pending, 0xc0, pendingLen);
+        missing -= pendingLen;
+        if (pendingLen == 0) stage = DONE;
+        break;
+    case DONE:
+        break;
+    }
+}
+
+size_t DeviceListMsgPack::read(uint8_t* buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+        if (pendingPos == pendingLen) {
+            produce();
+            if (pendingLen == 0) break;
+        }
+        size_t n = pendingLen - pendingPos;
+        if (n > maxLen - written) n = maxLen - written;
+        memcpy(buffer + written, pending + pendingPos, n);
+        pendingPos += n;
+        written += n;
+    }
+    return written;
+}
@@ -0,0 +1,57 @@
+#ifndef DEVICELISTMSGPACK_H
+#define DEVICELISTMSGPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DeviceManager.h"
+#include "DeviceSelection.h"
+
+// MessagePack twin of DeviceListJson: the same document, byte for byte what
+// serializeMsgPack emits for it, written one device at a time into the
+// caller's buffer. Takes a DeviceListQuery the same way. The array's length
+// goes out first, so a page cut short by an add or delete (see
+// DeviceSelection) ends in nils rather than with fewer entries.
+class DeviceListMsgPack {
+public:
+    // Longest single device entry: map header, the six keys with their
+    // length bytes, two int32s, title and type as fixstr, the bool and a
+    // uint8 level
+    static const size_t MAX_ENTRY_SIZE = 1 + sizeof("idtitletypegpioPinstatuslevel") - 1 + 6 + 2 * 5 +
+                                         sizeof(Device::title) + sizeof(Device::type) + 1 + 2;
+
+private:
+    enum Stage {
+        HEAD,
+        DEVICES,
+        PADDING,
+        DONE
+    };
+
+    const DeviceManager* manager;
+    DeviceSelection selection;
+    uint8_t fields = DeviceListQuery::ALL_FIELDS;
+    bool withTotal = false;
+    Stage stage = HEAD;
+    size_t missing = 0; // nils still owed for devices the page lost
+    uint8_t pending[MAX_ENTRY_SIZE] = {};
+    size_t pendingLen = 0;
+    size_t pendingPos = 0;
+
+    void produce();
+
+public:
+    explicit DeviceListMsgPack(const DeviceManager& deviceManager) : manager(&deviceManager) {}
+    DeviceListMsgPack(const DeviceManager& deviceManager, const DeviceListQuery& query)
+        : manager(&deviceManager), selection(query), fields(query.fields), withTotal(true) {}
+
+    // Copies up to maxLen further bytes of the document into buffer. Returns
+    // 0 once the whole document has been written.
+    size_t read(uint8_t* buffer, size_t maxLen);
+};
+
+// Writes one device map, with the DeviceListQuery::Field members in fields,
+// as serializeMsgPack would, returning its length. out must hold
+// DeviceListMsgPack::MAX_ENTRY_SIZE bytes.
+size_t writeDeviceMsgPack(uint8_t* out, const Device& device, uint8_t fields = DeviceListQuery::ALL_FIELDS);
+
+#endif // DEVICELISTMSGPACK_H
@@ -0,0 +1,58 @@
+#include "DeviceSelection.h"
+#include <string.h>
+
+namespace {
+
+const char* const FIELD_NAMES[] = {"id", "title", "type", "gpioPin", "status", "level"};
+
+} // namespace
+
+bool DeviceListQuery::parseFields(const char* list, uint8_t& fields) {
+    fields = 0;
+    const char* name = list;
+    while (true) {
+        const char* end = strchr(name, ',');
+        size_t len = end ? static_cast<size_t>(end - name) : strlen(name);
+        uint8_t field = 0;
+        for (size_t i = 0; i < sizeof(FIELD_NAMES) / sizeof(FIELD_NAMES[0]); i++) {
+            if (strlen(FIELD_NAMES[i]) == len && strncmp(FIELD_NAMES[i], name, len) == 0) field = 1 << i;
+        }
+        if (!field) return false;
+        fields |= field;
+        if (!end) return true;
+        name = end + 1;
+    }
+}
+
+DeviceSelection::DeviceSelection(const DeviceListQuery& query)
+    : hasType(query.filter.type != nullptr), status(query.filter.status), offset(query.offset), limit(query.limit),
+      all(false) {
+    if (hasType) {
+        strncpy(type, query.filter.type, sizeof(type) - 1);
+        type[sizeof(type) - 1] = '\0';
+    }
+}
+
+void DeviceSelection::take(const DeviceManager& manager) {
+    if (all) {
+        layout = manager.getLayout(&total);
+        left = total;
+        return;
+    }
+    DeviceFilter filter;
+    filter.type = hasType ? type : nullptr;
+    filter.status = status;
+    total = manager.select(filter, matches, &layout);
+    if (offset >= total) return;
+    left = total - offset < limit ? total - offset : limit;
+    cursor = matches.nthSet(offset);
+}
+
+bool DeviceSelection::next(const DeviceManager& manager, Device& out) {
+    if (left == 0) return false;
+    size_t slot = all ? cursor : matches.nextSet(cursor);
+    if (!manager.readDevice(slot, out, layout)) return false;
+    cursor = slot + 1;
+    left--;
+    return true;
+}
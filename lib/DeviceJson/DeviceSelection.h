@@ -0,0 +1,74 @@
+#ifndef DEVICESELECTION_H
+#define DEVICESELECTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DeviceManager.h"
+
+// What GET /api/devices?type=&status=&fields=&offset=&limit= asks for
+struct DeviceListQuery {
+    enum Field : uint8_t {
+        ID = 1 << 0,
+        TITLE = 1 << 1,
+        TYPE = 1 << 2,
+        GPIO_PIN = 1 << 3,
+        STATUS = 1 << 4,
+        LEVEL = 1 << 5,
+        ALL_FIELDS = 0x3f
+    };
+
+    DeviceFilter filter;
+    uint8_t fields = ALL_FIELDS;
+    size_t offset = 0;
+    size_t limit = SIZE_MAX;
+
+    // The plain list, as served without parameters
+    bool isDefault() const {
+        return !filter.type && filter.status == DeviceFilter::ANY && fields == ALL_FIELDS && offset == 0 &&
+               limit == SIZE_MAX;
+    }
+
+    // Reads a comma-separated list of device field names, e.g. "id,status";
+    // false if it is empty or names an unknown field
+    static bool parseFields(const char* list, uint8_t& fields);
+};
+
+// The devices a DeviceListQuery picks, in list order. The matches are taken
+// once, from DeviceManager's indexes, when the page starts; only the page is
+// walked after that, so the cost follows the page size. The page is pinned
+// to the slots of that moment: once a device is added or deleted they name
+// other devices, and the page ends there rather than repeat or skip one.
+class DeviceSelection {
+private:
+    DeviceManager::Selection matches;
+    // The query, kept until take(); its type is copied, as the request
+    // holding it may be gone by then
+    char type[sizeof(Device::type)] = "";
+    bool hasType = false;
+    DeviceFilter::Status status = DeviceFilter::ANY;
+    size_t offset = 0;
+    size_t limit = SIZE_MAX;
+    bool all;
+    uint32_t layout = 0;
+    size_t total = 0; // devices matching the filter
+    size_t left = 0;  // still to come on the page
+    size_t cursor = 0;
+
+public:
+    // Every device
+    DeviceSelection() : all(true) {}
+    explicit DeviceSelection(const DeviceListQuery& query);
+
+    // Takes the matches and pins the page to the current slots; call once,
+    // before getTotal() and remaining() are needed
+    void take(const DeviceManager& manager);
+    size_t getTotal() const { return total; }
+    // Devices still to come on the page; after next() fails early, the
+    // ones that will not come
+    size_t remaining() const { return left; }
+    // Copy of the next device on the page; false after the last, or once a
+    // device has been added or deleted since take()
+    bool next(const DeviceManager& manager, Device& out);
+};
+
+#endif // DEVICESELECTION_H
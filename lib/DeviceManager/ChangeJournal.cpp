@@ -0,0 +1,54 @@
+#include "ChangeJournal.h"
+
+ChangeJournal& ChangeJournal::operator=(const ChangeJournal& other) {
+    for (size_t i = 0; i < CAPACITY; i++) {
+        entries[i].seq.store(other.entries[i].seq.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        entries[i].id = other.entries[i].id;
+        entries[i].kind = other.entries[i].kind;
+        entries[i].status = other.entries[i].status;
+        entries[i].level = other.entries[i].level;
+    }
+    base = other.base;
+    last.store(other.latest(), std::memory_order_release);
+    return *this;
+}
+
+void ChangeJournal::start(uint32_t first) {
+    base = first;
+    last.store(first, std::memory_order_release);
+}
+
+void ChangeJournal::record(int id, DeviceChange::Kind kind, bool status, uint8_t level) {
+    uint32_t seq = last.load(std::memory_order_relaxed) + 1;
+    Entry& entry = entries[seq % CAPACITY];
+
+    // Mark the slot invalid while its fields are rewritten
+    entry.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.id = id;
+    entry.kind = kind;
+    entry.status = status;
+    entry.level = level;
+    entry.seq.store(seq, std::memory_order_release);
+    last.store(seq, std::memory_order_release);
+}
+
+uint32_t ChangeJournal::oldest() const {
+    uint32_t newest = latest();
+    return newest - base < CAPACITY ? base + 1 : newest - CAPACITY + 1;
+}
+
+bool ChangeJournal::get(uint32_t seq, DeviceChange& out) const {
+    if (seq <= base) return false;
+    const Entry& entry = entries[seq % CAPACITY];
+    if (entry.seq.load(std::memory_order_acquire) != seq) return false;
+
+    out.seq = seq;
+    out.id = entry.id;
+    out.kind = entry.kind;
+    out.status = entry.status;
+    out.level = entry.level;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return entry.seq.load(std::memory_order_relaxed) == seq;
+}
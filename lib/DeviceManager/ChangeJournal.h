@@ -0,0 +1,63 @@
+#ifndef CHANGEJOURNAL_H
+#define CHANGEJOURNAL_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+struct DeviceChange {
+    enum Kind : uint8_t {
+        STATUS,
+        ADDED,
+        REMOVED,
+        LEVEL // a dimmer's level changed, maybe its status too
+    };
+
+    uint32_t seq;
+    int id;
+    Kind kind;
+    bool status;
+    uint8_t level;
+};
+
+// Fixed-size ring of the most recent device changes, numbered on from a base
+// (0 unless start() says otherwise). There is one writer (whoever mutates DeviceManager); readers on other tasks use
+// get(), which detects entries overwritten while being copied by checking the
+// per-entry sequence number before and after the copy.
+class ChangeJournal {
+public:
+    static const size_t CAPACITY = 64;
+
+private:
+    struct Entry {
+        std::atomic<uint32_t> seq{0};
+        int id = 0;
+        DeviceChange::Kind kind = DeviceChange::STATUS;
+        bool status = false;
+        uint8_t level = 0;
+    };
+
+    Entry entries[CAPACITY];
+    uint32_t base = 0;
+    std::atomic<uint32_t> last{0};
+
+public:
+    ChangeJournal() {}
+    ChangeJournal(const ChangeJournal& other) { *this = other; }
+    ChangeJournal& operator=(const ChangeJournal& other);
+
+    // Numbers changes from first + 1 on. Call before the first record(); a
+    // base picked at random per boot keeps numbers from before a restart
+    // from passing for current ones.
+    void start(uint32_t first);
+    void record(int id, DeviceChange::Kind kind, bool status, uint8_t level = 0);
+
+    // Sequence number of the newest change, the base if none yet
+    uint32_t latest() const { return last.load(std::memory_order_acquire); }
+    // Oldest sequence number still held
+    uint32_t oldest() const;
+    // Copies change seq into out; false once it has been overwritten
+    bool get(uint32_t seq, DeviceChange& out) const;
+};
+
+#endif // CHANGEJOURNAL_H
@@ -0,0 +1,119 @@
+#include "DeviceIndex.h"
+
+namespace {
+
+typedef DeviceIndexEntry Entry;
+
+const uint32_t EMPTY = UINT32_MAX;
+const size_t MIN_CAPACITY = 16;
+
+template <typename Table>
+size_t home(const Table& table, int id) {
+    // Fibonacci hashing: the top bits of the product depend on every bit of
+    // the id, so ids a multiple of the table size apart still spread out
+    unsigned bits = __builtin_ctz(static_cast<uint32_t>(table.size()));
+    return (static_cast<uint32_t>(id) * 2654435769u) >> (32 - bits);
+}
+
+// Position holding id, or the empty position where it would be inserted
+template <typename Table>
+size_t probe(const Table& table, int id) {
+    size_t mask = table.size() - 1;
+    size_t pos = home(table, id);
+    while (table[pos].slot != EMPTY && table[pos].id != id) {
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+// The heap table doubles; a fixed one is full at half its size
+bool grow(std::vector<Entry>& table) {
+    std::vector<Entry> old;
+    old.swap(table);
+    table.assign(old.empty() ? MIN_CAPACITY : old.size() * 2, Entry{0, EMPTY});
+    for (const Entry& entry : old) {
+        if (entry.slot != EMPTY) table[probe(table, entry.id)] = entry;
+    }
+    return true;
+}
+
+template <size_t N>
+bool grow(std::array<Entry, N>&) {
+    return false;
+}
+
+void reset(std::vector<Entry>& table) {
+    table.clear();
+}
+
+template <size_t N>
+void reset(std::array<Entry, N>& table) {
+    table.fill(Entry{0, EMPTY});
+}
+
+} // namespace
+
+template <size_t MaxEntries>
+size_t BasicDeviceIndex<MaxEntries>::probe(int id) const {
+    return ::probe(table, id);
+}
+
+template <size_t MaxEntries>
+size_t BasicDeviceIndex<MaxEntries>::find(int id) const {
+    if (table.empty()) return NOT_FOUND;
+    const Entry& entry = table[probe(id)];
+    return entry.slot == EMPTY ? NOT_FOUND : entry.slot;
+}
+
+template <size_t MaxEntries>
+bool BasicDeviceIndex<MaxEntries>::insert(int id, size_t slot) {
+    if ((count + 1) * 2 > table.size() && !grow(table)) return false;
+    Entry& entry = table[probe(id)];
+    if (entry.slot == EMPTY) count++;
+    entry.id = id;
+    entry.slot = static_cast<uint32_t>(slot);
+    return true;
+}
+
+template <size_t MaxEntries>
+void BasicDeviceIndex<MaxEntries>::update(int id, size_t slot) {
+    if (table.empty()) return;
+    Entry& entry = table[probe(id)];
+    if (entry.slot != EMPTY) entry.slot = static_cast<uint32_t>(slot);
+}
+
+template <size_t MaxEntries>
+void BasicDeviceIndex<MaxEntries>::erase(int id) {
+    if (table.empty()) return;
+    size_t mask = table.size() - 1;
+    size_t hole = probe(id);
+    if (table[hole].slot == EMPTY) return;
+
+    // Pull later members of the probe run back into the hole so lookups never
+    // stop early at a gap
+    size_t pos = hole;
+    for (;;) {
+        pos = (pos + 1) & mask;
+        if (table[pos].slot == EMPTY) break;
+        size_t want = home(table, table[pos].id);
+        bool movable = (pos > hole) ? (want <= hole || want > pos) : (want <= hole && want > pos);
+        if (movable) {
+            table[hole] = table[pos];
+            hole = pos;
+        }
+    }
+    table[hole].slot = EMPTY;
+    count--;
+}
+
+template <size_t MaxEntries>
+void BasicDeviceIndex<MaxEntries>::clear() {
+    reset(table);
+    count = 0;
+}
+
+// The growable index, and a fixed one for the build's DEVICE_CAPACITY
+template class BasicDeviceIndex<0>;
+#if DEVICE_CAPACITY > 0
+template class BasicDeviceIndex<DEVICE_CAPACITY>;
+#endif
@@ -0,0 +1,51 @@
+#ifndef DEVICEINDEX_H
+#define DEVICEINDEX_H
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include <vector>
+
+struct DeviceIndexEntry {
+    int id;
+    uint32_t slot;
+};
+
+// Smallest power-of-two table, from 16, that keeps maxEntries at most half full
+constexpr size_t deviceIndexTableSize(size_t maxEntries, size_t size = 16) {
+    return size >= 2 * maxEntries ? size : deviceIndexTableSize(maxEntries, size * 2);
+}
+
+// Maps device ids to their slot in DeviceManager's storage. Open addressing
+// with linear probing over a flat power-of-two table, kept at most half full;
+// erase uses backward-shift deletion so no tombstones accumulate. With
+// MaxEntries 0 the table lives on the heap and doubles as needed; otherwise
+// it is a fixed array with room for at least MaxEntries.
+template <size_t MaxEntries>
+class BasicDeviceIndex {
+private:
+    typedef DeviceIndexEntry Entry;
+    typedef typename std::conditional<MaxEntries == 0, std::vector<Entry>,
+                                      std::array<Entry, deviceIndexTableSize(MaxEntries)>>::type Table;
+
+    Table table;
+    size_t count = 0;
+
+    size_t probe(int id) const;
+
+public:
+    static const size_t NOT_FOUND = SIZE_MAX;
+
+    BasicDeviceIndex() { clear(); }
+
+    size_t find(int id) const;
+    // False once a fixed table is half full
+    bool insert(int id, size_t slot);
+    void update(int id, size_t slot);
+    void erase(int id);
+    void clear();
+    size_t size() const { return count; }
+};
+
+#endif // DEVICEINDEX_H
@@ -1,58 +1,263 @@
 #include "DeviceManager.h"
 #include <Arduino.h>
+#include <GpioPort.h>
+#include <PwmPort.h>
+#include <Trace.h>
 #include <string.h>
 
-bool DeviceManager::addDevice(int id, const char* title, const char* type, int gpioPin, bool status) {
-    // Check if device with same ID exists
-    for (const Device& device : devices) {
-        if (device.id == id) return false;
-    }
+template <size_t MaxDevices>
+bool BasicDeviceManager<MaxDevices>::addDevice(int id, const char* title, const char* type, int gpioPin, bool status, uint8_t level) {
+    TRACE_SPAN("DeviceManager::addDevice");
+    // Check if device with same ID exists, and for room
+    if (index.find(id) != Index::NOT_FOUND || !devices.fits(type)) return false;
 
-    Device newDevice;
+    Device newDevice = {};
     newDevice.id = id;
     strncpy(newDevice.title, title, sizeof(newDevice.title) - 1);
     strncpy(newDevice.type, type, sizeof(newDevice.type) - 1);
     newDevice.gpioPin = gpioPin;
     newDevice.status = status;
+    newDevice.level = 255;
+    newDevice.channel = -1;
 
-    // Initialize GPIO
-    pinMode(gpioPin, OUTPUT);
-    digitalWrite(gpioPin, status);
+    if (strcmp(newDevice.type, DIMMER_TYPE) == 0) {
+        int channel = pwmAttach(gpioPin, status ? level : 0);
+        if (channel < 0) return false;
+        newDevice.level = level;
+        newDevice.channel = static_cast<int8_t>(channel);
+    } else if (strcmp(newDevice.type, CONTACT_TYPE) == 0 || strcmp(newDevice.type, SENSOR_TYPE) == 0) {
+        newDevice.input = true;
+        newDevice.status = false;
+        pinMode(gpioPin, strcmp(newDevice.type, CONTACT_TYPE) == 0 ? INPUT_PULLUP : INPUT);
+    } else {
+        // Initialize GPIO
+        pinMode(gpioPin, OUTPUT);
+        digitalWrite(gpioPin, status);
+    }
 
+    lock.writeBegin();
+    if (!index.insert(id, devices.size())) {
+        // The index is full: nothing was written
+        lock.writeEnd();
+        pwmDetach(newDevice.channel);
+        return false;
+    }
     devices.push_back(newDevice);
+    generation++;
+    lock.writeEnd();
+    journal.record(id, DeviceChange::ADDED, newDevice.status, newDevice.level);
     return true;
 }
 
-bool DeviceManager::updateDeviceStatus(int id, bool status) {
-    for (Device& device : devices) {
-        if (device.id == id) {
-            device.status = status;
-            digitalWrite(device.gpioPin, status);
-            return true;
-        }
+// Stores the status and level a command asks for and journals the change;
+// driving the output is left to the caller
+template <size_t MaxDevices>
+void BasicDeviceManager<MaxDevices>::applyState(size_t slot, const DeviceCommand& command) {
+    bool status = command.status;
+    uint8_t level = devices.level(slot);
+    if (command.level != DeviceCommand::NO_LEVEL) {
+        status = command.level > 0;
+        if (devices.channel(slot) >= 0 && command.level > 0) level = static_cast<uint8_t>(command.level);
     }
-    return false;
+    if (devices.status(slot) == status && devices.level(slot) == level) return;
+
+    bool levelChanged = devices.level(slot) != level;
+    lock.writeBegin();
+    devices.setState(slot, status, level);
+    generation++;
+    lock.writeEnd();
+    journal.record(devices.id(slot), levelChanged ? DeviceChange::LEVEL : DeviceChange::STATUS, status, level);
 }
 
-bool DeviceManager::deleteDevice(int id) {
-    for (auto it = devices.begin(); it != devices.end(); ++it) {
-        if (it->id == id) {
-            devices.erase(it);
-            return true;
-        }
+template <size_t MaxDevices>
+bool BasicDeviceManager<MaxDevices>::updateDeviceStatus(int id, bool status) {
+    DeviceCommand command;
+    command.id = id;
+    command.status = status;
+    return updateDevice(command);
+}
+
+template <size_t MaxDevices>
+bool BasicDeviceManager<MaxDevices>::updateDevice(const DeviceCommand& command) {
+    TRACE_SPAN("DeviceManager::updateDevice");
+    size_t slot = index.find(command.id);
+    if (slot == Index::NOT_FOUND || devices.input(slot)) return false;
+
+    applyState(slot, command);
+    if (devices.channel(slot) >= 0) {
+        TRACE_SPAN("pwmWrite");
+        pwmWrite(devices.channel(slot), devices.status(slot) ? devices.level(slot) : 0, command.fadeMs);
+    } else {
+        TRACE_SPAN("digitalWrite");
+        digitalWrite(devices.pin(slot), devices.status(slot));
     }
-    return false;
+    return true;
 }
 
-Device* DeviceManager::getDevice(int id) {
-    for (Device& device : devices) {
-        if (device.id == id) {
-            return &device;
+template <size_t MaxDevices>
+bool BasicDeviceManager<MaxDevices>::updateDeviceStatuses(const DeviceCommand* commands, size_t count, bool* found) {
+    TRACE_SPAN("DeviceManager::updateDeviceStatuses");
+    bool allFound = true;
+    for (size_t i = 0; i < count; i++) {
+        size_t slot = index.find(commands[i].id);
+        bool known = slot != Index::NOT_FOUND && !devices.input(slot);
+        if (found) found[i] = known;
+        allFound = allFound && known;
+    }
+    if (!allFound) return false;
+
+    uint64_t setMask = 0;
+    uint64_t clearMask = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t slot = index.find(commands[i].id);
+        applyState(slot, commands[i]);
+
+        bool status = devices.status(slot);
+        if (devices.channel(slot) >= 0) {
+            pwmWrite(devices.channel(slot), status ? devices.level(slot) : 0, commands[i].fadeMs);
+            continue;
+        }
+        int pin = devices.pin(slot);
+        if (pin < 0 || pin >= 64) {
+            digitalWrite(pin, status);
+            continue;
+        }
+        uint64_t bit = 1ULL << pin;
+        if (status) {
+            setMask |= bit;
+            clearMask &= ~bit;
+        } else {
+            clearMask |= bit;
+            setMask &= ~bit;
         }
     }
-    return nullptr;
+
+    TRACE_SPAN("gpioWriteOutputMasks");
+    gpioWriteOutputMasks(setMask, clearMask);
+    return true;
 }
 
-const std::vector<Device>& DeviceManager::getAllDevices() const {
+template <size_t MaxDevices>
+bool BasicDeviceManager<MaxDevices>::deleteDevice(int id) {
+    TRACE_SPAN("DeviceManager::deleteDevice");
+    size_t slot = index.find(id);
+    if (slot == Index::NOT_FOUND) return false;
+
+    pwmDetach(devices.channel(slot));
+
+    // Swap-remove: the last device moves into the freed slot
+    size_t last = devices.size() - 1;
+    lock.writeBegin();
+    index.erase(id);
+    devices.remove(slot);
+    if (slot != last) index.update(devices.id(slot), slot);
+    generation++;
+    lock.writeEnd();
+    journal.record(id, DeviceChange::REMOVED, false);
+    return true;
+}
+
+template <size_t MaxDevices>
+const DeviceTable<MaxDevices>& BasicDeviceManager<MaxDevices>::getAllDevices() const {
     return devices;
-}
\ No newline at end of file
+}
+
+// The bounds check and the index lookup happen inside the read section too,
+// so a delete on the writer's task is either seen whole or retried
+template <size_t MaxDevices>
+bool BasicDeviceManager<MaxDevices>::readDevice(size_t slot, Device& out) const {
+    uint32_t start;
+    bool found;
+    do {
+        start = lock.readBegin();
+        found = slot < devices.size();
+        if (found) out = devices[slot];
+    } while (lock.readRetry(start));
+    return found;
+}
+
+template <size_t MaxDevices>
+bool BasicDeviceManager<MaxDevices>::readDevice(size_t slot, Device& out, uint32_t layout) const {
+    uint32_t start;
+    bool found;
+    do {
+        start = lock.readBegin();
+        found = devices.getLayout() == layout && slot < devices.size();
+        if (found) out = devices[slot];
+    } while (lock.readRetry(start));
+    return found;
+}
+
+template <size_t MaxDevices>
+bool BasicDeviceManager<MaxDevices>::copyDevice(int id, Device& out) const {
+    TRACE_SPAN("DeviceManager::copyDevice");
+    uint32_t start;
+    bool found;
+    do {
+        start = lock.readBegin();
+        size_t slot = index.find(id);
+        found = slot != Index::NOT_FOUND && slot < devices.size();
+        if (found) out = devices[slot];
+    } while (lock.readRetry(start));
+    return found;
+}
+
+template <size_t MaxDevices>
+void BasicDeviceManager<MaxDevices>::takeSnapshot(Snapshot& out) const {
+    uint32_t start;
+    do {
+        start = lock.readBegin();
+        out.status.copyFrom(devices.getStatuses());
+        out.layout = devices.getLayout();
+    } while (lock.readRetry(start));
+}
+
+template <size_t MaxDevices>
+size_t BasicDeviceManager<MaxDevices>::select(const DeviceFilter& filter, Selection& out, uint32_t* layout) const {
+    TRACE_SPAN("DeviceManager::select");
+    uint32_t start;
+    do {
+        start = lock.readBegin();
+        out.fill(devices.size());
+        if (filter.type) {
+            const Selection* members = devices.getTypeMembers(filter.type);
+            if (members) {
+                out.retain(*members);
+            } else {
+                out.fill(0);
+            }
+        }
+        if (filter.status != DeviceFilter::ANY) out.retain(devices.getStatuses(), filter.status == DeviceFilter::OFF);
+        if (layout) *layout = devices.getLayout();
+    } while (lock.readRetry(start));
+    return out.countSet();
+}
+
+template <size_t MaxDevices>
+uint32_t BasicDeviceManager<MaxDevices>::getLayout(size_t* count) const {
+    uint32_t start;
+    uint32_t value;
+    do {
+        start = lock.readBegin();
+        value = devices.getLayout();
+        if (count) *count = devices.size();
+    } while (lock.readRetry(start));
+    return value;
+}
+
+template <size_t MaxDevices>
+uint32_t BasicDeviceManager<MaxDevices>::getGeneration() const {
+    uint32_t start;
+    uint32_t value;
+    do {
+        start = lock.readBegin();
+        value = generation;
+    } while (lock.readRetry(start));
+    return value;
+}
+
+// The growable registry, and the fixed one the build is configured for
+template class BasicDeviceManager<0>;
+#if DEVICE_CAPACITY > 0
+template class BasicDeviceManager<DEVICE_CAPACITY>;
+#endif
@@ -1,19 +1,120 @@
 #ifndef DEVICEMANAGER_H
 #define DEVICEMANAGER_H
 
-#include <vector>
+#include "ChangeJournal.h"
 #include "Device.h"
+#include "DeviceIndex.h"
+#include "DeviceTable.h"
+#include "SeqLock.h"
 
-class DeviceManager {
+struct DeviceCommand {
+    static const int16_t NO_LEVEL = -1;
+
+    int id;
+    bool status;
+    // 0-255 sets a dimmer's level instead of status: above 0 it is switched
+    // on at that level, at 0 it is switched off and keeps its level for the
+    // next time. On/off devices take it as a status. NO_LEVEL for neither.
+    int16_t level = NO_LEVEL;
+    // Dimmers fade to the new output over this long; others ignore it
+    uint32_t fadeMs = 0;
+};
+
+// Which devices to list: those of one type (any when null) with a given
+// status
+struct DeviceFilter {
+    enum Status : uint8_t {
+        ANY,
+        ON,
+        OFF
+    };
+
+    const char* type = nullptr;
+    Status status = ANY;
+};
+
+// Registry size the firmware is built for: with DEVICE_CAPACITY set (see
+// platformio.ini) devices and their index sit in fixed arrays and the
+// registry never touches the heap; 0 keeps the growable one.
+#ifndef DEVICE_CAPACITY
+#define DEVICE_CAPACITY 0
+#endif
+
+// Devices are stored a field per column (see DeviceTable) and handed out as
+// copies. deleteDevice swap-removes: the last device moves into the freed
+// slot, so getAllDevices order is insertion order only until a delete.
+// MaxDevices caps the registry and keeps it in fixed storage; 0 lets it grow
+// on the heap.
+//
+// Status changes may come from one writer task while other tasks read:
+// readers use readDevice/copyDevice/takeSnapshot/getGeneration, which retry
+// around the writer through a seqlock. Deleting only shrinks the storage, so
+// the writer task may do it too; adding may grow it and must happen while
+// nothing else is reading.
+template <size_t MaxDevices>
+class BasicDeviceManager {
 private:
-    std::vector<Device> devices;
+    typedef BasicDeviceIndex<MaxDevices> Index;
+
+    DeviceTable<MaxDevices> devices;
+    Index index;
+    uint32_t generation = 0;
+    ChangeJournal journal;
+    SeqLock lock;
+
+    void applyState(size_t slot, const DeviceCommand& command);
 
 public:
-    bool addDevice(int id, const char* title, const char* type, int gpioPin, bool status);
+    typedef StatusSnapshot<MaxDevices> Snapshot;
+    typedef DeviceBits<MaxDevices> Selection;
+
+    // A DIMMER_TYPE device gets a PWM channel and starts at level while on;
+    // false if the id is taken, the registry is full, no channel is free or
+    // the type would be one past DeviceTypes::MAX_TYPES.
+    // CONTACT_TYPE and SENSOR_TYPE pins are set up as inputs and stay off.
+    bool addDevice(int id, const char* title, const char* type, int gpioPin, bool status, uint8_t level = 255);
     bool updateDeviceStatus(int id, bool status);
+    // Applies a status or level change, fading a dimmer if asked
+    bool updateDevice(const DeviceCommand& command);
+    // Applies every command or none: all ids are validated first, then the
+    // pins are driven with a single set-mask and clear-mask register write.
+    // found[i], when given, reports whether commands[i] named a known output
+    // device (inputs count as unknown).
+    // A device listed twice ends up with its last status. Dimmers are set
+    // through their PWM channels instead of the masks.
+    bool updateDeviceStatuses(const DeviceCommand* commands, size_t count, bool* found = nullptr);
     bool deleteDevice(int id);
-    Device* getDevice(int id);
-    const std::vector<Device>& getAllDevices() const;
+    // Iterates whole Devices by value; for use while nothing else writes
+    const DeviceTable<MaxDevices>& getAllDevices() const;
+    size_t size() const { return devices.size(); }
+    // Consistent copy of the device in a storage slot (getAllDevices order);
+    // false past the end
+    bool readDevice(size_t slot, Device& out) const;
+    // As readDevice, but false too once getLayout() is no longer layout, as
+    // the slot may then hold another device
+    bool readDevice(size_t slot, Device& out, uint32_t layout) const;
+    // Consistent copy of a device by id; false if unknown
+    bool copyDevice(int id, Device& out) const;
+    // Every status, a bit per slot, copied consistently; diff two snapshots
+    // to find the devices switched in between
+    void takeSnapshot(Snapshot& out) const;
+    // The devices matching filter, a bit per slot, and how many there are.
+    // Answered from the per-type and status bitsets, which every add, delete
+    // and switch keeps current, so no device is visited. layout, when
+    // given, gets the getLayout() the matches were taken at.
+    size_t select(const DeviceFilter& filter, Selection& out, uint32_t* layout = nullptr) const;
+    // Changes whenever a device is added or deleted, i.e. when slots move;
+    // count, when given, gets the number of devices taken with it
+    uint32_t getLayout(size_t* count = nullptr) const;
+    // Bumped by every call that changes a device, so equal generations mean
+    // an identical device list
+    uint32_t getGeneration() const;
+    // Recent adds, removals and status changes, for push notifications
+    const ChangeJournal& getJournal() const { return journal; }
+    // Numbers journal entries from first + 1 on; call before the first change
+    void startJournal(uint32_t first) { journal.start(first); }
 };
 
-#endif // DEVICEMANAGER_H
\ No newline at end of file
+typedef BasicDeviceManager<DEVICE_CAPACITY> DeviceManager;
+
+#endif // DEVICEMANAGER_H
@@ -0,0 +1,16 @@
+#include "DeviceTable.h"
+
+uint8_t DeviceTypes::find(const char* type) const {
+    for (size_t i = 0; i < count; i++) {
+        if (strncmp(names[i], type, sizeof(names[i]) - 1) == 0) return static_cast<uint8_t>(i);
+    }
+    return NONE;
+}
+
+uint8_t DeviceTypes::intern(const char* type) {
+    uint8_t found = find(type);
+    if (found != NONE || count == MAX_TYPES) return found;
+    strncpy(names[count], type, sizeof(names[count]) - 1);
+    names[count][sizeof(names[count]) - 1] = '\0';
+    return static_cast<uint8_t>(count++);
+}
@@ -0,0 +1,307 @@
+#ifndef DEVICETABLE_H
+#define DEVICETABLE_H
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+#include "Device.h"
+
+// Storage for one field of every device: MaxDevices values in place, or a
+// vector when MaxDevices is 0
+template <typename T, size_t MaxDevices>
+using DeviceColumn = typename std::conditional<MaxDevices == 0, std::vector<T>, std::array<T, MaxDevices>>::type;
+
+// Makes room for n values; a fixed column always has it
+template <typename T>
+void fitColumn(std::vector<T>& column, size_t n) {
+    column.resize(n);
+}
+
+template <typename T, size_t N>
+void fitColumn(std::array<T, N>&, size_t) {}
+
+// One bit per device slot, 32 to a word. Bits past size() are always 0, so
+// whole words can be compared, XORed and counted.
+template <size_t MaxDevices>
+class DeviceBits {
+private:
+    DeviceColumn<uint32_t, (MaxDevices + 31) / 32> words = {};
+    size_t count = 0;
+
+    // Words dropped from a fixed column are zeroed to keep bits past size() 0
+    void resize(size_t bits) {
+        for (size_t w = wordsFor(bits); w < wordCount(); w++) words[w] = 0;
+        count = bits;
+        fitColumn(words, wordCount());
+    }
+
+public:
+    static size_t wordsFor(size_t bits) { return (bits + 31) / 32; }
+
+    size_t size() const { return count; }
+    size_t wordCount() const { return wordsFor(count); }
+    const uint32_t* data() const { return words.data(); }
+
+    bool test(size_t slot) const { return words[slot / 32] >> (slot % 32) & 1; }
+
+    void set(size_t slot, bool value) {
+        uint32_t bit = 1u << (slot % 32);
+        if (value) {
+            words[slot / 32] |= bit;
+        } else {
+            words[slot / 32] &= ~bit;
+        }
+    }
+
+    void push_back(bool value) {
+        fitColumn(words, wordsFor(count + 1));
+        set(count++, value);
+    }
+
+    void pop_back() {
+        set(--count, false);
+        fitColumn(words, wordsFor(count));
+    }
+
+    void copyFrom(const DeviceBits& other) {
+        resize(other.count);
+        memcpy(words.data(), other.words.data(), other.wordCount() * sizeof(uint32_t));
+    }
+
+    // bits bits, all set
+    void fill(size_t bits) {
+        resize(bits);
+        for (size_t w = 0; w < wordCount(); w++) words[w] = UINT32_MAX;
+        if (count % 32) words[count / 32] = (1u << (count % 32)) - 1;
+    }
+
+    // Keeps the bits also set in other (or, with invert, clear in it); other
+    // must be the same size
+    void retain(const DeviceBits& other, bool invert = false) {
+        uint32_t flip = invert ? UINT32_MAX : 0;
+        for (size_t w = 0; w < wordCount(); w++) words[w] &= other.words[w] ^ flip;
+    }
+
+    // Bits set in exactly one of a and b, which must be the same size
+    void assignXor(const DeviceBits& a, const DeviceBits& b) {
+        resize(a.count);
+        for (size_t w = 0; w < wordCount(); w++) words[w] = a.words[w] ^ b.words[w];
+    }
+
+    size_t countSet() const {
+        size_t n = 0;
+        for (size_t w = 0; w < wordCount(); w++) n += __builtin_popcount(words[w]);
+        return n;
+    }
+
+    // First set bit at or after from; size() if there is none
+    size_t nextSet(size_t from) const {
+        for (size_t w = from / 32; w < wordCount(); w++) {
+            uint32_t bits = words[w];
+            if (w == from / 32) bits &= UINT32_MAX << (from % 32);
+            if (bits) return w * 32 + __builtin_ctz(bits);
+        }
+        return count;
+    }
+
+    // The set bit with n set bits before it; size() if there are too few
+    size_t nthSet(size_t n) const {
+        for (size_t w = 0; w < wordCount(); w++) {
+            uint32_t bits = words[w];
+            size_t here = __builtin_popcount(bits);
+            if (n >= here) {
+                n -= here;
+                continue;
+            }
+            for (; n > 0; n--) bits &= bits - 1;
+            return w * 32 + __builtin_ctz(bits);
+        }
+        return count;
+    }
+
+    // Calls f(slot) for each set bit, in slot order
+    template <typename F>
+    void forEachSet(F f) const {
+        for (size_t w = 0; w < wordCount(); w++) {
+            for (uint32_t bits = words[w]; bits; bits &= bits - 1) f(w * 32 + __builtin_ctz(bits));
+        }
+    }
+};
+
+// Every device's status at one moment, a bit per slot
+template <size_t MaxDevices>
+struct StatusSnapshot {
+    DeviceBits<MaxDevices> status;
+    uint32_t layout = 0; // DeviceTable::getLayout() when taken
+
+    // Slots whose status differs in other go into changed; false when a
+    // device was added or removed in between, so the slots no longer match
+    bool diff(const StatusSnapshot& other, DeviceBits<MaxDevices>& changed) const {
+        if (layout != other.layout) return false;
+        changed.assignXor(status, other.status);
+        return true;
+    }
+};
+
+// The distinct device types, each stored once; devices keep a 1-byte index
+class DeviceTypes {
+public:
+    static const size_t MAX_TYPES = 32;
+    static const uint8_t NONE = 0xff;
+
+private:
+    char names[MAX_TYPES][sizeof(Device::type)];
+    size_t count = 0;
+
+public:
+    // Index of type, NONE if it was never interned
+    uint8_t find(const char* type) const;
+    // Index of type, added if new; NONE once MAX_TYPES are taken
+    uint8_t intern(const char* type);
+    const char* name(uint8_t index) const { return names[index]; }
+    size_t size() const { return count; }
+};
+
+// DeviceManager's storage, a column per field. Scans and snapshots touch
+// only the hot columns (ids, pins and the status and input bitsets); titles
+// and type indexes are kept apart and only read to assemble a whole Device.
+// Each interned type also has a bitset of its devices, so the devices of a
+// type are found without visiting the others.
+template <size_t MaxDevices>
+class DeviceTable {
+private:
+    struct Title {
+        char text[sizeof(Device::title)];
+    };
+
+    DeviceColumn<int, MaxDevices> ids;
+    DeviceColumn<int, MaxDevices> pins;
+    DeviceBits<MaxDevices> statuses;
+    DeviceBits<MaxDevices> inputs;
+    DeviceColumn<uint8_t, MaxDevices> levels;
+    DeviceColumn<int8_t, MaxDevices> channels;
+    DeviceColumn<uint8_t, MaxDevices> types;
+    DeviceColumn<Title, MaxDevices> titles;
+    DeviceTypes typeNames;
+    std::array<DeviceBits<MaxDevices>, DeviceTypes::MAX_TYPES> typeMembers;
+    uint32_t layout = 0;
+
+    void copySlot(size_t to, size_t from) {
+        ids[to] = ids[from];
+        pins[to] = pins[from];
+        statuses.set(to, statuses.test(from));
+        inputs.set(to, inputs.test(from));
+        levels[to] = levels[from];
+        channels[to] = channels[from];
+        typeMembers[types[to]].set(to, false);
+        typeMembers[types[from]].set(to, true);
+        types[to] = types[from];
+        titles[to] = titles[from];
+    }
+
+public:
+    // Yields whole Devices by value, so `for (const Device& d : table)` works
+    class const_iterator {
+    private:
+        const DeviceTable* table;
+        size_t slot;
+
+    public:
+        const_iterator(const DeviceTable* table, size_t slot) : table(table), slot(slot) {}
+        Device operator*() const { return (*table)[slot]; }
+        const_iterator& operator++() {
+            slot++;
+            return *this;
+        }
+        bool operator!=(const const_iterator& other) const { return slot != other.slot; }
+    };
+
+    size_t size() const { return statuses.size(); }
+    bool full() const { return MaxDevices != 0 && size() == MaxDevices; }
+    // Room for one more device of this type
+    bool fits(const char* type) const {
+        return !full() && (typeNames.size() < DeviceTypes::MAX_TYPES || typeNames.find(type) != DeviceTypes::NONE);
+    }
+    // Changes whenever a device is added or removed, i.e. when slots move
+    uint32_t getLayout() const { return layout; }
+
+    int id(size_t slot) const { return ids[slot]; }
+    int pin(size_t slot) const { return pins[slot]; }
+    bool status(size_t slot) const { return statuses.test(slot); }
+    bool input(size_t slot) const { return inputs.test(slot); }
+    uint8_t level(size_t slot) const { return levels[slot]; }
+    int8_t channel(size_t slot) const { return channels[slot]; }
+    const char* title(size_t slot) const { return titles[slot].text; }
+    const char* type(size_t slot) const { return typeNames.name(types[slot]); }
+    const DeviceBits<MaxDevices>& getStatuses() const { return statuses; }
+    // Devices of the named type, or null if no device ever had it
+    const DeviceBits<MaxDevices>* getTypeMembers(const char* type) const {
+        uint8_t index = typeNames.find(type);
+        return index == DeviceTypes::NONE ? nullptr : &typeMembers[index];
+    }
+
+    // The device in a slot, put back together
+    Device operator[](size_t slot) const {
+        Device device;
+        device.id = ids[slot];
+        memcpy(device.title, titles[slot].text, sizeof(device.title));
+        memcpy(device.type, type(slot), sizeof(device.type));
+        device.gpioPin = pins[slot];
+        device.status = statuses.test(slot);
+        device.level = levels[slot];
+        device.channel = channels[slot];
+        device.input = inputs.test(slot);
+        return device;
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+
+    // Only after fits(device.type)
+    void push_back(const Device& device) {
+        uint8_t type = typeNames.intern(device.type);
+        size_t slot = size();
+        fitColumn(ids, slot + 1);
+        fitColumn(pins, slot + 1);
+        fitColumn(levels, slot + 1);
+        fitColumn(channels, slot + 1);
+        fitColumn(types, slot + 1);
+        fitColumn(titles, slot + 1);
+        ids[slot] = device.id;
+        pins[slot] = device.gpioPin;
+        statuses.push_back(device.status);
+        inputs.push_back(device.input);
+        for (size_t t = 0; t < DeviceTypes::MAX_TYPES; t++) typeMembers[t].push_back(t == type);
+        levels[slot] = device.level;
+        channels[slot] = device.channel;
+        types[slot] = type;
+        memcpy(titles[slot].text, device.title, sizeof(device.title));
+        layout++;
+    }
+
+    void setState(size_t slot, bool status, uint8_t level) {
+        statuses.set(slot, status);
+        levels[slot] = level;
+    }
+
+    // Swap-remove: the last device moves into the freed slot
+    void remove(size_t slot) {
+        size_t last = size() - 1;
+        if (slot != last) copySlot(slot, last);
+        statuses.pop_back();
+        inputs.pop_back();
+        for (DeviceBits<MaxDevices>& members : typeMembers) members.pop_back();
+        fitColumn(ids, last);
+        fitColumn(pins, last);
+        fitColumn(levels, last);
+        fitColumn(channels, last);
+        fitColumn(types, last);
+        fitColumn(titles, last);
+        layout++;
+    }
+};
+
+#endif // DEVICETABLE_H
@@ -0,0 +1,44 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <stdint.h>
+
+// Sequence counter for one writer and any number of lock-free readers. The
+// writer brackets each change with writeBegin/writeEnd, leaving the count odd
+// while data is in flux; a reader copies what it needs between readBegin and
+// readRetry and starts over if the count moved. Copies start a fresh count,
+// since copying the data is only safe with no writer running anyway.
+class SeqLock {
+private:
+    std::atomic<uint32_t> sequence{0};
+
+public:
+    SeqLock() {}
+    SeqLock(const SeqLock&) {}
+    SeqLock& operator=(const SeqLock&) { return *this; }
+
+    void writeBegin() {
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void writeEnd() {
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    uint32_t readBegin() const {
+        uint32_t start;
+        while ((start = sequence.load(std::memory_order_acquire)) & 1) {
+        }
+        return start;
+    }
+
+    // True when a write overlapped the read that began at start
+    bool readRetry(uint32_t start) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return sequence.load(std::memory_order_relaxed) != start;
+    }
+};
+
+#endif // SEQLOCK_H
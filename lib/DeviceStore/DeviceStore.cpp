@@ -0,0 +1,222 @@
+#include "DeviceStore.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+// Blob: header, then one packed little-endian record per device
+//   0  magic "DREG"    4  version    5  reserved    6  count (u16)
+//   8  epoch (u32)    12  CRC-32 of bytes 0-11 and every record
+const uint8_t MAGIC[4] = {'D', 'R', 'E', 'G'};
+const size_t HEADER_SIZE = 16;
+// id (i32), title, type, gpioPin (i32), status (u8), level (u8); version 1
+// records end after status
+const size_t V1_RECORD_SIZE = 4 + sizeof(Device::title) + sizeof(Device::type) + 4 + 1;
+const size_t RECORD_SIZE = V1_RECORD_SIZE + 1;
+const size_t STATUS_OFFSET = V1_RECORD_SIZE - 1;
+
+const char* const BLOB_KEYS[2] = {"reg0", "reg1"};
+
+// Log record (u64): id in bits 0-31, sequence (1..LOG_SLOTS) in 32-39,
+// status in 40, low 15 bits of the blob epoch in 41-55, CRC-8 of bits 0-55
+// in 56-63. Record k of the ring holds sequence k + 1.
+const uint32_t EPOCH_MASK = 0x7fff;
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+    }
+    return ~crc;
+}
+
+uint8_t crc8(uint64_t value) {
+    uint8_t crc = 0;
+    for (int byte = 0; byte < 7; byte++) {
+        crc ^= static_cast<uint8_t>(value >> (8 * byte));
+        for (int bit = 0; bit < 8; bit++) crc = static_cast<uint8_t>((crc << 1) ^ ((crc & 0x80) ? 0x07 : 0));
+    }
+    return crc;
+}
+
+uint64_t encodeRecord(int id, uint32_t seq, bool status, uint32_t epoch) {
+    uint64_t value = static_cast<uint32_t>(id);
+    value |= static_cast<uint64_t>(seq & 0xff) << 32;
+    value |= static_cast<uint64_t>(status) << 40;
+    value |= static_cast<uint64_t>(epoch & EPOCH_MASK) << 41;
+    return value | static_cast<uint64_t>(crc8(value)) << 56;
+}
+
+bool decodeRecord(uint64_t value, uint32_t seq, uint32_t epoch, int& id, bool& status) {
+    if (static_cast<uint8_t>(value >> 56) != crc8(value)) return false;
+    if (((value >> 32) & 0xff) != seq || ((value >> 41) & EPOCH_MASK) != (epoch & EPOCH_MASK)) return false;
+    id = static_cast<int>(static_cast<uint32_t>(value));
+    status = (value >> 40) & 1;
+    return true;
+}
+
+void logKey(char* key, size_t slot) {
+    snprintf(key, 8, "log%02u", static_cast<unsigned int>(slot));
+}
+
+void putU32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+uint32_t getU32(const uint8_t* in) {
+    return in[0] | in[1] << 8 | in[2] << 16 | static_cast<uint32_t>(in[3]) << 24;
+}
+
+uint32_t blobCrc(const std::vector<uint8_t>& blob) {
+    uint32_t crc = crc32(0, blob.data(), 12);
+    return crc32(crc, blob.data() + HEADER_SIZE, blob.size() - HEADER_SIZE);
+}
+
+size_t recordSize(uint8_t version) {
+    return version == 1 ? V1_RECORD_SIZE : RECORD_SIZE;
+}
+
+// Epoch of an intact blob of a known version, or 0
+uint32_t checkBlob(const std::vector<uint8_t>& blob) {
+    if (blob.size() < HEADER_SIZE || memcmp(blob.data(), MAGIC, sizeof(MAGIC)) != 0) return 0;
+    if (blob[4] != 1 && blob[4] != DeviceStore::FORMAT_VERSION) return 0;
+    size_t count = blob[6] | blob[7] << 8;
+    if (blob.size() != HEADER_SIZE + count * recordSize(blob[4])) return 0;
+    if (getU32(&blob[12]) != blobCrc(blob)) return 0;
+    return getU32(&blob[8]);
+}
+
+} // namespace
+
+bool DeviceStore::restore(DeviceManager& manager) {
+    prefs.begin(nvsNamespace, true);
+
+    std::vector<uint8_t> blob;
+    epoch = 0;
+    for (uint8_t key = 0; key < 2; key++) {
+        std::vector<uint8_t> candidate(prefs.getBytesLength(BLOB_KEYS[key]));
+        if (candidate.empty() || prefs.getBytes(BLOB_KEYS[key], candidate.data(), candidate.size()) != candidate.size()) continue;
+        uint32_t candidateEpoch = checkBlob(candidate);
+        if (candidateEpoch > epoch) {
+            epoch = candidateEpoch;
+            activeBlob = key;
+            blob.swap(candidate);
+        }
+    }
+    if (epoch == 0) {
+        prefs.end();
+        return false;
+    }
+
+    size_t count = blob[6] | blob[7] << 8;
+    size_t size = recordSize(blob[4]);
+    std::vector<Device> devices(count);
+    const uint8_t* in = blob.data() + HEADER_SIZE;
+    for (Device& device : devices) {
+        device = {};
+        device.id = static_cast<int>(getU32(in));
+        memcpy(device.title, in + 4, sizeof(device.title));
+        memcpy(device.type, in + 4 + sizeof(device.title), sizeof(device.type));
+        device.title[sizeof(device.title) - 1] = '\0';
+        device.type[sizeof(device.type) - 1] = '\0';
+        device.gpioPin = static_cast<int>(getU32(in + 4 + sizeof(device.title) + sizeof(device.type)));
+        device.status = in[STATUS_OFFSET] != 0;
+        device.level = size > V1_RECORD_SIZE ? in[STATUS_OFFSET + 1] : 255;
+        in += size;
+    }
+
+    // Replay in sequence order; a record left behind by a torn write or by
+    // an older blob ends the log
+    char key[8];
+    for (logUsed = 0; logUsed < LOG_SLOTS; logUsed++) {
+        int id;
+        bool status;
+        logKey(key, logUsed);
+        if (!decodeRecord(prefs.getULong64(key, 0), logUsed + 1, epoch, id, status)) break;
+        for (Device& device : devices) {
+            if (device.id == id) device.status = status;
+        }
+    }
+    prefs.end();
+    stats.logReplayed = logUsed;
+
+    for (const Device& device : devices) {
+        manager.addDevice(device.id, device.title, device.type, device.gpioPin, device.status, device.level);
+    }
+    persistedSeq = manager.getJournal().latest();
+    return true;
+}
+
+bool DeviceStore::save(const DeviceManager& manager) {
+    // Taken first: changes racing the snapshot are logged again by sync()
+    uint32_t upTo = manager.getJournal().latest();
+    size_t count = manager.size();
+    if (count > 0xffff) return false;
+
+    std::vector<uint8_t> blob(HEADER_SIZE + count * RECORD_SIZE);
+    memcpy(blob.data(), MAGIC, sizeof(MAGIC));
+    blob[4] = FORMAT_VERSION;
+    blob[5] = 0;
+    blob[6] = static_cast<uint8_t>(count);
+    blob[7] = static_cast<uint8_t>(count >> 8);
+    putU32(&blob[8], epoch + 1);
+
+    uint8_t* out = blob.data() + HEADER_SIZE;
+    Device device;
+    for (size_t slot = 0; slot < count && manager.readDevice(slot, device); slot++) {
+        putU32(out, static_cast<uint32_t>(device.id));
+        memcpy(out + 4, device.title, sizeof(device.title));
+        memcpy(out + 4 + sizeof(device.title), device.type, sizeof(device.type));
+        putU32(out + 4 + sizeof(device.title) + sizeof(device.type), static_cast<uint32_t>(device.gpioPin));
+        out[STATUS_OFFSET] = device.status;
+        out[STATUS_OFFSET + 1] = device.level;
+        out += RECORD_SIZE;
+    }
+    putU32(&blob[12], blobCrc(blob));
+
+    // Into the older key, so the current blob survives if this write tears
+    uint8_t target = epoch == 0 ? 0 : activeBlob ^ 1;
+    prefs.begin(nvsNamespace, false);
+    bool written = prefs.putBytes(BLOB_KEYS[target], blob.data(), blob.size()) == blob.size();
+    prefs.end();
+    if (!written) return false;
+
+    epoch++;
+    activeBlob = target;
+    logUsed = 0;
+    persistedSeq = upTo;
+    stats.blobWrites++;
+    return true;
+}
+
+bool DeviceStore::appendStatus(int id, bool status) {
+    char key[8];
+    logKey(key, logUsed);
+    if (prefs.putULong64(key, encodeRecord(id, logUsed + 1, status, epoch)) != sizeof(uint64_t)) return false;
+    logUsed++;
+    stats.logWrites++;
+    return true;
+}
+
+void DeviceStore::sync(const DeviceManager& manager) {
+    const ChangeJournal& journal = manager.getJournal();
+    uint32_t latest = journal.latest();
+    if (persistedSeq == latest) return;
+
+    DeviceChange change;
+    prefs.begin(nvsNamespace, false);
+    for (uint32_t seq = persistedSeq + 1; seq <= latest; seq++) {
+        if (epoch == 0 || logUsed == LOG_SLOTS || !journal.get(seq, change) || change.kind != DeviceChange::STATUS) {
+            // Nothing the log can express: store the whole state instead
+            prefs.end();
+            save(manager);
+            return;
+        }
+        // On failure the change stays pending and is retried next time
+        if (!appendStatus(change.id, change.status)) break;
+        persistedSeq = seq;
+    }
+    prefs.end();
+}
@@ -0,0 +1,58 @@
+#ifndef DEVICESTORE_H
+#define DEVICESTORE_H
+
+#include <Preferences.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <DeviceManager.h>
+
+// Keeps the device registry in NVS across power cycles.
+//
+// The registry is a packed, versioned blob of Device records with a CRC,
+// written to two keys in turn so a blob torn by a power cut leaves the
+// previous one intact. Status changes after it are appended to a ring of
+// LOG_SLOTS keys, one 8-byte record each with its own CRC, so a toggle costs
+// one small NVS entry instead of a blob rewrite. When the ring is full the
+// current state becomes the next blob (compaction) and the ring starts over;
+// records from before that carry the old blob's epoch and are ignored.
+class DeviceStore {
+public:
+    static const size_t LOG_SLOTS = 64;
+    static const uint8_t FORMAT_VERSION = 2;
+
+    struct Stats {
+        uint32_t blobWrites;
+        uint32_t logWrites;
+        uint32_t logReplayed; // records applied by the last restore
+    };
+
+private:
+    const char* nvsNamespace;
+    Preferences prefs;
+    uint32_t epoch = 0;        // of the newest blob, 0 before any
+    uint8_t activeBlob = 0;    // key holding it
+    size_t logUsed = 0;        // records appended since it
+    uint32_t persistedSeq = 0; // newest journal entry already stored
+    Stats stats = {};
+
+    bool appendStatus(int id, bool status);
+
+public:
+    explicit DeviceStore(const char* name = "devices") : nvsNamespace(name) {}
+
+    // Loads the newest intact blob into an empty manager, with the logged
+    // statuses applied before any pin is driven. The log replays up to the
+    // first missing or damaged record. Version 1 blobs, from before dimmers,
+    // load with every level at 255. False if no usable blob is stored.
+    bool restore(DeviceManager& manager);
+    // Writes the whole registry as a new blob and starts a new log
+    bool save(const DeviceManager& manager);
+    // Stores what the manager's journal recorded since the last call: status
+    // changes go to the log; added or removed devices, level changes, a full
+    // log, or a journal that overran trigger save(). Call from one task only.
+    void sync(const DeviceManager& manager);
+
+    const Stats& getStats() const { return stats; }
+};
+
+#endif // DEVICESTORE_H
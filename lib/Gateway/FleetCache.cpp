@@ -0,0 +1,127 @@
+#include "FleetCache.h"
+#include <string.h>
+
+size_t FleetCache::rangeOf(uint8_t peer, size_t& length) const {
+    size_t start = 0;
+    while (start < count && entries[start].peer < peer) start++;
+    size_t end = start;
+    while (end < count && entries[end].peer == peer) end++;
+    length = end - start;
+    return start;
+}
+
+void FleetCache::setPeer(uint8_t peer, const char* name) {
+    if (peer >= MAX_PEERS) return;
+    removePeer(peer);
+    lock.writeBegin();
+    Peer& slot = peers[peer];
+    strncpy(slot.name, name, NAME_MAX);
+    slot.name[NAME_MAX] = '\0';
+    slot.used = true;
+    lock.writeEnd();
+    changed();
+}
+
+void FleetCache::removePeer(uint8_t peer) {
+    if (peer >= MAX_PEERS) return;
+    replace(peer, nullptr, 0);
+    lock.writeBegin();
+    peers[peer] = Peer();
+    lock.writeEnd();
+    changed();
+}
+
+void FleetCache::setPeerState(uint8_t peer, bool online, bool stale) {
+    if (peer >= MAX_PEERS || (peers[peer].online == online && peers[peer].stale == stale)) return;
+    lock.writeBegin();
+    peers[peer].online = online;
+    peers[peer].stale = stale;
+    lock.writeEnd();
+    changed();
+}
+
+size_t FleetCache::replace(uint8_t peer, const Entry* list, size_t length, bool partial) {
+    if (peer >= MAX_PEERS) return 0;
+    size_t held;
+    size_t start = rangeOf(peer, held);
+    size_t kept = length;
+    if (kept > CAPACITY - (count - held)) kept = CAPACITY - (count - held);
+
+    // Everything after the peer moves up or down to fit the new range,
+    // within one write section so readers see before or after
+    lock.writeBegin();
+    memmove(&entries[start + kept], &entries[start + held], (count - start - held) * sizeof(Entry));
+    for (size_t i = 0; i < kept; i++) {
+        entries[start + i] = list[i];
+        entries[start + i].peer = peer;
+    }
+    count = count - held + kept;
+    peers[peer].devices = static_cast<uint16_t>(kept);
+    peers[peer].truncated = kept < length || partial;
+    lock.writeEnd();
+    changed();
+    return kept;
+}
+
+bool FleetCache::apply(uint8_t peer, int id, bool status, int16_t level) {
+    size_t length;
+    size_t start = rangeOf(peer, length);
+    for (size_t i = start; i < start + length; i++) {
+        Entry& entry = entries[i];
+        if (entry.id != id) continue;
+        lock.writeBegin();
+        // A level switches a dimmer on at it, or off at 0 keeping the old
+        // one; other devices take it as a status
+        if (level < 0) {
+            entry.status = status;
+        } else {
+            entry.status = level > 0;
+            if (level > 0 && strcmp(entry.type, DIMMER_TYPE) == 0) entry.level = static_cast<uint8_t>(level);
+        }
+        lock.writeEnd();
+        changed();
+        return true;
+    }
+    return false;
+}
+
+size_t FleetCache::owner(int id, uint8_t& peer) const {
+    // A board lists an id once, so each match is another peer
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i].id != id) continue;
+        if (found++ == 0) peer = entries[i].peer;
+    }
+    return found;
+}
+
+size_t FleetCache::size() const {
+    size_t n;
+    uint32_t start;
+    do {
+        start = lock.readBegin();
+        n = count;
+    } while (lock.readRetry(start));
+    return n;
+}
+
+bool FleetCache::read(size_t index, Entry& out) const {
+    bool found;
+    uint32_t start;
+    do {
+        start = lock.readBegin();
+        found = index < count;
+        if (found) out = entries[index];
+    } while (lock.readRetry(start));
+    return found;
+}
+
+bool FleetCache::readPeer(uint8_t peer, Peer& out) const {
+    if (peer >= MAX_PEERS) return false;
+    uint32_t start;
+    do {
+        start = lock.readBegin();
+        out = peers[peer];
+    } while (lock.readRetry(start));
+    return out.used;
+}
@@ -0,0 +1,95 @@
+#ifndef FLEETCACHE_H
+#define FLEETCACHE_H
+
+#include <Device.h>
+#include <SeqLock.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Peer boards a gateway keeps; each holds a socket open, out of lwIP's
+// socket limit on the ESP32
+#ifndef FLEET_MAX_PEERS
+#define FLEET_MAX_PEERS 8
+#endif
+
+// Devices the merged list holds across all peers, 40 bytes each
+#ifndef FLEET_CAPACITY
+#define FLEET_CAPACITY 256
+#endif
+
+// The merged device list behind GET /api/fleet/devices: every peer's
+// devices as the peer last listed them, grouped by peer. The gateway task is
+// the only writer, replacing one peer's devices at a time; handlers on other
+// tasks read without a lock, a device or a peer at a time, under a seqlock
+// as with Actuator's statistics. A reader going through the list while a
+// peer's devices are replaced may see one of them twice or not at all,
+// never a torn entry; the generation tells it the list moved.
+class FleetCache {
+public:
+    static const size_t CAPACITY = FLEET_CAPACITY;
+    static const size_t MAX_PEERS = FLEET_MAX_PEERS;
+    static const size_t NAME_MAX = 15;
+
+    struct Entry {
+        int id;
+        char title[sizeof(Device::title)];
+        char type[sizeof(Device::type)];
+        uint8_t peer; // slot in peers
+        bool status;
+        uint8_t level;
+    };
+
+    // What the list says about a peer; used is false for a free slot
+    struct Peer {
+        char name[NAME_MAX + 1];
+        bool used;
+        bool online;    // the last exchange with it worked
+        bool stale;     // its devices are older than the gateway allows
+        bool truncated; // it lists more devices than were kept
+        uint16_t devices;
+    };
+
+private:
+    Entry entries[CAPACITY];
+    size_t count = 0;
+    Peer peers[MAX_PEERS] = {};
+    std::atomic<uint32_t> generation{0};
+    SeqLock lock;
+
+    // Where peer's devices start, and how many there are
+    size_t rangeOf(uint8_t peer, size_t& length) const;
+    void changed() { generation.fetch_add(1, std::memory_order_release); }
+
+public:
+    FleetCache() {}
+    FleetCache(const FleetCache&) = delete;
+    FleetCache& operator=(const FleetCache&) = delete;
+
+    // Writer only. Takes over a peer slot, dropping whatever it listed
+    void setPeer(uint8_t peer, const char* name);
+    // Writer only. Frees a slot together with its devices
+    void removePeer(uint8_t peer);
+    // Writer only. Sets what the list says about a peer's link
+    void setPeerState(uint8_t peer, bool online, bool stale);
+    // Writer only. Replaces peer's devices with list; returns how many fit.
+    // The peer is marked truncated if some did not, or with partial, when
+    // the list is already short of what the peer has.
+    size_t replace(uint8_t peer, const Entry* list, size_t length, bool partial = false);
+    // Writer only. Applies a command a peer has carried out to its copy of
+    // the device, as DeviceManager would; false if the peer does not list it
+    bool apply(uint8_t peer, int id, bool status, int16_t level);
+    // Writer only. The peer listing device id, with the number of peers
+    // that do: more than one means the id alone does not say which
+    size_t owner(int id, uint8_t& peer) const;
+
+    // Bumped on every change, for the ETag of the merged list
+    uint32_t getGeneration() const { return generation.load(std::memory_order_acquire); }
+    size_t size() const;
+    // Copies device index; false past the end
+    bool read(size_t index, Entry& out) const;
+    // Copies a peer slot; false for a free one
+    bool readPeer(uint8_t peer, Peer& out) const;
+};
+
+#endif // FLEETCACHE_H
@@ -0,0 +1,116 @@
+#include "FleetJson.h"
+#include <stdio.h>
+#include <string.h>
+
+void FleetJson::append(const char* text) {
+    size_t n = strlen(text);
+    memcpy(pending + pendingLen, text, n);
+    pendingLen += n;
+}
+
+// Same escapes as DeviceListJson's, so a device reads as on its own board
+void FleetJson::appendEscaped(const char* text, size_t maxLen) {
+    for (size_t i = 0; i < maxLen && text[i]; i++) {
+        char escaped = 0;
+        switch (text[i]) {
+        case '"': escaped = '"'; break;
+        case '\\': escaped = '\\'; break;
+        case '\b': escaped = 'b'; break;
+        case '\f': escaped = 'f'; break;
+        case '\n': escaped = 'n'; break;
+        case '\r': escaped = 'r'; break;
+        case '\t': escaped = 't'; break;
+        }
+        if (escaped) {
+            pending[pendingLen++] = '\\';
+            pending[pendingLen++] = escaped;
+        } else {
+            pending[pendingLen++] = text[i];
+        }
+    }
+}
+
+void FleetJson::appendNumber(long value) {
+    pendingLen += snprintf(pending + pendingLen, 12, "%ld", value);
+}
+
+void FleetJson::produce() {
+    pendingPos = 0;
+    pendingLen = 0;
+
+    // Free peer slots write nothing, so go on until something is out
+    while (pendingLen == 0 && stage != DONE) {
+        switch (stage) {
+        case HEAD:
+            append("{\"message\":\"Fleet devices retrieved\",\"status\":true,\"peers\":[");
+            stage = PEERS;
+            break;
+        case PEERS: {
+            FleetCache::Peer peer;
+            if (next == FleetCache::MAX_PEERS) {
+                append("],\"data\":[");
+                stage = DEVICES;
+                next = 0;
+                first = true;
+                break;
+            }
+            if (cache->readPeer(static_cast<uint8_t>(next++), peer)) {
+                append(first ? "{\"name\":\"" : ",{\"name\":\"");
+                appendEscaped(peer.name, sizeof(peer.name));
+                append(peer.online ? "\",\"online\":true" : "\",\"online\":false");
+                append(peer.stale ? ",\"stale\":true" : ",\"stale\":false");
+                append(peer.truncated ? ",\"truncated\":true,\"devices\":" : ",\"truncated\":false,\"devices\":");
+                appendNumber(peer.devices);
+                append("}");
+                first = false;
+            }
+            break;
+        }
+        case DEVICES: {
+            FleetCache::Entry entry;
+            FleetCache::Peer peer;
+            if (!cache->read(next++, entry)) {
+                stage = TAIL;
+                break;
+            }
+            // A peer removed since the entry was read is left out
+            if (!cache->readPeer(entry.peer, peer)) break;
+            append(first ? "{\"peer\":\"" : ",{\"peer\":\"");
+            appendEscaped(peer.name, sizeof(peer.name));
+            append("\",\"id\":");
+            appendNumber(entry.id);
+            append(",\"title\":\"");
+            appendEscaped(entry.title, sizeof(entry.title));
+            append("\",\"type\":\"");
+            appendEscaped(entry.type, sizeof(entry.type));
+            append(entry.status ? "\",\"status\":true,\"level\":" : "\",\"status\":false,\"level\":");
+            appendNumber(entry.level);
+            append(peer.stale ? ",\"stale\":true}" : ",\"stale\":false}");
+            first = false;
+            break;
+        }
+        case TAIL:
+            append("]}");
+            stage = DONE;
+            break;
+        case DONE:
+            break;
+        }
+    }
+}
+
+size_t FleetJson::read(uint8_t* buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+        if (pendingPos == pendingLen) {
+            produce();
+            if (pendingLen == 0) break;
+        }
+        size_t n = pendingLen - pendingPos;
+        if (n > maxLen - written) n = maxLen - written;
+        memcpy(buffer + written, pending + pendingPos, n);
+        pendingPos += n;
+        written += n;
+    }
+    return written;
+}
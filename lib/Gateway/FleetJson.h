@@ -0,0 +1,49 @@
+#ifndef FLEETJSON_H
+#define FLEETJSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "FleetCache.h"
+
+// Resumable writer for the GET /api/fleet/devices body, after DeviceListJson:
+// {"message","status","peers":[{name,online,stale,truncated,devices}...],
+// "data":[{peer,id,title,type,status,level,stale}...]}, read from a
+// FleetCache one peer or device at a time as the response is sent, so
+// memory use is fixed however large the fleet.
+class FleetJson {
+public:
+    // Longest entry: a device with two names and every title/type byte
+    // escaped, its punctuation, and numbers of up to 11 characters
+    static const size_t MAX_ENTRY_SIZE = 128 + 2 * (FleetCache::NAME_MAX + sizeof(Device::title) + sizeof(Device::type));
+
+private:
+    enum Stage {
+        HEAD,
+        PEERS,
+        DEVICES,
+        TAIL,
+        DONE
+    };
+
+    const FleetCache* cache;
+    Stage stage = HEAD;
+    size_t next = 0;
+    bool first = true; // nothing written yet in the current array
+    char pending[MAX_ENTRY_SIZE];
+    size_t pendingLen = 0;
+    size_t pendingPos = 0;
+
+    void append(const char* text);
+    void appendEscaped(const char* text, size_t maxLen);
+    void appendNumber(long value);
+    void produce();
+
+public:
+    explicit FleetJson(const FleetCache& source) : cache(&source) {}
+
+    // Copies up to maxLen further bytes of the document into buffer. Returns
+    // 0 once the whole document has been written.
+    size_t read(uint8_t* buffer, size_t maxLen);
+};
+
+#endif // FLEETJSON_H
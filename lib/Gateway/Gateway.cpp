@@ -0,0 +1,901 @@
+#include "Gateway.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <Trace.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace {
+
+// How long wait() yields before falling back to sleeping a tick at a time
+const uint32_t SPIN_US = 1000;
+// Longest select() sleep with nothing due; submit() and addPeer() wake it
+const uint32_t IDLE_MS = 100;
+const size_t RECEIVE_SIZE = 1024;
+const size_t SEND_SIZE = 512;
+const char BLOB_KEY[] = "peers";
+
+class Guard {
+private:
+    SemaphoreHandle_t lock;
+
+public:
+    explicit Guard(SemaphoreHandle_t mutex) : lock(mutex) { xSemaphoreTake(lock, portMAX_DELAY); }
+    ~Guard() { xSemaphoreGive(lock); }
+};
+
+// The registry as saved; stored as is, like Settings
+struct Blob {
+    uint8_t version;
+    bool used[Gateway::MAX_PEERS];
+    Gateway::PeerConfig peers[Gateway::MAX_PEERS];
+};
+
+// True once now has reached time, across the millis() wrap
+bool due(uint32_t now, uint32_t time) {
+    return static_cast<int32_t>(now - time) >= 0;
+}
+
+sockaddr_in socketAddress(uint32_t address, uint16_t port) {
+    sockaddr_in out;
+    memset(&out, 0, sizeof(out));
+    out.sin_family = AF_INET;
+    out.sin_port = htons(port);
+    uint8_t* octets = reinterpret_cast<uint8_t*>(&out.sin_addr.s_addr);
+    for (int i = 0; i < 4; i++) octets[i] = static_cast<uint8_t>(address >> (8 * i));
+    return out;
+}
+
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Copies text, cut short to fit size
+void copyText(char* out, size_t size, const char* text) {
+    size_t n = strnlen(text, size - 1);
+    memcpy(out, text, n);
+    out[n] = '\0';
+}
+
+bool sameConfig(const Gateway::PeerConfig& a, const Gateway::PeerConfig& b) {
+    return strcmp(a.name, b.name) == 0 && a.address == b.address && a.port == b.port && strcmp(a.password, b.password) == 0;
+}
+
+size_t countBits(uint32_t mask) {
+    size_t n = 0;
+    for (; mask; mask &= mask - 1) n++;
+    return n;
+}
+
+// What a peer's /api/control/batch said of one command
+int16_t itemCode(const char* result) {
+    if (strcmp(result, "updated") == 0) return 200;
+    if (strcmp(result, "queued") == 0) return 202;
+    if (strcmp(result, "not_found") == 0) return 404;
+    return 409; // not_applied: found, but the batch as a whole was not
+}
+
+} // namespace
+
+// The part of a rendered request that falls in [offset, offset + room),
+// copied to out, and the length of the whole
+struct Gateway::Window {
+    char* out;
+    size_t offset;
+    size_t room;
+    size_t length = 0;
+
+    Window(char* buffer, size_t from, size_t size) : out(buffer), offset(from), room(size) {}
+
+    void put(const char* text, size_t n) {
+        for (size_t i = 0; i < n; i++, length++) {
+            if (length >= offset && length - offset < room) out[length - offset] = text[i];
+        }
+    }
+    void put(const char* text) { put(text, strlen(text)); }
+    void format(const char* pattern, ...) {
+        char piece[64];
+        va_list args;
+        va_start(args, pattern);
+        int n = vsnprintf(piece, sizeof(piece), pattern, args);
+        va_end(args);
+        if (n > 0) put(piece, static_cast<size_t>(n) < sizeof(piece) ? n : sizeof(piece) - 1);
+    }
+    // A JSON string's contents
+    void putEscaped(const char* text) {
+        for (; *text; text++) {
+            unsigned char c = static_cast<unsigned char>(*text);
+            if (c == '"' || c == '\\') {
+                char pair[2] = {'\\', static_cast<char>(c)};
+                put(pair, 2);
+            } else if (c < 0x20) {
+                format("\\u%04x", c);
+            } else {
+                put(text, 1);
+            }
+        }
+    }
+};
+
+Gateway::Gateway(const char* name) : nvsNamespace(name), registryLock(xSemaphoreCreateMutex()) {}
+
+void Gateway::begin() {
+    begin(Timing());
+}
+
+void Gateway::begin(const Timing& intervals) {
+    if (task) return;
+    timing = intervals;
+    load();
+
+    // submit() nudges the task out of select() with a datagram to itself
+    wakeFd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in local = socketAddress(IPAddress(127, 0, 0, 1), 0);
+    socklen_t length = sizeof(local);
+    if (wakeFd >= 0 && (bind(wakeFd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 ||
+                        getsockname(wakeFd, reinterpret_cast<sockaddr*>(&local), &length) != 0 || !setNonBlocking(wakeFd))) {
+        close(wakeFd);
+        wakeFd = -1;
+    }
+    if (wakeFd >= 0) wakePort = ntohs(local.sin_port);
+
+    xTaskCreatePinnedToCore(taskMain, "gateway", 6144, this, TASK_PRIORITY, &task, 1);
+}
+
+void Gateway::wake() {
+    if (wakeFd < 0) return;
+    sockaddr_in self = socketAddress(IPAddress(127, 0, 0, 1), wakePort);
+    sendto(wakeFd, "w", 1, 0, reinterpret_cast<sockaddr*>(&self), sizeof(self));
+}
+
+void Gateway::load() {
+    Blob blob;
+    Preferences prefs;
+    prefs.begin(nvsNamespace, true);
+    size_t read = prefs.getBytes(BLOB_KEY, &blob, sizeof(blob));
+    prefs.end();
+    if (read != sizeof(blob) || blob.version != FORMAT_VERSION) return;
+
+    Guard guard(registryLock);
+    for (size_t i = 0; i < MAX_PEERS; i++) {
+        registered[i] = blob.used[i];
+        registry[i] = blob.peers[i];
+        registry[i].name[NAME_MAX] = '\0';
+        registry[i].password[PASSWORD_MAX] = '\0';
+    }
+    registryVersion++;
+}
+
+// With registryLock held
+void Gateway::save() {
+    Blob blob;
+    memset(&blob, 0, sizeof(blob));
+    blob.version = FORMAT_VERSION;
+    for (size_t i = 0; i < MAX_PEERS; i++) {
+        blob.used[i] = registered[i];
+        if (registered[i]) blob.peers[i] = registry[i];
+    }
+    Preferences prefs;
+    prefs.begin(nvsNamespace, false);
+    prefs.putBytes(BLOB_KEY, &blob, sizeof(blob));
+    prefs.end();
+}
+
+int Gateway::findRegistered(const char* name) const {
+    for (size_t i = 0; i < MAX_PEERS; i++) {
+        if (registered[i] && strcmp(registry[i].name, name) == 0) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+Gateway::Registration Gateway::addPeer(const PeerConfig& peer) {
+    size_t nameLength = strnlen(peer.name, sizeof(peer.name));
+    if (nameLength == 0 || nameLength > NAME_MAX || strnlen(peer.password, sizeof(peer.password)) > PASSWORD_MAX ||
+        peer.address == 0 || peer.port == 0)
+        return INVALID;
+
+    Registration outcome;
+    {
+        Guard guard(registryLock);
+        int slot = findRegistered(peer.name);
+        outcome = slot >= 0 ? UPDATED : ADDED;
+        for (size_t i = 0; i < MAX_PEERS && slot < 0; i++) {
+            if (!registered[i]) slot = static_cast<int>(i);
+        }
+        if (slot < 0) return FULL;
+        registry[slot] = peer;
+        registered[slot] = true;
+        registryVersion++;
+        save();
+    }
+    wake();
+    return outcome;
+}
+
+bool Gateway::removePeer(const char* name) {
+    {
+        Guard guard(registryLock);
+        int slot = findRegistered(name);
+        if (slot < 0) return false;
+        registered[slot] = false;
+        memset(&registry[slot], 0, sizeof(PeerConfig));
+        registryVersion++;
+        save();
+    }
+    wake();
+    return true;
+}
+
+bool Gateway::peerStatus(uint8_t peer, PeerStatus& out) const {
+    if (peer >= MAX_PEERS) return false;
+    PeerConfig config;
+    {
+        Guard guard(registryLock);
+        if (!registered[peer]) return false;
+        config = registry[peer];
+    }
+
+    uint32_t start;
+    do {
+        start = statusLock.readBegin();
+        out = statuses[peer];
+    } while (statusLock.readRetry(start));
+
+    // Straight after addPeer() the task may not have taken it up yet
+    if (strcmp(out.name, config.name) != 0) out = PeerStatus();
+    copyText(out.name, sizeof(out.name), config.name);
+    out.address = config.address;
+    out.port = config.port;
+    return true;
+}
+
+uint32_t Gateway::submit(const Command* commands, size_t count) {
+    if (!task || count == 0 || count > MAX_COMMANDS) return 0;
+
+    Job job;
+    job.count = static_cast<uint8_t>(count);
+    memcpy(job.commands, commands, count * sizeof(Command));
+    uint32_t ticket;
+    if (!queue.push(job, ticket)) return 0;
+
+    // The newest ticket issued, for poll() to tell pending from unknown
+    uint32_t newest = issued.load(std::memory_order_relaxed);
+    while (static_cast<int32_t>(ticket - newest) > 0 && !issued.compare_exchange_weak(newest, ticket)) {
+    }
+    wake();
+    return ticket;
+}
+
+Gateway::TicketState Gateway::poll(uint32_t ticket, Result& result) const {
+    const Completion& completion = completions[ticket % COMPLETIONS];
+    uint32_t held = completion.ticket.load(std::memory_order_acquire);
+    if (held == ticket && ticket != 0) {
+        // Check-copy-recheck, as in Actuator::wait()
+        result = completion.result;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return completion.ticket.load(std::memory_order_relaxed) == ticket ? DONE : UNKNOWN;
+    }
+    if (ticket == 0 || static_cast<int32_t>(ticket - issued.load(std::memory_order_acquire)) > 0) return UNKNOWN;
+    // Far fewer jobs are in flight than there are slots, so a later ticket
+    // in the slot means this one finished long ago
+    if (held != 0 && static_cast<int32_t>(held - ticket) > 0) return UNKNOWN;
+    return PENDING;
+}
+
+bool Gateway::wait(uint32_t ticket, uint32_t timeoutMs, Result& result) const {
+    TRACE_SPAN("Gateway::wait");
+    uint32_t start = micros();
+    for (;;) {
+        TicketState state = poll(ticket, result);
+        if (state != PENDING) return state == DONE;
+        uint32_t waited = micros() - start;
+        if (waited >= timeoutMs * 1000) return false;
+        if (waited < SPIN_US) {
+            taskYIELD();
+        } else {
+            vTaskDelay(1);
+        }
+    }
+}
+
+void Gateway::taskMain(void* self) {
+    static_cast<Gateway*>(self)->run();
+}
+
+void Gateway::run() {
+    TRACE_THREAD("gateway");
+    for (;;) {
+        uint32_t now = millis();
+        reconcile(now);
+        startJobs();
+
+        fd_set reads;
+        fd_set writes;
+        FD_ZERO(&reads);
+        FD_ZERO(&writes);
+        int maxFd = wakeFd;
+        if (wakeFd >= 0) FD_SET(wakeFd, &reads);
+        uint32_t sleepMs = IDLE_MS;
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            Link& link = links[i];
+            if (!link.used) continue;
+            service(i, now);
+
+            // Sleep until the next deadline, poll or retry at the latest
+            uint32_t next = link.refreshAt;
+            if (link.connecting || link.exchange != IDLE) {
+                next = link.deadline;
+            } else if (link.backingOff && !due(next, link.retryAt)) {
+                next = link.retryAt;
+            }
+            uint32_t until = due(now, next) ? 0 : next - now;
+            if (until < sleepMs) sleepMs = until;
+
+            if (link.fd >= 0) {
+                FD_SET(link.fd, &reads);
+                if (link.connecting || (link.exchange != IDLE && link.sent < link.total)) FD_SET(link.fd, &writes);
+                if (link.fd > maxFd) maxFd = link.fd;
+            }
+            updateStatus(i);
+        }
+
+        timeval timeout;
+        timeout.tv_sec = sleepMs / 1000;
+        timeout.tv_usec = (sleepMs % 1000) * 1000;
+        if (select(maxFd + 1, &reads, &writes, nullptr, &timeout) <= 0) continue;
+
+        if (wakeFd >= 0 && FD_ISSET(wakeFd, &reads)) {
+            char drained[16];
+            while (recv(wakeFd, drained, sizeof(drained), 0) > 0) {
+            }
+        }
+        now = millis();
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            Link& link = links[i];
+            if (link.fd >= 0 && FD_ISSET(link.fd, &writes)) {
+                if (link.connecting) {
+                    int error = 0;
+                    socklen_t length = sizeof(error);
+                    if (getsockopt(link.fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+                        linkFailed(i, UNREACHABLE, now);
+                        continue;
+                    }
+                    link.connecting = false;
+                    service(i, now);
+                } else {
+                    sendMore(i, now);
+                }
+            }
+            if (link.fd >= 0 && FD_ISSET(link.fd, &reads)) receive(i, now);
+        }
+    }
+}
+
+// Takes up registry changes: a peer removed or changed loses its connection,
+// its queued commands and its devices
+void Gateway::reconcile(uint32_t now) {
+    uint32_t version = registryVersion.load(std::memory_order_acquire);
+    if (version == seenVersion) return;
+
+    PeerConfig wanted[MAX_PEERS];
+    bool present[MAX_PEERS];
+    {
+        Guard guard(registryLock);
+        memcpy(wanted, registry, sizeof(wanted));
+        memcpy(present, registered, sizeof(present));
+        seenVersion = registryVersion.load(std::memory_order_relaxed);
+    }
+
+    for (uint8_t i = 0; i < MAX_PEERS; i++) {
+        Link& link = links[i];
+        if (link.used && (!present[i] || !sameConfig(link.config, wanted[i]))) {
+            closeLink(i);
+            failParts(i, GONE);
+            fleet.removePeer(i);
+            link = Link();
+        }
+        if (present[i] && !link.used) {
+            link.used = true;
+            link.config = wanted[i];
+            link.lastSeenMs = now;
+            link.refreshAt = now;
+            fleet.setPeer(i, link.config.name);
+        }
+        updateStatus(i);
+    }
+}
+
+// Moves queued jobs into free slots, splitting each into one part per peer
+void Gateway::startJobs() {
+    for (uint8_t j = 0; j < ACTIVE_JOBS; j++) {
+        ActiveJob& job = active[j];
+        if (job.used || !queue.pop(job.job, job.ticket)) continue;
+        job.used = true;
+        job.waiting = 0;
+        job.result.count = job.job.count;
+
+        uint32_t masks[MAX_PEERS] = {};
+        for (size_t c = 0; c < job.job.count; c++) {
+            const Command& command = job.job.commands[c];
+            uint8_t peer = NO_PEER;
+            int16_t code = 0;
+            if (command.peer[0]) {
+                for (uint8_t i = 0; i < MAX_PEERS && peer == NO_PEER; i++) {
+                    if (links[i].used && strncmp(links[i].config.name, command.peer, NAME_MAX) == 0) peer = i;
+                }
+                if (peer == NO_PEER) code = NOT_FOUND;
+            } else {
+                size_t owners = fleet.owner(command.command.id, peer);
+                if (owners != 1) code = owners ? AMBIGUOUS : NOT_FOUND;
+                if (owners != 1) peer = NO_PEER;
+            }
+            job.result.codes[c] = code;
+            job.result.peers[c] = peer;
+            if (peer != NO_PEER) masks[peer] |= 1UL << c;
+        }
+
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            Link& link = links[i];
+            if (!masks[i]) continue;
+            link.partJobs[link.partCount] = j;
+            link.partMasks[link.partCount] = masks[i];
+            link.partCount++;
+            job.waiting++;
+        }
+        if (job.waiting == 0) complete(j);
+    }
+}
+
+void Gateway::finishCommands(uint8_t job, uint32_t mask, const int16_t* codes, uint8_t peer) {
+    ActiveJob& entry = active[job];
+    for (size_t c = 0; c < entry.job.count; c++) {
+        if (!(mask & (1UL << c))) continue;
+        entry.result.codes[c] = codes[c];
+        entry.result.peers[c] = peer;
+    }
+    if (--entry.waiting == 0) complete(job);
+}
+
+void Gateway::complete(uint8_t job) {
+    ActiveJob& entry = active[job];
+    Completion& completion = completions[entry.ticket % COMPLETIONS];
+    completion.ticket.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    completion.result = entry.result;
+    completion.ticket.store(entry.ticket, std::memory_order_release);
+    entry.used = false;
+}
+
+// Answers every part waiting for a peer with code
+void Gateway::failParts(uint8_t peer, int16_t code) {
+    Link& link = links[peer];
+    int16_t codes[MAX_COMMANDS];
+    for (size_t c = 0; c < MAX_COMMANDS; c++) codes[c] = code;
+    for (uint8_t p = 0; p < link.partCount; p++) finishCommands(link.partJobs[p], link.partMasks[p], codes, peer);
+    link.partCount = 0;
+}
+
+// Starts whatever a peer's link should do next, and enforces its deadlines
+// and staleness
+void Gateway::service(uint8_t peer, uint32_t now) {
+    Link& link = links[peer];
+    if ((link.connecting || link.exchange != IDLE) && due(now, link.deadline)) {
+        linkFailed(peer, link.connecting ? UNREACHABLE : TIMED_OUT, now);
+    }
+
+    // Devices not confirmed for staleMs are flagged, and dropped after
+    // dropMs; the next answer brings the whole list back
+    uint32_t age = now - link.lastSeenMs;
+    fleet.setPeerState(peer, link.online, age >= timing.staleMs);
+    FleetCache::Peer listed;
+    if (age >= timing.dropMs && fleet.readPeer(peer, listed) && (listed.devices || listed.truncated)) {
+        fleet.replace(peer, nullptr, 0);
+        link.etag[0] = '\0';
+    }
+
+    if (link.connecting || link.exchange != IDLE) return;
+    // While waiting to retry a peer that failed, commands for it fail at
+    // once rather than wait out the backoff. Only a running backoff is
+    // compared, as a time left behind for good stops being due after 2^31 ms.
+    if (link.backingOff) {
+        if (!due(now, link.retryAt)) {
+            failParts(peer, UNREACHABLE);
+            return;
+        }
+        link.backingOff = false;
+        // A refresh that came due during the failures is due now
+        if (due(now, link.refreshAt)) link.refreshAt = now;
+    }
+    if (link.partCount == 0 && !due(now, link.refreshAt)) return;
+    if (link.fd < 0) {
+        openLink(peer, now);
+        return;
+    }
+    if (!link.token[0]) {
+        start(peer, LOGIN, now);
+    } else if (link.partCount) {
+        start(peer, CONTROL, now);
+    } else {
+        // A list is read into a buffer of its own first, so the merged one
+        // never holds half of it; with every buffer busy, wait for one
+        for (int8_t s = 0; s < static_cast<int8_t>(REFRESH_SLOTS) && link.slot < 0; s++) {
+            if (!stagingUsed[s]) link.slot = s;
+        }
+        if (link.slot < 0) return;
+        stagingUsed[link.slot] = true;
+        start(peer, REFRESH, now);
+    }
+}
+
+void Gateway::openLink(uint8_t peer, uint32_t now) {
+    Link& link = links[peer];
+    link.connects++;
+    link.fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (link.fd < 0 || !setNonBlocking(link.fd)) {
+        linkFailed(peer, UNREACHABLE, now);
+        return;
+    }
+    // Requests go out whole; there is nothing to gain from Nagle's delay
+    int on = 1;
+    setsockopt(link.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    sockaddr_in address = socketAddress(link.config.address, link.config.port);
+    if (connect(link.fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+        link.connecting = false;
+    } else if (errno == EINPROGRESS) {
+        link.connecting = true;
+        link.deadline = now + timing.timeoutMs;
+    } else {
+        linkFailed(peer, UNREACHABLE, now);
+    }
+}
+
+void Gateway::closeLink(uint8_t peer) {
+    Link& link = links[peer];
+    if (link.fd >= 0) close(link.fd);
+    link.fd = -1;
+    link.connecting = false;
+    link.reused = false;
+    link.exchange = IDLE;
+    if (link.slot >= 0) stagingUsed[link.slot] = false;
+    link.slot = -1;
+}
+
+// The connection failed, or the exchange on it did: a command in flight
+// gets code and the rest of the peer's commands UNREACHABLE, and the peer
+// is not tried again until its backoff has passed
+void Gateway::linkFailed(uint8_t peer, int16_t code, uint32_t now) {
+    Link& link = links[peer];
+    if (link.exchange == CONTROL && link.partCount) {
+        int16_t codes[MAX_COMMANDS];
+        for (size_t c = 0; c < MAX_COMMANDS; c++) codes[c] = code;
+        finishCommands(link.partJobs[0], link.partMasks[0], codes, peer);
+        link.partCount--;
+        memmove(link.partJobs, link.partJobs + 1, link.partCount);
+        memmove(link.partMasks, link.partMasks + 1, link.partCount * sizeof(uint32_t));
+    }
+    closeLink(peer);
+    failParts(peer, UNREACHABLE);
+    link.failures++;
+    link.online = false;
+    link.backoffMs = link.backoffMs ? link.backoffMs * 2 : timing.backoffMs;
+    if (link.backoffMs > timing.maxBackoffMs) link.backoffMs = timing.maxBackoffMs;
+    link.retryAt = now + link.backoffMs;
+    link.backingOff = true;
+}
+
+void Gateway::start(uint8_t peer, Exchange exchange, uint32_t now) {
+    Link& link = links[peer];
+    link.exchange = exchange;
+    link.startedUs = micros();
+    link.deadline = now + timing.timeoutMs;
+    link.sent = 0;
+    link.answered = false;
+    link.response.reset();
+    link.body.reset();
+    link.staged = 0;
+    for (size_t c = 0; c < MAX_COMMANDS; c++) link.itemCodes[c] = 0;
+
+    Window length(nullptr, 0, 0);
+    renderRequest(link, length);
+    link.total = length.length;
+    sendMore(peer, now);
+}
+
+void Gateway::renderRequest(const Link& link, Window& out) const {
+    uint32_t address = link.config.address;
+    bool batch = link.exchange == CONTROL && countBits(link.partMasks[0]) > 1;
+    switch (link.exchange) {
+    case LOGIN: out.put("POST /api/connect HTTP/1.1\r\n"); break;
+    case REFRESH: out.put("GET /api/devices HTTP/1.1\r\n"); break;
+    default: out.put(batch ? "PUT /api/control/batch HTTP/1.1\r\n" : "PUT /api/control HTTP/1.1\r\n"); break;
+    }
+    out.format("Host: %u.%u.%u.%u:%u\r\n", static_cast<unsigned int>(address & 0xff), static_cast<unsigned int>(address >> 8 & 0xff),
+               static_cast<unsigned int>(address >> 16 & 0xff), static_cast<unsigned int>(address >> 24),
+               static_cast<unsigned int>(link.config.port));
+    if (link.exchange != LOGIN) {
+        out.put("Authorization: Bearer ");
+        out.put(link.token);
+        out.put("\r\n");
+    }
+    if (link.exchange == REFRESH) {
+        if (link.etag[0]) {
+            out.put("If-None-Match: ");
+            out.put(link.etag);
+            out.put("\r\n");
+        }
+        out.put("\r\n");
+        return;
+    }
+
+    Window body(nullptr, 0, 0);
+    renderBody(link, body);
+    out.format("Content-Type: application/json\r\nContent-Length: %u\r\n\r\n", static_cast<unsigned int>(body.length));
+    renderBody(link, out);
+}
+
+// {"password"} to log in; the commands of the first queued part as
+// /api/control or /api/control/batch take them
+void Gateway::renderBody(const Link& link, Window& out) const {
+    if (link.exchange == LOGIN) {
+        out.put("{\"password\":\"");
+        out.putEscaped(link.config.password);
+        out.put("\"}");
+        return;
+    }
+
+    const ActiveJob& job = active[link.partJobs[0]];
+    uint32_t mask = link.partMasks[0];
+    bool batch = countBits(mask) > 1;
+    bool first = true;
+    if (batch) out.put("[");
+    for (size_t c = 0; c < job.job.count; c++) {
+        if (!(mask & (1UL << c))) continue;
+        const DeviceCommand& command = job.job.commands[c].command;
+        out.format(first ? "{\"device\":%d,\"status\":%s" : ",{\"device\":%d,\"status\":%s", command.id, command.status ? "true" : "false");
+        if (command.level != DeviceCommand::NO_LEVEL) out.format(",\"level\":%d", command.level);
+        if (command.fadeMs) out.format(",\"fadeMs\":%u", static_cast<unsigned int>(command.fadeMs));
+        out.put("}");
+        first = false;
+    }
+    if (batch) out.put("]");
+}
+
+void Gateway::sendMore(uint8_t peer, uint32_t now) {
+    Link& link = links[peer];
+    while (link.fd >= 0 && link.sent < link.total) {
+        char piece[SEND_SIZE];
+        Window window(piece, link.sent, sizeof(piece));
+        renderRequest(link, window);
+        size_t n = link.total - link.sent;
+        if (n > sizeof(piece)) n = sizeof(piece);
+        ssize_t written = send(link.fd, piece, n, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+            linkFailed(peer, UNREACHABLE, now);
+            return;
+        }
+        link.sent += static_cast<size_t>(written);
+    }
+}
+
+void Gateway::receive(uint8_t peer, uint32_t now) {
+    Link& link = links[peer];
+    char buffer[RECEIVE_SIZE];
+    for (;;) {
+        ssize_t n = recv(link.fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+
+        if (n > 0 && link.exchange != IDLE) {
+            link.answered = true;
+            size_t at = 0;
+            while (at < static_cast<size_t>(n) && !link.response.complete() && !link.response.malformed()) {
+                size_t used;
+                const char* body;
+                size_t bodyLength;
+                link.response.feed(buffer + at, n - at, used, body, bodyLength);
+                at += used;
+                if (bodyLength) readBody(link, body, bodyLength);
+            }
+            if (link.response.complete()) {
+                finish(peer, now);
+                return;
+            }
+            if (link.response.malformed()) {
+                linkFailed(peer, UNREACHABLE, now);
+                return;
+            }
+            continue;
+        }
+
+        // Closed, reset, or something sent unasked
+        if (n == 0 && link.exchange != IDLE) link.response.closed();
+        if (link.exchange != IDLE && link.response.complete()) {
+            finish(peer, now);
+        } else if (link.exchange == IDLE || (link.reused && !link.answered)) {
+            // A kept-alive connection the peer let go of, idle or just as a
+            // request went out: open another and send it again
+            closeLink(peer);
+        } else {
+            linkFailed(peer, UNREACHABLE, now);
+        }
+        return;
+    }
+}
+
+// Picks what the exchange wants out of the response body as it arrives
+void Gateway::readBody(Link& link, const char* data, size_t len) {
+    JsonScanner& scanner = link.body;
+    size_t at = 0;
+    while (at < len) {
+        size_t used;
+        JsonScanner::Event event = scanner.next(data + at, len - at, used);
+        at += used;
+        if (event == JsonScanner::FAILED) return;
+        bool inList = scanner.depth() >= 2 && strcmp(scanner.keyAt(0), "data") == 0;
+
+        if (link.exchange == LOGIN && event == JsonScanner::VALUE && scanner.depth() == 2 && inList &&
+            strcmp(scanner.key(), "token") == 0) {
+            copyText(link.token, sizeof(link.token), scanner.value());
+        } else if (link.exchange == REFRESH && inList && link.slot >= 0) {
+            // {"data":[{id, title, type, gpioPin, status, level}, ...]}
+            if (link.staged >= PEER_DEVICES) continue;
+            FleetCache::Entry& entry = staging[link.slot][link.staged];
+            if (event == JsonScanner::OBJECT_END && scanner.depth() == 2) {
+                link.staged++;
+            } else if (event == JsonScanner::VALUE && scanner.depth() == 3) {
+                const char* key = scanner.key();
+                if (scanner.indexAt(1) != link.staged) {
+                    continue;
+                } else if (strcmp(key, "id") == 0) {
+                    // The first member of an entry: start it afresh
+                    memset(&entry, 0, sizeof(entry));
+                    entry.level = 255;
+                    entry.id = static_cast<int>(scanner.toInt());
+                } else if (strcmp(key, "title") == 0) {
+                    copyText(entry.title, sizeof(entry.title), scanner.value());
+                } else if (strcmp(key, "type") == 0) {
+                    copyText(entry.type, sizeof(entry.type), scanner.value());
+                } else if (strcmp(key, "status") == 0) {
+                    entry.status = scanner.isTrue();
+                } else if (strcmp(key, "level") == 0) {
+                    entry.level = static_cast<uint8_t>(scanner.toInt());
+                }
+            }
+        } else if (link.exchange == CONTROL && event == JsonScanner::VALUE && inList && scanner.depth() == 3 &&
+                   strcmp(scanner.key(), "result") == 0 && scanner.indexAt(1) < MAX_COMMANDS) {
+            link.itemCodes[scanner.indexAt(1)] = itemCode(scanner.value());
+        }
+    }
+}
+
+// A whole response is in
+void Gateway::finish(uint8_t peer, uint32_t now) {
+    Link& link = links[peer];
+    int status = link.response.status();
+    Exchange exchange = link.exchange;
+    link.exchange = IDLE;
+    link.reused = true;
+    link.requests++;
+    link.online = true;
+    link.seen = true;
+    link.lastSeenMs = now;
+    link.backoffMs = 0;
+
+    switch (exchange) {
+    case LOGIN:
+        TRACE_RECORD("Gateway login", link.startedUs, micros());
+        link.loginRefused = status != 200 || !link.token[0];
+        if (link.loginRefused) {
+            // A wrong password is not tried again at once
+            link.token[0] = '\0';
+            link.online = false;
+            link.failures++;
+            failParts(peer, UNREACHABLE);
+            link.backoffMs = timing.maxBackoffMs;
+            link.retryAt = now + link.backoffMs;
+            link.backingOff = true;
+        }
+        break;
+    case REFRESH:
+        TRACE_RECORD("Gateway refresh", link.startedUs, micros());
+        if (status == 401 && !link.retried) {
+            // The peer restarted or forgot the session; log in and ask again
+            link.token[0] = '\0';
+            link.retried = true;
+        } else {
+            if (status == 304) {
+                link.notModified++;
+            } else if (status == 200 && link.body.finished()) {
+                size_t kept = link.staged < PEER_DEVICES ? link.staged : PEER_DEVICES;
+                fleet.replace(peer, staging[link.slot], kept, link.staged > PEER_DEVICES);
+                copyText(link.etag, sizeof(link.etag), link.response.etag());
+            } else {
+                link.failures++;
+            }
+            link.retried = false;
+            link.refreshAt = now + timing.refreshMs;
+        }
+        stagingUsed[link.slot] = false;
+        link.slot = -1;
+        break;
+    case CONTROL: {
+        TRACE_RECORD("Gateway control", link.startedUs, micros());
+        if (status == 401 && !link.retried) {
+            link.token[0] = '\0';
+            link.retried = true;
+            break;
+        }
+        // A batch reports each command; otherwise the status is the answer
+        const ActiveJob& job = active[link.partJobs[0]];
+        uint32_t mask = link.partMasks[0];
+        bool batch = countBits(mask) > 1;
+        int16_t codes[MAX_COMMANDS];
+        size_t item = 0;
+        for (size_t c = 0; c < job.job.count; c++) {
+            if (!(mask & (1UL << c))) continue;
+            codes[c] = batch && link.itemCodes[item] ? link.itemCodes[item] : static_cast<int16_t>(status);
+            item++;
+            // Written through, so the merged list shows it before the next poll
+            if (codes[c] == 200) {
+                const DeviceCommand& command = job.job.commands[c].command;
+                fleet.apply(peer, command.id, command.status, command.level);
+            }
+        }
+        finishCommands(link.partJobs[0], mask, codes, peer);
+        link.partCount--;
+        memmove(link.partJobs, link.partJobs + 1, link.partCount);
+        memmove(link.partMasks, link.partMasks + 1, link.partCount * sizeof(uint32_t));
+        link.retried = false;
+        break;
+    }
+    case IDLE:
+        break;
+    }
+
+    if (!link.response.keepAlive()) closeLink(peer);
+}
+
+void Gateway::updateStatus(uint8_t peer) {
+    const Link& link = links[peer];
+    FleetCache::Peer listed;
+    bool inList = fleet.readPeer(peer, listed);
+
+    statusLock.writeBegin();
+    PeerStatus& status = statuses[peer];
+    if (!link.used) {
+        status = PeerStatus();
+    } else {
+        copyText(status.name, sizeof(status.name), link.config.name);
+        status.address = link.config.address;
+        status.port = link.config.port;
+        status.connected = link.fd >= 0 && !link.connecting;
+        status.online = link.online;
+        status.stale = inList && listed.stale;
+        status.loginRefused = link.loginRefused;
+        status.seen = link.seen;
+        status.lastSeenMs = link.lastSeenMs;
+        status.devices = inList ? listed.devices : 0;
+        status.connects = link.connects;
+        status.requests = link.requests;
+        status.notModified = link.notModified;
+        status.failures = link.failures;
+        status.pending = link.partCount;
+    }
+    statusLock.writeEnd();
+}
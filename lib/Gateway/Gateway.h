@@ -0,0 +1,290 @@
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <CommandQueue.h>
+#include <DeviceManager.h>
+#include <SeqLock.h>
+#include "FleetCache.h"
+#include "JsonScanner.h"
+#include "ResponseParser.h"
+
+// Gateway mode, the /api/fleet endpoints, built in with -DGATEWAY_ENABLED=1
+#ifndef GATEWAY_ENABLED
+#define GATEWAY_ENABLED 0
+#endif
+
+// Devices taken from any one peer's list
+#ifndef FLEET_PEER_DEVICES
+#define FLEET_PEER_DEVICES 64
+#endif
+
+// Peer lists read at once, each into a buffer of FLEET_PEER_DEVICES entries
+#ifndef FLEET_REFRESH_SLOTS
+#define FLEET_REFRESH_SLOTS 2
+#endif
+
+// One board standing in front of a fleet of peers running this firmware. A
+// task of its own keeps a connection to each peer, logs in with the peer's
+// password, and polls its device list with If-None-Match, so an unchanged
+// list costs a 304 and a changed one replaces that peer's part of the
+// merged FleetCache. Control commands are queued from any task as with
+// Actuator and come back as a ticket; the task routes each to the peer that
+// lists its device, one request per peer carrying all of that peer's
+// commands, with the peers' requests in flight together. Every exchange has
+// a deadline; a peer that stops answering is retried with a growing backoff,
+// its devices flagged stale after a while and dropped after longer.
+//
+// The sockets are plain BSD sockets in non-blocking mode driven by select(),
+// which lwIP provides on the ESP32 and Linux natively, so the same code runs
+// in the native build against local stand-in peers.
+class Gateway {
+public:
+    static const size_t MAX_PEERS = FleetCache::MAX_PEERS;
+    static const size_t NAME_MAX = FleetCache::NAME_MAX;
+    static const size_t PASSWORD_MAX = 64;
+    static const size_t MAX_COMMANDS = 16;
+    static const size_t QUEUE_DEPTH = 8;
+    static const size_t PEER_DEVICES = FLEET_PEER_DEVICES;
+    static const size_t REFRESH_SLOTS = FLEET_REFRESH_SLOTS;
+    // Above the AsyncTCP task, like the actuator: handlers read the cache
+    // under its seqlock. The task is blocked in select() nearly all the time.
+    static const UBaseType_t TASK_PRIORITY = 4;
+    static const uint8_t NO_PEER = 0xff;
+
+    // Codes of commands the gateway answers itself, as HTTP statuses
+    static const int16_t NOT_FOUND = 404;   // no such peer, or no peer lists the device
+    static const int16_t GONE = 410;        // the peer was removed before it was asked
+    static const int16_t AMBIGUOUS = 409;   // several peers list the device and none was named
+    static const int16_t UNREACHABLE = 502; // no connection, the login was refused, or no answer
+    static const int16_t TIMED_OUT = 504;   // asked, with no answer before the deadline
+
+    // Intervals, in milliseconds
+    struct Timing {
+        uint32_t refreshMs = 2000;   // between conditional GETs of a peer's list
+        uint32_t timeoutMs = 1000;   // to connect, or for one exchange
+        uint32_t staleMs = 10000;    // unanswered for this long: its devices are flagged stale
+        uint32_t dropMs = 300000;    // and for this long: dropped from the list
+        uint32_t backoffMs = 250;    // first wait before reconnecting, doubled per failure
+        uint32_t maxBackoffMs = 8000;
+    };
+
+    struct PeerConfig {
+        char name[NAME_MAX + 1];
+        uint32_t address; // IPv4, as IPAddress converts it
+        uint16_t port;
+        char password[PASSWORD_MAX + 1];
+    };
+
+    enum Registration {
+        ADDED,
+        UPDATED, // a peer of that name was there and now has these settings
+        FULL,
+        INVALID
+    };
+
+    struct PeerStatus {
+        char name[NAME_MAX + 1];
+        uint32_t address;
+        uint16_t port;
+        bool connected;
+        bool online;   // the last exchange worked
+        bool stale;
+        bool loginRefused;
+        bool seen;           // it has answered since it was added
+        uint32_t lastSeenMs; // millis() of its last answer
+        uint16_t devices;
+        uint32_t connects;   // TCP connections opened to it
+        uint32_t requests;   // exchanges completed
+        uint32_t notModified; // list polls answered 304
+        uint32_t failures;   // refused or broken connections, and timeouts
+        uint16_t pending;    // control requests waiting for it
+    };
+
+    // One device command; an empty peer routes it to whichever peer lists
+    // the device
+    struct Command {
+        char peer[NAME_MAX + 1];
+        DeviceCommand command;
+    };
+
+    // Per command, the HTTP status its peer answered with (or one of the
+    // codes above) and the peer's slot, NO_PEER when none was found
+    struct Result {
+        uint8_t count;
+        int16_t codes[MAX_COMMANDS];
+        uint8_t peers[MAX_COMMANDS];
+    };
+
+    enum TicketState {
+        PENDING,
+        DONE,
+        UNKNOWN // never issued, or finished so long ago its result is gone
+    };
+
+private:
+    static const uint8_t FORMAT_VERSION = 1;
+    static const size_t TOKEN_MAX = 47;
+    static const size_t ACTIVE_JOBS = 4;
+    static const size_t COMPLETIONS = QUEUE_DEPTH * 4;
+
+    struct Job {
+        uint8_t count;
+        Command commands[MAX_COMMANDS];
+    };
+
+    // A job taken off the queue, until every peer it involves has answered
+    struct ActiveJob {
+        bool used;
+        uint32_t ticket;
+        Job job;
+        Result result;
+        uint8_t waiting; // peers yet to answer
+    };
+
+    struct Completion {
+        std::atomic<uint32_t> ticket{0};
+        Result result = {};
+    };
+
+    enum Exchange {
+        IDLE,
+        LOGIN,
+        REFRESH,
+        CONTROL
+    };
+
+    // The task's side of one peer
+    struct Link {
+        bool used = false;
+        PeerConfig config = {};
+        int fd = -1;
+        bool connecting = false;
+        bool reused = false; // the connection has carried an exchange before
+        bool backingOff = false; // retryAt has not been reached yet
+        uint32_t retryAt = 0;
+        uint32_t backoffMs = 0;
+        bool loginRefused = false;
+        char token[TOKEN_MAX + 1] = {};
+        char etag[ResponseParser::MAX_ETAG + 1] = {};
+        uint32_t refreshAt = 0;
+        bool online = false;
+        bool seen = false;
+        uint32_t lastSeenMs = 0; // or when it was added, until it answers
+        uint32_t connects = 0;
+        uint32_t requests = 0;
+        uint32_t notModified = 0;
+        uint32_t failures = 0;
+
+        // The exchange in progress
+        Exchange exchange = IDLE;
+        uint32_t startedUs = 0;
+        uint32_t deadline = 0;
+        size_t sent = 0;
+        size_t total = 0;
+        bool answered = false; // any of the response has arrived
+        bool retried = false;  // after a 401, with a fresh token
+        ResponseParser response;
+        JsonScanner body;
+        int8_t slot = -1;     // refresh buffer being filled
+        size_t staged = 0;    // devices listed so far, kept or not
+        int16_t itemCodes[MAX_COMMANDS];
+
+        // Jobs with commands for this peer, oldest first, as ActiveJob
+        // indexes and command bits
+        uint8_t partJobs[ACTIVE_JOBS];
+        uint32_t partMasks[ACTIVE_JOBS];
+        uint8_t partCount = 0;
+    };
+
+    const char* nvsNamespace;
+    Timing timing;
+    TaskHandle_t task = nullptr;
+
+    // The registry: written by addPeer/removePeer on any task, read by the
+    // gateway task when the version moves
+    SemaphoreHandle_t registryLock = nullptr;
+    PeerConfig registry[MAX_PEERS] = {};
+    bool registered[MAX_PEERS] = {};
+    std::atomic<uint32_t> registryVersion{0};
+
+    FleetCache fleet;
+    CommandQueue<Job, QUEUE_DEPTH> queue;
+    Completion completions[COMPLETIONS];
+    std::atomic<uint32_t> issued{0};
+    int wakeFd = -1;
+    uint16_t wakePort = 0;
+
+    PeerStatus statuses[MAX_PEERS] = {};
+    SeqLock statusLock;
+
+    // Gateway task only
+    Link links[MAX_PEERS];
+    ActiveJob active[ACTIVE_JOBS] = {};
+    FleetCache::Entry staging[REFRESH_SLOTS][PEER_DEVICES];
+    bool stagingUsed[REFRESH_SLOTS] = {};
+    uint32_t seenVersion = 0;
+
+    static void taskMain(void* self);
+    void run();
+    void wake();
+    void load();
+    void save();
+    int findRegistered(const char* name) const;
+
+    // Gateway task: registry changes, jobs and the peers' links
+    void reconcile(uint32_t now);
+    void startJobs();
+    void finishCommands(uint8_t job, uint32_t mask, const int16_t* codes, uint8_t peer);
+    void complete(uint8_t job);
+    void failParts(uint8_t peer, int16_t code);
+    void service(uint8_t peer, uint32_t now);
+    void openLink(uint8_t peer, uint32_t now);
+    void closeLink(uint8_t peer);
+    void linkFailed(uint8_t peer, int16_t code, uint32_t now);
+    void start(uint8_t peer, Exchange exchange, uint32_t now);
+    // Request text is rendered again for each piece sent rather than kept
+    struct Window;
+    void renderRequest(const Link& link, Window& out) const;
+    void renderBody(const Link& link, Window& out) const;
+    void sendMore(uint8_t peer, uint32_t now);
+    void receive(uint8_t peer, uint32_t now);
+    void readBody(Link& link, const char* data, size_t len);
+    void finish(uint8_t peer, uint32_t now);
+    void updateStatus(uint8_t peer);
+
+public:
+    explicit Gateway(const char* name = "fleet");
+    Gateway(const Gateway&) = delete;
+    Gateway& operator=(const Gateway&) = delete;
+
+    // Loads the saved peers and starts the task. Later calls do nothing.
+    void begin();
+    void begin(const Timing& intervals);
+
+    // Adds a peer, or changes the one of the same name, and saves the
+    // registry. Its devices appear once it has been reached.
+    Registration addPeer(const PeerConfig& peer);
+    // Forgets a peer and its devices; false if there was none of that name
+    bool removePeer(const char* name);
+    // A peer slot's state; false for a free slot
+    bool peerStatus(uint8_t peer, PeerStatus& out) const;
+
+    // Queues up to MAX_COMMANDS commands for the task to route. Returns the
+    // ticket, or 0 if the queue is full, the count is out of range or
+    // begin() has not run.
+    uint32_t submit(const Command* commands, size_t count);
+    // Waits up to timeoutMs for every command of a ticket to be answered.
+    // False on timeout, or if the ticket is unknown.
+    bool wait(uint32_t ticket, uint32_t timeoutMs, Result& result) const;
+    // Where a ticket is, with its result once done
+    TicketState poll(uint32_t ticket, Result& result) const;
+
+    const FleetCache& cache() const { return fleet; }
+    const Timing& intervals() const { return timing; }
+};
+
+#endif // GATEWAY_H
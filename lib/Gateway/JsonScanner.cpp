@@ -0,0 +1,201 @@
+#include "JsonScanner.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+bool isLiteralChar(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '+' || c == '.';
+}
+
+bool isHexDigit(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+} // namespace
+
+void JsonScanner::reset() {
+    levelCount = 0;
+    state = VALUE_NEXT;
+    stringIsKey = false;
+    unicodeLeft = 0;
+    kind = NUL;
+    text[0] = '\0';
+    textLen = 0;
+}
+
+const char* JsonScanner::keyAt(size_t level) const {
+    return level < levelCount && levels[level].object ? levels[level].key : "";
+}
+
+long JsonScanner::toInt() const {
+    return kind == NUMBER ? strtol(text, nullptr, 10) : 0;
+}
+
+void JsonScanner::appendText(char c) {
+    if (textLen < MAX_VALUE) text[textLen++] = c;
+    text[textLen] = '\0';
+}
+
+bool JsonScanner::open(bool object) {
+    if (levelCount == MAX_DEPTH) return false;
+    Level& level = levels[levelCount++];
+    level.object = object;
+    level.index = 0;
+    level.key[0] = '\0';
+    return true;
+}
+
+void JsonScanner::valueDone() {
+    state = levelCount ? COMMA_OR_CLOSE : FINISHED;
+}
+
+JsonScanner::Event JsonScanner::close(bool object) {
+    if (levelCount == 0 || levels[levelCount - 1].object != object) {
+        state = BROKEN;
+        return FAILED;
+    }
+    levelCount--;
+    valueDone();
+    return object ? OBJECT_END : NONE;
+}
+
+JsonScanner::Event JsonScanner::finishLiteral() {
+    if (strcmp(text, "true") == 0 || strcmp(text, "false") == 0) {
+        kind = BOOLEAN;
+    } else if (strcmp(text, "null") == 0) {
+        kind = NUL;
+    } else if (text[0] == '-' || (text[0] >= '0' && text[0] <= '9')) {
+        kind = NUMBER;
+    } else {
+        state = BROKEN;
+        return FAILED;
+    }
+    valueDone();
+    return VALUE;
+}
+
+JsonScanner::Event JsonScanner::next(const char* data, size_t len, size_t& used) {
+    used = 0;
+    while (used < len && state != BROKEN) {
+        char c = data[used];
+        switch (state) {
+        case IN_STRING:
+            used++;
+            if (c == '"') {
+                if (stringIsKey) {
+                    Level& level = levels[levelCount - 1];
+                    size_t n = textLen < MAX_KEY ? textLen : MAX_KEY;
+                    memcpy(level.key, text, n);
+                    level.key[n] = '\0';
+                    state = COLON;
+                } else {
+                    kind = STRING;
+                    valueDone();
+                    return VALUE;
+                }
+            } else if (c == '\\') {
+                state = IN_ESCAPE;
+            } else {
+                appendText(c);
+            }
+            break;
+        case IN_ESCAPE:
+            used++;
+            state = IN_STRING;
+            switch (c) {
+            case 'b': appendText('\b'); break;
+            case 'f': appendText('\f'); break;
+            case 'n': appendText('\n'); break;
+            case 'r': appendText('\r'); break;
+            case 't': appendText('\t'); break;
+            case 'u':
+                appendText('?');
+                unicodeLeft = 4;
+                state = IN_UNICODE;
+                break;
+            default: appendText(c); break;
+            }
+            break;
+        case IN_UNICODE:
+            used++;
+            if (!isHexDigit(c)) {
+                state = BROKEN;
+            } else if (--unicodeLeft == 0) {
+                state = IN_STRING;
+            }
+            break;
+        case IN_LITERAL:
+            if (isLiteralChar(c)) {
+                used++;
+                appendText(c);
+                break;
+            }
+            // The character after a literal is left for the next call
+            return finishLiteral();
+        default:
+            used++;
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n') break;
+            switch (state) {
+            case VALUE_NEXT:
+                textLen = 0;
+                text[0] = '\0';
+                if (c == '{') {
+                    state = open(true) ? KEY_OR_CLOSE : BROKEN;
+                } else if (c == '[') {
+                    if (!open(false)) state = BROKEN;
+                } else if (c == ']' && levelCount && !levels[levelCount - 1].object && levels[levelCount - 1].index == 0) {
+                    // An empty array
+                    close(false);
+                } else if (c == '"') {
+                    stringIsKey = false;
+                    state = IN_STRING;
+                } else if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n') {
+                    appendText(c);
+                    state = IN_LITERAL;
+                } else {
+                    state = BROKEN;
+                }
+                break;
+            case KEY_OR_CLOSE:
+                if (c == '}') return close(true);
+                // fall through
+            case KEY_NEXT:
+                if (c == '"') {
+                    textLen = 0;
+                    text[0] = '\0';
+                    stringIsKey = true;
+                    state = IN_STRING;
+                } else {
+                    state = BROKEN;
+                }
+                break;
+            case COLON:
+                state = c == ':' ? VALUE_NEXT : BROKEN;
+                break;
+            case COMMA_OR_CLOSE:
+                if (c == ',') {
+                    Level& level = levels[levelCount - 1];
+                    if (level.object) {
+                        state = KEY_NEXT;
+                    } else {
+                        level.index++;
+                        state = VALUE_NEXT;
+                    }
+                } else if (c == '}' || c == ']') {
+                    Event event = close(c == '}');
+                    if (event != NONE) return event;
+                } else {
+                    state = BROKEN;
+                }
+                break;
+            default:
+                // Anything but whitespace after the document
+                state = BROKEN;
+                break;
+            }
+            break;
+        }
+    }
+    return state == BROKEN ? FAILED : NONE;
+}
@@ -0,0 +1,101 @@
+#ifndef JSONSCANNER_H
+#define JSONSCANNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming JSON reader with fixed memory, for the bodies the gateway gets
+// back from its peers. Text goes in as it arrives, in pieces split anywhere;
+// what comes out is one scalar value at a time, named by the keys of the
+// containers around it, plus the end of each object. Nothing is kept of the
+// document beyond the innermost value, so a peer's device list of any
+// length costs the same. Strings longer than MAX_VALUE are cut short, and
+// \u escapes come out as '?': peers only write them for control characters.
+class JsonScanner {
+public:
+    static const size_t MAX_DEPTH = 8;
+    static const size_t MAX_KEY = 15;
+    static const size_t MAX_VALUE = 63;
+
+    enum Event {
+        NONE,
+        VALUE,      // a string, number, true, false or null: see value()
+        OBJECT_END, // an object closed; depth() is that of its container
+        FAILED      // malformed or too deep; every later call returns it too
+    };
+
+    enum Kind {
+        STRING,
+        NUMBER,
+        BOOLEAN,
+        NUL
+    };
+
+private:
+    enum State {
+        VALUE_NEXT,       // a value, or ']' to close an empty array
+        KEY_OR_CLOSE,     // after '{'
+        KEY_NEXT,         // after ',' in an object
+        COLON,            // after a key
+        COMMA_OR_CLOSE,   // after a value
+        IN_STRING,
+        IN_ESCAPE,
+        IN_UNICODE,
+        IN_LITERAL,
+        FINISHED,
+        BROKEN
+    };
+
+    struct Level {
+        bool object;
+        uint16_t index; // element number within an array
+        char key[MAX_KEY + 1];
+    };
+
+    Level levels[MAX_DEPTH];
+    size_t levelCount = 0;
+    State state = VALUE_NEXT;
+    bool stringIsKey = false;
+    uint8_t unicodeLeft = 0;
+    Kind kind = NUL;
+    char text[MAX_VALUE + 1];
+    size_t textLen = 0;
+
+    void appendText(char c);
+    bool open(bool object);
+    // Ends a value at the current level
+    void valueDone();
+    Event close(bool object);
+    Event finishLiteral();
+
+public:
+    JsonScanner() { reset(); }
+
+    void reset();
+
+    // Reads from data until an event or the end of the input; used receives
+    // the number of bytes read. Call again with the rest for further events.
+    Event next(const char* data, size_t len, size_t& used);
+
+    // True once a whole document has been read
+    bool finished() const { return state == FINISHED; }
+
+    // Containers open around the current value or ending object
+    size_t depth() const { return levelCount; }
+    // Key of the current member of container level (0 is the outermost),
+    // "" within an array
+    const char* keyAt(size_t level) const;
+    // Element number within container level when it is an array
+    uint16_t indexAt(size_t level) const { return level < levelCount ? levels[level].index : 0; }
+    // The innermost key, "" within an array
+    const char* key() const { return levelCount ? keyAt(levelCount - 1) : ""; }
+
+    Kind valueKind() const { return kind; }
+    // The value's text: a string's contents unescaped, a number as written
+    const char* value() const { return text; }
+    bool isTrue() const { return kind == BOOLEAN && text[0] == 't'; }
+    // The number as an int; 0 for anything else
+    long toInt() const;
+};
+
+#endif // JSONSCANNER_H
@@ -0,0 +1,158 @@
+#include "ResponseParser.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+namespace {
+
+// The value of line when it is header name, else null
+const char* headerValue(const char* line, const char* name) {
+    size_t n = strlen(name);
+    if (strncasecmp(line, name, n) != 0 || line[n] != ':') return nullptr;
+    const char* value = line + n + 1;
+    while (*value == ' ' || *value == '\t') value++;
+    return value;
+}
+
+} // namespace
+
+void ResponseParser::reset(bool toHead) {
+    state = STATUS_LINE;
+    headOnly = toHead;
+    code = 0;
+    close = false;
+    chunked = false;
+    hasLength = false;
+    remaining = 0;
+    tag[0] = '\0';
+    lineLen = 0;
+    lineLong = false;
+}
+
+bool ResponseParser::readLine(const char* data, size_t len, size_t& used) {
+    while (used < len) {
+        char c = data[used++];
+        if (c == '\n') {
+            if (lineLen && line[lineLen - 1] == '\r') lineLen--;
+            line[lineLen] = '\0';
+            return true;
+        }
+        if (lineLen < MAX_LINE) {
+            line[lineLen++] = c;
+        } else {
+            lineLong = true;
+        }
+    }
+    return false;
+}
+
+void ResponseParser::statusLine() {
+    // HTTP/1.1 200 OK; an HTTP/1.0 peer closes after every response
+    if (strncmp(line, "HTTP/1.", 7) != 0 || lineLen < 12 || line[8] != ' ' || !isdigit(static_cast<unsigned char>(line[9]))) {
+        state = MALFORMED;
+        return;
+    }
+    close = line[7] == '0';
+    code = atoi(line + 9);
+    state = HEADER_LINE;
+}
+
+void ResponseParser::headerLine() {
+    const char* value;
+    if ((value = headerValue(line, "Content-Length"))) {
+        hasLength = true;
+        remaining = strtoul(value, nullptr, 10);
+    } else if ((value = headerValue(line, "Transfer-Encoding"))) {
+        chunked = strcasecmp(value, "chunked") == 0;
+    } else if ((value = headerValue(line, "Connection"))) {
+        close = strcasecmp(value, "close") == 0;
+    } else if ((value = headerValue(line, "ETag")) && !lineLong) {
+        size_t n = strlen(value);
+        if (n > MAX_ETAG) n = 0;
+        memcpy(tag, value, n);
+        tag[n] = '\0';
+    }
+}
+
+void ResponseParser::headEnd() {
+    if (headOnly || code == 204 || code == 304) {
+        state = COMPLETE;
+    } else if (chunked) {
+        state = CHUNK_SIZE;
+    } else if (hasLength) {
+        state = remaining ? BODY_LENGTH : COMPLETE;
+    } else {
+        // Only the close can end it, so the connection cannot be reused
+        close = true;
+        state = BODY_TO_CLOSE;
+    }
+}
+
+void ResponseParser::feed(const char* data, size_t len, size_t& used, const char*& body, size_t& bodyLen) {
+    used = 0;
+    body = nullptr;
+    bodyLen = 0;
+    while (used < len && state != COMPLETE && state != MALFORMED) {
+        switch (state) {
+        case STATUS_LINE:
+        case HEADER_LINE:
+        case TRAILER_LINE:
+            if (!readLine(data, len, used)) break;
+            if (state == STATUS_LINE) {
+                statusLine();
+            } else if (lineLen == 0) {
+                if (state == HEADER_LINE) {
+                    headEnd();
+                } else {
+                    state = COMPLETE;
+                }
+            } else if (state == HEADER_LINE) {
+                headerLine();
+            }
+            lineLen = 0;
+            lineLong = false;
+            break;
+        case BODY_LENGTH:
+        case BODY_TO_CLOSE:
+        case CHUNK_DATA: {
+            size_t n = len - used;
+            if (state != BODY_TO_CLOSE && n > remaining) n = remaining;
+            body = data + used;
+            bodyLen = n;
+            used += n;
+            if (state != BODY_TO_CLOSE) remaining -= n;
+            if (state == BODY_LENGTH && remaining == 0) state = COMPLETE;
+            if (state == CHUNK_DATA && remaining == 0) state = CHUNK_END;
+            return;
+        }
+        case CHUNK_SIZE:
+            if (!readLine(data, len, used)) break;
+            if (!isxdigit(static_cast<unsigned char>(line[0])) || lineLong) {
+                state = MALFORMED;
+                break;
+            }
+            // Extensions after the size are ignored
+            remaining = strtoul(line, nullptr, 16);
+            state = remaining ? CHUNK_DATA : TRAILER_LINE;
+            lineLen = 0;
+            lineLong = false;
+            break;
+        case CHUNK_END:
+            if (!readLine(data, len, used)) break;
+            state = lineLen == 0 ? CHUNK_SIZE : MALFORMED;
+            lineLen = 0;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void ResponseParser::closed() {
+    if (state == BODY_TO_CLOSE) {
+        state = COMPLETE;
+    } else if (state != COMPLETE) {
+        state = MALFORMED;
+    }
+}
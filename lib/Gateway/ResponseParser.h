@@ -0,0 +1,75 @@
+#ifndef RESPONSEPARSER_H
+#define RESPONSEPARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Incremental reader of one HTTP/1.1 response, for the gateway's peer
+// connections. Bytes go in as they are received; the body comes back out of
+// its framing (Content-Length, chunked, or up to the close) a piece at a
+// time, pointing into the caller's input, so nothing of it is buffered
+// here. Of the headers only the status, ETag, framing and Connection are
+// kept, read a line at a time; a longer line is cut short.
+class ResponseParser {
+public:
+    static const size_t MAX_LINE = 95;
+    static const size_t MAX_ETAG = 47;
+
+private:
+    enum State {
+        STATUS_LINE,
+        HEADER_LINE,
+        BODY_LENGTH,
+        BODY_TO_CLOSE,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_END,
+        TRAILER_LINE,
+        COMPLETE,
+        MALFORMED
+    };
+
+    State state = STATUS_LINE;
+    bool headOnly = false;
+    int code = 0;
+    bool close = false;
+    bool chunked = false;
+    bool hasLength = false;
+    size_t remaining = 0;
+    char tag[MAX_ETAG + 1];
+    char line[MAX_LINE + 1];
+    size_t lineLen = 0;
+    bool lineLong = false;
+
+    // Takes bytes up to the end of a line into `line`; true once it is there
+    bool readLine(const char* data, size_t len, size_t& used);
+    void statusLine();
+    void headerLine();
+    void headEnd();
+
+public:
+    ResponseParser() { reset(); }
+
+    // Ready for the next response. A response to HEAD, 204 and 304 has no
+    // body whatever its headers say.
+    void reset(bool toHead = false);
+
+    // Reads from data; used receives the number of bytes taken. Body bytes
+    // among them are pointed to by body and bodyLen (0 when none), one piece
+    // per call: call again with the rest until it is all used or the
+    // response is complete.
+    void feed(const char* data, size_t len, size_t& used, const char*& body, size_t& bodyLen);
+    // The connection closed; completes a body that runs to the close
+    void closed();
+
+    bool complete() const { return state == COMPLETE; }
+    bool malformed() const { return state == MALFORMED; }
+    // 0 until the status line is in
+    int status() const { return code; }
+    // The ETag header, quotes included; "" without one
+    const char* etag() const { return tag; }
+    // False when the peer will close the connection after this response
+    bool keepAlive() const { return !close; }
+};
+
+#endif // RESPONSEPARSER_H
@@ -0,0 +1,16 @@
+#include "GpioPort.h"
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+
+void gpioWriteOutputMasks(uint64_t setMask, uint64_t clearMask) {
+    uint32_t setLow = static_cast<uint32_t>(setMask);
+    uint32_t setHigh = static_cast<uint32_t>(setMask >> 32);
+    uint32_t clearLow = static_cast<uint32_t>(clearMask);
+    uint32_t clearHigh = static_cast<uint32_t>(clearMask >> 32);
+
+    // Pins 0-31 live in GPIO_OUT, 32-39 in GPIO_OUT1
+    if (setLow) REG_WRITE(GPIO_OUT_W1TS_REG, setLow);
+    if (clearLow) REG_WRITE(GPIO_OUT_W1TC_REG, clearLow);
+    if (setHigh) REG_WRITE(GPIO_OUT1_W1TS_REG, setHigh);
+    if (clearHigh) REG_WRITE(GPIO_OUT1_W1TC_REG, clearHigh);
+}
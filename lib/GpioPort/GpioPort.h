@@ -0,0 +1,11 @@
+#ifndef GPIOPORT_H
+#define GPIOPORT_H
+
+#include <stdint.h>
+
+// Bit n of a mask is GPIO n. Pins in setMask go high and pins in clearMask go
+// low through one write per output bank to the W1TS and W1TC registers, so
+// every pin in a batch changes together instead of one digitalWrite at a time.
+void gpioWriteOutputMasks(uint64_t setMask, uint64_t clearMask);
+
+#endif // GPIOPORT_H
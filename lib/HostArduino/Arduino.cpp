@@ -0,0 +1,194 @@
+#include "Arduino.h"
+#include "HostControl.h"
+#include "soc/gpio_reg.h"
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace {
+
+uint8_t pinModes[host::PIN_COUNT];
+uint8_t pinLevels[host::PIN_COUNT];
+uint16_t analogValues[host::PIN_COUNT];
+uint32_t writeCount = 0;
+uint32_t registerWriteCount = 0;
+bool serialEnabled = true;
+
+// A DevKit with WiFi and the server up, roughly
+uint32_t heapFree = 180000;
+uint32_t heapMinFree = 150000;
+uint32_t heapLargestBlock = 110000;
+
+const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+// While the virtual clock runs, time only moves through delay() and
+// host::advanceClock(). The offset keeps time monotonic once it stops.
+std::atomic<bool> virtualClock{false};
+std::atomic<uint64_t> virtualMicros{0};
+std::atomic<int64_t> clockOffsetUs{0};
+
+uint64_t realMicros() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - bootTime).count());
+}
+
+uint64_t nowMicros() {
+    return virtualClock ? virtualMicros.load() : realMicros() + clockOffsetUs;
+}
+
+} // namespace
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin < host::PIN_COUNT) pinModes[pin] = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin < host::PIN_COUNT) pinLevels[pin] = value ? HIGH : LOW;
+    writeCount++;
+}
+
+int digitalRead(uint8_t pin) {
+    return pin < host::PIN_COUNT ? pinLevels[pin] : LOW;
+}
+
+uint16_t analogRead(uint8_t pin) {
+    return pin < host::PIN_COUNT ? analogValues[pin] : 0;
+}
+
+unsigned long millis() {
+    return static_cast<unsigned long>(nowMicros() / 1000);
+}
+
+unsigned long micros() {
+    return static_cast<unsigned long>(nowMicros());
+}
+
+void delay(uint32_t ms) {
+    if (virtualClock) {
+        virtualMicros += uint64_t(ms) * 1000;
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+uint32_t esp_random() {
+    static std::random_device device;
+    return device();
+}
+
+uint32_t EspClass::getFreeHeap() {
+    return heapFree;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    return heapMinFree;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+    return heapLargestBlock;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    if (serialEnabled) fputc(c, stdout);
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* data, size_t size) {
+    if (serialEnabled) fwrite(data, 1, size, stdout);
+    return size;
+}
+
+namespace host {
+
+uint8_t pinMode(uint8_t pin) {
+    return pin < PIN_COUNT ? pinModes[pin] : 0;
+}
+
+uint8_t pinLevel(uint8_t pin) {
+    return pin < PIN_COUNT ? pinLevels[pin] : LOW;
+}
+
+void setPinLevel(uint8_t pin, uint8_t level) {
+    if (pin < PIN_COUNT) pinLevels[pin] = level ? HIGH : LOW;
+}
+
+void setAnalogValue(uint8_t pin, uint16_t value) {
+    if (pin < PIN_COUNT) analogValues[pin] = value;
+}
+
+uint32_t digitalWriteCount() {
+    return writeCount;
+}
+
+uint32_t gpioRegisterWriteCount() {
+    return registerWriteCount;
+}
+
+// Mock GPIO port: bank 0 covers pins 0-31, bank 1 pins 32-63
+void regWrite(uint32_t reg, uint32_t value) {
+    uint8_t base;
+    uint8_t level;
+    switch (reg) {
+    case GPIO_OUT_W1TS_REG: base = 0; level = HIGH; break;
+    case GPIO_OUT_W1TC_REG: base = 0; level = LOW; break;
+    case GPIO_OUT1_W1TS_REG: base = 32; level = HIGH; break;
+    case GPIO_OUT1_W1TC_REG: base = 32; level = LOW; break;
+    default: return;
+    }
+    registerWriteCount++;
+    for (uint8_t bit = 0; bit < 32; bit++) {
+        if (value & (1u << bit)) pinLevels[base + bit] = level;
+    }
+}
+
+uint32_t regRead(uint32_t reg) {
+    uint8_t base;
+    switch (reg) {
+    case GPIO_OUT_REG: base = 0; break;
+    case GPIO_OUT1_REG: base = 32; break;
+    default: return 0;
+    }
+    uint32_t value = 0;
+    for (uint8_t bit = 0; bit < 32; bit++) {
+        if (pinLevels[base + bit]) value |= 1u << bit;
+    }
+    return value;
+}
+
+void setSerialEnabled(bool enabled) {
+    serialEnabled = enabled;
+}
+
+void setHeap(uint32_t freeBytes, uint32_t minFreeBytes, uint32_t largestBlock) {
+    heapFree = freeBytes;
+    heapMinFree = minFreeBytes;
+    heapLargestBlock = largestBlock;
+}
+
+void setVirtualClock(bool enabled) {
+    if (enabled == virtualClock) return;
+    if (enabled) {
+        // Starts on a whole millisecond so millis() and micros() agree
+        virtualMicros = (realMicros() + clockOffsetUs + 999) / 1000 * 1000;
+        virtualClock = true;
+    } else {
+        clockOffsetUs = static_cast<int64_t>(virtualMicros - realMicros());
+        virtualClock = false;
+    }
+}
+
+void advanceClock(uint32_t ms) {
+    if (virtualClock) virtualMicros += uint64_t(ms) * 1000;
+}
+
+} // namespace host
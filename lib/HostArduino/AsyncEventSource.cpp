@@ -0,0 +1,36 @@
+#include "AsyncEventSource.h"
+
+void AsyncEventSourceClient::send(const char* message, const char* event, uint32_t id, uint32_t reconnect) {
+    String frame;
+    if (reconnect) {
+        frame += "retry: ";
+        frame.concat(static_cast<unsigned long>(reconnect));
+        frame += "\r\n";
+    }
+    if (id) {
+        frame += "id: ";
+        frame.concat(static_cast<unsigned long>(id));
+        frame += "\r\n";
+    }
+    if (event) {
+        frame += "event: ";
+        frame += event;
+        frame += "\r\n";
+    }
+    frame += "data: ";
+    frame += message;
+    frame += "\r\n\r\n";
+    sent.push_back(frame);
+}
+
+void AsyncEventSource::send(const char* message, const char* event, uint32_t id, uint32_t reconnect) {
+    for (auto& client : clients) client->send(message, event, id, reconnect);
+}
+
+AsyncEventSourceClient* AsyncEventSource::connect(AsyncWebServerRequest* request, uint32_t lastId) {
+    if (!filterRequest(request)) return nullptr;
+    clients.emplace_back(new AsyncEventSourceClient(lastId));
+    AsyncEventSourceClient* client = clients.back().get();
+    if (connectHandler) connectHandler(client);
+    return client;
+}
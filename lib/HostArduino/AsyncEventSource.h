@@ -0,0 +1,50 @@
+#ifndef HOST_ASYNCEVENTSOURCE_H
+#define HOST_ASYNCEVENTSOURCE_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "ESPAsyncWebServer.h"
+
+// Server-Sent Events stand-in. Clients are attached with the host-only
+// connect(); everything sent to a client is kept in SSE wire format.
+class AsyncEventSourceClient {
+private:
+    uint32_t lastEventId;
+    std::vector<String> sent;
+
+public:
+    explicit AsyncEventSourceClient(uint32_t lastId) : lastEventId(lastId) {}
+
+    uint32_t lastId() const { return lastEventId; }
+    bool connected() const { return true; }
+    void send(const char* message, const char* event = nullptr, uint32_t id = 0, uint32_t reconnect = 0);
+
+    // Host-only: messages delivered so far
+    const std::vector<String>& messages() const { return sent; }
+};
+
+typedef std::function<void(AsyncEventSourceClient* client)> ArEventHandlerFunction;
+
+class AsyncEventSource : public AsyncWebHandler {
+private:
+    String path;
+    ArEventHandlerFunction connectHandler;
+    std::vector<std::unique_ptr<AsyncEventSourceClient>> clients;
+
+public:
+    explicit AsyncEventSource(const String& url) : path(url) {}
+
+    const char* url() const { return path.c_str(); }
+    void onConnect(ArEventHandlerFunction cb) { connectHandler = cb; }
+    void send(const char* message, const char* event = nullptr, uint32_t id = 0, uint32_t reconnect = 0);
+    size_t count() const { return clients.size(); }
+
+    // Host-only: open a stream for request (subject to the handler filter),
+    // resuming from lastId as a Last-Event-ID header would. Null if filtered.
+    AsyncEventSourceClient* connect(AsyncWebServerRequest* request, uint32_t lastId = 0);
+    // Host-only: forget every client, as if their connections had closed
+    void disconnectAll() { clients.clear(); }
+};
+
+#endif // HOST_ASYNCEVENTSOURCE_H
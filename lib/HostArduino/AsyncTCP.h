@@ -0,0 +1,19 @@
+#ifndef HOST_ASYNCTCP_H
+#define HOST_ASYNCTCP_H
+
+#include "IPAddress.h"
+
+// The native build has no TCP stack; ESPAsyncWebServer.h provides the
+// in-process request/response fake. A client only carries its peer address.
+class AsyncClient {
+private:
+    IPAddress remote;
+
+public:
+    IPAddress remoteIP() const { return remote; }
+
+    // Host-only: the address the request appears to come from
+    void setRemoteIP(const IPAddress& ip) { remote = ip; }
+};
+
+#endif // HOST_ASYNCTCP_H
@@ -0,0 +1,4 @@
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#endif // HOST_EEPROM_H
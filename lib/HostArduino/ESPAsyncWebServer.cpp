@@ -0,0 +1,200 @@
+#include "ESPAsyncWebServer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+namespace {
+
+const AsyncWebHeader* findHeader(const std::vector<AsyncWebHeader>& headers, const char* name) {
+    for (const AsyncWebHeader& h : headers) {
+        if (strcasecmp(h.name().c_str(), name) == 0) return &h;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+const AsyncWebHeader* AsyncWebServerResponse::header(const char* name) const {
+    return findHeader(headerList, name);
+}
+
+size_t AsyncWebServerResponse::read(uint8_t* buffer, size_t maxLen) {
+    if (finished) return 0;
+    size_t n;
+    if (filler) {
+        if (!chunked() && maxLen > _contentLength - sent) maxLen = _contentLength - sent;
+        n = maxLen ? filler(buffer, maxLen, sent) : 0;
+    } else {
+        n = body.length() - sent;
+        if (n > maxLen) n = maxLen;
+        memcpy(buffer, body.c_str() + sent, n);
+    }
+    if (n == 0) finished = true;
+    sent += n;
+    return n;
+}
+
+size_t AsyncWebServerResponse::drain() {
+    uint8_t chunk[TCP_MSS];
+    size_t total = 0;
+    size_t n;
+    while ((n = read(chunk, sizeof(chunk))) > 0) total += n;
+    return total;
+}
+
+String AsyncWebServerResponse::readAll() {
+    uint8_t chunk[TCP_MSS];
+    String result;
+    size_t n;
+    while ((n = read(chunk, sizeof(chunk))) > 0) result.concat(reinterpret_cast<const char*>(chunk), n);
+    return result;
+}
+
+AsyncWebServerRequest::AsyncWebServerRequest(WebRequestMethodComposite method, const String& url) : requestMethod(method) {
+    int query = url.indexOf('?');
+    if (query < 0) {
+        requestUrl = url;
+        return;
+    }
+    requestUrl = url.substring(0, query);
+
+    size_t pos = query + 1;
+    while (pos < url.length()) {
+        int amp = url.indexOf('&', pos);
+        size_t end = amp < 0 ? url.length() : static_cast<size_t>(amp);
+        String pair = url.substring(pos, end);
+        int eq = pair.indexOf('=');
+        if (eq < 0) {
+            paramList.emplace_back(pair, String());
+        } else {
+            paramList.emplace_back(pair.substring(0, eq), pair.substring(eq + 1));
+        }
+        pos = end + 1;
+    }
+}
+
+AsyncWebServerRequest::~AsyncWebServerRequest() {
+    if (disconnectHandler) disconnectHandler();
+    delete lastResponse;
+    free(_tempObject);
+}
+
+const AsyncWebHeader* AsyncWebServerRequest::getHeader(const char* name) const {
+    return findHeader(headerList, name);
+}
+
+void AsyncWebServerRequest::removeNotInterestingHeaders() {
+    for (const String& name : interestingHeaders) {
+        if (name.equalsIgnoreCase("ANY")) return;
+    }
+    std::vector<AsyncWebHeader> kept;
+    for (const AsyncWebHeader& h : headerList) {
+        for (const String& name : interestingHeaders) {
+            if (name.equalsIgnoreCase(h.name())) {
+                kept.push_back(h);
+                break;
+            }
+        }
+    }
+    headerList.swap(kept);
+}
+
+const AsyncWebParameter* AsyncWebServerRequest::getParam(const char* name) const {
+    for (const AsyncWebParameter& p : paramList) {
+        if (p.name() == name) return &p;
+    }
+    return nullptr;
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(int code, const String& contentType, const String& content) {
+    return new AsyncWebServerResponse(code, contentType, content);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(const String& contentType, size_t len, AwsResponseFiller callback) {
+    return new AsyncWebServerResponse(200, contentType, callback, len);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse_P(int code, const String& contentType, const uint8_t* content, size_t len) {
+    AwsResponseFiller filler = [content, len](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+        size_t n = len - index < maxLen ? len - index : maxLen;
+        memcpy(buffer, content + index, n);
+        return n;
+    };
+    return new AsyncWebServerResponse(code, contentType, filler, len);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse_P(int code, const String& contentType, PGM_P content) {
+    return beginResponse_P(code, contentType, reinterpret_cast<const uint8_t*>(content), strlen(content));
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginChunkedResponse(const String& contentType, AwsResponseFiller callback) {
+    return new AsyncWebServerResponse(200, contentType, callback);
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse* response) {
+    delete lastResponse;
+    lastResponse = response;
+    sendCount++;
+}
+
+void AsyncWebServerRequest::send(int code, const String& contentType, const String& content) {
+    send(beginResponse(code, contentType, content));
+}
+
+void AsyncWebServer::on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest) {
+    routes.push_back(Route{uri, method, onRequest, nullptr, nullptr});
+}
+
+void AsyncWebServer::on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                        ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody) {
+    (void)onUpload;
+    routes.push_back(Route{uri, method, onRequest, onBody, nullptr});
+}
+
+AsyncWebHandler& AsyncWebServer::addHandler(AsyncWebHandler* handler) {
+    routes.push_back(Route{String(), 0, nullptr, nullptr, handler});
+    return *handler;
+}
+
+namespace {
+
+// Hands body to onBody in chunks of `chunk` bytes; handlers may parse in
+// place, as they may the pbuf payload
+template <typename OnBody>
+void deliverBody(AsyncWebServerRequest* request, const uint8_t* body, size_t len, size_t chunk, OnBody onBody) {
+    if (!body || len == 0) return;
+    std::vector<uint8_t> segment;
+    if (chunk == 0 || chunk > len) chunk = len;
+    for (size_t index = 0; index < len; index += chunk) {
+        size_t n = len - index < chunk ? len - index : chunk;
+        segment.assign(body + index, body + index + n);
+        onBody(request, segment.data(), n, index, len);
+    }
+}
+
+} // namespace
+
+void AsyncWebServer::dispatch(AsyncWebServerRequest* request, const uint8_t* body, size_t len, size_t chunk) {
+    const String& url = request->url();
+    request->setContentLength(body ? len : 0);
+    for (const Route& route : routes) {
+        if (route.handler) {
+            AsyncWebHandler* handler = route.handler;
+            if (!handler->filterRequest(request) || !handler->canHandle(request)) continue;
+            request->removeNotInterestingHeaders();
+            deliverBody(request, body, len, chunk,
+                        [handler](AsyncWebServerRequest* r, uint8_t* data, size_t n, size_t index, size_t total) {
+                            handler->handleBody(r, data, n, index, total);
+                        });
+            handler->handleRequest(request);
+            return;
+        }
+        if (!(route.method & request->method())) continue;
+        if (url != route.uri && !url.startsWith(route.uri + "/")) continue;
+
+        if (route.onBody) deliverBody(request, body, len, chunk, route.onBody);
+        if (route.onRequest) route.onRequest(request);
+        return;
+    }
+    if (notFound) notFound(request);
+}
@@ -0,0 +1,244 @@
+#ifndef HOST_ESPASYNCWEBSERVER_H
+#define HOST_ESPASYNCWEBSERVER_H
+
+#include <functional>
+#include <vector>
+#include "Arduino.h"
+#include "AsyncTCP.h"
+
+// In-process stand-in for ESPAsyncWebServer. Requests are built by the caller,
+// or by SocketServer from real connections, and dispatched synchronously;
+// the last response sent on a request is kept on it for inspection.
+
+typedef enum {
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebServerRequest;
+
+typedef std::function<void(AsyncWebServerRequest* request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total)> ArBodyHandlerFunction;
+typedef std::function<size_t(uint8_t* buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+typedef std::function<bool(AsyncWebServerRequest* request)> ArRequestFilterFunction;
+typedef std::function<void(void)> ArDisconnectHandler;
+
+class AsyncWebParameter {
+private:
+    String paramName;
+    String paramValue;
+
+public:
+    AsyncWebParameter(const String& name, const String& value) : paramName(name), paramValue(value) {}
+    const String& name() const { return paramName; }
+    const String& value() const { return paramValue; }
+};
+
+class AsyncWebHeader {
+private:
+    String headerName;
+    String headerValue;
+
+public:
+    AsyncWebHeader(const String& name, const String& value) : headerName(name), headerValue(value) {}
+    const String& name() const { return headerName; }
+    const String& value() const { return headerValue; }
+};
+
+// Either a fixed body or a chunked filler. The host side pulls the body out
+// with read(), in the same MSS-sized pieces AsyncTCP would ask for.
+class AsyncWebServerResponse {
+protected:
+    // Named as in ESPAsyncWebServer, for subclasses that set them
+    int _code;
+    String _contentType;
+    size_t _contentLength = SIZE_MAX;
+    // Set together by a subclass streaming a body of unknown length
+    bool _sendContentLength = true;
+    bool _chunked = false;
+
+private:
+    String body;
+    AwsResponseFiller filler;
+    size_t sent = 0;
+    bool finished = false;
+    std::vector<AsyncWebHeader> headerList;
+    std::vector<String> interestingHeaders;
+
+public:
+    static const size_t TCP_MSS = 1436;
+
+    AsyncWebServerResponse(int code, const String& contentType, const String& content)
+        : _code(code), _contentType(contentType), body(content) {}
+    AsyncWebServerResponse(int code, const String& contentType, AwsResponseFiller fill, size_t len = SIZE_MAX)
+        : _code(code), _contentType(contentType), _contentLength(len), filler(fill) {}
+    virtual ~AsyncWebServerResponse() {}
+
+protected:
+    // For AsyncAbstractResponse, whose subclass sets the type
+    AsyncWebServerResponse(int code, AwsResponseFiller fill, size_t len) : _code(code), _contentLength(len), filler(fill) {}
+
+public:
+
+    void addHeader(const String& name, const String& value) { headerList.emplace_back(name, value); }
+    void setCode(int code) { _code = code; }
+
+    int code() const { return _code; }
+    const String& contentType() const { return _contentType; }
+    bool chunked() const { return filler && (_chunked || _contentLength == SIZE_MAX); }
+    const AsyncWebHeader* header(const char* name) const;
+    // Host-only: every header added, in order
+    const std::vector<AsyncWebHeader>& headers() const { return headerList; }
+
+    // Host-only: next piece of the body, 0 once it is complete
+    size_t read(uint8_t* buffer, size_t maxLen);
+    // Host-only: drain the rest of the body through a fixed buffer, returning its length
+    size_t drain();
+    // Host-only: the rest of the body as a String
+    String readAll();
+};
+
+// Base for responses that produce their own body, as in ESPAsyncWebServer:
+// a subclass sets _code, _contentType and _contentLength and fills the
+// buffers the server hands it, in order.
+class AsyncAbstractResponse : public AsyncWebServerResponse {
+public:
+    AsyncAbstractResponse()
+        : AsyncWebServerResponse(200, [this](uint8_t* buffer, size_t maxLen, size_t) -> size_t {
+              return _sourceValid() ? _fillBuffer(buffer, maxLen) : 0;
+          }, 0) {}
+
+    virtual bool _sourceValid() const { return false; }
+    virtual size_t _fillBuffer(uint8_t* buf, size_t maxLen) { return 0; }
+};
+
+class AsyncWebServerRequest {
+private:
+    WebRequestMethodComposite requestMethod;
+    String requestUrl;
+    std::vector<AsyncWebHeader> headerList;
+    std::vector<String> interestingHeaders;
+    std::vector<AsyncWebParameter> paramList;
+    AsyncWebServerResponse* lastResponse = nullptr;
+    size_t sendCount = 0;
+    AsyncClient tcpClient;
+    ArDisconnectHandler disconnectHandler;
+    size_t bodyLength = 0;
+
+public:
+    void* _tempObject = nullptr;
+
+    // A query string in url is split off into GET parameters
+    AsyncWebServerRequest(WebRequestMethodComposite method, const String& url);
+    AsyncWebServerRequest(const AsyncWebServerRequest&) = delete;
+    AsyncWebServerRequest& operator=(const AsyncWebServerRequest&) = delete;
+    // Runs the onDisconnect callback, as closing the connection does
+    ~AsyncWebServerRequest();
+
+    WebRequestMethodComposite method() const { return requestMethod; }
+    const String& url() const { return requestUrl; }
+    // From Content-Length, so 0 when there is no body
+    size_t contentLength() const { return bodyLength; }
+    // Host-only: AsyncWebServer::dispatch() sets it to the body it delivers
+    void setContentLength(size_t length) { bodyLength = length; }
+    AsyncClient* client() { return &tcpClient; }
+    void onDisconnect(ArDisconnectHandler fn) { disconnectHandler = fn; }
+
+    void addHeader(const String& name, const String& value) { headerList.emplace_back(name, value); }
+    // As in the real server, the headers no handler asked for ("ANY" keeps
+    // them all) are dropped once an addHandler() handler takes the request
+    void addInterestingHeader(const String& name) { interestingHeaders.push_back(name); }
+    // Host-only: AsyncWebServer::dispatch() calls it after picking the handler
+    void removeNotInterestingHeaders();
+    bool hasHeader(const char* name) const { return getHeader(name) != nullptr; }
+    const AsyncWebHeader* getHeader(const char* name) const;
+    bool hasParam(const char* name) const { return getParam(name) != nullptr; }
+    const AsyncWebParameter* getParam(const char* name) const;
+    size_t params() const { return paramList.size(); }
+    const AsyncWebParameter* getParam(size_t index) const { return index < paramList.size() ? &paramList[index] : nullptr; }
+
+    AsyncWebServerResponse* beginResponse(int code, const String& contentType = String(), const String& content = String());
+    AsyncWebServerResponse* beginResponse(const String& contentType, size_t len, AwsResponseFiller callback);
+    // Body is read from content while sending, never copied
+    AsyncWebServerResponse* beginResponse_P(int code, const String& contentType, const uint8_t* content, size_t len);
+    AsyncWebServerResponse* beginResponse_P(int code, const String& contentType, PGM_P content);
+    AsyncWebServerResponse* beginChunkedResponse(const String& contentType, AwsResponseFiller callback);
+    void send(AsyncWebServerResponse* response);
+    void send(int code, const String& contentType = String(), const String& content = String());
+
+    // Host-only: the response most recently passed to send(), or null
+    AsyncWebServerResponse* response() const { return lastResponse; }
+    // Host-only: how many times send() was called
+    size_t sends() const { return sendCount; }
+};
+
+class AsyncWebHandler {
+protected:
+    ArRequestFilterFunction filter;
+
+public:
+    virtual ~AsyncWebHandler() {}
+    AsyncWebHandler& setFilter(ArRequestFilterFunction fn) {
+        filter = fn;
+        return *this;
+    }
+    bool filterRequest(AsyncWebServerRequest* request) const { return !filter || filter(request); }
+    virtual bool canHandle(AsyncWebServerRequest* request) {
+        (void)request;
+        return false;
+    }
+    virtual void handleRequest(AsyncWebServerRequest* request) { (void)request; }
+    virtual void handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+        (void)request;
+        (void)data;
+        (void)len;
+        (void)index;
+        (void)total;
+    }
+    virtual bool isRequestHandlerTrivial() { return true; }
+};
+
+class AsyncWebServer {
+private:
+    struct Route {
+        String uri;
+        WebRequestMethodComposite method;
+        ArRequestHandlerFunction onRequest;
+        ArBodyHandlerFunction onBody;
+        AsyncWebHandler* handler; // set for addHandler() entries instead
+    };
+
+    std::vector<Route> routes;
+    ArRequestHandlerFunction notFound;
+
+public:
+    explicit AsyncWebServer(uint16_t port) { (void)port; }
+
+    void on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
+    void on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+            ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody = nullptr);
+    AsyncWebHandler& addHandler(AsyncWebHandler* handler);
+    void onNotFound(ArRequestHandlerFunction fn) { notFound = fn; }
+    void begin() {}
+
+    // Host-only: route a request the way AsyncCallbackWebHandler does (first
+    // registered match wins, "/x" also matches "/x/..."), delivering the body
+    // before the request callback in chunks of `chunk` bytes (0: all at
+    // once), each in a scratch buffer as writable as a pbuf. Handlers added
+    // with addHandler() take part in the same order through canHandle(); one
+    // that takes the request gets the body through handleBody().
+    void dispatch(AsyncWebServerRequest* request, const uint8_t* body = nullptr, size_t len = 0, size_t chunk = 0);
+};
+
+#include "AsyncEventSource.h"
+
+#endif // HOST_ESPASYNCWEBSERVER_H
@@ -0,0 +1,137 @@
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Arduino.h"
+#include "HostControl.h"
+
+struct HostSemaphore {
+    std::timed_mutex lock;
+};
+
+struct HostTask {
+    std::mutex lock;
+    std::condition_variable wake;
+    uint32_t notifications = 0;
+};
+
+namespace {
+
+// Handle of the task running on this thread; null for the main thread
+thread_local HostTask* currentTask = nullptr;
+
+std::atomic<bool> tasksHeld{false};
+// Every task created, to wake them when the hold ends
+std::mutex tasksLock;
+std::vector<HostTask*> tasks;
+
+} // namespace
+
+namespace host {
+
+void holdNotifiedTasks(bool held) {
+    tasksHeld = held;
+    if (held) return;
+    std::lock_guard<std::mutex> guard(tasksLock);
+    for (HostTask* task : tasks) {
+        // Taking the task's lock orders this after a wait that saw the hold
+        std::lock_guard<std::mutex> taskGuard(task->lock);
+        task->wake.notify_one();
+    }
+}
+
+} // namespace host
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stackDepth, void* parameter,
+                                   UBaseType_t priority, TaskHandle_t* createdTask, BaseType_t coreId) {
+    (void)name;
+    (void)stackDepth;
+    (void)priority;
+    (void)coreId;
+
+    // Tasks never return, so their control blocks are never freed
+    HostTask* task = new HostTask();
+    if (createdTask) *createdTask = task;
+    {
+        std::lock_guard<std::mutex> guard(tasksLock);
+        tasks.push_back(task);
+    }
+    std::thread([code, parameter, task] {
+        currentTask = task;
+        code(parameter);
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        task->notifications++;
+    }
+    task->wake.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+    HostTask* task = currentTask;
+    if (!task) return 0;
+
+    std::unique_lock<std::mutex> guard(task->lock);
+    auto pending = [task] { return !tasksHeld && task->notifications > 0; };
+    if (ticksToWait == portMAX_DELAY) {
+        task->wake.wait(guard, pending);
+    } else {
+        task->wake.wait_for(guard, std::chrono::milliseconds(ticksToWait), pending);
+    }
+    task->wake.wait(guard, [] { return !tasksHeld; });
+
+    uint32_t count = task->notifications;
+    if (count > 0) task->notifications = clearCountOnExit ? 0 : count - 1;
+    return count;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+    }
+}
+
+void vTaskDelayUntil(TickType_t* previousWakeTime, TickType_t ticks) {
+    TickType_t wake = *previousWakeTime + ticks;
+    *previousWakeTime = wake;
+    // Polls so it also follows the virtual clock
+    while (static_cast<int32_t>(wake - xTaskGetTickCount()) > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+TickType_t xTaskGetTickCount() {
+    return static_cast<TickType_t>(millis());
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return new HostSemaphore();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+    if (ticksToWait == portMAX_DELAY) {
+        semaphore->lock.lock();
+        return pdTRUE;
+    }
+    return semaphore->lock.try_lock_for(std::chrono::milliseconds(ticksToWait)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    semaphore->lock.unlock();
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    delete semaphore;
+}
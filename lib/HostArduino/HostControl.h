@@ -0,0 +1,77 @@
+#ifndef HOST_CONTROL_H
+#define HOST_CONTROL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hooks into the native stand-ins, used by benchmarks and host tooling to
+// observe GPIO state and silence serial output.
+namespace host {
+
+const uint8_t PIN_COUNT = 64;
+
+uint8_t pinMode(uint8_t pin);
+uint8_t pinLevel(uint8_t pin);
+// What an input pin reads: its level for digitalRead, and the 12-bit value
+// for analogRead
+void setPinLevel(uint8_t pin, uint8_t level);
+void setAnalogValue(uint8_t pin, uint16_t value);
+uint32_t digitalWriteCount();
+
+// Writes to the mocked GPIO output set/clear registers
+uint32_t gpioRegisterWriteCount();
+
+void setSerialEnabled(bool enabled);
+
+// What ESP.getFreeHeap(), getMinFreeHeap() and getMaxAllocHeap() report
+void setHeap(uint32_t freeBytes, uint32_t minFreeBytes, uint32_t largestBlock);
+
+// millis()/micros() stop following real time and only move through
+// advanceClock() and delay(), which then returns at once. Time stays
+// monotonic when it is switched off again.
+void setVirtualClock(bool enabled);
+void advanceClock(uint32_t ms);
+
+// While held, a task waiting in ulTaskNotifyTake stays asleep through
+// notifications and timeouts, as if suspended there; used to back work up
+// behind a task
+void holdNotifiedTasks(bool held);
+
+// Preferences put* calls so far, i.e. NVS writes
+uint32_t preferenceWriteCount();
+// The next Preferences write keeps only its first keepBytes bytes, as if
+// power failed halfway through it
+void tearNextPreferenceWrite(size_t keepBytes);
+// Drops every namespace, like erasing the NVS partition
+void clearPreferences();
+
+// Mock WiFi: how long association and the DHCP lease take, whether the
+// access point answers at all, and how many associations were started
+void setWiFiTiming(uint32_t associateMs, uint32_t dhcpMs);
+void setWiFiReachable(bool reachable);
+uint32_t wifiAssociationCount();
+// The access point goes away, as if out of range
+void dropWiFi();
+
+// Mock LEDC: every duty step (durationMs 0) and fade, in the order started
+struct LedcFade {
+    uint8_t channel;
+    int pin;
+    uint32_t fromDuty;
+    uint32_t toDuty;
+    uint32_t startMs;
+    uint32_t durationMs;
+};
+size_t ledcFadeCount();
+bool ledcFade(size_t index, LedcFade& out);
+void clearLedcFades();
+// Duty of a channel at millis(), part way along a running fade
+uint32_t ledcDuty(uint8_t channel);
+// Pin routed to a channel, -1 once stopped
+int ledcPin(uint8_t channel);
+// Calls that would have blocked behind a running fade on the device
+uint32_t ledcBlockedCalls();
+
+} // namespace host
+
+#endif // HOST_CONTROL_H
@@ -0,0 +1,12 @@
+#include "IPAddress.h"
+#include <stdio.h>
+
+String IPAddress::toString() const {
+    char tmp[16];
+    snprintf(tmp, sizeof(tmp), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+    return String(tmp);
+}
+
+size_t IPAddress::printTo(Print& p) const {
+    return p.print(toString());
+}
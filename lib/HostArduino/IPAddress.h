@@ -0,0 +1,33 @@
+#ifndef HOST_IPADDRESS_H
+#define HOST_IPADDRESS_H
+
+#include <stdint.h>
+#include "Print.h"
+
+class IPAddress : public Printable {
+private:
+    uint8_t octets[4];
+
+public:
+    IPAddress() : octets{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+    explicit IPAddress(uint32_t address) {
+        for (int i = 0; i < 4; i++) octets[i] = static_cast<uint8_t>(address >> (8 * i));
+    }
+
+    operator uint32_t() const {
+        return octets[0] | (octets[1] << 8) | (octets[2] << 16) | (static_cast<uint32_t>(octets[3]) << 24);
+    }
+    bool operator==(const IPAddress& other) const { return uint32_t(*this) == uint32_t(other); }
+    bool operator!=(const IPAddress& other) const { return !(*this == other); }
+    uint8_t operator[](int index) const { return octets[index]; }
+    uint8_t& operator[](int index) { return octets[index]; }
+
+    String toString() const;
+    size_t printTo(Print& p) const override;
+};
+
+// Passed to WiFi.config() to go back to DHCP
+#define INADDR_NONE IPAddress(0, 0, 0, 0)
+
+#endif // HOST_IPADDRESS_H
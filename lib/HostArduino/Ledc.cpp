@@ -0,0 +1,143 @@
+#include "driver/ledc.h"
+#include "Arduino.h"
+#include "HostControl.h"
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Channel {
+    int pin = -1;
+    host::LedcFade fade = {}; // the step or fade that set the current duty
+    uint32_t busyUntil = 0;   // a fade holds the channel until then
+    bool busy = false;
+};
+
+std::mutex lock;
+Channel channels[LEDC_CHANNEL_MAX];
+std::vector<host::LedcFade> fades;
+uint32_t timerResolution = 0;
+uint32_t blockedCalls = 0;
+
+uint32_t dutyAt(const host::LedcFade& fade, uint32_t now) {
+    uint32_t elapsed = now - fade.startMs;
+    if (fade.durationMs == 0 || elapsed >= fade.durationMs) return fade.toDuty;
+    int64_t span = static_cast<int64_t>(fade.toDuty) - fade.fromDuty;
+    return static_cast<uint32_t>(fade.fromDuty + span * elapsed / fade.durationMs);
+}
+
+// Starts a step (durationMs 0) or fade from wherever the channel is now. As
+// in the IDF 4.4 driver, a fade cannot be cut short: a call made while one
+// runs would block until it ended, so it is counted and takes effect then.
+esp_err_t start(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty, uint32_t durationMs) {
+    if (mode >= LEDC_SPEED_MODE_MAX || channel >= LEDC_CHANNEL_MAX) return ESP_FAIL;
+    uint32_t now = millis();
+    std::lock_guard<std::mutex> guard(lock);
+    Channel& state = channels[channel];
+    if (state.busy && static_cast<int32_t>(now - state.busyUntil) < 0) {
+        blockedCalls++;
+        now = state.busyUntil;
+    }
+    host::LedcFade fade;
+    fade.channel = static_cast<uint8_t>(channel);
+    fade.pin = state.pin;
+    fade.fromDuty = dutyAt(state.fade, now);
+    fade.toDuty = duty;
+    fade.startMs = now;
+    fade.durationMs = durationMs;
+    state.fade = fade;
+    state.busy = durationMs > 0;
+    state.busyUntil = now + durationMs;
+    fades.push_back(fade);
+    return ESP_OK;
+}
+
+} // namespace
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t* config) {
+    timerResolution = config->duty_resolution;
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t* config) {
+    if (config->channel >= LEDC_CHANNEL_MAX || timerResolution == 0) return ESP_FAIL;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        channels[config->channel].pin = config->gpio_num;
+    }
+    return start(config->speed_mode, config->channel, config->duty, 0);
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags) {
+    (void)intr_alloc_flags;
+    return ESP_OK;
+}
+
+// Does not wait for a running fade, which keeps the channel until it ends
+esp_err_t ledc_stop(ledc_mode_t mode, ledc_channel_t channel, uint32_t idle_level) {
+    if (mode >= LEDC_SPEED_MODE_MAX || channel >= LEDC_CHANNEL_MAX) return ESP_FAIL;
+    uint32_t now = millis();
+    std::lock_guard<std::mutex> guard(lock);
+    Channel& state = channels[channel];
+    host::LedcFade fade;
+    fade.channel = static_cast<uint8_t>(channel);
+    fade.pin = state.pin;
+    fade.fromDuty = dutyAt(state.fade, now);
+    fade.toDuty = idle_level ? (1u << timerResolution) : 0;
+    fade.startMs = now;
+    fade.durationMs = 0;
+    state.fade = fade;
+    state.pin = -1;
+    fades.push_back(fade);
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty_and_update(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty, uint32_t hpoint) {
+    (void)hpoint;
+    return start(mode, channel, duty, 0);
+}
+
+esp_err_t ledc_set_fade_time_and_start(ledc_mode_t mode, ledc_channel_t channel, uint32_t target_duty,
+                                       uint32_t max_fade_time_ms, ledc_fade_mode_t fade_mode) {
+    (void)fade_mode;
+    return start(mode, channel, target_duty, max_fade_time_ms);
+}
+
+namespace host {
+
+size_t ledcFadeCount() {
+    std::lock_guard<std::mutex> guard(lock);
+    return fades.size();
+}
+
+bool ledcFade(size_t index, LedcFade& out) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (index >= fades.size()) return false;
+    out = fades[index];
+    return true;
+}
+
+void clearLedcFades() {
+    std::lock_guard<std::mutex> guard(lock);
+    fades.clear();
+}
+
+uint32_t ledcBlockedCalls() {
+    std::lock_guard<std::mutex> guard(lock);
+    return blockedCalls;
+}
+
+uint32_t ledcDuty(uint8_t channel) {
+    if (channel >= LEDC_CHANNEL_MAX) return 0;
+    uint32_t now = millis();
+    std::lock_guard<std::mutex> guard(lock);
+    return dutyAt(channels[channel].fade, now);
+}
+
+int ledcPin(uint8_t channel) {
+    if (channel >= LEDC_CHANNEL_MAX) return -1;
+    std::lock_guard<std::mutex> guard(lock);
+    return channels[channel].pin;
+}
+
+} // namespace host
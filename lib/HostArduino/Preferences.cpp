@@ -0,0 +1,141 @@
+#include "Preferences.h"
+#include <HostControl.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <string.h>
+
+namespace {
+
+typedef std::map<std::string, std::vector<uint8_t>> Namespace;
+
+std::map<std::string, Namespace>& store() {
+    static std::map<std::string, Namespace> nvs;
+    return nvs;
+}
+
+uint32_t writes = 0;
+bool tearNext = false;
+size_t tornLength = 0;
+
+} // namespace
+
+namespace host {
+
+uint32_t preferenceWriteCount() {
+    return writes;
+}
+
+void tearNextPreferenceWrite(size_t keepBytes) {
+    tearNext = true;
+    tornLength = keepBytes;
+}
+
+void clearPreferences() {
+    store().clear();
+}
+
+} // namespace host
+
+bool Preferences::begin(const char* name, bool ro) {
+    if (started) end();
+    ns = name;
+    readOnly = ro;
+    started = true;
+    return true;
+}
+
+void Preferences::end() {
+    started = false;
+}
+
+bool Preferences::clear() {
+    if (!started || readOnly) return false;
+    store()[ns.c_str()].clear();
+    return true;
+}
+
+bool Preferences::remove(const char* key) {
+    if (!started || readOnly) return false;
+    return store()[ns.c_str()].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char* key) const {
+    if (!started) return false;
+    const Namespace& entries = store()[ns.c_str()];
+    return entries.find(key) != entries.end();
+}
+
+bool Preferences::put(const char* key, const void* value, size_t len) {
+    if (!started || readOnly) return false;
+    const uint8_t* bytes = static_cast<const uint8_t*>(value);
+    writes++;
+    if (tearNext) {
+        tearNext = false;
+        if (tornLength < len) len = tornLength;
+    }
+    store()[ns.c_str()][key].assign(bytes, bytes + len);
+    return true;
+}
+
+size_t Preferences::get(const char* key, void* value, size_t maxLen) const {
+    if (!started) return 0;
+    const Namespace& entries = store()[ns.c_str()];
+    auto it = entries.find(key);
+    if (it == entries.end() || it->second.size() > maxLen) return 0;
+    memcpy(value, it->second.data(), it->second.size());
+    return it->second.size();
+}
+
+size_t Preferences::putBool(const char* key, bool value) {
+    uint8_t v = value ? 1 : 0;
+    return put(key, &v, sizeof(v)) ? sizeof(v) : 0;
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+    return put(key, &value, sizeof(value)) ? sizeof(value) : 0;
+}
+
+size_t Preferences::putULong64(const char* key, uint64_t value) {
+    return put(key, &value, sizeof(value)) ? sizeof(value) : 0;
+}
+
+size_t Preferences::putString(const char* key, const char* value) {
+    size_t len = strlen(value);
+    return put(key, value, len + 1) ? len : 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+    return put(key, value, len) ? len : 0;
+}
+
+bool Preferences::getBool(const char* key, bool defaultValue) const {
+    uint8_t v;
+    return get(key, &v, sizeof(v)) == sizeof(v) ? v != 0 : defaultValue;
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) const {
+    uint32_t v;
+    return get(key, &v, sizeof(v)) == sizeof(v) ? v : defaultValue;
+}
+
+uint64_t Preferences::getULong64(const char* key, uint64_t defaultValue) const {
+    uint64_t v;
+    return get(key, &v, sizeof(v)) == sizeof(v) ? v : defaultValue;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) const {
+    char tmp[256];
+    return get(key, tmp, sizeof(tmp)) > 0 ? String(tmp) : defaultValue;
+}
+
+size_t Preferences::getBytesLength(const char* key) const {
+    if (!started) return 0;
+    const Namespace& entries = store()[ns.c_str()];
+    auto it = entries.find(key);
+    return it == entries.end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLen) const {
+    return get(key, buffer, maxLen);
+}
@@ -0,0 +1,42 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "WString.h"
+
+// In-memory NVS stand-in. All instances share one store, keyed by namespace,
+// so data written by one Preferences object is visible to the next begin().
+class Preferences {
+private:
+    String ns;
+    bool started = false;
+    bool readOnly = false;
+
+    bool put(const char* key, const void* value, size_t len);
+    size_t get(const char* key, void* value, size_t maxLen) const;
+
+public:
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+
+    bool clear();
+    bool remove(const char* key);
+    bool isKey(const char* key) const;
+
+    size_t putBool(const char* key, bool value);
+    size_t putUInt(const char* key, uint32_t value);
+    size_t putULong64(const char* key, uint64_t value);
+    size_t putString(const char* key, const char* value);
+    size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+    size_t putBytes(const char* key, const void* value, size_t len);
+
+    bool getBool(const char* key, bool defaultValue = false) const;
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0) const;
+    uint64_t getULong64(const char* key, uint64_t defaultValue = 0) const;
+    String getString(const char* key, const String& defaultValue = String()) const;
+    size_t getBytesLength(const char* key) const;
+    size_t getBytes(const char* key, void* buffer, size_t maxLen) const;
+};
+
+#endif // HOST_PREFERENCES_H
@@ -0,0 +1,40 @@
+#include "Print.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+size_t Print::write(const uint8_t* data, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        n += write(*data++);
+    }
+    return n;
+}
+
+size_t Print::print(long value) {
+    char tmp[24];
+    int n = snprintf(tmp, sizeof(tmp), "%ld", value);
+    return write(tmp, static_cast<size_t>(n));
+}
+
+size_t Print::print(unsigned long value) {
+    char tmp[24];
+    int n = snprintf(tmp, sizeof(tmp), "%lu", value);
+    return write(tmp, static_cast<size_t>(n));
+}
+
+size_t Print::print(double value, int digits) {
+    char tmp[48];
+    int n = snprintf(tmp, sizeof(tmp), "%.*f", digits, value);
+    return write(tmp, static_cast<size_t>(n));
+}
+
+size_t Print::printf(const char* format, ...) {
+    char tmp[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(tmp, sizeof(tmp), format, args);
+    va_end(args);
+    if (n < 0) return 0;
+    if (static_cast<size_t>(n) >= sizeof(tmp)) n = sizeof(tmp) - 1;
+    return write(tmp, static_cast<size_t>(n));
+}
@@ -0,0 +1,433 @@
+#include "SocketServer.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// netinet/tcp.h's, which would hide AsyncWebServerResponse::TCP_MSS
+#undef TCP_MSS
+
+struct SocketServer::Connection {
+    int fd;
+    IPAddress remote;
+    std::string input;
+    std::string output;
+    size_t written = 0;
+    bool closing = false;  // close once output is written
+    bool writable = false; // watching EPOLLOUT rather than EPOLLIN
+};
+
+namespace {
+
+// Offset and length of a piece of a request's head
+struct Span {
+    size_t at;
+    size_t length;
+};
+
+struct RequestHead {
+    WebRequestMethodComposite method = 0;
+    Span target = {0, 0};
+    std::vector<std::pair<Span, Span>> headers;
+    size_t length = 0; // of the head, blank line included
+    size_t bodyLength = 0;
+    bool keepAlive = true;
+};
+
+const char* reasonPhrase(int code) {
+    switch (code) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default: return "Unknown";
+    }
+}
+
+// HEAD is left out: its responses would need their bodies cut off
+WebRequestMethodComposite parseMethod(const char* name, size_t length) {
+    static const struct {
+        const char* name;
+        WebRequestMethod method;
+    } METHODS[] = {{"GET", HTTP_GET}, {"POST", HTTP_POST},   {"DELETE", HTTP_DELETE},
+                   {"PUT", HTTP_PUT}, {"PATCH", HTTP_PATCH}, {"OPTIONS", HTTP_OPTIONS}};
+    for (const auto& m : METHODS) {
+        if (strlen(m.name) == length && memcmp(m.name, name, length) == 0) return m.method;
+    }
+    return 0;
+}
+
+bool equalsIgnoreCase(const char* text, size_t length, const char* word) {
+    return strlen(word) == length && strncasecmp(text, word, length) == 0;
+}
+
+// Parses a request line and headers, the head's blank line excluded. 0, or
+// the status to refuse the request with.
+int parseHead(const char* head, size_t length, RequestHead& out) {
+    const char* end = head + length;
+    const char* line = head;
+    bool first = true;
+    while (line < end) {
+        const char* eol = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (!eol) eol = end;
+        size_t n = eol - line;
+        if (n > 0 && line[n - 1] == '\r') n--;
+
+        if (first) {
+            // METHOD SP target SP HTTP/1.x
+            const char* space = static_cast<const char*>(memchr(line, ' ', n));
+            const char* last = space ? static_cast<const char*>(memrchr(line, ' ', n)) : nullptr;
+            if (!space || last == space) return 400;
+            out.method = parseMethod(line, space - line);
+            if (!out.method) return 501;
+            out.target = {static_cast<size_t>(space + 1 - head), static_cast<size_t>(last - space - 1)};
+            if (out.target.length == 0 || space[1] != '/') return 400;
+            size_t versionLength = line + n - last - 1;
+            if (equalsIgnoreCase(last + 1, versionLength, "HTTP/1.0")) {
+                out.keepAlive = false;
+            } else if (!equalsIgnoreCase(last + 1, versionLength, "HTTP/1.1")) {
+                return 400;
+            }
+            first = false;
+        } else {
+            const char* colon = static_cast<const char*>(memchr(line, ':', n));
+            if (!colon || colon == line) return 400;
+            Span name = {static_cast<size_t>(line - head), static_cast<size_t>(colon - line)};
+            const char* value = colon + 1;
+            const char* valueEnd = line + n;
+            while (value < valueEnd && (*value == ' ' || *value == '\t')) value++;
+            while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) valueEnd--;
+            out.headers.emplace_back(name, Span{static_cast<size_t>(value - head), static_cast<size_t>(valueEnd - value)});
+
+            size_t valueLength = valueEnd - value;
+            if (equalsIgnoreCase(line, name.length, "Content-Length")) {
+                size_t bodyLength = 0;
+                if (valueLength == 0) return 400;
+                for (const char* c = value; c < valueEnd; c++) {
+                    if (*c < '0' || *c > '9') return 400;
+                    bodyLength = bodyLength * 10 + (*c - '0');
+                    if (bodyLength > SocketServer::MAX_BODY_BYTES) return 413;
+                }
+                out.bodyLength = bodyLength;
+            } else if (equalsIgnoreCase(line, name.length, "Transfer-Encoding")) {
+                return 501;
+            } else if (equalsIgnoreCase(line, name.length, "Connection")) {
+                if (equalsIgnoreCase(value, valueLength, "close")) out.keepAlive = false;
+                if (equalsIgnoreCase(value, valueLength, "keep-alive")) out.keepAlive = true;
+            }
+        }
+        line = eol + 1;
+    }
+    return first ? 400 : 0;
+}
+
+// A bodyless response for a request refused before dispatch
+void appendRefusal(std::string& out, int code) {
+    char head[128];
+    snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", code,
+             reasonPhrase(code));
+    out += head;
+}
+
+// Status line, headers and body of response, which is drained. Chunked
+// responses go out chunked, a chunk per read() as AsyncTCP would send them.
+void appendResponse(std::string& out, AsyncWebServerResponse* response, bool keepAlive) {
+    char line[160];
+    int code = response->code();
+    snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", code, reasonPhrase(code));
+    out += line;
+    if (!response->contentType().isEmpty()) {
+        out += "Content-Type: ";
+        out += response->contentType().c_str();
+        out += "\r\n";
+    }
+    for (const AsyncWebHeader& header : response->headers()) {
+        out += header.name().c_str();
+        out += ": ";
+        out += header.value().c_str();
+        out += "\r\n";
+    }
+    out += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+
+    uint8_t chunk[AsyncWebServerResponse::TCP_MSS];
+    size_t n;
+    if (response->chunked()) {
+        out += "Transfer-Encoding: chunked\r\n\r\n";
+        while ((n = response->read(chunk, sizeof(chunk))) > 0) {
+            snprintf(line, sizeof(line), "%zx\r\n", n);
+            out += line;
+            out.append(reinterpret_cast<const char*>(chunk), n);
+            out += "\r\n";
+        }
+        out += "0\r\n\r\n";
+        return;
+    }
+
+    std::string body;
+    while ((n = response->read(chunk, sizeof(chunk))) > 0) body.append(reinterpret_cast<const char*>(chunk), n);
+    if (code >= 200 && code != 204 && code != 304) {
+        snprintf(line, sizeof(line), "Content-Length: %zu\r\n", body.size());
+        out += line;
+    }
+    out += "\r\n";
+    out += body;
+}
+
+} // namespace
+
+SocketServer::SocketServer(AsyncWebServer& server) : server(server) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+}
+
+SocketServer::~SocketServer() {
+    for (std::unique_ptr<Connection>& connection : connections) {
+        if (connection) close(*connection);
+    }
+    if (listenFd >= 0) ::close(listenFd);
+    ::close(wakeFd);
+    ::close(epollFd);
+}
+
+bool SocketServer::listen(uint16_t port, const char* address) {
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return false;
+    }
+
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) return false;
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    socklen_t length = sizeof(addr);
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listenFd, SOMAXCONN) != 0 ||
+        getsockname(listenFd, reinterpret_cast<sockaddr*>(&addr), &length) != 0) {
+        int error = errno;
+        ::close(listenFd);
+        listenFd = -1;
+        errno = error;
+        return false;
+    }
+    boundPort = ntohs(addr.sin_port);
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = listenFd;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) == 0;
+}
+
+void SocketServer::run() {
+    epoll_event events[64];
+    while (!stopping.load()) {
+        int n = epoll_wait(epollFd, events, 64, -1);
+        if (n < 0 && errno != EINTR) break;
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptAll();
+            } else if (fd == wakeFd) {
+                uint64_t count;
+                ssize_t ignored = read(wakeFd, &count, sizeof(count));
+                (void)ignored;
+            } else if (static_cast<size_t>(fd) < connections.size() && connections[fd]) {
+                Connection& connection = *connections[fd];
+                // Pending output goes first; reading resumes once it is out
+                if (connection.writable) {
+                    process(connection);
+                } else {
+                    onReadable(connection);
+                }
+            }
+        }
+    }
+    for (std::unique_ptr<Connection>& connection : connections) {
+        if (connection) close(*connection);
+    }
+}
+
+void SocketServer::stop() {
+    stopping = true;
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+SocketServer::Stats SocketServer::getStats() const {
+    return Stats{accepted.load(), requests.load(), rejected.load(), open.load()};
+}
+
+void SocketServer::acceptAll() {
+    for (;;) {
+        sockaddr_in peer;
+        socklen_t length = sizeof(peer);
+        int fd = accept4(listenFd, reinterpret_cast<sockaddr*>(&peer), &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return; // EAGAIN, or out of descriptors: the rest wait in the backlog
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        if (static_cast<size_t>(fd) >= connections.size()) connections.resize(fd + 1);
+        connections[fd].reset(new Connection());
+        connections[fd]->fd = fd;
+        connections[fd]->remote = IPAddress(static_cast<uint32_t>(peer.sin_addr.s_addr));
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        accepted++;
+        open++;
+    }
+}
+
+void SocketServer::onReadable(Connection& connection) {
+    char buffer[16384];
+    for (;;) {
+        ssize_t n = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            connection.input.append(buffer, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        close(connection); // closed by the peer, or reset
+        return;
+    }
+    process(connection);
+}
+
+// Answers the complete requests read so far and sends the responses,
+// pausing whenever MAX_PENDING_OUTPUT is queued until it has gone out
+void SocketServer::process(Connection& connection) {
+    bool more = true;
+    while (more) {
+        size_t consumed = 0;
+        more = false;
+        while (!connection.closing && dispatch(connection, consumed)) {
+            if (connection.output.size() - connection.written >= MAX_PENDING_OUTPUT) {
+                more = true;
+                break;
+            }
+        }
+        connection.input.erase(0, consumed);
+        if (!flush(connection)) return;
+    }
+}
+
+// The request at consumed in the connection's input, if it has all arrived
+bool SocketServer::dispatch(Connection& connection, size_t& consumed) {
+    const char* data = connection.input.data() + consumed;
+    size_t available = connection.input.size() - consumed;
+    const char* blank = static_cast<const char*>(memmem(data, available, "\r\n\r\n", 4));
+    if (blank ? static_cast<size_t>(blank - data) > MAX_HEADER_BYTES : available > MAX_HEADER_BYTES) {
+        appendRefusal(connection.output, 431);
+        connection.closing = true;
+        rejected++;
+        return false;
+    }
+    if (!blank) return false;
+
+    RequestHead head;
+    int refusal = parseHead(data, blank - data, head);
+    if (refusal) {
+        appendRefusal(connection.output, refusal);
+        connection.closing = true;
+        rejected++;
+        return false;
+    }
+    head.length = blank + 4 - data;
+    if (available < head.length + head.bodyLength) return false;
+
+    AsyncWebServerRequest request(head.method, String(data + head.target.at, head.target.length));
+    for (const auto& header : head.headers) {
+        request.addHeader(String(data + header.first.at, header.first.length),
+                          String(data + header.second.at, header.second.length));
+    }
+    request.client()->setRemoteIP(connection.remote);
+    server.dispatch(&request, reinterpret_cast<const uint8_t*>(data + head.length), head.bodyLength,
+                    AsyncWebServerResponse::TCP_MSS);
+
+    if (request.response()) {
+        appendResponse(connection.output, request.response(), head.keepAlive);
+    } else {
+        // The real server leaves the client waiting; say so instead
+        appendRefusal(connection.output, 500);
+        head.keepAlive = false;
+    }
+    connection.closing = !head.keepAlive;
+    consumed += head.length + head.bodyLength;
+    requests++;
+    return true;
+}
+
+// True once everything queued is out and the connection still open
+bool SocketServer::flush(Connection& connection) {
+    while (connection.written < connection.output.size()) {
+        ssize_t n = send(connection.fd, connection.output.data() + connection.written,
+                         connection.output.size() - connection.written, MSG_NOSIGNAL);
+        if (n > 0) {
+            connection.written += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            watch(connection, true);
+            return false;
+        }
+        close(connection);
+        return false;
+    }
+    connection.output.clear();
+    connection.written = 0;
+    if (connection.closing) {
+        close(connection);
+        return false;
+    }
+    watch(connection, false);
+    return true;
+}
+
+// Waits for room to write, or for more to read; never both, so a client
+// that does not read its responses is not read from either
+void SocketServer::watch(Connection& connection, bool writable) {
+    if (connection.writable == writable) return;
+    connection.writable = writable;
+    epoll_event event = {};
+    event.events = writable ? EPOLLOUT : EPOLLIN;
+    event.data.fd = connection.fd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+}
+
+void SocketServer::close(Connection& connection) {
+    int fd = connection.fd;
+    ::close(fd);
+    open--;
+    connections[fd].reset();
+}
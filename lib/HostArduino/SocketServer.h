@@ -0,0 +1,80 @@
+#ifndef HOST_SOCKETSERVER_H
+#define HOST_SOCKETSERVER_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "ESPAsyncWebServer.h"
+
+// Serves an AsyncWebServer over TCP on Linux, so the firmware's handlers can
+// be driven by real HTTP clients and load generators without a board. The
+// handlers only see the ESPAsyncWebServer API; this is a second transport
+// for it next to AsyncTCP.
+//
+// HTTP/1.1 with keep-alive and pipelining; request bodies need a
+// Content-Length, and HEAD is not supported. One thread runs everything
+// from an epoll loop, as the AsyncTCP task does on the board: a request is
+// dispatched once it has fully arrived, with its body in TCP_MSS pieces,
+// and its response is queued whole before the next request on the
+// connection is read. Event streams are not served.
+class SocketServer {
+public:
+    static const size_t MAX_HEADER_BYTES = 8192;
+    static const size_t MAX_BODY_BYTES = 65536;
+    // Pipelined requests wait while a connection has this much unsent
+    static const size_t MAX_PENDING_OUTPUT = 65536;
+
+    struct Stats {
+        uint64_t accepted;
+        uint64_t requests;
+        uint64_t rejected; // malformed or oversized, answered and closed
+        uint32_t open;
+    };
+
+private:
+    struct Connection;
+
+    AsyncWebServer& server;
+    int listenFd = -1;
+    int epollFd = -1;
+    int wakeFd = -1;
+    uint16_t boundPort = 0;
+    std::atomic<bool> stopping{false};
+    // By file descriptor
+    std::vector<std::unique_ptr<Connection>> connections;
+
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint32_t> open{0};
+
+    void acceptAll();
+    void onReadable(Connection& connection);
+    void process(Connection& connection);
+    bool dispatch(Connection& connection, size_t& consumed);
+    bool flush(Connection& connection);
+    void watch(Connection& connection, bool writable);
+    void close(Connection& connection);
+
+public:
+    explicit SocketServer(AsyncWebServer& server);
+    SocketServer(const SocketServer&) = delete;
+    SocketServer& operator=(const SocketServer&) = delete;
+    ~SocketServer();
+
+    // Binds address:port (port 0 picks a free one); false with errno set
+    bool listen(uint16_t port, const char* address = "127.0.0.1");
+    uint16_t port() const { return boundPort; }
+
+    // Serves until stop(), then closes every connection
+    void run();
+    // From any thread
+    void stop();
+
+    Stats getStats() const;
+};
+
+#endif // HOST_SOCKETSERVER_H
@@ -0,0 +1,179 @@
+#include "WString.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+String::String(const char* cstr) : buffer(nullptr), capacity(0), len(0) {
+    if (cstr) assign(cstr, strlen(cstr));
+}
+
+String::String(const char* cstr, size_t length) : buffer(nullptr), capacity(0), len(0) {
+    if (cstr) assign(cstr, length);
+}
+
+String::String(const String& other) : buffer(nullptr), capacity(0), len(0) {
+    assign(other.c_str(), other.len);
+}
+
+String::String(String&& other) noexcept : buffer(other.buffer), capacity(other.capacity), len(other.len) {
+    other.buffer = nullptr;
+    other.capacity = 0;
+    other.len = 0;
+}
+
+String::String(char c) : buffer(nullptr), capacity(0), len(0) {
+    assign(&c, 1);
+}
+
+String::String(int value) : String(static_cast<long>(value)) {}
+
+String::String(unsigned int value) : String(static_cast<unsigned long>(value)) {}
+
+String::String(long value) : buffer(nullptr), capacity(0), len(0) {
+    concat(value);
+}
+
+String::String(unsigned long value) : buffer(nullptr), capacity(0), len(0) {
+    concat(value);
+}
+
+String::~String() {
+    free(buffer);
+}
+
+String& String::operator=(const String& other) {
+    if (this != &other) assign(other.c_str(), other.len);
+    return *this;
+}
+
+String& String::operator=(String&& other) noexcept {
+    if (this != &other) {
+        free(buffer);
+        buffer = other.buffer;
+        capacity = other.capacity;
+        len = other.len;
+        other.buffer = nullptr;
+        other.capacity = 0;
+        other.len = 0;
+    }
+    return *this;
+}
+
+String& String::operator=(const char* cstr) {
+    if (cstr) {
+        assign(cstr, strlen(cstr));
+    } else {
+        len = 0;
+        if (buffer) buffer[0] = 0;
+    }
+    return *this;
+}
+
+bool String::grow(size_t size) {
+    if (buffer && capacity >= size) return true;
+    char* next = static_cast<char*>(realloc(buffer, size + 1));
+    if (!next) return false;
+    if (!buffer) next[0] = 0;
+    buffer = next;
+    capacity = size;
+    return true;
+}
+
+void String::assign(const char* cstr, size_t length) {
+    if (!grow(length)) return;
+    memmove(buffer, cstr, length);
+    buffer[length] = 0;
+    len = length;
+}
+
+bool String::reserve(size_t size) {
+    return grow(size);
+}
+
+bool String::concat(const char* cstr) {
+    return cstr ? concat(cstr, strlen(cstr)) : false;
+}
+
+bool String::concat(const char* cstr, size_t length) {
+    if (length == 0) return true;
+    if (!grow(len + length)) return false;
+    memmove(buffer + len, cstr, length);
+    len += length;
+    buffer[len] = 0;
+    return true;
+}
+
+bool String::concat(int value) {
+    return concat(static_cast<long>(value));
+}
+
+bool String::concat(unsigned int value) {
+    return concat(static_cast<unsigned long>(value));
+}
+
+bool String::concat(long value) {
+    char tmp[24];
+    int n = snprintf(tmp, sizeof(tmp), "%ld", value);
+    return concat(tmp, static_cast<size_t>(n));
+}
+
+bool String::concat(unsigned long value) {
+    char tmp[24];
+    int n = snprintf(tmp, sizeof(tmp), "%lu", value);
+    return concat(tmp, static_cast<size_t>(n));
+}
+
+bool String::equals(const char* cstr) const {
+    if (!cstr) return len == 0;
+    return strcmp(c_str(), cstr) == 0;
+}
+
+bool String::equalsIgnoreCase(const String& other) const {
+    return len == other.len && strcasecmp(c_str(), other.c_str()) == 0;
+}
+
+bool String::startsWith(const char* prefix) const {
+    size_t n = strlen(prefix);
+    return n <= len && strncmp(c_str(), prefix, n) == 0;
+}
+
+bool String::endsWith(const char* suffix) const {
+    size_t n = strlen(suffix);
+    return n <= len && strcmp(c_str() + len - n, suffix) == 0;
+}
+
+int String::indexOf(char c, size_t from) const {
+    for (size_t i = from; i < len; i++) {
+        if (buffer[i] == c) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+String String::substring(size_t from, size_t to) const {
+    if (to > len) to = len;
+    if (from >= to) return String();
+    return String(buffer + from, to - from);
+}
+
+long String::toInt() const {
+    return strtol(c_str(), nullptr, 10);
+}
+
+String operator+(const String& lhs, const String& rhs) {
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+String operator+(const String& lhs, const char* rhs) {
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+String operator+(const char* lhs, const String& rhs) {
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
@@ -0,0 +1,73 @@
+#ifndef HOST_WSTRING_H
+#define HOST_WSTRING_H
+
+#include <stddef.h>
+
+// Heap-backed String with the subset of the Arduino API used by the firmware.
+// Storage is malloc/realloc based like the ESP32 core so allocation counts in
+// the native benchmarks track what the board does.
+class String {
+private:
+    char* buffer;
+    size_t capacity;
+    size_t len;
+
+    bool grow(size_t size);
+    void assign(const char* cstr, size_t length);
+
+public:
+    String(const char* cstr = "");
+    String(const char* cstr, size_t length);
+    String(const String& other);
+    String(String&& other) noexcept;
+    explicit String(char c);
+    explicit String(int value);
+    explicit String(unsigned int value);
+    explicit String(long value);
+    explicit String(unsigned long value);
+    ~String();
+
+    String& operator=(const String& other);
+    String& operator=(String&& other) noexcept;
+    String& operator=(const char* cstr);
+
+    bool reserve(size_t size);
+    const char* c_str() const { return buffer ? buffer : ""; }
+    size_t length() const { return len; }
+    bool isEmpty() const { return len == 0; }
+    char operator[](size_t index) const { return index < len ? buffer[index] : 0; }
+
+    bool concat(const char* cstr);
+    bool concat(const char* cstr, size_t length);
+    bool concat(const String& other) { return concat(other.c_str(), other.len); }
+    bool concat(char c) { return concat(&c, 1); }
+    bool concat(int value);
+    bool concat(unsigned int value);
+    bool concat(long value);
+    bool concat(unsigned long value);
+    String& operator+=(const char* cstr) { concat(cstr); return *this; }
+    String& operator+=(const String& other) { concat(other); return *this; }
+    String& operator+=(char c) { concat(c); return *this; }
+
+    bool equals(const char* cstr) const;
+    bool equals(const String& other) const { return equals(other.c_str()); }
+    bool operator==(const char* cstr) const { return equals(cstr); }
+    bool operator==(const String& other) const { return equals(other); }
+    bool operator!=(const char* cstr) const { return !equals(cstr); }
+    bool operator!=(const String& other) const { return !equals(other); }
+    bool equalsIgnoreCase(const String& other) const;
+
+    bool startsWith(const char* prefix) const;
+    bool startsWith(const String& prefix) const { return startsWith(prefix.c_str()); }
+    bool endsWith(const char* suffix) const;
+    int indexOf(char c, size_t from = 0) const;
+    String substring(size_t from) const { return substring(from, len); }
+    String substring(size_t from, size_t to) const;
+    long toInt() const;
+
+    friend String operator+(const String& lhs, const String& rhs);
+    friend String operator+(const String& lhs, const char* rhs);
+    friend String operator+(const char* lhs, const String& rhs);
+};
+
+#endif // HOST_WSTRING_H
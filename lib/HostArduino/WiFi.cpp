@@ -0,0 +1,148 @@
+#include "WiFi.h"
+#include <HostControl.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+WiFiClass WiFi;
+
+namespace {
+
+struct Handler {
+    WiFiEventCb callback;
+    arduino_event_id_t event;
+};
+
+std::mutex handlerLock;
+std::vector<Handler> handlers;
+
+std::atomic<wl_status_t> linkStatus{WL_DISCONNECTED};
+// Bumped by every begin/disconnect so a superseded attempt stops quietly
+std::atomic<uint32_t> attempt{0};
+std::atomic<uint32_t> associateDelayMs{50};
+std::atomic<uint32_t> dhcpDelayMs{50};
+std::atomic<bool> apReachable{true};
+std::atomic<uint32_t> associations{0};
+
+void raise(arduino_event_id_t event) {
+    std::vector<Handler> snapshot;
+    {
+        std::lock_guard<std::mutex> guard(handlerLock);
+        snapshot = handlers;
+    }
+    for (const Handler& handler : snapshot) {
+        if (handler.event == ARDUINO_EVENT_MAX || handler.event == event) handler.callback(event);
+    }
+}
+
+void sleepMs(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+} // namespace
+
+namespace host {
+
+void setWiFiTiming(uint32_t associateMs, uint32_t dhcpMs) {
+    associateDelayMs = associateMs;
+    dhcpDelayMs = dhcpMs;
+}
+
+void setWiFiReachable(bool reachable) {
+    apReachable = reachable;
+}
+
+uint32_t wifiAssociationCount() {
+    return associations;
+}
+
+void dropWiFi() {
+    attempt++;
+    if (linkStatus.exchange(WL_CONNECTION_LOST) == WL_CONNECTED) raise(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+}
+
+} // namespace host
+
+bool WiFiClass::mode(wifi_mode_t m) {
+    currentMode = m;
+    return true;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password) {
+    (void)password;
+    if (!ssid || !ssid[0]) return linkStatus = WL_NO_SSID_AVAIL;
+
+    uint32_t self = ++attempt;
+    associations++;
+    linkStatus = WL_DISCONNECTED;
+    bool leaseNeeded = !staticConfig;
+
+    // Plays the driver task: association, then DHCP, each after a delay
+    std::thread([self, leaseNeeded] {
+        sleepMs(associateDelayMs);
+        if (attempt != self) return;
+        if (!apReachable) {
+            linkStatus = WL_NO_SSID_AVAIL;
+            raise(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+            return;
+        }
+        raise(ARDUINO_EVENT_WIFI_STA_CONNECTED);
+        if (leaseNeeded) sleepMs(dhcpDelayMs);
+        if (attempt != self) return;
+        linkStatus = WL_CONNECTED;
+        raise(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    }).detach();
+    return WL_DISCONNECTED;
+}
+
+wl_status_t WiFiClass::status() const {
+    return linkStatus;
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+    attempt++;
+    bool wasConnected = linkStatus.exchange(WL_DISCONNECTED) == WL_CONNECTED;
+    if (wifiOff) currentMode = WIFI_OFF;
+    if (wasConnected) raise(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    return true;
+}
+
+wifi_event_id_t WiFiClass::onEvent(WiFiEventCb callback, arduino_event_id_t event) {
+    std::lock_guard<std::mutex> guard(handlerLock);
+    handlers.push_back({callback, event});
+    return static_cast<wifi_event_id_t>(handlers.size());
+}
+
+bool WiFiClass::config(IPAddress local, IPAddress gw, IPAddress mask) {
+    // INADDR_NONE switches back to DHCP
+    staticConfig = local != INADDR_NONE;
+    staticIP = local;
+    gateway = gw;
+    subnet = mask;
+    return true;
+}
+
+bool WiFiClass::softAPConfig(IPAddress local, IPAddress gw, IPAddress mask) {
+    return config(local, gw, mask);
+}
+
+bool WiFiClass::softAP(const char* ssid, const char* password) {
+    (void)password;
+    currentMode = WIFI_AP;
+    return ssid != nullptr;
+}
+
+IPAddress WiFiClass::localIP() const {
+    if (linkStatus != WL_CONNECTED) return IPAddress();
+    return staticConfig ? staticIP : IPAddress(192, 168, 1, 57);
+}
+
+IPAddress WiFiClass::gatewayIP() const {
+    return staticConfig ? gateway : IPAddress(192, 168, 1, 1);
+}
+
+IPAddress WiFiClass::subnetMask() const {
+    return staticConfig ? subnet : IPAddress(255, 255, 255, 0);
+}
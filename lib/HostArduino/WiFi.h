@@ -0,0 +1,65 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include "Arduino.h"
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} wifi_mode_t;
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+    ARDUINO_EVENT_WIFI_STA_START = 2,
+    ARDUINO_EVENT_WIFI_STA_CONNECTED = 4,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED = 5,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP = 7,
+    ARDUINO_EVENT_WIFI_STA_LOST_IP = 8,
+    ARDUINO_EVENT_MAX = 41
+} arduino_event_id_t;
+
+typedef void (*WiFiEventCb)(arduino_event_id_t event);
+typedef uint32_t wifi_event_id_t;
+
+// Station/AP stand-in driven like the real driver: begin() returns at once
+// and a background thread associates after a delay, gets a DHCP lease unless
+// a static config is set, and raises the matching events. Timing and
+// failures are set through HostControl.h. The network is 192.168.1.0/24.
+class WiFiClass {
+private:
+    wifi_mode_t currentMode = WIFI_OFF;
+    bool staticConfig = false;
+    IPAddress staticIP;
+    IPAddress gateway;
+    IPAddress subnet;
+
+public:
+    bool mode(wifi_mode_t m);
+    wifi_mode_t getMode() const { return currentMode; }
+    wl_status_t begin(const char* ssid, const char* password = nullptr);
+    wl_status_t status() const;
+    bool disconnect(bool wifiOff = false);
+    wifi_event_id_t onEvent(WiFiEventCb callback, arduino_event_id_t event = ARDUINO_EVENT_MAX);
+    bool config(IPAddress local, IPAddress gw, IPAddress mask);
+
+    bool softAPConfig(IPAddress local, IPAddress gw, IPAddress mask);
+    bool softAP(const char* ssid, const char* password = nullptr);
+
+    IPAddress localIP() const;
+    IPAddress gatewayIP() const;
+    IPAddress subnetMask() const;
+};
+
+extern WiFiClass WiFi;
+
+#endif // HOST_WIFI_H
@@ -0,0 +1,9 @@
+#ifndef HOST_ESP_IDF_VERSION_H
+#define HOST_ESP_IDF_VERSION_H
+
+// The ESP-IDF under arduino-esp32 2.x, whose LEDC driver Ledc.cpp models
+#define ESP_IDF_VERSION_MAJOR 4
+#define ESP_IDF_VERSION_MINOR 4
+#define ESP_IDF_VERSION_PATCH 0
+
+#endif // HOST_ESP_IDF_VERSION_H
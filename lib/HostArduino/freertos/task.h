@@ -0,0 +1,24 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+// Task API subset backed by detached std::threads. Priorities and cores are
+// accepted and ignored; notifications behave as counting semaphores.
+
+struct HostTask;
+typedef HostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* parameter);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stackDepth, void* parameter,
+                                   UBaseType_t priority, TaskHandle_t* createdTask, BaseType_t coreId);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+void vTaskDelay(TickType_t ticks);
+// Sleeps until *previousWakeTime + ticks and moves *previousWakeTime there
+void vTaskDelayUntil(TickType_t* previousWakeTime, TickType_t ticks);
+TickType_t xTaskGetTickCount();
+
+#define taskYIELD() vTaskDelay(0)
+
+#endif // HOST_FREERTOS_TASK_H
@@ -0,0 +1,14 @@
+#ifndef HOST_GPIO_REG_H
+#define HOST_GPIO_REG_H
+
+#include "soc.h"
+
+// Register addresses as on the ESP32 (DR_REG_GPIO_BASE = 0x3ff44000)
+#define GPIO_OUT_REG 0x3ff44004
+#define GPIO_OUT_W1TS_REG 0x3ff44008
+#define GPIO_OUT_W1TC_REG 0x3ff4400c
+#define GPIO_OUT1_REG 0x3ff44010
+#define GPIO_OUT1_W1TS_REG 0x3ff44014
+#define GPIO_OUT1_W1TC_REG 0x3ff44018
+
+#endif // HOST_GPIO_REG_H
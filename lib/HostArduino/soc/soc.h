@@ -0,0 +1,15 @@
+#ifndef HOST_SOC_H
+#define HOST_SOC_H
+
+#include <stdint.h>
+
+// Peripheral register access routed to the mock GPIO port in Arduino.cpp
+namespace host {
+void regWrite(uint32_t reg, uint32_t value);
+uint32_t regRead(uint32_t reg);
+} // namespace host
+
+#define REG_WRITE(reg, val) host::regWrite((reg), (val))
+#define REG_READ(reg) host::regRead((reg))
+
+#endif // HOST_SOC_H
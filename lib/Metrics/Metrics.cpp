@@ -0,0 +1,77 @@
+#include "Metrics.h"
+#include <string.h>
+
+void Metrics::Histogram::record(uint32_t us) {
+    size_t i = 0;
+    if (us > FIRST_BOUND_US) {
+        // Bits above those of the first bound, rounding up to the next power of two
+        i = 32 - __builtin_clz(us - 1) - 5;
+        if (i >= BUCKETS) i = BUCKETS - 1;
+    }
+    buckets[i]++;
+    count++;
+    sumUs += us;
+}
+
+int Metrics::addRoute(const char* method, const char* path) {
+    for (size_t i = 0; i < routeCount; i++) {
+        if (strcmp(routes[i].method, method) == 0 && strcmp(routes[i].path, path) == 0) return static_cast<int>(i);
+    }
+    if (routeCount == MAX_ROUTES) return -1;
+    routes[routeCount].method = method;
+    routes[routeCount].path = path;
+    return static_cast<int>(routeCount++);
+}
+
+void Metrics::record(int route, int code, uint32_t us, size_t requestBytes, size_t responseBytes) {
+    if (route < 0 || static_cast<size_t>(route) >= routeCount) return;
+    routes[route].requestBytes += requestBytes;
+    routes[route].responseBytes += responseBytes;
+
+    for (size_t i = 0; i < seriesCount; i++) {
+        if (series[i].route == route && series[i].code == code) {
+            series[i].latency.record(us);
+            return;
+        }
+    }
+    if (seriesCount == MAX_SERIES) {
+        dropped++;
+        return;
+    }
+    Series& added = series[seriesCount++];
+    added.route = static_cast<uint8_t>(route);
+    added.code = static_cast<uint16_t>(code);
+    added.latency.record(us);
+}
+
+void Metrics::addResponseBytes(int route, size_t bytes) {
+    if (route >= 0 && static_cast<size_t>(route) < routeCount) routes[route].responseBytes += bytes;
+}
+
+void Metrics::loopSleeping(uint32_t nowUs, uint32_t sleepMs) {
+    wakeDueUs = nowUs + sleepMs * 1000;
+    sleeping = true;
+}
+
+void Metrics::loopWoke(uint32_t nowUs) {
+    if (!sleeping) return;
+    sleeping = false;
+    int32_t late = static_cast<int32_t>(nowUs - wakeDueUs);
+    uint32_t lateUs = late > 0 ? static_cast<uint32_t>(late) : 0;
+
+    loopLock.writeBegin();
+    loopStats.iterations++;
+    if (lateUs > loopStats.maxLateUs) loopStats.maxLateUs = lateUs;
+    loopStats.lateness.record(lateUs);
+    loopLock.writeEnd();
+}
+
+Metrics::LoopStats Metrics::getLoopStats() const {
+    LoopStats copy;
+    uint32_t start;
+    do {
+        start = loopLock.readBegin();
+        copy = loopStats;
+    } while (loopLock.readRetry(start));
+    return copy;
+}
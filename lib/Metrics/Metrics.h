@@ -0,0 +1,87 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <SeqLock.h>
+
+// Request latency per route and status code, request and byte counts per
+// route, and how late loop() wakes up, all in fixed arrays so recording
+// never allocates. Durations are counted in log2 buckets: bucket i holds
+// those up to FIRST_BOUND_US << i, the last one everything longer.
+//
+// Routes and request series belong to the task the web server runs on
+// (AsyncTCP); the loop figures are written by loop() and may be read from
+// any task.
+class Metrics {
+public:
+    static const size_t MAX_ROUTES = 32;
+    // (route, status code) pairs; requests of pairs past these are only
+    // counted in droppedSeries()
+    static const size_t MAX_SERIES = 48;
+    static const size_t BUCKETS = 15;
+    static const uint32_t FIRST_BOUND_US = 32; // up to 262 ms before +Inf
+
+    struct Histogram {
+        uint32_t buckets[BUCKETS]; // not cumulative
+        uint32_t count;
+        uint64_t sumUs;
+
+        void record(uint32_t us);
+        // Upper bound of bucket i; the last one has none
+        static uint32_t boundUs(size_t i) { return FIRST_BOUND_US << i; }
+    };
+
+    struct Route {
+        const char* method;
+        const char* path;
+        uint64_t requestBytes;
+        uint64_t responseBytes;
+    };
+
+    struct Series {
+        uint8_t route;
+        uint16_t code;
+        Histogram latency;
+    };
+
+    struct LoopStats {
+        uint32_t iterations;
+        uint32_t maxLateUs;
+        Histogram lateness; // wake-up past the end of the requested sleep
+    };
+
+private:
+    Route routes[MAX_ROUTES] = {};
+    size_t routeCount = 0;
+    Series series[MAX_SERIES] = {};
+    size_t seriesCount = 0;
+    uint32_t dropped = 0;
+
+    LoopStats loopStats = {};
+    SeqLock loopLock;
+    uint32_t wakeDueUs = 0;
+    bool sleeping = false;
+
+public:
+    // Index of the route with this method and path, added if new; -1 once
+    // MAX_ROUTES are taken. Both strings must outlive the Metrics.
+    int addRoute(const char* method, const char* path);
+    // One request to route answered with code after us microseconds
+    void record(int route, int code, uint32_t us, size_t requestBytes, size_t responseBytes);
+    // Body bytes of a streamed response, as they go out
+    void addResponseBytes(int route, size_t bytes);
+
+    // Called by loop() just before it sleeps and as soon as it wakes
+    void loopSleeping(uint32_t nowUs, uint32_t sleepMs);
+    void loopWoke(uint32_t nowUs);
+
+    size_t routeSize() const { return routeCount; }
+    const Route& route(size_t i) const { return routes[i]; }
+    size_t seriesSize() const { return seriesCount; }
+    const Series& seriesAt(size_t i) const { return series[i]; }
+    uint32_t droppedSeries() const { return dropped; }
+    LoopStats getLoopStats() const;
+};
+
+#endif // METRICS_H
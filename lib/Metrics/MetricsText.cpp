@@ -0,0 +1,170 @@
+#include "MetricsText.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const char LATENCY_NAME[] = "http_request_duration_seconds";
+const char LOOP_NAME[] = "loop_lateness_seconds";
+
+// Room for the method, route and code labels of one series
+const size_t LABELS_SIZE = 96;
+
+} // namespace
+
+MetricsText::MetricsText(const Metrics& source, const Value* scraped, size_t count)
+    : metrics(&source), valueCount(count < MAX_VALUES ? count : MAX_VALUES), loop(source.getLoopStats()) {
+    memcpy(values, scraped, valueCount * sizeof(Value));
+}
+
+void MetricsText::append(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(pending + pendingLen, sizeof(pending) - pendingLen, format, args);
+    va_end(args);
+    if (n > 0) pendingLen += static_cast<size_t>(n) < sizeof(pending) - pendingLen ? n : sizeof(pending) - 1 - pendingLen;
+}
+
+void MetricsText::header(const char* name, const char* help, const char* type) {
+    append("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Writes bucket lines (cumulative, as Prometheus expects), then _sum and
+// _count; true after the last of them
+bool MetricsText::histogramLine(const char* name, const char* labels, const Metrics::Histogram& h) {
+    const char* comma = *labels ? "," : "";
+    if (line < Metrics::BUCKETS) {
+        uint32_t cumulative = 0;
+        for (size_t i = 0; i <= line; i++) cumulative += h.buckets[i];
+        if (line + 1 < Metrics::BUCKETS) {
+            uint32_t bound = Metrics::Histogram::boundUs(line);
+            append("%s_bucket{%s%sle=\"%u.%06u\"} %u\n", name, labels, comma, static_cast<unsigned int>(bound / 1000000),
+                   static_cast<unsigned int>(bound % 1000000), static_cast<unsigned int>(cumulative));
+        } else {
+            append("%s_bucket{%s%sle=\"+Inf\"} %u\n", name, labels, comma, static_cast<unsigned int>(cumulative));
+        }
+    } else if (line == Metrics::BUCKETS) {
+        append("%s_sum%s%s%s %llu.%06u\n", name, *labels ? "{" : "", labels, *labels ? "}" : "",
+               static_cast<unsigned long long>(h.sumUs / 1000000), static_cast<unsigned int>(h.sumUs % 1000000));
+    } else {
+        append("%s_count%s%s%s %u\n", name, *labels ? "{" : "", labels, *labels ? "}" : "",
+               static_cast<unsigned int>(h.count));
+    }
+    return ++line > Metrics::BUCKETS + 1;
+}
+
+void MetricsText::next(Stage following) {
+    stage = following;
+    item = 0;
+    line = 0;
+    headed = false;
+}
+
+void MetricsText::produce() {
+    pendingPos = 0;
+    pendingLen = 0;
+    char labels[LABELS_SIZE];
+
+    // A stage may end without writing anything, so go on until a line is out
+    while (pendingLen == 0 && stage != DONE) {
+        switch (stage) {
+        case LATENCY:
+            if (!headed) {
+                header(LATENCY_NAME, "Time from a handler being called to its response being queued", "histogram");
+                headed = true;
+            } else if (item == metrics->seriesSize()) {
+                next(REQUESTS);
+            } else {
+                const Metrics::Series& series = metrics->seriesAt(item);
+                const Metrics::Route& route = metrics->route(series.route);
+                snprintf(labels, sizeof(labels), "method=\"%s\",route=\"%s\",code=\"%u\"", route.method, route.path,
+                         series.code);
+                if (line == 0) histogram = series.latency;
+                if (histogramLine(LATENCY_NAME, labels, histogram)) {
+                    item++;
+                    line = 0;
+                }
+            }
+            break;
+        case REQUESTS:
+            if (!headed) {
+                header("http_requests_total", "Requests answered, by route and status code", "counter");
+                headed = true;
+            } else if (item == metrics->seriesSize()) {
+                next(REQUEST_BYTES);
+            } else {
+                const Metrics::Series& series = metrics->seriesAt(item++);
+                const Metrics::Route& route = metrics->route(series.route);
+                append("http_requests_total{method=\"%s\",route=\"%s\",code=\"%u\"} %u\n", route.method, route.path,
+                       series.code, static_cast<unsigned int>(series.latency.count));
+            }
+            break;
+        case REQUEST_BYTES:
+        case RESPONSE_BYTES: {
+            bool requests = stage == REQUEST_BYTES;
+            const char* name = requests ? "http_request_body_bytes_total" : "http_response_body_bytes_total";
+            if (!headed) {
+                header(name, requests ? "Body bytes received, by route" : "Body bytes sent, by route", "counter");
+                headed = true;
+            } else if (item == metrics->routeSize()) {
+                next(requests ? RESPONSE_BYTES : LOOP);
+            } else {
+                const Metrics::Route& route = metrics->route(item++);
+                append("%s{method=\"%s\",route=\"%s\"} %llu\n", name, route.method, route.path,
+                       static_cast<unsigned long long>(requests ? route.requestBytes : route.responseBytes));
+            }
+            break;
+        }
+        case LOOP:
+            if (!headed) {
+                header(LOOP_NAME, "How long after the end of its sleep loop() ran again", "histogram");
+                headed = true;
+            } else if (item == 0) {
+                if (histogramLine(LOOP_NAME, "", loop.lateness)) item++;
+            } else {
+                header("loop_lateness_max_seconds", "Longest wait past the end of a loop() sleep", "gauge");
+                append("loop_lateness_max_seconds %u.%06u\n", static_cast<unsigned int>(loop.maxLateUs / 1000000),
+                       static_cast<unsigned int>(loop.maxLateUs % 1000000));
+                next(VALUES);
+            }
+            break;
+        case VALUES:
+            if (item == valueCount) {
+                next(DROPPED);
+            } else {
+                const Value& value = values[item++];
+                header(value.name, value.help, value.counter ? "counter" : "gauge");
+                if (value.micros)
+                    append("%s %llu.%06u\n", value.name, static_cast<unsigned long long>(value.value / 1000000),
+                           static_cast<unsigned int>(value.value % 1000000));
+                else
+                    append("%s %llu\n", value.name, static_cast<unsigned long long>(value.value));
+            }
+            break;
+        case DROPPED:
+            header("metrics_dropped_series_total", "Requests not recorded because every series was taken", "counter");
+            append("metrics_dropped_series_total %u\n", static_cast<unsigned int>(metrics->droppedSeries()));
+            next(DONE);
+            break;
+        case DONE:
+            break;
+        }
+    }
+}
+
+size_t MetricsText::read(uint8_t* buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+        if (pendingPos == pendingLen) {
+            produce();
+            if (pendingLen == 0) break;
+        }
+        size_t n = pendingLen - pendingPos;
+        if (n > maxLen - written) n = maxLen - written;
+        memcpy(buffer + written, pending + pendingPos, n);
+        pendingPos += n;
+        written += n;
+    }
+    return written;
+}
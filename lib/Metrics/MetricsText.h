@@ -0,0 +1,70 @@
+#ifndef METRICSTEXT_H
+#define METRICSTEXT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Metrics.h"
+
+// Resumable writer for the GET /api/metrics body in the Prometheus text
+// format: request latency histograms and counts per route and status code,
+// bytes per route, loop() lateness, then whatever single values the caller
+// gathered when the scrape began. It reads the Metrics as it goes, one line
+// at a time, and copies each histogram before writing it, so every
+// histogram comes out consistent without the whole body being held.
+class MetricsText {
+public:
+    // A value taken at scrape time, e.g. free heap
+    struct Value {
+        const char* name;
+        const char* help;
+        bool counter;    // else a gauge
+        bool micros;     // written in seconds
+        uint64_t value;
+    };
+
+    static const size_t MAX_VALUES = 16;
+    // HELP and TYPE lines of one metric, or one sample with its labels
+    static const size_t MAX_ENTRY_SIZE = 256;
+
+private:
+    enum Stage {
+        LATENCY,
+        REQUESTS,
+        REQUEST_BYTES,
+        RESPONSE_BYTES,
+        LOOP,
+        VALUES,
+        DROPPED,
+        DONE
+    };
+
+    const Metrics* metrics;
+    Value values[MAX_VALUES];
+    size_t valueCount;
+    Metrics::LoopStats loop;
+
+    Stage stage = LATENCY;
+    size_t item = 0; // series, route or value within the stage
+    size_t line = 0; // line within the item
+    bool headed = false; // the stage's HELP and TYPE are out
+    Metrics::Histogram histogram;
+    char pending[MAX_ENTRY_SIZE];
+    size_t pendingLen = 0;
+    size_t pendingPos = 0;
+
+    void append(const char* format, ...);
+    void header(const char* name, const char* help, const char* type);
+    bool histogramLine(const char* name, const char* labels, const Metrics::Histogram& h);
+    void next(Stage following);
+    void produce();
+
+public:
+    // Values past MAX_VALUES are left out
+    MetricsText(const Metrics& source, const Value* scraped, size_t count);
+
+    // Copies up to maxLen further bytes of the text into buffer. Returns 0
+    // once all of it has been written.
+    size_t read(uint8_t* buffer, size_t maxLen);
+};
+
+#endif // METRICSTEXT_H
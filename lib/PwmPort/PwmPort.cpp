@@ -0,0 +1,149 @@
+#include "PwmPort.h"
+#include <Arduino.h>
+#include <driver/ledc.h>
+#include <esp_idf_version.h>
+
+namespace {
+
+const ledc_mode_t MODE = LEDC_LOW_SPEED_MODE;
+const ledc_timer_t TIMER = LEDC_TIMER_0;
+const uint32_t FREQUENCY_HZ = 5000;
+
+struct Channel {
+    int pin;
+    bool fading;      // a fade started and may not have ended
+    uint32_t fadeEnd; // millis() it ends by
+    bool held;        // a write waits for the fade
+    uint8_t heldDuty;
+    uint32_t heldFadeMs;
+};
+
+uint8_t usedChannels = 0;     // bit n set when channel n is attached
+uint8_t retiringChannels = 0; // detached mid-fade, free once it ends
+Channel channels[PWM_CHANNELS] = {};
+bool timerReady = false;
+
+bool setUpTimer() {
+    if (timerReady) return true;
+    ledc_timer_config_t timer = {};
+    timer.speed_mode = MODE;
+    timer.duty_resolution = LEDC_TIMER_8_BIT;
+    timer.timer_num = TIMER;
+    timer.freq_hz = FREQUENCY_HZ;
+    timer.clk_cfg = LEDC_AUTO_CLK;
+    if (ledc_timer_config(&timer) != ESP_OK) return false;
+    // Fades finish in hardware; the interrupt only ends them
+    if (ledc_fade_func_install(0) != ESP_OK) return false;
+    timerReady = true;
+    return true;
+}
+
+// True while the channel's fade may still be running; clears it once over
+bool fadeRunning(Channel& state, uint32_t now) {
+    if (state.fading && static_cast<int32_t>(now - state.fadeEnd) >= 0) state.fading = false;
+    return state.fading;
+}
+
+void start(uint8_t channel, uint8_t duty, uint32_t fadeMs, uint32_t now) {
+    ledc_channel_t ledcChannel = static_cast<ledc_channel_t>(channel);
+    if (fadeMs == 0) {
+        ledc_set_duty_and_update(MODE, ledcChannel, duty, 0);
+        return;
+    }
+    ledc_set_fade_time_and_start(MODE, ledcChannel, duty, fadeMs, LEDC_FADE_NO_WAIT);
+    channels[channel].fading = true;
+    channels[channel].fadeEnd = now + fadeMs;
+}
+
+} // namespace
+
+int pwmAttach(int pin, uint8_t duty) {
+    if (!setUpTimer()) return -1;
+    pwmPoll(millis());
+    for (uint8_t channel = 0; channel < PWM_CHANNELS; channel++) {
+        if ((usedChannels | retiringChannels) & (1u << channel)) continue;
+
+        ledc_channel_config_t config = {};
+        config.gpio_num = pin;
+        config.speed_mode = MODE;
+        config.channel = static_cast<ledc_channel_t>(channel);
+        config.timer_sel = TIMER;
+        config.duty = duty;
+        config.hpoint = 0;
+        if (ledc_channel_config(&config) != ESP_OK) return -1;
+        channels[channel] = Channel();
+        channels[channel].pin = pin;
+        usedChannels |= 1u << channel;
+        return channel;
+    }
+    return -1;
+}
+
+void pwmDetach(int channel) {
+    if (channel < 0 || channel >= PWM_CHANNELS || !(usedChannels & (1u << channel))) return;
+    Channel& state = channels[channel];
+    usedChannels &= ~(1u << channel);
+    state.held = false;
+#if ESP_IDF_VERSION_MAJOR < 5
+    if (fadeRunning(state, millis())) {
+        // Off the LEDC signal and low now; the channel waits out its fade
+        pinMode(state.pin, OUTPUT);
+        digitalWrite(state.pin, LOW);
+        retiringChannels |= 1u << channel;
+        return;
+    }
+#else
+    if (fadeRunning(state, millis())) ledc_fade_stop(MODE, static_cast<ledc_channel_t>(channel));
+#endif
+    ledc_stop(MODE, static_cast<ledc_channel_t>(channel), 0);
+}
+
+void pwmWrite(int channel, uint8_t duty, uint32_t fadeMs) {
+    if (channel < 0 || channel >= PWM_CHANNELS || !(usedChannels & (1u << channel))) return;
+    if (fadeMs > PWM_MAX_FADE_MS) fadeMs = PWM_MAX_FADE_MS;
+    Channel& state = channels[channel];
+    uint32_t now = millis();
+    if (fadeRunning(state, now)) {
+#if ESP_IDF_VERSION_MAJOR < 5
+        state.held = true;
+        state.heldDuty = duty;
+        state.heldFadeMs = fadeMs;
+        return;
+#else
+        ledc_fade_stop(MODE, static_cast<ledc_channel_t>(channel));
+        state.fading = false;
+#endif
+    }
+    start(channel, duty, fadeMs, now);
+}
+
+uint32_t pwmPoll(uint32_t now) {
+    uint32_t next = PWM_IDLE;
+    for (uint8_t channel = 0; channel < PWM_CHANNELS; channel++) {
+        uint8_t bit = 1u << channel;
+        Channel& state = channels[channel];
+        if (retiringChannels & bit) {
+            if (fadeRunning(state, now)) continue;
+            ledc_stop(MODE, static_cast<ledc_channel_t>(channel), 0);
+            retiringChannels &= ~bit;
+            continue;
+        }
+        if (!(usedChannels & bit) || !state.held) continue;
+        if (fadeRunning(state, now)) {
+            uint32_t wait = state.fadeEnd - now;
+            if (wait < next) next = wait;
+            continue;
+        }
+        state.held = false;
+        start(channel, state.heldDuty, state.heldFadeMs, now);
+    }
+    return next;
+}
+
+uint8_t pwmChannelsInUse() {
+    uint8_t count = 0;
+    for (uint8_t channel = 0; channel < PWM_CHANNELS; channel++) {
+        if (usedChannels & (1u << channel)) count++;
+    }
+    return count;
+}
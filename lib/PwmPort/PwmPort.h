@@ -0,0 +1,39 @@
+#ifndef PWMPORT_H
+#define PWMPORT_H
+
+#include <stdint.h>
+
+// LEDC PWM outputs for dimmable devices. All channels share one 5 kHz timer
+// with 8-bit duty, so a duty is a device level (0-255). Channels are handed
+// out on attach and returned on detach. Fades run in the LEDC fade engine:
+// pwmWrite() starts one and returns, and the hardware steps the duty.
+//
+// The ESP-IDF 4.4 driver under arduino-esp32 2.x cannot stop a running fade,
+// and every other duty call on the channel blocks until it ends. So a write
+// to a channel mid-fade is held and made by pwmPoll() once the fade is over,
+// the newest write replacing one already held; a channel detached mid-fade
+// has its pin switched to a plain low output and is only handed out again
+// after the fade. With IDF 5 the fade is stopped with ledc_fade_stop()
+// instead and the write made at once.
+//
+// Called from one task at a time (setup(), then the actuator task).
+const uint8_t PWM_CHANNELS = 8;
+const uint32_t PWM_MAX_FADE_MS = 30000;
+// pwmPoll() with nothing held
+const uint32_t PWM_IDLE = UINT32_MAX;
+
+// Routes pin to a free channel at the given duty; -1 if none is free
+int pwmAttach(int pin, uint8_t duty);
+// Stops the channel with its pin low and frees it
+void pwmDetach(int channel);
+// Moves the channel to duty, linearly over fadeMs (0 for at once, capped at
+// PWM_MAX_FADE_MS), from where the output is when it starts
+void pwmWrite(int channel, uint8_t duty, uint32_t fadeMs);
+// Makes the writes held behind fades that have ended by now, and frees
+// channels detached mid-fade. Returns the ms until the next held write is
+// due, or PWM_IDLE.
+uint32_t pwmPoll(uint32_t now);
+// Channels currently attached
+uint8_t pwmChannelsInUse();
+
+#endif // PWMPORT_H
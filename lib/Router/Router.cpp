@@ -0,0 +1,112 @@
+#include "Router.h"
+#include <limits.h>
+#include <string.h>
+
+bool PathParams::toInt(size_t i, int& out) const {
+    if (i >= count || lengths[i] == 0) return false;
+    const char* text = values[i];
+    size_t n = lengths[i];
+    bool negative = text[0] == '-';
+    size_t at = negative || text[0] == '+';
+    if (at == n) return false;
+
+    long long value = 0;
+    for (; at < n; at++) {
+        if (text[at] < '0' || text[at] > '9') return false;
+        value = value * 10 + (text[at] - '0');
+        if (value > static_cast<long long>(INT_MAX) + negative) return false;
+    }
+    out = static_cast<int>(negative ? -value : value);
+    return true;
+}
+
+RouteTrie::RouteTrie() {
+    nodes[0] = Node{"", 0, false, NO_MATCH, NONE, NONE};
+}
+
+// The child of parent for a segment, added if there is none yet; every
+// {param} at one position shares a node. NONE once the nodes run out.
+uint8_t RouteTrie::child(uint8_t parent, const char* segment, size_t length, bool param) {
+    uint8_t last = NONE;
+    for (uint8_t at = nodes[parent].firstChild; at != NONE; at = nodes[at].nextSibling) {
+        const Node& node = nodes[at];
+        if (node.param == param && (param || (node.length == length && memcmp(node.segment, segment, length) == 0)))
+            return at;
+        last = at;
+    }
+    if (nodeCount == MAX_NODES || length > UINT8_MAX) return NONE;
+
+    uint8_t added = static_cast<uint8_t>(nodeCount++);
+    nodes[added] = Node{segment, static_cast<uint8_t>(length), param, NO_MATCH, NONE, NONE};
+    if (last == NONE) {
+        nodes[parent].firstChild = added;
+    } else {
+        nodes[last].nextSibling = added;
+    }
+    return added;
+}
+
+int RouteTrie::add(const char* pattern) {
+    if (pattern[0] != '/') return NO_MATCH;
+    uint8_t node = 0;
+    size_t params = 0;
+    const char* segment = pattern + 1; // "/" alone is the root
+    while (*segment) {
+        const char* slash = strchr(segment, '/');
+        size_t length = slash ? static_cast<size_t>(slash - segment) : strlen(segment);
+        if (length == 0) return NO_MATCH;
+
+        bool param = segment[0] == '{' && segment[length - 1] == '}';
+        if (param && ++params > PathParams::MAX_PARAMS) return NO_MATCH;
+        node = child(node, segment, length, param);
+        if (node == NONE) return NO_MATCH;
+        if (!slash) break;
+        segment = slash + 1;
+        if (!*segment) return NO_MATCH; // trailing slash
+    }
+
+    if (nodes[node].pattern == NO_MATCH) {
+        if (patternCount == MAX_PATTERNS) return NO_MATCH;
+        nodes[node].pattern = static_cast<int8_t>(patternCount++);
+    }
+    return nodes[node].pattern;
+}
+
+int RouteTrie::match(const char* path, size_t len, PathParams& params) const {
+    params.count = 0;
+    if (len == 0 || path[0] != '/') return NO_MATCH;
+
+    uint8_t node = 0;
+    const char* end = path + len;
+    const char* segment = path + 1;
+    while (segment < end) {
+        const char* slash = static_cast<const char*>(memchr(segment, '/', end - segment));
+        size_t length = (slash ? slash : end) - segment;
+        if (length == 0) return NO_MATCH;
+
+        uint8_t literal = NONE;
+        uint8_t param = NONE;
+        for (uint8_t at = nodes[node].firstChild; at != NONE && literal == NONE; at = nodes[at].nextSibling) {
+            const Node& candidate = nodes[at];
+            if (candidate.param) {
+                param = at;
+            } else if (candidate.length == length && memcmp(candidate.segment, segment, length) == 0) {
+                literal = at;
+            }
+        }
+        if (literal != NONE) {
+            node = literal;
+        } else if (param != NONE && length <= UINT8_MAX) {
+            node = param;
+            params.values[params.count] = segment;
+            params.lengths[params.count] = static_cast<uint8_t>(length);
+            params.count++;
+        } else {
+            return NO_MATCH;
+        }
+        if (!slash) break;
+        segment = slash + 1;
+        if (segment == end) return NO_MATCH; // trailing slash
+    }
+    return nodes[node].pattern;
+}
@@ -0,0 +1,64 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The {param} segments of a matched path, pointing into the path itself
+struct PathParams {
+    static const size_t MAX_PARAMS = 2;
+
+    const char* values[MAX_PARAMS];
+    uint8_t lengths[MAX_PARAMS];
+    size_t count = 0;
+
+    // Parameter i as a whole decimal int, optionally signed; false for
+    // anything else, or one out of range
+    bool toInt(size_t i, int& out) const;
+};
+
+// Matches request paths against patterns such as "/api/devices/{id}/status"
+// by walking a trie of path segments, so a lookup costs one pass over the
+// path whatever the number of routes. At each segment a literal child is
+// taken before a {param} one and the walk never backs up: "/a/b" and
+// "/a/{x}/c" may coexist, but "/a/b/c" then does not reach the latter.
+// Nodes live in a fixed array and the patterns' text is referenced, not
+// copied, so patterns must outlive the trie (string literals do).
+class RouteTrie {
+public:
+    static const size_t MAX_NODES = 48;
+    static const size_t MAX_PATTERNS = 24;
+    static const int NO_MATCH = -1;
+
+private:
+    static const uint8_t NONE = 0; // no child or sibling: the root is nobody's
+
+    struct Node {
+        const char* segment;
+        uint8_t length;
+        bool param;
+        int8_t pattern; // pattern ending here, NO_MATCH for none
+        uint8_t firstChild;
+        uint8_t nextSibling;
+    };
+
+    Node nodes[MAX_NODES];
+    size_t nodeCount = 1;
+    size_t patternCount = 0;
+
+    uint8_t child(uint8_t parent, const char* segment, size_t length, bool param);
+
+public:
+    RouteTrie();
+
+    // Index of pattern, from 0 in the order patterns are first added, or
+    // NO_MATCH if it does not start with '/', has an empty segment, has
+    // more than MAX_PARAMS parameters or there is no room left
+    int add(const char* pattern);
+    // Index of the pattern path matches, with its parameters, or NO_MATCH.
+    // path is len bytes, without the query string.
+    int match(const char* path, size_t len, PathParams& params) const;
+    size_t size() const { return patternCount; }
+};
+
+#endif // ROUTER_H
@@ -0,0 +1,49 @@
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+struct Sample {
+    uint32_t timeMs;
+    uint16_t value;
+};
+
+// The newest samples of one input, numbered from 1. One task pushes; any
+// task reads by sequence number without a lock, the same check-copy-recheck
+// as ChangeJournal: get() fails for a sample that was overwritten, or that
+// the writer may be overwriting while it is copied.
+class SampleRing {
+public:
+    static const size_t CAPACITY = 256;
+
+private:
+    Sample slots[CAPACITY];
+    std::atomic<uint32_t> last{0};
+
+public:
+    void push(uint32_t timeMs, uint16_t value) {
+        uint32_t seq = last.load(std::memory_order_relaxed) + 1;
+        slots[seq % CAPACITY] = {timeMs, value};
+        last.store(seq, std::memory_order_release);
+    }
+
+    // Sequence number of the newest sample, 0 if none yet
+    uint32_t latest() const { return last.load(std::memory_order_acquire); }
+    // Oldest sequence number still readable; latest() + 1 while empty. The
+    // slot after the newest is the next one written, so one is kept spare.
+    uint32_t oldest() const {
+        uint32_t newest = latest();
+        return newest >= CAPACITY - 1 ? newest - (CAPACITY - 2) : 1;
+    }
+
+    bool get(uint32_t seq, Sample& out) const {
+        if (seq == 0 || seq > latest() || seq < oldest()) return false;
+        out = slots[seq % CAPACITY];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return last.load(std::memory_order_relaxed) - seq < CAPACITY - 1;
+    }
+};
+
+#endif // SAMPLERING_H
@@ -0,0 +1,194 @@
+#include "SampleStream.h"
+#include <string.h>
+
+namespace {
+
+const char HEAD_JSON[] = "{\"message\":\"Samples retrieved\",\"status\":true,\"data\":{\"device\":";
+const char TAIL_JSON[] = "]}}";
+
+// {"message":"Samples retrieved","status":true,"data":
+const uint8_t HEAD_MSGPACK[] = {0x83, 0xa7, 'm', 'e', 's', 's', 'a', 'g', 'e', 0xb1, 'S', 'a', 'm', 'p', 'l', 'e',
+                                's', ' ', 'r', 'e', 't', 'r', 'i', 'e', 'v', 'e', 'd', 0xa6, 's', 't', 'a', 't',
+                                'u', 's', 0xc3, 0xa4, 'd', 'a', 't', 'a'};
+
+size_t writeLiteral(uint8_t* out, const char* text) {
+    size_t n = strlen(text);
+    memcpy(out, text, n);
+    return n;
+}
+
+size_t writeDecimal(uint8_t* out, uint32_t magnitude, bool negative) {
+    char digits[10];
+    size_t count = 0;
+    size_t n = 0;
+    if (negative) out[n++] = '-';
+    do {
+        digits[count++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    while (count) out[n++] = digits[--count];
+    return n;
+}
+
+size_t writeBigEndian(uint8_t* out, uint32_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) out[i] = static_cast<uint8_t>(value >> (8 * (bytes - 1 - i)));
+    return bytes;
+}
+
+// Smallest encoding, as ArduinoJson picks it
+size_t writeUint(uint8_t* out, uint32_t value) {
+    if (value <= 0x7f) {
+        out[0] = static_cast<uint8_t>(value);
+        return 1;
+    }
+    if (value <= 0xff) {
+        out[0] = 0xcc;
+        return 1 + writeBigEndian(out + 1, value, 1);
+    }
+    if (value <= 0xffff) {
+        out[0] = 0xcd;
+        return 1 + writeBigEndian(out + 1, value, 2);
+    }
+    out[0] = 0xce;
+    return 1 + writeBigEndian(out + 1, value, 4);
+}
+
+size_t writeInt(uint8_t* out, int value) {
+    if (value >= 0) return writeUint(out, static_cast<uint32_t>(value));
+    if (value >= -32) {
+        out[0] = static_cast<uint8_t>(value);
+        return 1;
+    }
+    if (value >= -128) {
+        out[0] = 0xd0;
+        return 1 + writeBigEndian(out + 1, static_cast<uint32_t>(value), 1);
+    }
+    if (value >= -32768) {
+        out[0] = 0xd1;
+        return 1 + writeBigEndian(out + 1, static_cast<uint32_t>(value), 2);
+    }
+    out[0] = 0xd2;
+    return 1 + writeBigEndian(out + 1, static_cast<uint32_t>(value), 4);
+}
+
+size_t writeKey(uint8_t* out, const char* key) {
+    size_t len = strlen(key);
+    out[0] = static_cast<uint8_t>(0xa0 | len);
+    memcpy(out + 1, key, len);
+    return 1 + len;
+}
+
+size_t writeArrayHeader(uint8_t* out, uint32_t count) {
+    if (count < 16) {
+        out[0] = static_cast<uint8_t>(0x90 | count);
+        return 1;
+    }
+    if (count <= 0xffff) {
+        out[0] = 0xdc;
+        return 1 + writeBigEndian(out + 1, count, 2);
+    }
+    out[0] = 0xdd;
+    return 1 + writeBigEndian(out + 1, count, 4);
+}
+
+} // namespace
+
+SampleStream::SampleStream(const SampleRing& samples, int id, uint32_t since, Format bodyFormat)
+    : ring(&samples), format(bodyFormat), deviceId(id) {
+    upTo = samples.latest();
+    if (since > upTo) since = 0;
+    from = since + 1;
+    uint32_t oldest = samples.oldest();
+    if (from < oldest) from = oldest;
+    // The ring moved on since latest() was read
+    if (from > upTo + 1) from = upTo + 1;
+    dropped = from - since - 1;
+    next = from;
+}
+
+void SampleStream::produce() {
+    pendingPos = 0;
+    pendingLen = 0;
+    uint8_t* out = pending;
+
+    switch (stage) {
+    case HEAD:
+        if (format == JSON) {
+            out += writeLiteral(out, HEAD_JSON);
+            out += writeDecimal(out, deviceId < 0 ? 0u - static_cast<uint32_t>(deviceId) : deviceId, deviceId < 0);
+            out += writeLiteral(out, ",\"from\":");
+            out += writeDecimal(out, from, false);
+            out += writeLiteral(out, ",\"next\":");
+            out += writeDecimal(out, upTo, false);
+            out += writeLiteral(out, ",\"dropped\":");
+            out += writeDecimal(out, dropped, false);
+            out += writeLiteral(out, ",\"samples\":[");
+        } else {
+            memcpy(out, HEAD_MSGPACK, sizeof(HEAD_MSGPACK));
+            out += sizeof(HEAD_MSGPACK);
+            *out++ = 0x85;
+            out += writeKey(out, "device");
+            out += writeInt(out, deviceId);
+            out += writeKey(out, "from");
+            out += writeUint(out, from);
+            out += writeKey(out, "next");
+            out += writeUint(out, upTo);
+            out += writeKey(out, "dropped");
+            out += writeUint(out, dropped);
+            out += writeKey(out, "samples");
+            out += writeArrayHeader(out, upTo + 1 - from);
+        }
+        stage = SAMPLES;
+        break;
+    case SAMPLES: {
+        if (next > upTo) {
+            if (format == JSON) out += writeLiteral(out, TAIL_JSON);
+            stage = format == JSON ? TAIL : DONE;
+            break;
+        }
+        Sample sample;
+        bool held = ring->get(next, sample);
+        if (format == JSON) {
+            if (next > from) *out++ = ',';
+            if (held) {
+                *out++ = '[';
+                out += writeDecimal(out, sample.timeMs, false);
+                *out++ = ',';
+                out += writeDecimal(out, sample.value, false);
+                *out++ = ']';
+            } else {
+                out += writeLiteral(out, "null");
+            }
+        } else if (held) {
+            *out++ = 0x92;
+            out += writeUint(out, sample.timeMs);
+            out += writeUint(out, sample.value);
+        } else {
+            *out++ = 0xc0;
+        }
+        next++;
+        break;
+    }
+    case TAIL:
+    case DONE:
+        stage = DONE;
+        break;
+    }
+    pendingLen = out - pending;
+}
+
+size_t SampleStream::read(uint8_t* buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+        if (pendingPos == pendingLen) {
+            produce();
+            if (pendingLen == 0) break;
+        }
+        size_t n = pendingLen - pendingPos;
+        if (n > maxLen - written) n = maxLen - written;
+        memcpy(buffer + written, pending + pendingPos, n);
+        pendingPos += n;
+        written += n;
+    }
+    return written;
+}
@@ -0,0 +1,61 @@
+#ifndef SAMPLESTREAM_H
+#define SAMPLESTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "SampleRing.h"
+
+// Resumable writer for the GET /api/devices/{id}/samples body:
+// {"message","status","data":{device,from,next,dropped,samples:[[timeMs,
+// value]...]}}, as JSON or MessagePack. Samples are read out of the ring one
+// at a time as the response is sent, never copied as a whole. The range is
+// fixed when the stream is made: samples after `since` up to the newest one,
+// from the oldest still held if `since` is older than that (the ones skipped
+// are counted in `dropped`). A sample overwritten before it could be sent is
+// written as null, keeping its place.
+class SampleStream {
+public:
+    enum Format {
+        JSON,
+        MSGPACK
+    };
+
+    // Longest head: its fixed text plus four numbers of up to 11 characters
+    static const size_t MAX_ENTRY_SIZE = 160;
+
+private:
+    enum Stage {
+        HEAD,
+        SAMPLES,
+        TAIL,
+        DONE
+    };
+
+    const SampleRing* ring;
+    Format format;
+    int deviceId;
+    uint32_t from;
+    uint32_t upTo;
+    uint32_t dropped;
+    uint32_t next;
+    Stage stage = HEAD;
+    uint8_t pending[MAX_ENTRY_SIZE];
+    size_t pendingLen = 0;
+    size_t pendingPos = 0;
+
+    void produce();
+
+public:
+    // A since beyond the newest sample, as a client holds across a restart,
+    // starts from the oldest sample
+    SampleStream(const SampleRing& samples, int id, uint32_t since, Format bodyFormat = JSON);
+
+    // Copies up to maxLen further bytes of the document into buffer. Returns
+    // 0 once the whole document has been written.
+    size_t read(uint8_t* buffer, size_t maxLen);
+
+    uint32_t first() const { return from; }
+    uint32_t last() const { return upTo; }
+};
+
+#endif // SAMPLESTREAM_H
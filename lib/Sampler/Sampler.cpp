@@ -0,0 +1,100 @@
+#include "Sampler.h"
+#include <Arduino.h>
+#include <string.h>
+
+void Sampler::begin(const DeviceManager& manager) {
+    if (task) return;
+
+    Device device;
+    for (size_t slot = 0; manager.readDevice(slot, device); slot++) {
+        if (device.input) addInput(device.id, device.gpioPin, strcmp(device.type, SENSOR_TYPE) == 0);
+    }
+    if (inputCount == 0) return;
+    xTaskCreatePinnedToCore(taskMain, "sampler", 4096, this, TASK_PRIORITY, &task, 1);
+}
+
+bool Sampler::addInput(int deviceId, int pin, bool analog) {
+    if (task || inputCount == MAX_INPUTS || ring(deviceId)) return false;
+    Input& input = inputs[inputCount++];
+    input.deviceId = deviceId;
+    input.pin = static_cast<uint8_t>(pin);
+    input.analog = analog;
+    input.started = false;
+    input.changed = 0;
+    input.count = 0;
+    input.sum = 0;
+    return true;
+}
+
+void Sampler::sample(uint32_t nowMs) {
+    for (size_t i = 0; i < inputCount; i++) {
+        Input& input = inputs[i];
+        if (input.analog) {
+            input.sum += analogRead(input.pin);
+            if (++input.count == SENSOR_AVERAGE) {
+                input.ring.push(nowMs, static_cast<uint16_t>((input.sum + SENSOR_AVERAGE / 2) / SENSOR_AVERAGE));
+                input.sum = 0;
+                input.count = 0;
+            }
+            continue;
+        }
+
+        uint16_t level = digitalRead(input.pin);
+        if (!input.started) {
+            input.started = true;
+            input.stable = level;
+            input.ring.push(nowMs, level);
+        } else if (level == input.stable) {
+            input.changed = 0;
+        } else if (++input.changed == DEBOUNCE_SAMPLES) {
+            input.stable = level;
+            input.changed = 0;
+            input.ring.push(nowMs, level);
+        }
+    }
+}
+
+const SampleRing* Sampler::ring(int deviceId) const {
+    for (size_t i = 0; i < inputCount; i++) {
+        if (inputs[i].deviceId == deviceId) return &inputs[i].ring;
+    }
+    return nullptr;
+}
+
+Sampler::Stats Sampler::getStats() const {
+    Stats copy;
+    uint32_t start;
+    do {
+        start = statsLock.readBegin();
+        copy = stats;
+    } while (statsLock.readRetry(start));
+    return copy;
+}
+
+void Sampler::taskMain(void* self) {
+    static_cast<Sampler*>(self)->run();
+}
+
+void Sampler::run() {
+    const TickType_t period = pdMS_TO_TICKS(PERIOD_MS);
+    TickType_t wake = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelayUntil(&wake, period);
+        uint32_t start = micros();
+        sample(millis());
+        uint32_t busy = micros() - start;
+
+        // Behind by more than a period: skip ahead rather than sample in a
+        // burst, which would only store stale readings
+        TickType_t late = xTaskGetTickCount() - wake;
+        uint32_t skipped = late >= period ? late / period : 0;
+        wake += skipped * period;
+
+        statsLock.writeBegin();
+        stats.passes++;
+        stats.missed += skipped;
+        stats.busyUs += busy;
+        if (busy > stats.maxBusyUs) stats.maxBusyUs = busy;
+        statsLock.writeEnd();
+    }
+}
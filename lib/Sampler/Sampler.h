@@ -0,0 +1,73 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <DeviceManager.h>
+#include <SeqLock.h>
+#include "SampleRing.h"
+
+// Reads every input device once per millisecond on its own task and keeps
+// what it learns in a SampleRing per device, so handlers can serve history
+// without touching a pin. Contacts are debounced: a new level is stored
+// only once it has held for DEBOUNCE_SAMPLES readings in a row, so the ring
+// holds edges, not raw readings. Sensors are decimated: SENSOR_AVERAGE ADC
+// readings are averaged into each stored sample.
+class Sampler {
+public:
+    static const size_t MAX_INPUTS = 8;
+    static const uint32_t PERIOD_MS = 1;
+    static const uint8_t DEBOUNCE_SAMPLES = 20;
+    static const uint16_t SENSOR_AVERAGE = 100;
+    // Above the actuator, so a burst of commands does not delay a reading
+    static const UBaseType_t TASK_PRIORITY = 5;
+
+    struct Stats {
+        uint32_t passes;     // periods sampled
+        uint32_t missed;     // periods skipped because a pass started late
+        uint64_t busyUs;     // time spent reading and storing
+        uint32_t maxBusyUs;  // longest single pass
+    };
+
+private:
+    struct Input {
+        int deviceId;
+        uint8_t pin;
+        bool analog;
+        bool started;
+        uint16_t stable;  // contact: last stored level
+        uint8_t changed;  // contact: readings in a row that differ from it
+        uint16_t count;   // sensor: readings summed so far
+        uint32_t sum;
+        SampleRing ring;
+    };
+
+    Input inputs[MAX_INPUTS];
+    size_t inputCount = 0;
+    TaskHandle_t task = nullptr;
+    Stats stats = {};
+    SeqLock statsLock;
+
+    static void taskMain(void* self);
+    void run();
+
+public:
+    // Takes up to MAX_INPUTS CONTACT_TYPE and SENSOR_TYPE devices from the
+    // manager and starts the task if there are any. Inputs added to the
+    // manager later are not sampled. Later calls do nothing.
+    void begin(const DeviceManager& manager);
+    // False when all MAX_INPUTS are taken or the device already has one.
+    // Only before begin().
+    bool addInput(int deviceId, int pin, bool analog);
+
+    // One reading of every input, as the task takes each period; public so
+    // the host build can drive it on a virtual clock
+    void sample(uint32_t nowMs);
+
+    // Samples of an input device, or null if it has none
+    const SampleRing* ring(int deviceId) const;
+    size_t size() const { return inputCount; }
+    Stats getStats() const;
+};
+
+#endif // SAMPLER_H
@@ -0,0 +1,193 @@
+#include "ScheduleStream.h"
+#include <string.h>
+
+namespace {
+
+const char HEAD_JSON[] = "{\"message\":\"Schedules\",\"status\":true,\"data\":[";
+const char TAIL_JSON[] = "]}";
+
+// {"message":"Schedules","status":true,"data":
+const uint8_t HEAD_MSGPACK[] = {0x83, 0xa7, 'm', 'e', 's', 's', 'a', 'g', 'e', 0xa9, 'S', 'c', 'h', 'e', 'd', 'u',
+                                'l', 'e', 's', 0xa6, 's', 't', 'a', 't', 'u', 's', 0xc3, 0xa4, 'd', 'a', 't', 'a'};
+
+size_t writeLiteral(uint8_t* out, const char* text) {
+    size_t n = strlen(text);
+    memcpy(out, text, n);
+    return n;
+}
+
+size_t writeDecimal(uint8_t* out, uint32_t magnitude, bool negative) {
+    char digits[10];
+    size_t count = 0;
+    size_t n = 0;
+    if (negative) out[n++] = '-';
+    do {
+        digits[count++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    while (count) out[n++] = digits[--count];
+    return n;
+}
+
+size_t writeBigEndian(uint8_t* out, uint32_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) out[i] = static_cast<uint8_t>(value >> (8 * (bytes - 1 - i)));
+    return bytes;
+}
+
+// Smallest encoding, as ArduinoJson picks it
+size_t writeUint(uint8_t* out, uint32_t value) {
+    if (value <= 0x7f) {
+        out[0] = static_cast<uint8_t>(value);
+        return 1;
+    }
+    if (value <= 0xff) {
+        out[0] = 0xcc;
+        return 1 + writeBigEndian(out + 1, value, 1);
+    }
+    if (value <= 0xffff) {
+        out[0] = 0xcd;
+        return 1 + writeBigEndian(out + 1, value, 2);
+    }
+    out[0] = 0xce;
+    return 1 + writeBigEndian(out + 1, value, 4);
+}
+
+size_t writeInt(uint8_t* out, int value) {
+    if (value >= 0) return writeUint(out, static_cast<uint32_t>(value));
+    if (value >= -32) {
+        out[0] = static_cast<uint8_t>(value);
+        return 1;
+    }
+    if (value >= -128) {
+        out[0] = 0xd0;
+        return 1 + writeBigEndian(out + 1, static_cast<uint32_t>(value), 1);
+    }
+    if (value >= -32768) {
+        out[0] = 0xd1;
+        return 1 + writeBigEndian(out + 1, static_cast<uint32_t>(value), 2);
+    }
+    out[0] = 0xd2;
+    return 1 + writeBigEndian(out + 1, static_cast<uint32_t>(value), 4);
+}
+
+// Keys and action names are all fixstr
+size_t writeString(uint8_t* out, const char* text) {
+    size_t len = strlen(text);
+    out[0] = static_cast<uint8_t>(0xa0 | len);
+    memcpy(out + 1, text, len);
+    return 1 + len;
+}
+
+size_t writeArrayHeader(uint8_t* out, uint32_t count) {
+    if (count < 16) {
+        out[0] = static_cast<uint8_t>(0x90 | count);
+        return 1;
+    }
+    if (count <= 0xffff) {
+        out[0] = 0xdc;
+        return 1 + writeBigEndian(out + 1, count, 2);
+    }
+    out[0] = 0xdd;
+    return 1 + writeBigEndian(out + 1, count, 4);
+}
+
+} // namespace
+
+void ScheduleStream::writeTimer(uint8_t*& out, const Scheduler::Timer& timer) {
+    int32_t dueIn = static_cast<int32_t>(timer.due - now);
+    uint32_t dueInMs = dueIn > 0 ? static_cast<uint32_t>(dueIn) : 0;
+    const char* action = Scheduler::ACTION_NAMES[timer.action];
+    if (format == JSON) {
+        if (listed > 0) *out++ = ',';
+        out += writeLiteral(out, "{\"schedule\":");
+        out += writeDecimal(out, timer.id, false);
+        out += writeLiteral(out, ",\"device\":");
+        out += writeDecimal(out, timer.deviceId < 0 ? 0u - static_cast<uint32_t>(timer.deviceId) : timer.deviceId,
+                            timer.deviceId < 0);
+        out += writeLiteral(out, ",\"action\":\"");
+        out += writeLiteral(out, action);
+        out += writeLiteral(out, "\",\"dueInMs\":");
+        out += writeDecimal(out, dueInMs, false);
+        out += writeLiteral(out, ",\"repeatMs\":");
+        out += writeDecimal(out, timer.periodMs, false);
+        out += writeLiteral(out, ",\"pulseMs\":");
+        out += writeDecimal(out, timer.pulseMs, false);
+        *out++ = '}';
+    } else {
+        *out++ = 0x86;
+        out += writeString(out, "schedule");
+        out += writeUint(out, timer.id);
+        out += writeString(out, "device");
+        out += writeInt(out, timer.deviceId);
+        out += writeString(out, "action");
+        out += writeString(out, action);
+        out += writeString(out, "dueInMs");
+        out += writeUint(out, dueInMs);
+        out += writeString(out, "repeatMs");
+        out += writeUint(out, timer.periodMs);
+        out += writeString(out, "pulseMs");
+        out += writeUint(out, timer.pulseMs);
+        left--;
+    }
+    listed++;
+}
+
+void ScheduleStream::produce() {
+    pendingPos = 0;
+    pendingLen = 0;
+    uint8_t* out = pending;
+
+    switch (stage) {
+    case HEAD:
+        if (format == JSON) {
+            out += writeLiteral(out, HEAD_JSON);
+        } else {
+            left = scheduler->size();
+            memcpy(out, HEAD_MSGPACK, sizeof(HEAD_MSGPACK));
+            out += sizeof(HEAD_MSGPACK);
+            out += writeArrayHeader(out, static_cast<uint32_t>(left));
+        }
+        stage = SCHEDULES;
+        break;
+    case SCHEDULES: {
+        Scheduler::Timer timer;
+        if ((format == JSON || left > 0) && scheduler->next(slot, timer)) {
+            writeTimer(out, timer);
+            break;
+        }
+        if (format == JSON) {
+            out += writeLiteral(out, TAIL_JSON);
+            stage = TAIL;
+            break;
+        }
+        stage = PADDING;
+    }
+    // fall through
+    case PADDING:
+        // Timers that fired before they were reached
+        for (; left > 0 && out < pending + MAX_ENTRY_SIZE; left--) *out++ = 0xc0;
+        if (out == pending) stage = DONE;
+        break;
+    case TAIL:
+    case DONE:
+        stage = DONE;
+        break;
+    }
+    pendingLen = out - pending;
+}
+
+size_t ScheduleStream::read(uint8_t* buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+        if (pendingPos == pendingLen) {
+            produce();
+            if (pendingLen == 0) break;
+        }
+        size_t n = pendingLen - pendingPos;
+        if (n > maxLen - written) n = maxLen - written;
+        memcpy(buffer + written, pending + pendingPos, n);
+        pendingPos += n;
+        written += n;
+    }
+    return written;
+}
@@ -0,0 +1,60 @@
+#ifndef SCHEDULESTREAM_H
+#define SCHEDULESTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Scheduler.h"
+
+// Resumable writer for the GET /api/schedules body: {"message","status",
+// "data":[{schedule,device,action,dueInMs,repeatMs,pulseMs}...]}, as JSON or
+// MessagePack, byte for byte what ArduinoJson writes for it. Timers are read
+// out of the scheduler one at a time as the response is sent (see
+// Scheduler::next()), never copied as a whole. The MessagePack array's length
+// is the count pending when the stream starts: timers that fire before they
+// are reached are written as nil, and ones armed later may be left out.
+class ScheduleStream {
+public:
+    enum Format {
+        JSON,
+        MSGPACK
+    };
+
+    // Longest entry: separating comma, keys and punctuation, the longest
+    // action and five numbers of up to 11 characters
+    static const size_t MAX_ENTRY_SIZE =
+        sizeof(",{\"schedule\":,\"device\":,\"action\":\"toggle\",\"dueInMs\":,\"repeatMs\":,\"pulseMs\":}") + 5 * 11;
+
+private:
+    enum Stage {
+        HEAD,
+        SCHEDULES,
+        PADDING,
+        TAIL,
+        DONE
+    };
+
+    const Scheduler* scheduler;
+    Format format;
+    uint32_t now;
+    Stage stage = HEAD;
+    size_t slot = 0; // next pool slot to look at
+    size_t listed = 0;
+    size_t left = 0; // MessagePack entries the array still needs
+    uint8_t pending[MAX_ENTRY_SIZE] = {};
+    size_t pendingLen = 0;
+    size_t pendingPos = 0;
+
+    void writeTimer(uint8_t*& out, const Scheduler::Timer& timer);
+    void produce();
+
+public:
+    // dueInMs is counted from at, a millis() value
+    ScheduleStream(const Scheduler& timers, uint32_t at, Format bodyFormat = JSON)
+        : scheduler(&timers), format(bodyFormat), now(at) {}
+
+    // Copies up to maxLen further bytes of the document into buffer. Returns
+    // 0 once the whole document has been written.
+    size_t read(uint8_t* buffer, size_t maxLen);
+};
+
+#endif // SCHEDULESTREAM_H
@@ -0,0 +1,221 @@
+#include "Scheduler.h"
+#include <Arduino.h>
+
+namespace {
+
+// True if time a is at or past time b, across millis() wraparound
+bool reached(uint32_t a, uint32_t b) {
+    return static_cast<int32_t>(a - b) >= 0;
+}
+
+class Guard {
+private:
+    SemaphoreHandle_t lock;
+
+public:
+    explicit Guard(SemaphoreHandle_t mutex) : lock(mutex) { xSemaphoreTake(lock, portMAX_DELAY); }
+    ~Guard() { xSemaphoreGive(lock); }
+};
+
+} // namespace
+
+const char* const Scheduler::ACTION_NAMES[PULSE + 1] = {"off", "on", "toggle", "pulse"};
+
+Scheduler::Scheduler(size_t capacity) : lock(xSemaphoreCreateMutex()) {
+    if (capacity > MAX_CAPACITY) capacity = MAX_CAPACITY;
+    slots.resize(capacity);
+    heap.reserve(capacity);
+    freeSlots.reserve(capacity);
+    for (size_t i = capacity; i > 0; i--) {
+        slots[i - 1].generation = 1;
+        freeSlots.push_back(static_cast<uint16_t>(i - 1));
+    }
+}
+
+Scheduler::~Scheduler() {
+    vSemaphoreDelete(lock);
+}
+
+bool Scheduler::before(uint16_t a, uint16_t b) const {
+    return static_cast<int32_t>(slots[a].timer.due - slots[b].timer.due) < 0;
+}
+
+void Scheduler::place(uint32_t index, uint16_t slot) {
+    heap[index] = slot;
+    slots[slot].heapIndex = index;
+}
+
+void Scheduler::siftUp(uint32_t index) {
+    uint16_t slot = heap[index];
+    while (index > 0) {
+        uint32_t parent = (index - 1) / 2;
+        if (!before(slot, heap[parent])) break;
+        place(index, heap[parent]);
+        index = parent;
+    }
+    place(index, slot);
+}
+
+void Scheduler::siftDown(uint32_t index) {
+    uint16_t slot = heap[index];
+    uint32_t count = static_cast<uint32_t>(heap.size());
+    while (true) {
+        uint32_t child = 2 * index + 1;
+        if (child >= count) break;
+        if (child + 1 < count && before(heap[child + 1], heap[child])) child++;
+        if (!before(heap[child], slot)) break;
+        place(index, heap[child]);
+        index = child;
+    }
+    place(index, slot);
+}
+
+// Drops heap entry index and returns its slot to the pool
+void Scheduler::removeAt(uint32_t index) {
+    uint16_t slot = heap[index];
+    uint16_t last = heap.back();
+    heap.pop_back();
+    if (index < heap.size()) {
+        place(index, last);
+        if (index > 0 && before(last, heap[(index - 1) / 2])) {
+            siftUp(index);
+        } else {
+            siftDown(index);
+        }
+    }
+
+    Slot& freed = slots[slot];
+    freed.timer.id = 0;
+    if (++freed.generation == 0) freed.generation = 1;
+    freeSlots.push_back(slot);
+}
+
+uint32_t Scheduler::arm(int deviceId, Action action, uint32_t now, uint32_t delayMs, uint32_t periodMs,
+                        uint32_t pulseMs) {
+    if (delayMs > MAX_DELAY_MS || pulseMs > MAX_DELAY_MS) return 0;
+    if (periodMs != 0 && (periodMs < MIN_PERIOD_MS || periodMs > MAX_DELAY_MS)) return 0;
+
+    Guard guard(lock);
+    if (freeSlots.empty()) return 0;
+    uint16_t slot = freeSlots.back();
+    freeSlots.pop_back();
+
+    Timer& timer = slots[slot].timer;
+    timer.id = (static_cast<uint32_t>(slots[slot].generation) << 16) | slot;
+    timer.deviceId = deviceId;
+    timer.action = action;
+    timer.due = now + delayMs;
+    timer.periodMs = periodMs;
+    timer.pulseMs = pulseMs;
+
+    heap.push_back(slot);
+    siftUp(static_cast<uint32_t>(heap.size() - 1));
+    return timer.id;
+}
+
+bool Scheduler::cancel(uint32_t id) {
+    uint16_t slot = static_cast<uint16_t>(id & 0xffff);
+    Guard guard(lock);
+    if (id == 0 || slot >= slots.size() || slots[slot].timer.id != id) return false;
+    removeAt(slots[slot].heapIndex);
+    return true;
+}
+
+bool Scheduler::reschedule(uint32_t id, uint32_t now, uint32_t delayMs) {
+    if (delayMs > MAX_DELAY_MS) return false;
+    uint16_t slot = static_cast<uint16_t>(id & 0xffff);
+    Guard guard(lock);
+    if (id == 0 || slot >= slots.size() || slots[slot].timer.id != id) return false;
+    slots[slot].timer.due = now + delayMs;
+    uint32_t index = slots[slot].heapIndex;
+    if (index > 0 && before(slot, heap[(index - 1) / 2])) {
+        siftUp(index);
+    } else {
+        siftDown(index);
+    }
+    return true;
+}
+
+size_t Scheduler::cancelDevice(int deviceId) {
+    Guard guard(lock);
+    size_t cancelled = 0;
+    // By slot, since removals reorder the heap
+    for (Slot& slot : slots) {
+        if (slot.timer.id != 0 && slot.timer.deviceId == deviceId) {
+            removeAt(slot.heapIndex);
+            cancelled++;
+        }
+    }
+    return cancelled;
+}
+
+size_t Scheduler::poll(uint32_t now, Timer* fired, size_t max) {
+    uint32_t nowUs = micros();
+    Guard guard(lock);
+    size_t count = 0;
+    while (count < max && !heap.empty()) {
+        uint16_t slot = heap[0];
+        Timer& timer = slots[slot].timer;
+        if (!reached(now, timer.due)) break;
+
+        fired[count++] = timer;
+        // millis() and micros() come from the same counter, so the due
+        // time in microseconds wraps along with micros()
+        int32_t lateUs = static_cast<int32_t>(nowUs - timer.due * 1000);
+        if (lateUs < 0) lateUs = 0;
+        stats.fired++;
+        stats.totalLateUs += lateUs;
+        if (static_cast<uint32_t>(lateUs) > stats.maxLateUs) stats.maxLateUs = lateUs;
+
+        if (timer.periodMs == 0) {
+            removeAt(0);
+            continue;
+        }
+        timer.due += timer.periodMs;
+        if (reached(now, timer.due)) timer.due = now + timer.periodMs;
+        siftDown(0);
+    }
+    return count;
+}
+
+uint32_t Scheduler::msUntilNext(uint32_t now, uint32_t limit) const {
+    Guard guard(lock);
+    if (heap.empty()) return limit;
+    uint32_t due = slots[heap[0]].timer.due;
+    if (reached(now, due)) return 0;
+    return due - now < limit ? due - now : limit;
+}
+
+size_t Scheduler::snapshot(Timer* out, size_t max) const {
+    Guard guard(lock);
+    size_t count = heap.size() < max ? heap.size() : max;
+    for (size_t i = 0; i < count; i++) out[i] = slots[heap[i]].timer;
+    return count;
+}
+
+bool Scheduler::next(size_t& slot, Timer& out) const {
+    Guard guard(lock);
+    for (; slot < slots.size(); slot++) {
+        // Free slots have their id cleared
+        if (slots[slot].timer.id != 0) {
+            out = slots[slot++].timer;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t Scheduler::size() const {
+    Guard guard(lock);
+    return heap.size();
+}
+
+Scheduler::Stats Scheduler::getStats() const {
+    Guard guard(lock);
+    return stats;
+}
+
+void Scheduler::resetStats() {
+    Guard guard(lock);
+    stats = {};
+}
@@ -0,0 +1,106 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Pending device timers: one-shot or recurring, each switching one device.
+//
+// Timers live in a fixed pool allocated up front and are ordered by a binary
+// min-heap of pool slots that tracks each slot's position, so arm(), cancel()
+// and firing are O(log n) and finding the next due timer is O(1). Ids carry
+// the slot and a generation, so a cancelled id is never mistaken for a later
+// timer in the same slot. Times are millis() values compared wrap-safely,
+// which is why delays and periods are capped at MAX_DELAY_MS.
+//
+// Request handlers arm and cancel while loop() polls; a mutex covers both.
+class Scheduler {
+public:
+    enum Action : uint8_t {
+        OFF,
+        ON,
+        TOGGLE,
+        PULSE // on now, off after pulseMs
+    };
+
+    // As the API names them
+    static const char* const ACTION_NAMES[PULSE + 1];
+
+    static const uint32_t MAX_DELAY_MS = 7UL * 24 * 60 * 60 * 1000;
+    static const uint32_t MIN_PERIOD_MS = 100;
+    static const size_t MAX_CAPACITY = 0xffff;
+
+    struct Timer {
+        uint32_t id;
+        int deviceId;
+        Action action;
+        uint32_t due;      // millis()
+        uint32_t periodMs; // 0 for one-shot
+        uint32_t pulseMs;
+    };
+
+    // How late timers fired compared to when they were due
+    struct Stats {
+        uint32_t fired;
+        uint64_t totalLateUs;
+        uint32_t maxLateUs;
+    };
+
+private:
+    struct Slot {
+        Timer timer;
+        uint32_t heapIndex;
+        uint16_t generation;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint16_t> heap;      // slot numbers, earliest due first
+    std::vector<uint16_t> freeSlots;
+    SemaphoreHandle_t lock;
+    Stats stats = {};
+
+    bool before(uint16_t a, uint16_t b) const;
+    void place(uint32_t index, uint16_t slot);
+    void siftUp(uint32_t index);
+    void siftDown(uint32_t index);
+    void removeAt(uint32_t index);
+
+public:
+    explicit Scheduler(size_t capacity = 128);
+    ~Scheduler();
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Id of the new timer, or 0 if the pool is full or the times are out of
+    // range (periodMs is 0 or MIN_PERIOD_MS..MAX_DELAY_MS)
+    uint32_t arm(int deviceId, Action action, uint32_t now, uint32_t delayMs, uint32_t periodMs = 0,
+                 uint32_t pulseMs = 0);
+    bool cancel(uint32_t id);
+    // Moves a pending timer to delayMs after now; false if it is gone
+    bool reschedule(uint32_t id, uint32_t now, uint32_t delayMs);
+    // Cancels every timer of one device, e.g. when it is deleted
+    size_t cancelDevice(int deviceId);
+
+    // Copies up to max timers due at now into fired, earliest first.
+    // Recurring ones are re-armed one period on, skipping periods already
+    // missed; one-shots are released.
+    size_t poll(uint32_t now, Timer* fired, size_t max);
+    // Time until the next timer is due, at most limit
+    uint32_t msUntilNext(uint32_t now, uint32_t limit) const;
+
+    // Copies up to max pending timers in no particular order
+    size_t snapshot(Timer* out, size_t max) const;
+    // Copies the timer in the first pool slot from slot on that holds one
+    // and moves slot past it; false once there is none. A walk from 0 sees
+    // each timer pending throughout it once, without a copy of the pool.
+    bool next(size_t& slot, Timer& out) const;
+    size_t size() const;
+    size_t capacity() const { return slots.size(); }
+    Stats getStats() const;
+    void resetStats();
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,113 @@
+#include "Settings.h"
+#include <string.h>
+
+namespace {
+
+const char* BLOB_KEY = "values";
+const char* LEGACY_NAMESPACE = "wifi";
+
+const Settings::Values DEFAULTS = {
+    0,     // wifiMode: AP
+    false, // wifiConfigured
+    "",    // ssid
+    "",    // password
+};
+
+struct Header {
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t length; // of the Values that follow
+};
+
+struct Blob {
+    Header header;
+    Settings::Values values;
+};
+
+void copyString(char* out, size_t size, const String& value) {
+    strncpy(out, value.c_str(), size - 1);
+    out[size - 1] = '\0';
+}
+
+} // namespace
+
+Settings::Settings(const char* name) : nvsNamespace(name), values(DEFAULTS) {}
+
+bool Settings::load() {
+    values = DEFAULTS;
+    dirty = 0;
+
+    Blob blob;
+    stats.nvsOpens++;
+    prefs.begin(nvsNamespace, true);
+    size_t read = prefs.getBytes(BLOB_KEY, &blob, sizeof(blob));
+    prefs.end();
+
+    if (read >= sizeof(Header) && blob.header.version == FORMAT_VERSION) {
+        // Shorter blobs predate the fields at the end, which keep their defaults
+        size_t length = read - sizeof(Header);
+        if (length > blob.header.length) length = blob.header.length;
+        if (length > sizeof(Values)) length = sizeof(Values);
+        memcpy(&values, &blob.values, length);
+        values.ssid[SSID_MAX] = '\0';
+        values.password[PASSWORD_MAX] = '\0';
+        return true;
+    }
+    return loadLegacy();
+}
+
+bool Settings::loadLegacy() {
+    stats.nvsOpens++;
+    prefs.begin(LEGACY_NAMESPACE, true);
+    bool found = prefs.isKey("mode") || prefs.isKey("configured");
+    if (found) {
+        values.wifiMode = static_cast<uint8_t>(prefs.getUInt("mode", DEFAULTS.wifiMode));
+        values.wifiConfigured = prefs.getBool("configured", false);
+        if (values.wifiConfigured) {
+            copyString(values.ssid, sizeof(values.ssid), prefs.getString("ssid", ""));
+            copyString(values.password, sizeof(values.password), prefs.getString("password", ""));
+        }
+        dirty = WIFI_MODE | WIFI_CREDENTIALS;
+    }
+    prefs.end();
+    return found;
+}
+
+bool Settings::commit() {
+    if (!dirty) return true;
+
+    Blob blob;
+    memset(&blob, 0, sizeof(blob));
+    blob.header.version = FORMAT_VERSION;
+    blob.header.length = sizeof(Values);
+    blob.values = values;
+
+    stats.nvsOpens++;
+    prefs.begin(nvsNamespace, false);
+    bool written = prefs.putBytes(BLOB_KEY, &blob, sizeof(blob)) == sizeof(blob);
+    prefs.end();
+    if (!written) return false;
+
+    stats.commits++;
+    dirty = 0;
+    return true;
+}
+
+void Settings::setWiFiMode(uint8_t mode) {
+    if (values.wifiMode == mode) return;
+    values.wifiMode = mode;
+    dirty |= WIFI_MODE;
+}
+
+bool Settings::setWiFiCredentials(const char* ssid, const char* password) {
+    size_t ssidLength = ssid ? strlen(ssid) : 0;
+    size_t passwordLength = password ? strlen(password) : 0;
+    if (ssidLength == 0 || ssidLength > SSID_MAX || passwordLength == 0 || passwordLength > PASSWORD_MAX) return false;
+
+    if (values.wifiConfigured && strcmp(values.ssid, ssid) == 0 && strcmp(values.password, password) == 0) return true;
+    memcpy(values.ssid, ssid, ssidLength + 1);
+    memcpy(values.password, password, passwordLength + 1);
+    values.wifiConfigured = true;
+    dirty |= WIFI_CREDENTIALS;
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <Preferences.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Device settings held in RAM and stored in NVS as one blob.
+//
+// load() reads everything with a single namespace open at boot; after that
+// getters never touch flash. Setters only mark the fields they change, and
+// commit() writes the blob in one NVS entry when anything is dirty, so a
+// batch of changes lands together or not at all. Boards that still have the
+// older one-key-per-value layout in the "wifi" namespace are read from it
+// once and come back dirty, so the first commit moves them to the blob.
+//
+// Used from setup() and the request handlers, never concurrently.
+class Settings {
+public:
+    static const uint8_t FORMAT_VERSION = 1;
+    static const size_t SSID_MAX = 32;
+    static const size_t PASSWORD_MAX = 64;
+
+    enum Field : uint32_t {
+        WIFI_MODE = 1u << 0,
+        WIFI_CREDENTIALS = 1u << 1,
+    };
+
+    // Stored as is. New settings go at the end with a default in
+    // Settings.cpp, and blobs written before them load with that default.
+    struct Values {
+        uint8_t wifiMode; // 0 = AP, 1 = STA
+        bool wifiConfigured;
+        char ssid[SSID_MAX + 1];
+        char password[PASSWORD_MAX + 1];
+    };
+
+    struct Stats {
+        uint32_t nvsOpens;
+        uint32_t commits; // blobs written
+    };
+
+private:
+    const char* nvsNamespace;
+    Preferences prefs;
+    Values values;
+    uint32_t dirty = 0;
+    Stats stats = {};
+
+    bool loadLegacy();
+
+public:
+    explicit Settings(const char* name = "settings");
+
+    // Defaults, then whatever is stored. False when nothing was.
+    bool load();
+    // Writes the blob if any field changed since load() or the last commit
+    bool commit();
+
+    const Values& get() const { return values; }
+    uint32_t dirtyFields() const { return dirty; }
+    const Stats& getStats() const { return stats; }
+
+    void setWiFiMode(uint8_t mode);
+    // False, with nothing changed, if either is empty or too long
+    bool setWiFiCredentials(const char* ssid, const char* password);
+};
+
+#endif // SETTINGS_H
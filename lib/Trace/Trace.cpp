@@ -0,0 +1,68 @@
+#include "Trace.h"
+
+#if TRACE_ENABLED
+TraceRing traceRing;
+#endif
+
+namespace {
+
+std::atomic<const char*> threadNames[TraceRing::MAX_THREADS];
+std::atomic<uint16_t> threadsSeen{0};
+thread_local int threadId = -1;
+
+} // namespace
+
+void TraceRing::record(const char* name, uint32_t startUs, uint32_t endUs) {
+    uint32_t seq = last.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (seq == BUSY) return;
+    Entry& entry = entries[seq % CAPACITY];
+
+    // Claim the slot, marking it invalid while its fields are rewritten. A
+    // writer lapped by the whole ring may still be at it; then this span is
+    // dropped rather than waited for.
+    uint32_t previous = entry.seq.load(std::memory_order_relaxed);
+    if (previous == BUSY || !entry.seq.compare_exchange_strong(previous, BUSY, std::memory_order_relaxed)) return;
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.name = name;
+    entry.startUs = startUs;
+    entry.durationUs = endUs - startUs;
+    entry.thread = currentThread();
+    entry.seq.store(seq, std::memory_order_release);
+}
+
+uint32_t TraceRing::oldest() const {
+    uint32_t newest = latest();
+    return newest < CAPACITY ? 1 : newest - CAPACITY + 1;
+}
+
+bool TraceRing::get(uint32_t seq, Span& out) const {
+    if (seq == 0 || seq == BUSY) return false;
+    const Entry& entry = entries[seq % CAPACITY];
+    if (entry.seq.load(std::memory_order_acquire) != seq) return false;
+
+    out.name = entry.name;
+    out.startUs = entry.startUs;
+    out.durationUs = entry.durationUs;
+    out.thread = entry.thread;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return entry.seq.load(std::memory_order_relaxed) == seq;
+}
+
+uint16_t TraceRing::currentThread() {
+    if (threadId < 0) threadId = threadsSeen.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<uint16_t>(threadId);
+}
+
+void TraceRing::nameThread(const char* name) {
+    uint16_t thread = currentThread();
+    if (thread < MAX_THREADS) threadNames[thread].store(name, std::memory_order_release);
+}
+
+const char* TraceRing::threadName(uint16_t thread) {
+    return thread < MAX_THREADS ? threadNames[thread].load(std::memory_order_acquire) : nullptr;
+}
+
+uint16_t TraceRing::threadCount() {
+    return threadsSeen.load(std::memory_order_relaxed);
+}
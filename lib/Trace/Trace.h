@@ -0,0 +1,132 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Span tracing behind GET /api/trace, built in with -DTRACE_ENABLED=1.
+// Without it the TRACE_* macros below expand to nothing: no ring, no
+// timestamps, no calls.
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+// Spans kept; 20 bytes each on the ESP32
+#ifndef TRACE_CAPACITY
+#define TRACE_CAPACITY 256
+#endif
+
+// Fixed-size ring of the most recent spans, numbered from 1. Any task may
+// record without a lock: a writer takes the next number with one atomic
+// increment and fills its slot like the change journal does, so a reader on
+// another task sees a slot being rewritten as missing rather than torn.
+// Span names are not copied and must be string literals (or live as long).
+class TraceRing {
+public:
+    static const size_t CAPACITY = TRACE_CAPACITY;
+    // Threads (tasks) that can be given a name for the export
+    static const size_t MAX_THREADS = 16;
+
+    struct Span {
+        const char* name;
+        uint32_t startUs;
+        uint32_t durationUs;
+        uint16_t thread;
+    };
+
+private:
+    // Sequence number of a slot being written
+    static const uint32_t BUSY = UINT32_MAX;
+
+    struct Entry {
+        std::atomic<uint32_t> seq{0};
+        const char* name = nullptr;
+        uint32_t startUs = 0;
+        uint32_t durationUs = 0;
+        uint16_t thread = 0;
+    };
+
+    Entry entries[CAPACITY];
+    std::atomic<uint32_t> last{0};
+
+public:
+    TraceRing() {}
+    TraceRing(const TraceRing&) = delete;
+    TraceRing& operator=(const TraceRing&) = delete;
+
+    void record(const char* name, uint32_t startUs, uint32_t endUs);
+
+    // Sequence number of the newest span, 0 if none yet
+    uint32_t latest() const { return last.load(std::memory_order_acquire); }
+    // Oldest sequence number still held
+    uint32_t oldest() const;
+    // Copies span seq into out; false once it has been overwritten, or
+    // while it is still being written
+    bool get(uint32_t seq, Span& out) const;
+
+    // Small number for the calling thread, the same in every ring
+    static uint16_t currentThread();
+    // Names the calling thread in exports; the name is not copied
+    static void nameThread(const char* name);
+    // Null for a thread never named
+    static const char* threadName(uint16_t thread);
+    // Threads seen so far; ids run from 0
+    static uint16_t threadCount();
+};
+
+// Records the span from its construction to the end of the enclosing block,
+// if it lasted at least minUs
+class TraceScope {
+private:
+    TraceRing& ring;
+    const char* name;
+    uint32_t startUs;
+    uint32_t minUs;
+
+public:
+    TraceScope(TraceRing& target, const char* spanName, uint32_t minimumUs = 0)
+        : ring(target), name(spanName), startUs(micros()), minUs(minimumUs) {}
+    ~TraceScope() {
+        uint32_t endUs = micros();
+        if (endUs - startUs >= minUs) ring.record(name, startUs, endUs);
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#if TRACE_ENABLED
+
+extern TraceRing traceRing;
+
+#define TRACE_JOIN_(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN_(a, b)
+// Times the rest of the enclosing block as a span called name
+#define TRACE_SPAN(name) TraceScope TRACE_JOIN(traceScope, __LINE__)(traceRing, name)
+// The same, left out when shorter than minUs: for work that runs all the
+// time and only matters when slow, so it does not crowd requests out
+#define TRACE_SPAN_OVER(name, minUs) TraceScope TRACE_JOIN(traceScope, __LINE__)(traceRing, name, minUs)
+// A span timed by the caller, e.g. from a timestamp taken on another task
+#define TRACE_RECORD(name, startUs, endUs) traceRing.record(name, startUs, endUs)
+// Names the calling task in the export
+#define TRACE_THREAD(name) TraceRing::nameThread(name)
+
+#else
+
+#define TRACE_SPAN(name) \
+    do {                 \
+    } while (0)
+#define TRACE_SPAN_OVER(name, minUs) \
+    do {                             \
+    } while (0)
+#define TRACE_RECORD(name, startUs, endUs) \
+    do {                                   \
+    } while (0)
+#define TRACE_THREAD(name) \
+    do {                   \
+    } while (0)
+
+#endif // TRACE_ENABLED
+
+#endif // TRACE_H
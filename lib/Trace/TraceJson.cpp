@@ -0,0 +1,116 @@
+#include "TraceJson.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+// Shown as the process in the viewer; every thread belongs to it
+const char PROCESS_NAME[] = "ESP32 Device Manager";
+
+} // namespace
+
+TraceJson::TraceJson(const TraceRing& source, uint32_t nowUs)
+    : ring(&source), first(source.oldest()), last(source.latest()), threads(TraceRing::threadCount()) {
+    // Ages rather than raw times, so the oldest is found even when micros()
+    // wrapped in between
+    uint32_t oldestAge = 0;
+    TraceRing::Span span;
+    for (uint32_t seq = first; seq != last + 1; seq++) {
+        if (ring->get(seq, span) && nowUs - span.startUs > oldestAge) oldestAge = nowUs - span.startUs;
+    }
+    originUs = nowUs - oldestAge;
+}
+
+void TraceJson::append(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(pending + pendingLen, sizeof(pending) - pendingLen, format, args);
+    va_end(args);
+    if (n > 0) pendingLen += static_cast<size_t>(n) < sizeof(pending) - pendingLen ? n : sizeof(pending) - 1 - pendingLen;
+}
+
+// Span names are literals from the firmware, but are escaped anyway so a
+// route pattern or a future name cannot break the document
+void TraceJson::appendName(const char* name) {
+    for (size_t i = 0; name && name[i] && i < MAX_NAME; i++) {
+        char c = name[i];
+        if (static_cast<unsigned char>(c) < 0x20) continue;
+        if (c == '"' || c == '\\') pending[pendingLen++] = '\\';
+        pending[pendingLen++] = c;
+    }
+}
+
+void TraceJson::produce() {
+    pendingPos = 0;
+    pendingLen = 0;
+
+    // Skipped spans and unnamed threads write nothing, so go on until
+    // something is out
+    while (pendingLen == 0 && stage != DONE) {
+        switch (stage) {
+        case HEAD:
+            // The process record comes first, so every later event starts
+            // with a comma
+            append("{\"traceEvents\":[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"%s\"}}",
+                   PROCESS_NAME);
+            stage = THREADS;
+            break;
+        case THREADS:
+            if (next >= threads) {
+                stage = SPANS;
+                next = first;
+            } else {
+                const char* name = TraceRing::threadName(next);
+                if (name) {
+                    append(",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"",
+                           static_cast<unsigned int>(next));
+                    appendName(name);
+                    append("\"}}");
+                }
+                next++;
+            }
+            break;
+        case SPANS:
+            if (next == last + 1) {
+                stage = TAIL;
+            } else {
+                TraceRing::Span span;
+                if (ring->get(next, span)) {
+                    append(",{\"name\":\"");
+                    appendName(span.name);
+                    append("\",\"ph\":\"X\",\"ts\":%u,\"dur\":%u,\"pid\":1,\"tid\":%u}",
+                           static_cast<unsigned int>(span.startUs - originUs), static_cast<unsigned int>(span.durationUs),
+                           static_cast<unsigned int>(span.thread));
+                } else {
+                    skipped++;
+                }
+                next++;
+            }
+            break;
+        case TAIL:
+            append("],\"displayTimeUnit\":\"ms\",\"otherData\":{\"recorded\":%u,\"skipped\":%u}}",
+                   static_cast<unsigned int>(last), static_cast<unsigned int>(skipped));
+            stage = DONE;
+            break;
+        case DONE:
+            break;
+        }
+    }
+}
+
+size_t TraceJson::read(uint8_t* buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+        if (pendingPos == pendingLen) {
+            produce();
+            if (pendingLen == 0) break;
+        }
+        size_t n = pendingLen - pendingPos;
+        if (n > maxLen - written) n = maxLen - written;
+        memcpy(buffer + written, pending + pendingPos, n);
+        pendingPos += n;
+        written += n;
+    }
+    return written;
+}
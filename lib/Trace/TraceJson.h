@@ -0,0 +1,58 @@
+#ifndef TRACEJSON_H
+#define TRACEJSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Trace.h"
+
+// Resumable writer for the GET /api/trace body: the spans a TraceRing held
+// when the writer was made, in the Chrome trace-event format that Perfetto
+// and chrome://tracing open. Each span is a complete ("X") event on its
+// thread's track, with times in microseconds from the oldest span; named
+// threads get a thread_name record. Spans are read from the ring as they
+// are written out, so memory use is fixed; one overwritten before its turn
+// is left out and counted in otherData.skipped.
+class TraceJson {
+public:
+    // Names longer than this are cut short
+    static const size_t MAX_NAME = 64;
+    // One event: punctuation, keys, three numbers and a name escaped in full
+    static const size_t MAX_ENTRY_SIZE = 96 + 2 * MAX_NAME;
+
+private:
+    enum Stage {
+        HEAD,
+        THREADS,
+        SPANS,
+        TAIL,
+        DONE
+    };
+
+    const TraceRing* ring;
+    uint32_t first;
+    uint32_t last;
+    uint32_t originUs = 0; // start of the oldest span
+    uint16_t threads;
+    uint32_t skipped = 0;
+
+    Stage stage = HEAD;
+    uint32_t next = 0; // thread or sequence number within the stage
+    char pending[MAX_ENTRY_SIZE];
+    size_t pendingLen = 0;
+    size_t pendingPos = 0;
+
+    void append(const char* format, ...);
+    void appendName(const char* name);
+    void produce();
+
+public:
+    // nowUs is micros() at the request; span times are taken relative to it
+    // so they come out right across the 32-bit wrap
+    TraceJson(const TraceRing& source, uint32_t nowUs);
+
+    // Copies up to maxLen further bytes of the document into buffer. Returns
+    // 0 once the whole document has been written.
+    size_t read(uint8_t* buffer, size_t maxLen);
+};
+
+#endif // TRACEJSON_H
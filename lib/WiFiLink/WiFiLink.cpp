@@ -0,0 +1,145 @@
+#include "WiFiLink.h"
+
+namespace {
+
+const uint8_t EVENT_GOT_IP = 1;
+const uint8_t EVENT_LOST = 2;
+
+} // namespace
+
+std::atomic<uint8_t> WiFiLink::pendingEvents{0};
+
+// Runs on the WiFi event task; poll() does the work
+void WiFiLink::onWiFiEvent(arduino_event_id_t event) {
+    switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+        pendingEvents.fetch_or(EVENT_GOT_IP);
+        break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+        pendingEvents.fetch_or(EVENT_LOST);
+        break;
+    default:
+        break;
+    }
+}
+
+void WiFiLink::begin(const char* newSsid, const char* newPassword, uint32_t now) {
+    static bool registered = false;
+    if (!registered) {
+        WiFi.onEvent(onWiFiEvent);
+        registered = true;
+    }
+
+    ssid = newSsid;
+    password = newPassword;
+    retryDelay = RETRY_MIN_MS;
+    downSince = now;
+    WiFi.mode(WIFI_STA);
+    startAttempt(now);
+}
+
+void WiFiLink::startAttempt(uint32_t now) {
+    IPAddress ip, gateway, mask;
+    usingCache = loadCache(ip, gateway, mask);
+    if (usingCache) {
+        WiFi.config(ip, gateway, mask);
+    } else {
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    }
+
+    // Flags from an earlier link mean nothing to this attempt
+    pendingEvents = 0;
+    WiFi.begin(ssid.c_str(), password.c_str());
+    enter(CONNECTING, now);
+}
+
+void WiFiLink::enter(State next, uint32_t now) {
+    current = next;
+    stateSince = now;
+}
+
+WiFiLink::Event WiFiLink::poll(uint32_t now) {
+    uint8_t events = pendingEvents.exchange(0);
+
+    switch (current) {
+    case CONNECTING:
+        if (events & EVENT_GOT_IP) {
+            if (!usingCache) {
+                // Move to the fixed address without associating again
+                IPAddress gateway = WiFi.gatewayIP();
+                IPAddress mask = WiFi.subnetMask();
+                IPAddress ip = gateway;
+                ip[3] = STATIC_HOST;
+                WiFi.config(ip, gateway, mask);
+                saveCache(ip, gateway, mask);
+            }
+            lastConnectMs = now - downSince;
+            retryDelay = RETRY_MIN_MS;
+            enter(CONNECTED, now);
+            return GOT_IP;
+        }
+        // Disconnect events while associating are left to the timeout: the
+        // driver raises them for earlier links too
+        if (now - stateSince >= CONNECT_TIMEOUT_MS) {
+            WiFi.disconnect();
+            if (usingCache) {
+                dropCache();
+                startAttempt(now);
+                return CACHE_DROPPED;
+            }
+            enter(WAITING_RETRY, now);
+            return ATTEMPT_FAILED;
+        }
+        return NONE;
+
+    case CONNECTED:
+        if ((events & EVENT_LOST) || WiFi.status() != WL_CONNECTED) {
+            downSince = now;
+            startAttempt(now);
+            return LOST;
+        }
+        return NONE;
+
+    case WAITING_RETRY:
+        if (now - stateSince >= retryDelay) {
+            retryDelay = retryDelay * 2 > RETRY_MAX_MS ? RETRY_MAX_MS : retryDelay * 2;
+            startAttempt(now);
+        }
+        return NONE;
+
+    case IDLE:
+    default:
+        return NONE;
+    }
+}
+
+bool WiFiLink::loadCache(IPAddress& ip, IPAddress& gateway, IPAddress& mask) {
+    prefs.begin(nvsNamespace, true);
+    bool found = prefs.getString("ssid", "") == ssid;
+    if (found) {
+        ip = IPAddress(prefs.getUInt("ip", 0));
+        gateway = IPAddress(prefs.getUInt("gw", 0));
+        mask = IPAddress(prefs.getUInt("mask", 0));
+        found = uint32_t(ip) != 0 && uint32_t(mask) != 0;
+    }
+    prefs.end();
+    return found;
+}
+
+void WiFiLink::saveCache(IPAddress ip, IPAddress gateway, IPAddress mask) {
+    prefs.begin(nvsNamespace, false);
+    prefs.putString("ssid", ssid);
+    prefs.putUInt("ip", uint32_t(ip));
+    prefs.putUInt("gw", uint32_t(gateway));
+    prefs.putUInt("mask", uint32_t(mask));
+    prefs.end();
+    usingCache = true;
+}
+
+void WiFiLink::dropCache() {
+    prefs.begin(nvsNamespace, false);
+    prefs.clear();
+    prefs.end();
+    usingCache = false;
+}
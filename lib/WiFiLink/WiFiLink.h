@@ -0,0 +1,76 @@
+#ifndef WIFILINK_H
+#define WIFILINK_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <atomic>
+#include <stdint.h>
+
+// Station link kept up by a state machine instead of blocking waits.
+//
+// begin() starts the association and returns; the WiFi event task only sets
+// flags, and poll(), called from loop(), acts on them and on timeouts. The
+// first DHCP lease on a network is turned into a static address (the
+// gateway's subnet, host STATIC_HOST) applied in place, and that config is
+// cached in NVS per SSID so later boots and reconnects associate once with
+// it and skip DHCP. A cached config that fails to connect is dropped and the
+// next attempt uses DHCP.
+class WiFiLink {
+public:
+    enum State {
+        IDLE,
+        CONNECTING,
+        CONNECTED,
+        WAITING_RETRY
+    };
+
+    // What a poll() did, for the caller to log
+    enum Event {
+        NONE,
+        GOT_IP,
+        LOST,
+        CACHE_DROPPED,
+        ATTEMPT_FAILED
+    };
+
+    static const uint32_t CONNECT_TIMEOUT_MS = 10000;
+    static const uint32_t RETRY_MIN_MS = 1000;
+    static const uint32_t RETRY_MAX_MS = 30000;
+    static const uint8_t STATIC_HOST = 200;
+
+private:
+    const char* nvsNamespace;
+    Preferences prefs;
+    String ssid;
+    String password;
+    State current = IDLE;
+    bool usingCache = false;  // current attempt or link runs on the cached config
+    uint32_t stateSince = 0;
+    uint32_t downSince = 0;   // begin() or the loss of the last link
+    uint32_t retryDelay = RETRY_MIN_MS;
+    uint32_t lastConnectMs = 0;
+
+    static std::atomic<uint8_t> pendingEvents;
+    static void onWiFiEvent(arduino_event_id_t event);
+
+    void startAttempt(uint32_t now);
+    void enter(State next, uint32_t now);
+    bool loadCache(IPAddress& ip, IPAddress& gateway, IPAddress& mask);
+    void saveCache(IPAddress ip, IPAddress gateway, IPAddress mask);
+    void dropCache();
+
+public:
+    explicit WiFiLink(const char* name = "wifinet") : nvsNamespace(name) {}
+
+    void begin(const char* ssid, const char* password, uint32_t now);
+    Event poll(uint32_t now);
+
+    State state() const { return current; }
+    bool connected() const { return current == CONNECTED; }
+    bool staticFromCache() const { return usingCache; }
+    // From begin() or the last loss to the most recent GOT_IP
+    uint32_t connectTimeMs() const { return lastConnectMs; }
+};
+
+#endif // WIFILINK_H
@@ -0,0 +1,300 @@
+#include "LoadGenerator.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <errno.h>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// Finds where the first response in a connection's input ends, keeping its
+// place between calls so a long chunked body is scanned once
+class ResponseReader {
+private:
+    size_t headLength = 0; // 0 until the head has arrived
+    size_t contentLength = 0;
+    bool chunked = false;
+    size_t nextChunk = 0;
+
+    static const char* value(const char* text) {
+        while (*text == ' ') text++;
+        return text;
+    }
+
+    bool readHead(const std::string& data, size_t blank) {
+        if (data.compare(0, 7, "HTTP/1.") != 0 || blank < 12) return false;
+        code = atoi(data.c_str() + 9);
+        close = data[7] == '0';
+        bool sized = code < 200 || code == 204 || code == 304;
+        for (size_t line = data.find("\r\n") + 2; line < blank; line = data.find("\r\n", line) + 2) {
+            const char* text = data.c_str() + line;
+            if (strncasecmp(text, "Content-Length:", 15) == 0) {
+                contentLength = strtoul(text + 15, nullptr, 10);
+                sized = true;
+            } else if (strncasecmp(text, "Transfer-Encoding:", 18) == 0) {
+                chunked = strncasecmp(value(text + 18), "chunked", 7) == 0;
+                sized = chunked;
+            } else if (strncasecmp(text, "Connection:", 11) == 0) {
+                close = strncasecmp(value(text + 11), "close", 5) == 0;
+            }
+        }
+        headLength = blank + 4;
+        nextChunk = headLength;
+        return sized;
+    }
+
+public:
+    int code = 0;
+    bool close = false;
+
+    // Length of the first response in data once it is all there, 0 until
+    // then, -1 if it cannot be read
+    long complete(const std::string& data) {
+        if (headLength == 0) {
+            size_t blank = data.find("\r\n\r\n");
+            if (blank == std::string::npos) return data.size() > 65536 ? -1 : 0;
+            if (!readHead(data, blank)) return -1;
+        }
+        if (!chunked) return data.size() >= headLength + contentLength ? static_cast<long>(headLength + contentLength) : 0;
+
+        for (;;) {
+            size_t eol = data.find("\r\n", nextChunk);
+            if (eol == std::string::npos) return 0;
+            size_t size = strtoul(data.c_str() + nextChunk, nullptr, 16);
+            // Data and its CRLF; the last chunk has no data, and no trailers
+            // here, just the closing CRLF
+            size_t end = eol + 2 + size + 2;
+            if (data.size() < end) return 0;
+            if (size == 0) return static_cast<long>(end);
+            nextChunk = end;
+        }
+    }
+
+    void reset() { *this = ResponseReader(); }
+};
+
+struct Client {
+    size_t index;
+    int fd = -1;
+    bool connecting = false;
+    uint64_t sent = 0;
+    std::string request;
+    size_t written = 0;
+    std::string input;
+    ResponseReader reader;
+    Clock::time_point startedAt;
+};
+
+class Run {
+private:
+    const LoadGenerator::Options& options;
+    const LoadGenerator::RequestSource& source;
+    int epollFd;
+    std::vector<std::unique_ptr<Client>> clients;
+    std::vector<float> latencies;
+    Clock::time_point countFrom;
+    LoadGenerator::Report report;
+
+    void watch(Client& client, uint32_t events, int op = EPOLL_CTL_MOD) {
+        epoll_event event = {};
+        event.events = events;
+        event.data.u64 = client.index;
+        epoll_ctl(epollFd, op, client.fd, &event);
+    }
+
+    void disconnect(Client& client) {
+        ::close(client.fd);
+        client.fd = -1;
+        client.input.clear();
+        client.reader.reset();
+    }
+
+    bool connect(Client& client) {
+        client.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (client.fd < 0) return false;
+        int one = 1;
+        setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (options.spreadSources) {
+            size_t i = client.index;
+            sockaddr_in local = {};
+            local.sin_family = AF_INET;
+            local.sin_addr.s_addr = htonl(0x7f000000 | (1 + i / 62500) << 16 | (i / 250 % 250) << 8 | (1 + i % 250));
+            setsockopt(client.fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(client.fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+                disconnect(client);
+                return false;
+            }
+        }
+
+        sockaddr_in remote = {};
+        remote.sin_family = AF_INET;
+        remote.sin_port = htons(options.port);
+        remote.sin_addr.s_addr = htonl(options.address);
+        if (::connect(client.fd, reinterpret_cast<sockaddr*>(&remote), sizeof(remote)) != 0 && errno != EINPROGRESS) {
+            disconnect(client);
+            return false;
+        }
+        client.connecting = true;
+        watch(client, EPOLLOUT, EPOLL_CTL_ADD);
+        return true;
+    }
+
+    void reconnect(Client& client) {
+        disconnect(client);
+        report.reconnects++;
+        if (!connect(client)) report.connectFailures++;
+    }
+
+    void startRequest(Client& client) {
+        client.request.clear();
+        source(client.index, client.sent++, client.request);
+        client.written = 0;
+        client.startedAt = Clock::now();
+        write(client);
+    }
+
+    void write(Client& client) {
+        while (client.written < client.request.size()) {
+            ssize_t n = send(client.fd, client.request.data() + client.written, client.request.size() - client.written,
+                             MSG_NOSIGNAL);
+            if (n > 0) {
+                client.written += n;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                watch(client, EPOLLOUT);
+                return;
+            } else if (!(n < 0 && errno == EINTR)) {
+                reconnect(client);
+                return;
+            }
+        }
+        watch(client, EPOLLIN);
+    }
+
+    void read(Client& client) {
+        char buffer[65536];
+        bool closed = false; // by the server, or reset
+        for (;;) {
+            ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                client.input.append(buffer, n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            closed = !(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+            break;
+        }
+
+        long length = client.reader.complete(client.input);
+        if (length < 0) {
+            report.malformed++;
+            reconnect(client);
+            return;
+        }
+        if (length == 0) {
+            if (closed) reconnect(client);
+            return;
+        }
+
+        Clock::time_point now = Clock::now();
+        if (now >= countFrom) {
+            latencies.push_back(std::chrono::duration<float, std::milli>(now - client.startedAt).count());
+            report.codes[client.reader.code]++;
+        }
+        bool close = client.reader.close;
+        client.input.erase(0, length);
+        client.reader.reset();
+        if (close || closed) {
+            reconnect(client);
+        } else if (!client.input.empty()) {
+            report.malformed++; // more than was asked for
+            reconnect(client);
+        } else {
+            startRequest(client);
+        }
+    }
+
+    void onEvent(Client& client, uint32_t events) {
+        if (client.fd < 0) return;
+        if (client.connecting) {
+            // Events left over from a socket just replaced are ignored
+            if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) return;
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(client.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error) {
+                disconnect(client);
+                report.connectFailures++;
+                return;
+            }
+            client.connecting = false;
+            startRequest(client);
+        } else if (client.written < client.request.size()) {
+            write(client);
+        } else {
+            read(client);
+        }
+    }
+
+    double percentile(double q) const {
+        size_t at = static_cast<size_t>(q * latencies.size());
+        return latencies[std::min(at, latencies.size() - 1)];
+    }
+
+public:
+    Run(const LoadGenerator::Options& options, const LoadGenerator::RequestSource& source)
+        : options(options), source(source), epollFd(epoll_create1(EPOLL_CLOEXEC)) {}
+
+    ~Run() {
+        for (std::unique_ptr<Client>& client : clients) {
+            if (client->fd >= 0) ::close(client->fd);
+        }
+        ::close(epollFd);
+    }
+
+    LoadGenerator::Report go() {
+        Clock::time_point start = Clock::now();
+        countFrom = start + std::chrono::milliseconds(options.warmupMs);
+        Clock::time_point end = countFrom + std::chrono::milliseconds(options.durationMs);
+        for (size_t i = 0; i < options.clients; i++) {
+            clients.emplace_back(new Client());
+            clients.back()->index = i;
+            if (!connect(*clients.back())) report.connectFailures++;
+        }
+
+        epoll_event events[256];
+        for (Clock::time_point now = start; now < end; now = Clock::now()) {
+            int wait = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(end - now).count()) + 1;
+            int n = epoll_wait(epollFd, events, 256, wait);
+            for (int i = 0; i < n; i++) onEvent(*clients[events[i].data.u64], events[i].events);
+        }
+
+        report.seconds = options.durationMs / 1000.0;
+        report.requests = latencies.size();
+        if (!latencies.empty()) {
+            std::sort(latencies.begin(), latencies.end());
+            report.p50 = percentile(0.5);
+            report.p90 = percentile(0.9);
+            report.p99 = percentile(0.99);
+            report.p999 = percentile(0.999);
+            report.max = latencies.back();
+        }
+        return report;
+    }
+};
+
+} // namespace
+
+LoadGenerator::Report LoadGenerator::run(const Options& options, const RequestSource& source) {
+    return Run(options, source).go();
+}
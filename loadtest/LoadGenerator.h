@@ -0,0 +1,54 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <functional>
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Closed-loop HTTP/1.1 load from one thread: each of `clients` keep-alive
+// connections sends its next request as soon as the last response has fully
+// arrived, until the time is up. Latency runs from a request being written
+// to the last byte of its response, which may use Content-Length or chunked
+// encoding. A connection the server closes is opened again; one that cannot
+// be opened is given up.
+class LoadGenerator {
+public:
+    struct Options {
+        uint32_t address = 0x7f000001; // IPv4, host byte order
+        uint16_t port = 80;
+        size_t clients = 1;
+        uint32_t durationMs = 3000;
+        // Responses in this first stretch are not counted
+        uint32_t warmupMs = 500;
+        // Client i connects from its own loopback address (127.1.0.1,
+        // 127.1.0.2, ...), so a server limiting each address sees as many
+        // clients as there are connections. Only for a loopback target.
+        bool spreadSources = false;
+    };
+
+    // The full text of a client's n-th request, headers and body
+    typedef std::function<void(size_t client, uint64_t n, std::string& out)> RequestSource;
+
+    struct Report {
+        uint64_t requests = 0; // answered after the warm-up
+        double seconds = 0;    // measured, warm-up excluded
+        uint64_t connectFailures = 0;
+        uint64_t reconnects = 0;
+        uint64_t malformed = 0; // responses that could not be read; the connection is dropped
+        std::map<int, uint64_t> codes;
+        // Response times in milliseconds
+        double p50 = 0;
+        double p90 = 0;
+        double p99 = 0;
+        double p999 = 0;
+        double max = 0;
+
+        double perSecond() const { return seconds > 0 ? requests / seconds : 0; }
+    };
+
+    static Report run(const Options& options, const RequestSource& source);
+};
+
+#endif // LOADGENERATOR_H
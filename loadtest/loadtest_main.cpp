@@ -0,0 +1,275 @@
+#include <DeviceManager.h>
+#include <ESPAsyncWebServer.h>
+#include <HostControl.h>
+#include <SessionTable.h>
+#include <SocketServer.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+#include "LoadGenerator.h"
+
+// Firmware entry points and globals from src/main.cpp
+void setup();
+void loop();
+extern AsyncWebServer server;
+extern DeviceManager deviceManager;
+extern SessionTable sessions;
+
+namespace {
+
+const char USAGE[] =
+    "usage: program [options]\n"
+    "  --clients 1,16,256,2048   keep-alive clients, one run per count\n"
+    "  --seconds 5               measured time per run, after a 0.5 s warm-up\n"
+    "  --scenarios devices,control\n"
+    "                            devices: GET /api/devices\n"
+    "                            control: PUT /api/control, switching devices 1..ids on and off\n"
+    "  --devices 1000            devices in the registry (in-process firmware only)\n"
+    "  --port 0                  port the in-process firmware listens on, 0 for any\n"
+    "  --serve                   only serve the firmware until interrupted\n"
+    "  --target ADDRESS:PORT     load another server, e.g. a board, instead\n"
+    "  --token TOKEN             bearer token for --target (from POST /api/connect)\n"
+    "  --ids 6                   devices --target has, for the control scenario\n";
+
+struct Config {
+    std::vector<size_t> clients = {1, 16, 256, 2048};
+    uint32_t seconds = 5;
+    std::vector<std::string> scenarios = {"devices", "control"};
+    size_t devices = 1000;
+    uint16_t port = 0;
+    bool serveOnly = false;
+    uint32_t target = 0; // host byte order; 0 for the in-process firmware
+    uint16_t targetPort = 0;
+    std::string token;
+    size_t ids = 6;
+};
+
+std::atomic<bool> interrupted{false};
+
+void onInterrupt(int) {
+    interrupted = true;
+}
+
+[[noreturn]] void usage(const char* problem) {
+    fprintf(stderr, "%s\n%s", problem, USAGE);
+    exit(2);
+}
+
+std::vector<std::string> split(const char* list) {
+    std::vector<std::string> items;
+    for (const char* at = list; *at;) {
+        const char* comma = strchr(at, ',');
+        size_t n = comma ? static_cast<size_t>(comma - at) : strlen(at);
+        if (n > 0) items.emplace_back(at, n);
+        at += comma ? n + 1 : n;
+    }
+    return items;
+}
+
+unsigned long number(const char* text, unsigned long max) {
+    char* end;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text || *end || value > max) usage("bad number");
+    return value;
+}
+
+Config parse(int argc, char** argv) {
+    Config config;
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        if (strcmp(option, "--serve") == 0) {
+            config.serveOnly = true;
+            continue;
+        }
+        if (i + 1 == argc) usage(option);
+        const char* value = argv[++i];
+        if (strcmp(option, "--clients") == 0) {
+            config.clients.clear();
+            for (const std::string& n : split(value)) config.clients.push_back(number(n.c_str(), 60000));
+        } else if (strcmp(option, "--seconds") == 0) {
+            config.seconds = number(value, 3600);
+        } else if (strcmp(option, "--scenarios") == 0) {
+            config.scenarios = split(value);
+        } else if (strcmp(option, "--devices") == 0) {
+            config.devices = number(value, 1000000);
+        } else if (strcmp(option, "--port") == 0) {
+            config.port = number(value, 65535);
+        } else if (strcmp(option, "--target") == 0) {
+            std::string address(value);
+            size_t colon = address.rfind(':');
+            in_addr parsed;
+            if (colon == std::string::npos || inet_pton(AF_INET, address.substr(0, colon).c_str(), &parsed) != 1)
+                usage("--target takes an IPv4 ADDRESS:PORT");
+            config.target = ntohl(parsed.s_addr);
+            config.targetPort = number(address.c_str() + colon + 1, 65535);
+        } else if (strcmp(option, "--token") == 0) {
+            config.token = value;
+        } else if (strcmp(option, "--ids") == 0) {
+            config.ids = number(value, 1000000);
+        } else {
+            usage(option);
+        }
+    }
+    for (const std::string& scenario : config.scenarios) {
+        if (scenario != "devices" && scenario != "control") usage(scenario.c_str());
+    }
+    if (config.target && config.token.empty()) usage("--target needs --token");
+    return config;
+}
+
+// Both ends of every connection may be in this process
+void raiseDescriptorLimit(size_t clients) {
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < 2 * clients + 64)
+        printf("only %lu file descriptors: runs with %zu clients will lose connections\n",
+               static_cast<unsigned long>(limit.rlim_cur), clients);
+}
+
+// The firmware booted as on a board, with `devices` devices in all
+void bootFirmware(size_t devices) {
+    const char* const TYPES[] = {"LED", "FAN", "HEATER"};
+    host::setSerialEnabled(false);
+    setup();
+    char title[20];
+    for (size_t id = deviceManager.size() + 1; id <= devices; id++) {
+        snprintf(title, sizeof(title), "Device %zu", id);
+        if (!deviceManager.addDevice(static_cast<int>(id), title, TYPES[id % 3], 2, false)) {
+            printf("registry full at %zu devices\n", deviceManager.size());
+            break;
+        }
+    }
+}
+
+void printHeader(const char* what) {
+    printf("\n== %s\n", what);
+    printf("%8s %10s %10s %9s %9s %9s %9s %9s  %s\n", "clients", "requests", "req/s", "p50 ms", "p90 ms", "p99 ms",
+           "p99.9 ms", "max ms", "codes");
+}
+
+void printReport(size_t clients, const LoadGenerator::Report& report) {
+    printf("%8zu %10llu %10.0f %9.3f %9.3f %9.3f %9.3f %9.3f ", clients,
+           static_cast<unsigned long long>(report.requests), report.perSecond(), report.p50, report.p90, report.p99,
+           report.p999, report.max);
+    for (const auto& code : report.codes) {
+        printf(" %d:%llu", code.first, static_cast<unsigned long long>(code.second));
+    }
+    if (report.connectFailures || report.reconnects || report.malformed) {
+        printf("  (%llu failed connects, %llu reconnects, %llu unreadable)",
+               static_cast<unsigned long long>(report.connectFailures),
+               static_cast<unsigned long long>(report.reconnects), static_cast<unsigned long long>(report.malformed));
+    }
+    printf("\n");
+}
+
+void runScenario(const Config& config, const std::string& scenario, const LoadGenerator::Options& base,
+                 const std::string& bearer, size_t ids, const char* where) {
+    std::string head;
+    LoadGenerator::RequestSource source;
+    char title[160];
+    if (scenario == "devices") {
+        head = "GET /api/devices HTTP/1.1\r\nHost: loadtest\r\nAuthorization: " + bearer + "\r\n\r\n";
+        source = [&head](size_t, uint64_t, std::string& out) { out = head; };
+        snprintf(title, sizeof(title), "GET /api/devices (%s)", where);
+    } else {
+        // Each client switches one device on and off in turn
+        head = "PUT /api/control HTTP/1.1\r\nHost: loadtest\r\nAuthorization: " + bearer +
+               "\r\nContent-Type: application/json\r\nContent-Length: ";
+        source = [&head, ids](size_t client, uint64_t n, std::string& out) {
+            char body[64];
+            int length = snprintf(body, sizeof(body), "{\"device\":%zu,\"status\":%s}", 1 + client % ids,
+                                  n % 2 ? "false" : "true");
+            out = head;
+            out += std::to_string(length);
+            out += "\r\n\r\n";
+            out.append(body, length);
+        };
+        snprintf(title, sizeof(title), "PUT /api/control, devices 1-%zu (%s)", ids, where);
+    }
+
+    printHeader(title);
+    for (size_t clients : config.clients) {
+        if (interrupted) return;
+        LoadGenerator::Options options = base;
+        options.clients = clients;
+        printReport(clients, LoadGenerator::run(options, source));
+    }
+}
+
+} // namespace
+
+// Entry point of the loadtest env: `pio run -e loadtest -t exec` runs the
+// default sweep; pass options to .pio/build/loadtest/program directly
+int main(int argc, char** argv) {
+    Config config = parse(argc, argv);
+    signal(SIGINT, onInterrupt);
+    signal(SIGTERM, onInterrupt);
+    size_t mostClients = 0;
+    for (size_t clients : config.clients) mostClients = clients > mostClients ? clients : mostClients;
+    raiseDescriptorLimit(mostClients);
+
+    LoadGenerator::Options base;
+    base.durationMs = config.seconds * 1000;
+    if (config.target) {
+        base.address = config.target;
+        base.port = config.targetPort;
+        base.spreadSources = (config.target >> 24) == 127;
+        char where[32];
+        in_addr address = {htonl(config.target)};
+        snprintf(where, sizeof(where), "%s:%u", inet_ntoa(address), config.targetPort);
+        for (const std::string& scenario : config.scenarios)
+            runScenario(config, scenario, base, "Bearer " + config.token, config.ids, where);
+        printf("\n");
+        return 0;
+    }
+
+    // The firmware in this process: loop() on one thread, as on the board,
+    // and the socket transport on another in place of the AsyncTCP task
+    bootFirmware(config.devices);
+    char token[SessionTable::TOKEN_LENGTH + 1];
+    sessions.issue(millis(), 24 * 3600000u, token);
+    SocketServer transport(server);
+    if (!transport.listen(config.port)) {
+        perror("listen");
+        return 1;
+    }
+    std::atomic<bool> running{true};
+    std::thread loopTask([&running] {
+        while (running) loop();
+    });
+    std::thread tcpTask([&transport] { transport.run(); });
+
+    if (config.serveOnly) {
+        printf("serving %zu devices on 127.0.0.1:%u, token %s\n", deviceManager.size(), transport.port(), token);
+        fflush(stdout);
+        while (!interrupted) delay(100);
+    } else {
+        // Every client from its own address, as separate boards or browsers
+        // would be, so admission control sees them apart
+        base.port = transport.port();
+        base.spreadSources = true;
+        char where[48];
+        snprintf(where, sizeof(where), "in-process, %zu devices", deviceManager.size());
+        for (const std::string& scenario : config.scenarios)
+            runScenario(config, scenario, base, std::string("Bearer ") + token, deviceManager.size(), where);
+    }
+
+    transport.stop();
+    tcpTask.join();
+    running = false;
+    loopTask.join();
+    SocketServer::Stats stats = transport.getStats();
+    printf("\n%llu connections, %llu requests served, %llu refused by the transport\n",
+           static_cast<unsigned long long>(stats.accepted), static_cast<unsigned long long>(stats.requests),
+           static_cast<unsigned long long>(stats.rejected));
+    return 0;
+}
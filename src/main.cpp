@@ -1,10 +1,36 @@
 #include <Arduino.h>
+#include <freertos/semphr.h>
+#include <atomic>
+#include <memory>
 #include <WiFi.h>
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
+#include "Actuator.h"
+#include "AdmissionControl.h"
+#include "BodyAccumulator.h"
 #include "Device.h"
 #include "DeviceManager.h"
+#include "DeviceStore.h"
+#include "DeviceListCache.h"
+#include "DeviceListJson.h"
+#include "DeviceListMsgPack.h"
+#include "DeviceSelection.h"
+#include "FleetJson.h"
+#include "Gateway.h"
+#include "Metrics.h"
+#include "MetricsText.h"
+#include "PwmPort.h"
+#include "Router.h"
+#include "SampleStream.h"
+#include "Sampler.h"
+#include "ScheduleStream.h"
+#include "Scheduler.h"
+#include "SessionTable.h"
+#include "Settings.h"
+#include "Trace.h"
+#include "TraceJson.h"
+#include "WiFiLink.h"
 #include <EEPROM.h>
 #include <Preferences.h>
 #include <nvs_flash.h>
@@ -21,89 +47,378 @@ Mode wifiMode = AP;
 const char *ESP32_SSID = "ESP32_Device_Manager";
 const char *ESP32_PASSWORD = "esp32password";
 
-// WiFi Credentials Storage
-Preferences preferences;
+// WiFi credentials, mode and other settings, loaded once at boot
+Settings settings;
+
+// Upper bound on commands accepted by one /api/control/batch request
+const size_t MAX_BATCH_COMMANDS = Actuator::MAX_COMMANDS;
+
+// How long a control request waits for the actuator task before answering
+// 202 with its ticket instead
+const uint32_t CONTROL_TIMEOUT_MS = 100;
+
+// Longest sleep at the end of loop(); it wakes earlier for a due schedule
+const uint32_t LOOP_DELAY_MS = 20;
+// A schedule that found the actuator queue full fires again after this
+const uint32_t SCHEDULE_RETRY_MS = 10;
+
+// Longest that live events wait for an /api/events stream to open
+const uint32_t EVENT_STREAM_OPEN_MS = 2000;
+
+// loop() work shorter than this is left out of the trace, so the 50 Hz loop
+// does not push requests out of the ring
+const uint32_t LOOP_TRACE_MIN_US = 200;
+
+// JSON document capacities, from the members each document holds, so every
+// handler's documents are fixed-size and never touch the heap. Request
+// bodies are parsed in place, so their strings take no room; responses only
+// hold string literals apart from the session token.
+// Members a request object may carry beyond the ones read, before it is
+// refused as invalid
+const size_t SPARE_MEMBERS = 4;
+// {message, status}
+const size_t MESSAGE_DOC_SIZE = JSON_OBJECT_SIZE(2);
+// {password}
+const size_t CONNECT_REQUEST_SIZE = JSON_OBJECT_SIZE(1 + SPARE_MEMBERS);
+// {message, status, data: {token, expiresIn}}
+const size_t CONNECT_RESPONSE_SIZE = JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(2) + JSON_STRING_SIZE(SessionTable::TOKEN_LENGTH);
+// {device, status, level, fadeMs}
+const size_t CONTROL_REQUEST_SIZE = JSON_OBJECT_SIZE(4 + SPARE_MEMBERS);
+// {message, status, data: {id, title, type, gpioPin, status, level}}
+const size_t DEVICE_RESPONSE_SIZE = JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(6);
+// {message, status, data: {ticket}}
+const size_t CONTROL_RESPONSE_SIZE = JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(1);
+// [{device, status, level, fadeMs}, ...]
+const size_t BATCH_REQUEST_SIZE = JSON_ARRAY_SIZE(MAX_BATCH_COMMANDS) + MAX_BATCH_COMMANDS * JSON_OBJECT_SIZE(4);
+// {message, status, ticket, data: [{device, status, level, result}, ...]}
+const size_t BATCH_RESPONSE_SIZE = JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(MAX_BATCH_COMMANDS) + MAX_BATCH_COMMANDS * JSON_OBJECT_SIZE(4);
+// {device, action, delayMs, repeatMs, pulseMs}
+const size_t SCHEDULE_REQUEST_SIZE = JSON_OBJECT_SIZE(5 + SPARE_MEMBERS);
+// {message, status, data: {id, device, action, dueInMs, repeatMs, pulseMs}}
+const size_t SCHEDULE_RESPONSE_SIZE = JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(6);
+// {message, status, data: {admitted, rateLimited, shed, evicted, inFlight, maxInFlight}}
+const size_t ADMISSION_RESPONSE_SIZE = JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(6);
+// {mode}
+const size_t WIFI_MODE_REQUEST_SIZE = JSON_OBJECT_SIZE(1 + SPARE_MEMBERS);
+// {ssid, password}
+const size_t WIFI_SETUP_REQUEST_SIZE = JSON_OBJECT_SIZE(2 + SPARE_MEMBERS);
+#if GATEWAY_ENABLED
+// How long PUT /api/fleet/control waits for the peers before answering 202;
+// longer than CONTROL_TIMEOUT_MS, as every command is a round trip
+const uint32_t FLEET_CONTROL_TIMEOUT_MS = 150;
+// {peer, device, status, level, fadeMs} commands, as many as a ticket takes
+const size_t FLEET_CONTROL_REQUEST_SIZE = JSON_ARRAY_SIZE(Gateway::MAX_COMMANDS) + Gateway::MAX_COMMANDS * JSON_OBJECT_SIZE(5);
+// {message, status, data: [{peer, device, code}], ticket}, peer names copied
+const size_t FLEET_CONTROL_RESPONSE_SIZE = JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(Gateway::MAX_COMMANDS) + Gateway::MAX_COMMANDS * (JSON_OBJECT_SIZE(3) + JSON_STRING_SIZE(Gateway::NAME_MAX));
+const size_t FLEET_PEER_REQUEST_SIZE = JSON_OBJECT_SIZE(4 + SPARE_MEMBERS);
+// A peer's status, with its name and dotted address copied
+const size_t FLEET_PEER_SIZE = JSON_OBJECT_SIZE(14) + JSON_STRING_SIZE(Gateway::NAME_MAX) + JSON_STRING_SIZE(15);
+// {message, status, data: [peer, ...]}, every peer registered
+const size_t FLEET_PEERS_RESPONSE_SIZE = JSON_OBJECT_SIZE(3) + JSON_ARRAY_SIZE(Gateway::MAX_PEERS) + Gateway::MAX_PEERS * FLEET_PEER_SIZE;
+#endif
 
 // Authentication
 const char *AUTH_PASSWORD = "Esp32SecurePass";
-const char *AUTH_TOKEN = "eyJzdWIiOiIxMjM0NTY3ODkwIiwibmFtZSI6IkpvaG4gRG9lIiwiaWF0IjoxNTE2MjM5MDIyfQ.SflKxwRJSMeKKF2QT4fwpMeJf36POk6yJV_adQssw5c";
+const uint32_t SESSION_TTL_MS = 12UL * 60 * 60 * 1000; // tokens from /api/connect last 12 hours
+
+// Prebuilt 401 bodies, sent straight from flash so rejecting a request never
+// builds JSON or touches the heap for the body
+const char UNAUTHORIZED_MISSING[] PROGMEM = "{\"message\":\"Token missing\",\"status\":false}";
+const char UNAUTHORIZED_FORMAT[] PROGMEM = "{\"message\":\"Invalid authorization format. Use 'Bearer <token>'\",\"status\":false}";
+const char UNAUTHORIZED_INVALID[] PROGMEM = "{\"message\":\"Invalid token\",\"status\":false}";
+// The same bodies in MessagePack
+const char UNAUTHORIZED_MISSING_MSGPACK[] PROGMEM = "\x82\xa7message\xadToken missing\xa6status\xc2";
+const char UNAUTHORIZED_FORMAT_MSGPACK[] PROGMEM = "\x82\xa7message\xd9\x32Invalid authorization format. Use 'Bearer <token>'\xa6status\xc2";
+const char UNAUTHORIZED_INVALID_MSGPACK[] PROGMEM = "\x82\xa7message\xadInvalid token\xa6status\xc2";
+
+// Sent by AdmissionHandler, before anything about the request is parsed
+const char TOO_MANY_REQUESTS[] PROGMEM = "{\"message\":\"Too many requests\",\"status\":false}";
+const char SERVER_BUSY[] PROGMEM = "{\"message\":\"Server busy\",\"status\":false}";
+const char TOO_MANY_REQUESTS_MSGPACK[] PROGMEM = "\x82\xa7message\xb1Too many requests\xa6status\xc2";
+const char SERVER_BUSY_MSGPACK[] PROGMEM = "\x82\xa7message\xabServer busy\xa6status\xc2";
+
+const char BODY_TOO_LARGE[] PROGMEM = "{\"message\":\"Request body too large\",\"status\":false}";
+const char BODY_TOO_LARGE_MSGPACK[] PROGMEM = "\x82\xa7message\xb6Request body too large\xa6status\xc2";
+const char BODY_MISSING[] PROGMEM = "{\"message\":\"Request body required\",\"status\":false}";
+const char BODY_MISSING_MSGPACK[] PROGMEM = "\x82\xa7message\xb5Request body required\xa6status\xc2";
+
+const char METHOD_NOT_ALLOWED[] PROGMEM = "{\"message\":\"Method not allowed\",\"status\":false}";
+const char METHOD_NOT_ALLOWED_MSGPACK[] PROGMEM = "\x82\xa7message\xb2Method not allowed\xa6status\xc2";
+
+// Tokens a login attempt takes from its client's bucket, against 1 for
+// anything else, so passwords cannot be guessed at the full request rate
+const uint32_t CONNECT_COST = 5;
+
+// Media types; MessagePack carries the same documents as JSON
+const char *JSON_TYPE = "application/json";
+const char *MSGPACK_TYPE = "application/msgpack";
+
+// WebRequestMethod bits, HTTP_GET to HTTP_OPTIONS, and their names
+const size_t METHOD_COUNT = 7;
+const char *const METHOD_NAMES[METHOD_COUNT] = {"GET", "POST", "DELETE", "PUT", "PATCH", "HEAD", "OPTIONS"};
 
 // Function declarations
 void connectToWiFi();
-void saveWiFiCredentials(const char *ssid, const char *password);
-bool loadWiFiCredentials(String &ssid, String &password);
 void setupAPMode();
-void saveWiFiMode(Mode m);
-Mode loadWiFiMode();
-bool isValidToken(const char *token);
-void handleOptionsRequest(AsyncWebServerRequest *request);
+bool isValidToken(const char *token, size_t len);
+void sendPreflight(AsyncWebServerRequest *request, uint8_t allowed);
+void sendMethodNotAllowed(AsyncWebServerRequest *request, uint8_t allowed);
+void handleNotFound(AsyncWebServerRequest *request);
 void addCorsHeaders(AsyncWebServerResponse *response);
+bool acceptsMsgPack(AsyncWebServerRequest *request);
+char *collectBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total, bool authorize);
+DeserializationError parseBody(AsyncWebServerRequest *request, JsonDocument &doc, char *body, size_t len);
+AsyncWebServerResponse *beginDocumentResponse(AsyncWebServerRequest *request, int statusCode, const JsonDocument &doc, size_t &length);
+void sendResponse(AsyncWebServerRequest *request, AsyncWebServerResponse *response, int statusCode, size_t length);
+AsyncWebServerResponse *beginFixedResponse(AsyncWebServerRequest *request, int statusCode, PGM_P jsonBody, PGM_P msgPackBody, size_t &length);
+void sendFixed(AsyncWebServerRequest *request, int statusCode, PGM_P jsonBody, PGM_P msgPackBody);
+ArRequestHandlerFunction metered(const char *method, const char *route, ArRequestHandlerFunction onRequest);
+void sendDocument(AsyncWebServerRequest *request, int statusCode, const JsonDocument &doc);
 void handleWiFiSetup(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
 void handleWiFiMode(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
 void handleConnect(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
 void handleGetDevices(AsyncWebServerRequest *request);
+const char *readDeviceListQuery(AsyncWebServerRequest *request, DeviceListQuery &query);
+void handleGetSamples(AsyncWebServerRequest *request);
+void handleGetDevice(AsyncWebServerRequest *request);
+void handleUpdateDevice(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleUpdateDeviceStatus(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleDeleteDevice(AsyncWebServerRequest *request);
+bool readLevel(JsonVariantConst item, DeviceCommand &command);
 void handleControl(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleControlBatch(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
 void handleValidateRequest(AsyncWebServerRequest *request);
+bool isAuthorizedEventStream(AsyncWebServerRequest *request);
+void handleEventsUnauthorized(AsyncWebServerRequest *request);
+void replayDeviceChanges(AsyncEventSourceClient *client);
+void publishDeviceChanges();
+void noteResponse();
+void runSchedules();
+void handleCreateSchedule(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleListSchedules(AsyncWebServerRequest *request);
+void handleCancelSchedule(AsyncWebServerRequest *request);
+void handleGetAdmission(AsyncWebServerRequest *request);
+void handleGetMetrics(AsyncWebServerRequest *request);
+#if TRACE_ENABLED
+void handleGetTrace(AsyncWebServerRequest *request);
+#endif
+#if GATEWAY_ENABLED
+void handleGetFleetDevices(AsyncWebServerRequest *request);
+void handleFleetControl(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleGetFleetControl(AsyncWebServerRequest *request);
+void handleGetFleetPeers(AsyncWebServerRequest *request);
+void handleAddFleetPeer(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleRemoveFleetPeer(AsyncWebServerRequest *request);
+#endif
+
+// Every API endpoint. A handler reads a path parameter such as {id} through
+// apiRouter.match(), so it can also be called directly; one taking a body
+// gets it through onBody, in chunks, and answers from there. Order does not
+// matter.
+struct ApiRoute
+{
+    WebRequestMethod method;
+    const char *pattern;
+    void (*onRequest)(AsyncWebServerRequest *request);
+    void (*onBody)(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+};
+
+const ApiRoute ROUTES[] = {
+    {HTTP_POST, "/api/wifi/setup", nullptr, handleWiFiSetup},
+    {HTTP_POST, "/api/wifi/mode", nullptr, handleWiFiMode},
+    {HTTP_POST, "/api/connect", nullptr, handleConnect},
+    {HTTP_GET, "/api/devices", handleGetDevices, nullptr},
+    {HTTP_GET, "/api/devices/{id}", handleGetDevice, nullptr},
+    {HTTP_PUT, "/api/devices/{id}", nullptr, handleUpdateDevice},
+    {HTTP_DELETE, "/api/devices/{id}", handleDeleteDevice, nullptr},
+    {HTTP_PUT, "/api/devices/{id}/status", nullptr, handleUpdateDeviceStatus},
+    {HTTP_GET, "/api/devices/{id}/samples", handleGetSamples, nullptr},
+    {HTTP_PUT, "/api/control", nullptr, handleControl},
+    {HTTP_PUT, "/api/control/batch", nullptr, handleControlBatch},
+    {HTTP_POST, "/api/schedules", nullptr, handleCreateSchedule},
+    {HTTP_GET, "/api/schedules", handleListSchedules, nullptr},
+    {HTTP_DELETE, "/api/schedules", handleCancelSchedule, nullptr},
+    {HTTP_POST, "/api/validate", handleValidateRequest, nullptr},
+    {HTTP_GET, "/api/admission", handleGetAdmission, nullptr},
+    {HTTP_GET, "/api/metrics", handleGetMetrics, nullptr},
+#if TRACE_ENABLED
+    {HTTP_GET, "/api/trace", handleGetTrace, nullptr},
+#endif
+#if GATEWAY_ENABLED
+    {HTTP_GET, "/api/fleet/devices", handleGetFleetDevices, nullptr},
+    {HTTP_PUT, "/api/fleet/control", nullptr, handleFleetControl},
+    {HTTP_GET, "/api/fleet/control", handleGetFleetControl, nullptr},
+    {HTTP_GET, "/api/fleet/peers", handleGetFleetPeers, nullptr},
+    {HTTP_POST, "/api/fleet/peers", nullptr, handleAddFleetPeer},
+    {HTTP_DELETE, "/api/fleet/peers", handleRemoveFleetPeer, nullptr},
+#endif
+    // Reached only by streams the event source's filter turned away
+    {HTTP_GET, "/api/events", handleEventsUnauthorized, nullptr},
+};
+const size_t ROUTE_COUNT = sizeof(ROUTES) / sizeof(ROUTES[0]);
+
+// Registered ahead of every route: takes over, and refuses, the requests
+// AdmissionControl turns away. canHandle() runs as soon as the headers are
+// in, so nothing of those requests is authenticated or parsed.
+class AdmissionHandler : public AsyncWebHandler
+{
+public:
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override;
+};
+
+// Dispatches ROUTES with one RouteTrie lookup per request (and per body
+// chunk), where server.on() registrations are tried one after another.
+// For every path it knows it also answers the CORS preflight, and 405 for
+// a method the path does not take, so neither is registered per route.
+// Each request is metered under its route's pattern.
+class ApiRouter : public AsyncWebHandler
+{
+private:
+    RouteTrie paths;
+    // ROUTES index per pattern and method bit, -1 for none
+    int8_t routeOf[RouteTrie::MAX_PATTERNS][METHOD_COUNT];
+    // Methods each pattern takes, OPTIONS included
+    uint8_t allowed[RouteTrie::MAX_PATTERNS];
+    // Each route's index in `metrics`
+    int meteredAs[ROUTE_COUNT];
+    int preflightRoute = -1;
+    int unmatchedRoute = -1;
+#if TRACE_ENABLED
+    // "METHOD /pattern" per route, the name of its handler's span
+    char spanNames[ROUTE_COUNT][40];
+#endif
+
+    int find(AsyncWebServerRequest *request, int &pattern) const;
+
+public:
+    // Builds the trie from ROUTES; later calls do nothing
+    void begin();
+    // The pattern the request's path matches, with its parameters, or
+    // RouteTrie::NO_MATCH
+    int match(AsyncWebServerRequest *request, PathParams &params) const;
+
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override;
+    void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) override;
+    bool isRequestHandlerTrivial() override { return false; }
+};
 
 // Global instances
 AsyncWebServer server(80);
 DeviceManager deviceManager;
+DeviceStore deviceStore;
+Actuator actuator;
+DeviceListCache deviceListCache;
+DeviceListCache deviceListMsgPackCache(DeviceListCache::MSGPACK);
+SessionTable sessions;
+AsyncEventSource events("/api/events");
+WiFiLink wifiLink;
+Scheduler scheduler;
+Sampler sampler;
+AdmissionControl admission;
+AdmissionHandler admissionHandler;
+ApiRouter apiRouter;
+Metrics metrics;
+#if GATEWAY_ENABLED
+Gateway gateway;
+#endif
+
+// The metered handler running now on the AsyncTCP task, until it sends its
+// response: its route in `metrics`, when it was called and the body size
+struct MeteredCall
+{
+    int route;
+    uint32_t startUs;
+    size_t requestBytes;
+};
+MeteredCall meteredCall = {-1, 0, 0};
+
+// Newest journal entry already pushed to /api/events subscribers. Written by
+// loop(), read when a client connects on the AsyncTCP task.
+std::atomic<uint32_t> publishedSeq{0};
+
+// Held while events are sent, live ones from loop() and a new subscriber's
+// replay on the AsyncTCP task, so the two never interleave
+SemaphoreHandle_t eventsLock = xSemaphoreCreateMutex();
+// Streams let through by the filter that have not been replayed to yet, and
+// when the newest was. The server lists a new subscriber before onConnect,
+// so live events wait for its replay rather than reach it first.
+uint8_t openingStreams = 0;
+uint32_t openingSinceMs = 0;
+
+// Random per boot so ETags issued before a restart never match afterwards
+uint32_t etagSalt = 0;
+
+// millis() at the first response sent after boot, 0 until then
+std::atomic<uint32_t> firstResponseMs{0};
 
 void setup()
 {
     // Initialize Serial for debugging
     Serial.begin(115200);
-
-    // Load saved WiFi mode (AP/STA) from persistent storage
-    wifiMode = loadWiFiMode();
+    etagSalt = esp_random();
+
+    // Load saved settings, WiFi mode (AP/STA) included, from persistent
+    // storage in one go; a board with the older per-key layout is moved to
+    // the single blob here
+    settings.load();
+    if (settings.dirtyFields())
+        settings.commit();
+    wifiMode = settings.get().wifiMode == STA ? STA : AP;
     Serial.print("Loaded wifiMode: ");
     Serial.println(wifiMode == AP ? "AP" : "STA");
 
-    // Connect to WiFi (respecting loaded wifiMode)
+    // Start the AP, or the station association (respecting loaded wifiMode).
+    // Neither waits, so the server below is up before the link is.
     connectToWiFi();
 
-    // Initialize sample devices
-    deviceManager.addDevice(1, "Main Room Light", "LED", 2, false);
-    deviceManager.addDevice(2, "Bedroom Fan", "FAN", 4, true);
-    deviceManager.addDevice(3, "Garden Light", "LED", 5, false);
-    deviceManager.addDevice(4, "Kitchen Heater", "HEATER", 18, true);
-    deviceManager.addDevice(5, "Garage Door", "DOOR", 19, false);
-    deviceManager.addDevice(6, "Bathroom Exhaust", "FAN", 21, true);
-
-    // Setup regular endpoints
-    server.on("/api/wifi/setup", HTTP_OPTIONS, handleOptionsRequest);
-    server.on("/api/wifi/setup", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, handleWiFiSetup);
-
-    server.on("/api/wifi/mode", HTTP_OPTIONS, handleOptionsRequest);
-    server.on("/api/wifi/mode", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, handleWiFiMode);
-
-    server.on("/api/connect", HTTP_OPTIONS, handleOptionsRequest);
-    server.on("/api/connect", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, handleConnect);
-
-    server.on("/api/devices", HTTP_OPTIONS, handleOptionsRequest);
-    server.on("/api/devices", HTTP_GET, handleGetDevices);
-
-    server.on("/api/control", HTTP_OPTIONS, handleOptionsRequest);
-    server.on("/api/control", HTTP_PUT, [](AsyncWebServerRequest *request) {}, NULL, handleControl);
-
-    server.on("/api/validate", HTTP_OPTIONS, handleOptionsRequest);
-    server.on("/api/validate", HTTP_POST, handleValidateRequest);
-
-    // Setup API endpoints with OPTIONS handling
-    server.onNotFound([](AsyncWebServerRequest *request)
-                      {
-        if (request->method() == HTTP_OPTIONS) {
-            handleOptionsRequest(request);
-        } else {
-            DynamicJsonDocument errorResp(200);
-            errorResp["message"] = "Not Found";
-            errorResp["status"] = false;
-            String jsonResponse;
-            serializeJson(errorResp, jsonResponse);
-            AsyncWebServerResponse *resp = request->beginResponse(404, "application/json", jsonResponse);
-            addCorsHeaders(resp);
-            request->send(resp);
-        } });
+    // Change ids, which are the SSE event ids, carry on from a random base so
+    // a Last-Event-ID from before a restart never passes for one of this
+    // boot's. Under 2^30, as the server reads the header with atoi().
+    deviceManager.startJournal(etagSalt >> 2);
+
+    // Restore the saved registry with its last statuses; the sample devices
+    // only seed a board that has none yet
+    if (deviceStore.restore(deviceManager))
+    {
+        Serial.print("Restored devices: ");
+        Serial.println((unsigned int)deviceManager.size());
+    }
+    else
+    {
+        deviceManager.addDevice(1, "Main Room Light", "LED", 2, false);
+        deviceManager.addDevice(2, "Bedroom Fan", "FAN", 4, true);
+        deviceManager.addDevice(3, "Garden Light", "LED", 5, false);
+        deviceManager.addDevice(4, "Kitchen Heater", "HEATER", 18, true);
+        deviceManager.addDevice(5, "Garage Door", "DOOR", 19, false);
+        deviceManager.addDevice(6, "Bathroom Exhaust", "FAN", 21, true);
+        deviceStore.save(deviceManager);
+    }
+
+    // From here on device status only changes on the actuator task
+    actuator.begin(deviceManager);
+    // Inputs are read in the background from now on
+    sampler.begin(deviceManager);
+#if GATEWAY_ENABLED
+    // Peers saved through /api/fleet/peers are reached from here on
+    gateway.begin();
+#endif
+
+    // First, so a refused request never reaches the handlers below
+    server.addHandler(&admissionHandler);
+
+    // Server-Sent Events stream of device changes. The filter rejects bad
+    // tokens, which then fall through to the router's 401 route.
+    publishedSeq = deviceManager.getJournal().latest();
+    events.onConnect(replayDeviceChanges);
+    events.setFilter(isAuthorizedEventStream);
+    server.addHandler(&events);
+
+    // Every other endpoint, each request metered for /api/metrics
+    apiRouter.begin();
+    server.addHandler(&apiRouter);
+    server.onNotFound(metered("*", "unmatched", handleNotFound));
 
     // Start server
     server.begin();
@@ -111,76 +426,55 @@ void setup()
 
 void loop()
 {
-    static unsigned long lastWiFiCheck = 0;
-    const unsigned long WIFI_CHECK_INTERVAL = 30000; // Check every 30 seconds
-
-    // Check WiFi connection status periodically
-    if (millis() - lastWiFiCheck >= WIFI_CHECK_INTERVAL)
+    TRACE_THREAD("loop");
+    metrics.loopWoke(micros());
+
+    // Only keep the station link up when running in STA mode.
+    // In AP mode we host an access point and should not try to reconnect
+    // as a station — attempting to do so causes unnecessary disconnects
+    // and reconnect loops.
+    if (wifiMode == STA)
     {
-        lastWiFiCheck = millis();
-
-        // Only attempt to reconnect when running in STA mode.
-        // In AP mode we host an access point and should not try to reconnect
-        // as a station — attempting to do so causes unnecessary disconnects
-        // and reconnect loops.
-        if (wifiMode == STA)
+        TRACE_SPAN_OVER("WiFiLink::poll", LOOP_TRACE_MIN_US);
+        switch (wifiLink.poll(millis()))
         {
-            if (WiFi.status() != WL_CONNECTED)
-            {
-                Serial.println("WiFi connection lost!");
-
-                // Try to reconnect
-                WiFi.disconnect();
-                delay(1000);
-                connectToWiFi();
-            }
+        case WiFiLink::GOT_IP:
+            Serial.printf("WiFi connected in %u ms (%s), IP Address: ",
+                          (unsigned int)wifiLink.connectTimeMs(),
+                          wifiLink.staticFromCache() ? "static" : "DHCP");
+            Serial.println(WiFi.localIP());
+            break;
+        case WiFiLink::LOST:
+            Serial.println("WiFi connection lost, reconnecting");
+            break;
+        case WiFiLink::CACHE_DROPPED:
+            Serial.println("Cached static IP failed, trying DHCP");
+            break;
+        case WiFiLink::ATTEMPT_FAILED:
+            Serial.println("Failed to connect, retrying");
+            break;
+        default:
+            break;
         }
     }
 
-    // The async web server handles requests in the background
-    delay(100);
-}
-
-// Function to save WiFi credentials
-void saveWiFiCredentials(const char *ssid, const char *password)
-{
-    preferences.begin("wifi", false);
-    preferences.putString("ssid", ssid);
-    preferences.putString("password", password);
-    preferences.putBool("configured", true);
-    preferences.end();
-}
-
-// Save WiFi mode (AP or STA) persistently
-void saveWiFiMode(Mode m)
-{
-    preferences.begin("wifi", false);
-    // store as unsigned int (0 = AP, 1 = STA)
-    preferences.putUInt("mode", (unsigned int)m);
-    preferences.end();
-}
-
-// Load saved WiFi mode; default to AP when not present
-Mode loadWiFiMode()
-{
-    preferences.begin("wifi", true);
-    unsigned int v = preferences.getUInt("mode", (unsigned int)AP);
-    preferences.end();
-    return (v == (unsigned int)STA) ? STA : AP;
-}
+    // Timers that came due go to the actuator task like any other command
+    runSchedules();
 
-// Function to load WiFi credentials
-bool loadWiFiCredentials(String &ssid, String &password)
-{
-    preferences.begin("wifi", true);
-    bool configured = preferences.getBool("configured", false);
-    if (configured)
+    // Push device changes recorded by the actuator task to /api/events,
+    // then persist them
+    publishDeviceChanges();
     {
-        ssid = preferences.getString("ssid", "");
-        password = preferences.getString("password", "");
+        TRACE_SPAN_OVER("DeviceStore::sync", LOOP_TRACE_MIN_US);
+        deviceStore.sync(deviceManager);
     }
-    preferences.end();
-    return configured;
+
+    // The async web server handles requests in the background; keep the
+    // sleep short so pushed events follow changes closely, and shorter still
+    // when a schedule is about to come due
+    uint32_t sleepMs = scheduler.msUntilNext(millis(), LOOP_DELAY_MS);
+    metrics.loopSleeping(micros(), sleepMs);
+    delay(sleepMs);
 }
 
 // Function to setup AP mode
@@ -209,259 +503,635 @@ void connectToWiFi()
         return;
     }
 
-    String saved_ssid, saved_password;
-    if (!loadWiFiCredentials(saved_ssid, saved_password))
+    const Settings::Values &saved = settings.get();
+    if (!saved.wifiConfigured)
     {
         Serial.println("No WiFi credentials found");
         return;
     }
 
-    // First try DHCP to learn the gateway/subnet, then set a unique static IP derived from MAC
-    Serial.println("Connecting to WiFi (DHCP) to obtain network info...");
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(saved_ssid.c_str(), saved_password.c_str());
+    // Returns at once; loop() follows the link through WiFiLink::poll()
+    Serial.println("Connecting to WiFi...");
+    wifiLink.begin(saved.ssid, saved.password, millis());
+}
 
-    // Wait for connection for up to 10 seconds
-    uint8_t attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 10)
+// Writes the names of the methods in a WebRequestMethod mask, comma
+// separated, to out (room for all of them) and returns it
+const char *methodList(uint8_t methods, char *out)
+{
+    size_t n = 0;
+    out[0] = '\0';
+    for (size_t i = 0; i < METHOD_COUNT; i++)
     {
-        delay(1000);
-        Serial.print(".");
-        attempts++;
+        if (methods & (1 << i))
+            n += sprintf(out + n, "%s%s", n ? ", " : "", METHOD_NAMES[i]);
     }
+    return out;
+}
+
+// Answers a CORS preflight for a path taking the allowed methods; the
+// origin and header rules come with every response from sendResponse()
+void sendPreflight(AsyncWebServerRequest *request, uint8_t allowed)
+{
+    char methods[sizeof("GET, POST, DELETE, PUT, PATCH, HEAD, OPTIONS")];
+    AsyncWebServerResponse *response = request->beginResponse(204);
+    response->addHeader("Access-Control-Allow-Methods", methodList(allowed, methods));
+    response->addHeader("Access-Control-Max-Age", "86400"); // 24 hours cache for preflight
+    sendResponse(request, response, 204, 0);
+}
+
+// 405 for a known path asked with a method it does not take
+void sendMethodNotAllowed(AsyncWebServerRequest *request, uint8_t allowed)
+{
+    char methods[sizeof("GET, POST, DELETE, PUT, PATCH, HEAD, OPTIONS")];
+    size_t length;
+    AsyncWebServerResponse *resp = beginFixedResponse(request, 405, METHOD_NOT_ALLOWED, METHOD_NOT_ALLOWED_MSGPACK, length);
+    resp->addHeader("Allow", methodList(allowed, methods));
+    sendResponse(request, resp, 405, length);
+}
+
+void handleNotFound(AsyncWebServerRequest *request)
+{
+    StaticJsonDocument<MESSAGE_DOC_SIZE> errorResp;
+    errorResp["message"] = "Not Found";
+    errorResp["status"] = false;
+    sendDocument(request, 404, errorResp);
+}
+
+// Logs the time from boot to the first response once
+void noteResponse()
+{
+    if (firstResponseMs.load(std::memory_order_relaxed) != 0)
+        return;
+    uint32_t now = millis();
+    uint32_t expected = 0;
+    if (firstResponseMs.compare_exchange_strong(expected, now ? now : 1))
+        Serial.printf("First response after %u ms\n", (unsigned int)now);
+}
+
+uint32_t admissionCost(AsyncWebServerRequest *request)
+{
+    return request->url() == "/api/connect" && request->method() == HTTP_POST ? CONNECT_COST : 1;
+}
 
-    if (WiFi.status() != WL_CONNECTED)
+bool AdmissionHandler::canHandle(AsyncWebServerRequest *request)
+{
+    // The first code of ours to run on the server's task for a request
+    TRACE_THREAD("async_tcp");
+    TRACE_SPAN("admission");
+    // An event stream stays open for as long as the client wants it, so it
+    // is not counted against the in-flight cap
+    bool tracked = !request->url().startsWith("/api/events");
+    uint32_t ip = request->client()->remoteIP();
+    if (admission.admit(ip, millis(), admissionCost(request), tracked) != AdmissionControl::ADMIT)
     {
-        Serial.println("\nFailed to connect (DHCP)");
+        // The refusal is encoded as Accept asks, and the server keeps only
+        // the headers a handler asked for
+        request->addInterestingHeader("Accept");
+        return true;
+    }
+    if (tracked)
+        request->onDisconnect([]()
+                              { admission.release(); });
+    return false;
+}
+
+// Tells the two refusals apart by the bucket: a shed request spent none of
+// its tokens, so the client could go again now were the server less busy
+void AdmissionHandler::handleRequest(AsyncWebServerRequest *request)
+{
+    uint32_t retryAfter = admission.retryAfterSec(request->client()->remoteIP(), millis(), admissionCost(request));
+    bool shed = retryAfter == 0;
+    bool msgPack = acceptsMsgPack(request);
+    PGM_P body = shed ? (msgPack ? SERVER_BUSY_MSGPACK : SERVER_BUSY) : (msgPack ? TOO_MANY_REQUESTS_MSGPACK : TOO_MANY_REQUESTS);
+    AsyncWebServerResponse *resp = request->beginResponse_P(shed ? 503 : 429, msgPack ? MSGPACK_TYPE : JSON_TYPE, body);
+    resp->addHeader("Retry-After", String(shed ? 1 : retryAfter));
+    resp->addHeader("Vary", "Accept");
+    sendResponse(request, resp, shed ? 503 : 429, strlen_P(body));
+}
+
+void ApiRouter::begin()
+{
+    if (paths.size() > 0)
         return;
+    memset(routeOf, -1, sizeof(routeOf));
+    memset(allowed, 0, sizeof(allowed));
+    for (size_t i = 0; i < ROUTE_COUNT; i++)
+    {
+        const ApiRoute &route = ROUTES[i];
+        int pattern = paths.add(route.pattern);
+        if (pattern == RouteTrie::NO_MATCH)
+        {
+            Serial.printf("No room for route %s\n", route.pattern);
+            meteredAs[i] = -1;
+            continue;
+        }
+        routeOf[pattern][__builtin_ctz(route.method)] = (int8_t)i;
+        allowed[pattern] |= route.method | HTTP_OPTIONS;
+        meteredAs[i] = metrics.addRoute(METHOD_NAMES[__builtin_ctz(route.method)], route.pattern);
+#if TRACE_ENABLED
+        snprintf(spanNames[i], sizeof(spanNames[i]), "%s %s", METHOD_NAMES[__builtin_ctz(route.method)], route.pattern);
+#endif
     }
+    // Preflights of all paths count as one route, as do 404s and 405s
+    preflightRoute = metrics.addRoute("OPTIONS", "*");
+    unmatchedRoute = metrics.addRoute("*", "unmatched");
+}
 
-    // We have a DHCP address; obtain gateway/subnet
-    IPAddress gw = WiFi.gatewayIP();
-    IPAddress subnet = WiFi.subnetMask();
-    IPAddress local = WiFi.localIP();
-    Serial.println();
-    Serial.print("DHCP IP: ");
-    Serial.println(WiFi.localIP());
-    Serial.print("Subnet: ");
-    Serial.println(subnet);
-    Serial.print("Gateway: ");
-    Serial.println(gw);
+int ApiRouter::match(AsyncWebServerRequest *request, PathParams &params) const
+{
+    const String &url = request->url();
+    return paths.match(url.c_str(), url.length(), params);
+}
 
-    IPAddress staticIP = gw;
-    staticIP[3] = 200; // choose your desired host part
+// ROUTES index for the request, -1 when its method is not one the path
+// takes; pattern is the path's, NO_MATCH for an unknown one
+int ApiRouter::find(AsyncWebServerRequest *request, int &pattern) const
+{
+    PathParams params;
+    pattern = match(request, params);
+    uint8_t method = request->method();
+    if (pattern == RouteTrie::NO_MATCH || method == 0)
+        return -1;
+    return routeOf[pattern][__builtin_ctz(method)];
+}
 
-    // Apply static IP by reconfiguring then reconnecting
-    Serial.print("Configuring static IP: ");
-    Serial.println(staticIP);
-    WiFi.disconnect(true);
-    delay(500);
-    WiFi.mode(WIFI_STA);
+bool ApiRouter::canHandle(AsyncWebServerRequest *request)
+{
+    PathParams params;
+    if (match(request, params) == RouteTrie::NO_MATCH)
+        return false;
+    // The handlers read Authorization, Accept, If-None-Match and more
+    request->addInterestingHeader("ANY");
+    return true;
+}
 
-    if (!WiFi.config(staticIP, gw, subnet))
+// Runs once the body, if any, has gone to handleBody(); a route that
+// takes one answers 400 when there is none
+void ApiRouter::handleRequest(AsyncWebServerRequest *request)
+{
+    int pattern;
+    int route = find(request, pattern);
+    uint32_t now = micros();
+    if (pattern == RouteTrie::NO_MATCH)
     {
-        Serial.println("Failed to set static IP (WiFi.config returned false)");
+        meteredCall = {unmatchedRoute, now, 0};
+        handleNotFound(request);
     }
-
-    WiFi.begin(saved_ssid.c_str(), saved_password.c_str());
-    attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 10)
+    else if (request->method() == HTTP_OPTIONS)
     {
-        delay(1000);
-        Serial.print("+");
-        attempts++;
+        meteredCall = {preflightRoute, now, 0};
+        sendPreflight(request, allowed[pattern]);
     }
-
-    if (WiFi.status() == WL_CONNECTED)
+    else if (route < 0)
     {
-        Serial.println("\nConnected with static IP");
-        Serial.print("IP Address: ");
-        Serial.println(WiFi.localIP());
+        meteredCall = {unmatchedRoute, now, 0};
+        sendMethodNotAllowed(request, allowed[pattern]);
     }
-    else
+    else if (ROUTES[route].onRequest)
+    {
+        TRACE_SPAN(spanNames[route]);
+        meteredCall = {meteredAs[route], now, 0};
+        ROUTES[route].onRequest(request);
+    }
+    else if (request->contentLength() == 0)
     {
-        Serial.println("\nFailed to connect with static IP, falling back to DHCP IP");
-        // optionally fall back to DHCP — try to reconnect normally
-        WiFi.disconnect();
-        delay(200);
-        WiFi.begin(saved_ssid.c_str(), saved_password.c_str());
+        // No body, so onBody never runs to answer
+        meteredCall = {meteredAs[route], now, 0};
+        sendFixed(request, 400, BODY_MISSING, BODY_MISSING_MSGPACK);
     }
+    meteredCall.route = -1;
 }
 
-// Handle OPTIONS requests for CORS
-void handleOptionsRequest(AsyncWebServerRequest *request)
+// The path is matched again for every chunk: other requests may be handled
+// between two chunks of this one. The chunk that sends the response is timed.
+void ApiRouter::handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
 {
-    AsyncWebServerResponse *response = request->beginResponse(204);
-    response->addHeader("Access-Control-Allow-Methods", "GET, POST, PUT, OPTIONS");
-    response->addHeader("Access-Control-Allow-Headers", "Content-Type, Authorization");
-    response->addHeader("Access-Control-Allow-Origin", "*");
-    response->addHeader("Access-Control-Max-Age", "86400"); // 24 hours cache for preflight
+    int pattern;
+    int route = find(request, pattern);
+    if (route < 0 || !ROUTES[route].onBody)
+        return;
+    TRACE_SPAN(spanNames[route]);
+    meteredCall = {meteredAs[route], (uint32_t)micros(), total};
+    ROUTES[route].onBody(request, data, len, index, total);
+    meteredCall.route = -1;
+}
+
+// Wraps a handler so the request it answers is timed from the call to its
+// sendResponse() and counted under method and route in `metrics`
+ArRequestHandlerFunction metered(const char *method, const char *route, ArRequestHandlerFunction onRequest)
+{
+    int id = metrics.addRoute(method, route);
+    return [id, onRequest](AsyncWebServerRequest *request)
+    {
+        meteredCall = {id, (uint32_t)micros(), 0};
+        onRequest(request);
+        meteredCall.route = -1;
+    };
+}
+
+// Queues a response with the CORS headers every response carries,
+// recording it against the metered handler it answers. length is the body
+// size, 0 for a streamed body that counts its own bytes.
+void sendResponse(AsyncWebServerRequest *request, AsyncWebServerResponse *response, int statusCode, size_t length)
+{
+    TRACE_SPAN("sendResponse");
+    addCorsHeaders(response);
+    if (meteredCall.route >= 0)
+    {
+        metrics.record(meteredCall.route, statusCode, micros() - meteredCall.startUs, meteredCall.requestBytes, length);
+        meteredCall.route = -1;
+    }
     request->send(response);
 }
 
-// Function to add CORS headers to responses
+// The CORS headers, added to every response by sendResponse()
 void addCorsHeaders(AsyncWebServerResponse *response)
 {
     response->addHeader("Access-Control-Allow-Origin", "*");
-    response->addHeader("Access-Control-Allow-Headers", "Content-Type, Authorization");
+    response->addHeader("Access-Control-Allow-Headers", "Content-Type, Authorization, If-None-Match");
+    response->addHeader("Access-Control-Expose-Headers", "ETag, Retry-After");
+    noteResponse();
 }
 
-// Utility function to validate token
-bool isValidToken(const char *token)
+// Position of a MessagePack media type in a header value, or null
+const char *findMsgPack(const char *value)
 {
-    return (token != nullptr && strcmp(token, AUTH_TOKEN) == 0);
+    const char *found = strstr(value, "application/msgpack");
+    return found ? found : strstr(value, "application/x-msgpack");
 }
 
-// Helper function to check authorization and send unauthorized response if needed
-bool checkAuthorization(AsyncWebServerRequest *request)
+// True when the client lists MessagePack in Accept ahead of JSON (or
+// without it). Quality values are not weighed; order stands in for them.
+bool acceptsMsgPack(AsyncWebServerRequest *request)
+{
+    const AsyncWebHeader *accept = request->getHeader("Accept");
+    if (!accept)
+        return false;
+    const char *value = accept->value().c_str();
+    const char *msgPack = findMsgPack(value);
+    const char *json = strstr(value, "application/json");
+    return msgPack && (!json || msgPack < json);
+}
+
+// Decodes a whole request body as MessagePack or JSON according to
+// Content-Type. The body is parsed in place: strings in doc point into it
+// (and it is modified), so it must outlive doc.
+DeserializationError parseBody(AsyncWebServerRequest *request, JsonDocument &doc, char *body, size_t len)
+{
+    TRACE_SPAN("parseBody");
+    const AsyncWebHeader *type = request->getHeader("Content-Type");
+    if (type && findMsgPack(type->value().c_str()))
+        return deserializeMsgPack(doc, body, len);
+    return deserializeJson(doc, body, len);
+}
+
+// Response that carries its serialized body in the same allocation as
+// itself, so a document costs nothing beyond the response object the server
+// needs anyway (and frees once it is sent)
+class DocumentResponse : public AsyncAbstractResponse
 {
-    if (!request->hasHeader("Authorization"))
+private:
+    size_t sent = 0;
+
+public:
+    // Room for length bytes of body after the object
+    static void *operator new(size_t size, size_t length) { return ::operator new(size + length); }
+    static void operator delete(void *p) { ::operator delete(p); }
+
+    DocumentResponse(int statusCode, const char *contentType, size_t length)
     {
-        DynamicJsonDocument errorResp(200);
-        errorResp["message"] = "Token missing";
-        errorResp["status"] = false;
+        _code = statusCode;
+        _contentType = contentType;
+        _contentLength = length;
+    }
 
-        String jsonResponse;
-        serializeJson(errorResp, jsonResponse);
-        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", jsonResponse);
-        addCorsHeaders(resp);
-        request->send(resp);
-        return false;
+    uint8_t *body() { return reinterpret_cast<uint8_t *>(this + 1); }
+
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t *buf, size_t maxLen) override
+    {
+        size_t n = _contentLength - sent;
+        if (n > maxLen)
+            n = maxLen;
+        memcpy(buf, body() + sent, n);
+        sent += n;
+        return n;
     }
+};
 
-    const AsyncWebHeader *h = request->getHeader("Authorization");
-    String authHeader = h->value();
+// Response carrying doc in the encoding the client asked for; the caller
+// adds any headers and sends it. length is set to the body size.
+AsyncWebServerResponse *beginDocumentResponse(AsyncWebServerRequest *request, int statusCode, const JsonDocument &doc, size_t &length)
+{
+    TRACE_SPAN("beginDocumentResponse");
+    bool msgPack = acceptsMsgPack(request);
+    length = msgPack ? measureMsgPack(doc) : measureJson(doc);
+    // One byte over for the terminator serializeJson() adds
+    DocumentResponse *resp = new (length + 1) DocumentResponse(statusCode, msgPack ? MSGPACK_TYPE : JSON_TYPE, length);
+    if (msgPack)
+        serializeMsgPack(doc, resp->body(), length + 1);
+    else
+        serializeJson(doc, reinterpret_cast<char *>(resp->body()), length + 1);
+    resp->addHeader("Vary", "Accept");
+    return resp;
+}
 
-    // Check for "Bearer " prefix
-    if (!authHeader.startsWith("Bearer "))
+void sendDocument(AsyncWebServerRequest *request, int statusCode, const JsonDocument &doc)
+{
+    size_t length;
+    AsyncWebServerResponse *resp = beginDocumentResponse(request, statusCode, doc, length);
+    sendResponse(request, resp, statusCode, length);
+}
+
+// Utility function to validate token (len bytes, not NUL-terminated)
+bool isValidToken(const char *token, size_t len)
+{
+    return token != nullptr && sessions.validate(token, len, millis());
+}
+
+// Compares without an early exit so the time taken does not reveal how much
+// of a secret matched
+bool constantTimeEquals(const char *a, const char *b)
+{
+    size_t lenA = strlen(a);
+    size_t lenB = strlen(b);
+    unsigned char diff = lenA != lenB;
+    for (size_t i = 0; i < lenA; i++)
     {
-        DynamicJsonDocument errorResp(200);
-        errorResp["message"] = "Invalid authorization format. Use 'Bearer <token>'";
-        errorResp["status"] = false;
+        diff |= a[i] ^ b[i % (lenB ? lenB : 1)];
+    }
+    return diff == 0;
+}
+
+// Response with one of the prebuilt error bodies, in the encoding the
+// client asked for; length is set to the body size
+AsyncWebServerResponse *beginFixedResponse(AsyncWebServerRequest *request, int statusCode, PGM_P jsonBody, PGM_P msgPackBody, size_t &length)
+{
+    bool msgPack = acceptsMsgPack(request);
+    PGM_P body = msgPack ? msgPackBody : jsonBody;
+    AsyncWebServerResponse *resp = request->beginResponse_P(statusCode, msgPack ? MSGPACK_TYPE : JSON_TYPE, body);
+    resp->addHeader("Vary", "Accept");
+    length = strlen_P(body);
+    return resp;
+}
+
+void sendFixed(AsyncWebServerRequest *request, int statusCode, PGM_P jsonBody, PGM_P msgPackBody)
+{
+    size_t length;
+    AsyncWebServerResponse *resp = beginFixedResponse(request, statusCode, jsonBody, msgPackBody, length);
+    if (statusCode == 503)
+        resp->addHeader("Retry-After", "1");
+    sendResponse(request, resp, statusCode, length);
+}
 
-        String jsonResponse;
-        serializeJson(errorResp, jsonResponse);
-        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", jsonResponse);
-        addCorsHeaders(resp);
-        request->send(resp);
+void sendUnauthorized(AsyncWebServerRequest *request, PGM_P jsonBody, PGM_P msgPackBody)
+{
+    sendFixed(request, 401, jsonBody, msgPackBody);
+}
+
+// Helper function to check authorization and send unauthorized response if needed.
+// The header is inspected in place: no copies of it or of the token are made.
+bool checkAuthorization(AsyncWebServerRequest *request)
+{
+    TRACE_SPAN("checkAuthorization");
+    const AsyncWebHeader *h = request->getHeader("Authorization");
+    if (!h)
+    {
+        sendUnauthorized(request, UNAUTHORIZED_MISSING, UNAUTHORIZED_MISSING_MSGPACK);
         return false;
     }
 
-    // Extract token (remove "Bearer " prefix)
-    String tokenValue = authHeader.substring(7); // "Bearer " is 7 characters
-    const char *token = tokenValue.c_str();
-
-    if (!isValidToken(token))
+    // Check for "Bearer " prefix
+    const String &authHeader = h->value();
+    if (strncmp(authHeader.c_str(), "Bearer ", 7) != 0)
     {
-        DynamicJsonDocument errorResp(200);
-        errorResp["message"] = "Invalid token";
-        errorResp["status"] = false;
+        sendUnauthorized(request, UNAUTHORIZED_FORMAT, UNAUTHORIZED_FORMAT_MSGPACK);
+        return false;
+    }
 
-        String jsonResponse;
-        serializeJson(errorResp, jsonResponse);
-        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", jsonResponse);
-        addCorsHeaders(resp);
-        request->send(resp);
+    // Token follows the "Bearer " prefix (7 characters)
+    if (!isValidToken(authHeader.c_str() + 7, authHeader.length() - 7))
+    {
+        sendUnauthorized(request, UNAUTHORIZED_INVALID, UNAUTHORIZED_INVALID_MSGPACK);
         return false;
     }
 
     return true;
 }
 
-// Request handlers
-void handleConnect(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+// Body handlers call this with every chunk they get. Returns the whole
+// body, writable for parsing in place, once the last chunk is in, and null
+// until then. With authorize, the token is checked on the first chunk so
+// nothing is buffered for a client without one. Refusals (401, 413 past
+// BodyAccumulator::MAX_SIZE, 503 without memory) are sent here, and the
+// remaining chunks of that body are ignored.
+char *collectBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total, bool authorize)
 {
-    // Only process the complete body
-    if (index + len != total)
-        return;
+    TRACE_SPAN("collectBody");
+    if (index == 0 && authorize && !checkAuthorization(request))
+        return nullptr;
 
-    DynamicJsonDocument doc(200);
-    DeserializationError error = deserializeJson(doc, data);
+    char *body;
+    switch (BodyAccumulator::feed(request->_tempObject, data, len, index, total, body))
+    {
+    case BodyAccumulator::COMPLETE:
+        return body;
+    case BodyAccumulator::TOO_LARGE:
+        sendFixed(request, 413, BODY_TOO_LARGE, BODY_TOO_LARGE_MSGPACK);
+        return nullptr;
+    case BodyAccumulator::NO_MEMORY:
+        sendFixed(request, 503, SERVER_BUSY, SERVER_BUSY_MSGPACK);
+        return nullptr;
+    default:
+        return nullptr;
+    }
+}
 
-    DynamicJsonDocument response(200);
-    int statusCode = 200;
+// EventSource clients cannot set headers, so the stream also accepts ?token=
+// The server runs it for every request that reaches the events handler, so
+// anything but GET /api/events is turned away before the token is looked at.
+// A stream it lets through holds back live events until replayDeviceChanges()
+// has run
+bool isAuthorizedEventStream(AsyncWebServerRequest *request)
+{
+    if (request->method() != HTTP_GET || request->url() != events.url())
+        return false;
 
-    if (error)
+    bool authorized;
+    const AsyncWebParameter *param = request->getParam("token");
+    if (param)
     {
-        response["message"] = "Invalid JSON";
-        response["status"] = false;
-        statusCode = 400;
+        authorized = isValidToken(param->value().c_str(), param->value().length());
     }
     else
     {
-        const char *password = doc["password"];
-        if (password && strcmp(password, AUTH_PASSWORD) == 0)
+        const AsyncWebHeader *h = request->getHeader("Authorization");
+        authorized = h && strncmp(h->value().c_str(), "Bearer ", 7) == 0 && isValidToken(h->value().c_str() + 7, h->value().length() - 7);
+    }
+
+    if (authorized)
+    {
+        xSemaphoreTake(eventsLock, portMAX_DELAY);
+        if (openingStreams < UINT8_MAX)
+            openingStreams++;
+        openingSinceMs = millis();
+        xSemaphoreGive(eventsLock);
+    }
+    return authorized;
+}
+
+// Reached only when isAuthorizedEventStream rejected a /api/events request
+void handleEventsUnauthorized(AsyncWebServerRequest *request)
+{
+    bool tokenGiven = request->hasParam("token") || request->hasHeader("Authorization");
+    if (tokenGiven)
+        sendUnauthorized(request, UNAUTHORIZED_INVALID, UNAUTHORIZED_INVALID_MSGPACK);
+    else
+        sendUnauthorized(request, UNAUTHORIZED_MISSING, UNAUTHORIZED_MISSING_MSGPACK);
+}
+
+// Writes the SSE data for a journal entry; returns the event name
+const char *formatDeviceChange(const DeviceChange &change, char *payload)
+{
+    switch (change.kind)
+    {
+    case DeviceChange::ADDED:
+    {
+        Device device;
+        if (deviceManager.copyDevice(change.id, device))
         {
-            response["message"] = "Authentication successful";
-            response["status"] = true;
-            JsonObject data = response.createNestedObject("data");
-            data["token"] = AUTH_TOKEN;
+            payload[writeDeviceJson(payload, device)] = '\0';
         }
         else
         {
-            response["message"] = "Invalid password";
-            response["status"] = false;
-            statusCode = 401;
+            sprintf(payload, "{\"id\":%d}", change.id);
         }
+        return "added";
+    }
+    case DeviceChange::REMOVED:
+        sprintf(payload, "{\"id\":%d}", change.id);
+        return "removed";
+    case DeviceChange::LEVEL:
+        sprintf(payload, "{\"id\":%d,\"status\":%s,\"level\":%u}", change.id, change.status ? "true" : "false",
+                (unsigned int)change.level);
+        return "status";
+    default:
+        sprintf(payload, "{\"id\":%d,\"status\":%s}", change.id, change.status ? "true" : "false");
+        return "status";
     }
-
-    String jsonResponse;
-    serializeJson(response, jsonResponse);
-    AsyncWebServerResponse *resp = request->beginResponse(statusCode, "application/json", jsonResponse);
-    addCorsHeaders(resp);
-    request->send(resp);
 }
 
-void handleGetDevices(AsyncWebServerRequest *request)
+// Sends a new subscriber what it missed, under eventsLock
+void sendReplay(AsyncEventSourceClient *client)
 {
-    // Check authorization first
-    if (!checkAuthorization(request))
+    const ChangeJournal &journal = deviceManager.getJournal();
+    uint32_t upTo = publishedSeq;
+    uint32_t lastId = client->lastId();
+
+    if (lastId == 0)
     {
+        client->send("{}", "ready", upTo);
+        return;
+    }
+    // Ids from another boot are below this one's base or above what it has
+    // recorded, so they fail one check or the other
+    if (lastId > upTo || lastId + 1 < journal.oldest())
+    {
+        client->send("{}", "resync", upTo);
         return;
     }
 
-    // Authorization valid, proceed with getting devices
-    DynamicJsonDocument response(1024);
-    response["message"] = "Devices retrieved";
-    response["status"] = true;
-
-    JsonArray data = response.createNestedArray("data");
-    for (const Device &device : deviceManager.getAllDevices())
+    char payload[DeviceListJson::MAX_ENTRY_SIZE + 1];
+    DeviceChange change;
+    for (uint32_t seq = lastId + 1; seq <= upTo; seq++)
     {
-        JsonObject deviceObj = data.createNestedObject();
-        deviceObj["id"] = device.id;
-        deviceObj["title"] = device.title;
-        deviceObj["type"] = device.type;
-        deviceObj["gpioPin"] = device.gpioPin;
-        deviceObj["status"] = device.status;
+        if (!journal.get(seq, change))
+        {
+            client->send("{}", "resync", upTo);
+            return;
+        }
+        const char *name = formatDeviceChange(change, payload);
+        client->send(payload, name, change.seq);
     }
+}
 
-    String jsonResponse;
-    serializeJson(response, jsonResponse);
-    AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", jsonResponse);
-    addCorsHeaders(resp);
-    request->send(resp);
+// Brings a (re)connecting subscriber up to date. A Last-Event-ID still held
+// in the journal is resumed from; anything older, or from before a restart,
+// gets a resync event telling the client to fetch /api/devices again. Live
+// events are held back from the filter until here, so none reach the
+// client ahead of its replay.
+void replayDeviceChanges(AsyncEventSourceClient *client)
+{
+    xSemaphoreTake(eventsLock, portMAX_DELAY);
+    sendReplay(client);
+    if (openingStreams > 0)
+        openingStreams--;
+    xSemaphoreGive(eventsLock);
 }
 
-void handleControl(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+// Fans each new journal entry out once to every subscriber. Runs from loop()
+// so the actuator task only appends to the journal and never waits on it.
+void publishDeviceChanges()
 {
-    // Only process the complete body
-    if (index + len != total)
+    TRACE_SPAN_OVER("publishDeviceChanges", LOOP_TRACE_MIN_US);
+    const ChangeJournal &journal = deviceManager.getJournal();
+    uint32_t latest = journal.latest();
+    uint32_t seq = publishedSeq;
+    if (seq == latest)
         return;
 
-    // Check authorization first
-    if (!checkAuthorization(request))
+    xSemaphoreTake(eventsLock, portMAX_DELAY);
+    // A stream still opening would get these ahead of its replay; wait for
+    // it, unless it has been so long that it never will
+    if (openingStreams > 0 && millis() - openingSinceMs < EVENT_STREAM_OPEN_MS)
     {
+        xSemaphoreGive(eventsLock);
         return;
     }
+    openingStreams = 0;
 
-    DynamicJsonDocument response(200);
+    if (events.count() == 0)
+    {
+        publishedSeq = latest;
+        xSemaphoreGive(eventsLock);
+        return;
+    }
 
-    // Token is valid, process the request
-    DynamicJsonDocument doc(200);
-    DeserializationError error = deserializeJson(doc, data);
+    char payload[DeviceListJson::MAX_ENTRY_SIZE + 1];
+    DeviceChange change;
+    while (seq < latest)
+    {
+        if (!journal.get(seq + 1, change))
+        {
+            // Fell more than a journal's worth behind
+            latest = journal.latest();
+            events.send("{}", "resync", latest);
+            seq = latest;
+            break;
+        }
+        const char *name = formatDeviceChange(change, payload);
+        events.send(payload, name, change.seq);
+        publishedSeq = ++seq;
+    }
+    publishedSeq = seq;
+    xSemaphoreGive(eventsLock);
+}
+
+// Request handlers
+void handleConnect(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    // Only process the complete body
+    char *body = collectBody(request, data, len, index, total, false);
+    if (!body)
+        return;
 
+    StaticJsonDocument<CONNECT_REQUEST_SIZE> doc;
+    DeserializationError error = parseBody(request, doc, body, total);
+
+    StaticJsonDocument<CONNECT_RESPONSE_SIZE> response;
     int statusCode = 200;
+
     if (error)
     {
         response["message"] = "Invalid JSON";
@@ -470,72 +1140,106 @@ void handleControl(AsyncWebServerRequest *request, uint8_t *data, size_t len, si
     }
     else
     {
-        int deviceId = doc["device"];
-        bool status = doc["status"];
-
-        if (deviceManager.updateDeviceStatus(deviceId, status))
+        const char *password = doc["password"];
+        if (password && constantTimeEquals(password, AUTH_PASSWORD))
         {
-            response["message"] = "Device updated";
+            // Every client gets its own token, held in the session table
+            char token[SessionTable::TOKEN_LENGTH + 1];
+            sessions.issue(millis(), SESSION_TTL_MS, token);
+
+            response["message"] = "Authentication successful";
             response["status"] = true;
+            JsonObject data = response.createNestedObject("data");
+            data["token"] = token;
+            data["expiresIn"] = SESSION_TTL_MS / 1000;
         }
         else
         {
-            response["message"] = "Device not found";
+            response["message"] = "Invalid password";
             response["status"] = false;
-            statusCode = 404;
+            statusCode = 401;
         }
     }
 
-    String jsonResponse;
-    serializeJson(response, jsonResponse);
-    AsyncWebServerResponse *resp = request->beginResponse(statusCode, "application/json", jsonResponse);
-    addCorsHeaders(resp);
-    request->send(resp);
+    sendDocument(request, statusCode, response);
 }
 
-void handleValidate(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+// Response sending a body shared with DeviceListCache. It keeps the body
+// alive itself rather than through a filler, whose captured shared_ptr would
+// cost std::function an allocation of its own.
+class SharedBodyResponse : public AsyncAbstractResponse
 {
-    // Check authorization first
-    if (!checkAuthorization(request))
+private:
+    std::shared_ptr<const String> body;
+    size_t sent = 0;
+
+public:
+    SharedBodyResponse(const char *contentType, const std::shared_ptr<const String> &shared) : body(shared)
     {
-        return;
+        _code = 200;
+        _contentType = contentType;
+        _contentLength = body->length();
     }
 
-    DynamicJsonDocument response(200);
-
-    // If we got here, the token is valid
-    response["message"] = "Token valid";
-    response["status"] = true;
-
-    String jsonResponse;
-    serializeJson(response, jsonResponse);
-    AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", jsonResponse);
-    addCorsHeaders(resp);
-    request->send(resp);
-}
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t *buf, size_t maxLen) override
+    {
+        size_t n = _contentLength - sent;
+        if (n > maxLen)
+            n = maxLen;
+        memcpy(buf, body->c_str() + sent, n);
+        sent += n;
+        return n;
+    }
+};
 
-// Request-only handler for /api/validate (handles POST requests without a body)
-void handleValidateRequest(AsyncWebServerRequest *request)
+// Chunked response streaming a resumable writer's read(), metered under
+// route and, given a span name, traced. The writer lives in the response
+// object, so unlike a filler capturing it (too large for std::function to
+// hold inline) it costs no allocation of its own. Every streamed body goes
+// out through one.
+template <typename Writer>
+class WriterResponse : public AsyncAbstractResponse
 {
-    // Reuse checkAuthorization which handles missing/invalid tokens and sends error responses
-    if (!checkAuthorization(request))
+private:
+    Writer writer;
+    int route;
+    const char *span;
+
+public:
+    WriterResponse(const char *contentType, const Writer &source, int meteredRoute, const char *spanName = nullptr)
+        : writer(source), route(meteredRoute), span(spanName)
     {
-        return;
+        _code = 200;
+        _contentType = contentType;
+        _contentLength = 0;
+        _sendContentLength = false;
+        _chunked = true;
     }
 
-    DynamicJsonDocument response(200);
-    response["message"] = "Token valid";
-    response["status"] = true;
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t *buf, size_t maxLen) override
+    {
+#if TRACE_ENABLED
+        uint32_t startUs = micros();
+        size_t n = writer.read(buf, maxLen);
+        if (span)
+            TRACE_RECORD(span, startUs, micros());
+#else
+        size_t n = writer.read(buf, maxLen);
+#endif
+        metrics.addResponseBytes(route, n);
+        return n;
+    }
+};
 
-    String jsonResponse;
-    serializeJson(response, jsonResponse);
-    AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", jsonResponse);
-    addCorsHeaders(resp);
-    request->send(resp);
+// True when an If-None-Match value lists etag (or is "*")
+bool etagMatches(const char *ifNoneMatch, const char *etag)
+{
+    return strcmp(ifNoneMatch, "*") == 0 || strstr(ifNoneMatch, etag) != nullptr;
 }
 
-// Handler for WiFi mode changes
-void handleWiFiMode(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+void handleGetDevices(AsyncWebServerRequest *request)
 {
     // Check authorization first
     if (!checkAuthorization(request))
@@ -543,14 +1247,1170 @@ void handleWiFiMode(AsyncWebServerRequest *request, uint8_t *data, size_t len, s
         return;
     }
 
-    // Only process the complete body
-    if (index + len != total)
+    DeviceListQuery query;
+    const char *malformed = readDeviceListQuery(request, query);
+    if (malformed)
+    {
+        StaticJsonDocument<MESSAGE_DOC_SIZE> response;
+        response["message"] = malformed;
+        response["status"] = false;
+        sendDocument(request, 400, response);
+        return;
+    }
+
+    // The device list only changes when the generation does; the two
+    // encodings are different representations and get different tags. A
+    // query is part of the URL, so one tag serves every query too.
+    bool msgPack = acceptsMsgPack(request);
+    char etag[28];
+    snprintf(etag, sizeof(etag), "\"%08x-%u%s\"", (unsigned int)etagSalt, (unsigned int)deviceManager.getGeneration(), msgPack ? "-m" : "");
+
+    const AsyncWebHeader *ifNoneMatch = request->getHeader("If-None-Match");
+    if (ifNoneMatch && etagMatches(ifNoneMatch->value().c_str(), etag))
+    {
+        AsyncWebServerResponse *resp = request->beginResponse(304);
+        resp->addHeader("ETag", etag);
+        resp->addHeader("Vary", "Accept");
+        sendResponse(request, resp, 304, 0);
+        return;
+    }
+
+    // Serve the cached body when it fits; the response holds its own
+    // reference so a later rebuild cannot pull the buffer out from under it.
+    // Filtered and paged lists are not cached.
+    AsyncWebServerResponse *resp;
+    const char *contentType = msgPack ? MSGPACK_TYPE : JSON_TYPE;
+    std::shared_ptr<const String> body;
+    if (query.isDefault())
+        body = (msgPack ? deviceListMsgPackCache : deviceListCache).get(deviceManager);
+    int route = meteredCall.route;
+    if (body)
+    {
+        resp = new SharedBodyResponse(contentType, body);
+    }
+    else
+    {
+        // Too large to cache, or a query: stream it one device at a time
+        // straight into the TCP send buffer so memory use does not grow with
+        // the device count
+        if (msgPack)
+        {
+            DeviceListMsgPack writer = query.isDefault() ? DeviceListMsgPack(deviceManager) : DeviceListMsgPack(deviceManager, query);
+            resp = new WriterResponse<DeviceListMsgPack>(contentType, writer, route, "DeviceListMsgPack::read");
+        }
+        else
+        {
+            DeviceListJson writer = query.isDefault() ? DeviceListJson(deviceManager) : DeviceListJson(deviceManager, query);
+            resp = new WriterResponse<DeviceListJson>(contentType, writer, route, "DeviceListJson::read");
+        }
+    }
+    resp->addHeader("ETag", etag);
+    resp->addHeader("Vary", "Accept");
+    sendResponse(request, resp, 200, body ? body->length() : 0);
+}
+
+// Reads a whole non-negative decimal number; false for anything else
+bool readCount(const String &text, size_t &count)
+{
+    if (text.length() == 0 || text.length() > 9)
+        return false;
+    count = 0;
+    for (size_t i = 0; i < text.length(); i++)
+    {
+        if (text[i] < '0' || text[i] > '9')
+            return false;
+        count = count * 10 + (text[i] - '0');
+    }
+    return true;
+}
+
+// Reads ?type=, ?status=, ?fields=, ?offset= and ?limit= into query. The
+// type points into the request. Returns what is wrong with the first
+// malformed one, or nullptr.
+const char *readDeviceListQuery(AsyncWebServerRequest *request, DeviceListQuery &query)
+{
+    const AsyncWebParameter *param = request->getParam("type");
+    if (param)
+        query.filter.type = param->value().c_str();
+
+    param = request->getParam("status");
+    if (param)
+    {
+        if (param->value() == "true")
+            query.filter.status = DeviceFilter::ON;
+        else if (param->value() == "false")
+            query.filter.status = DeviceFilter::OFF;
+        else
+            return "status must be true or false";
+    }
+
+    param = request->getParam("fields");
+    if (param && !DeviceListQuery::parseFields(param->value().c_str(), query.fields))
+        return "fields must list id, title, type, gpioPin, status or level";
+
+    param = request->getParam("offset");
+    if (param && !readCount(param->value(), query.offset))
+        return "offset must be a whole number";
+
+    param = request->getParam("limit");
+    if (param && !readCount(param->value(), query.limit))
+        return "limit must be a whole number";
+    return nullptr;
+}
+
+// Sends 404 with message
+void sendNotFound(AsyncWebServerRequest *request, const char *message)
+{
+    StaticJsonDocument<MESSAGE_DOC_SIZE> response;
+    response["message"] = message;
+    response["status"] = false;
+    sendDocument(request, 404, response);
+}
+
+// The {id} of a /api/devices/{id} route; sends 404 when it is not a number
+bool readDeviceId(AsyncWebServerRequest *request, int &id)
+{
+    PathParams params;
+    apiRouter.match(request, params);
+    if (params.toInt(0, id))
+        return true;
+    sendNotFound(request, "Device not found");
+    return false;
+}
+
+// GET /api/devices/{id}
+void handleGetDevice(AsyncWebServerRequest *request)
+{
+    int id;
+    Device device;
+    if (!checkAuthorization(request) || !readDeviceId(request, id))
+        return;
+    if (!deviceManager.copyDevice(id, device))
+    {
+        sendNotFound(request, "Device not found");
+        return;
+    }
+
+    // The strings are referenced, not copied: device outlives the document
+    StaticJsonDocument<DEVICE_RESPONSE_SIZE> response;
+    response["message"] = "Device retrieved";
+    response["status"] = true;
+    JsonObject data = response.createNestedObject("data");
+    data["id"] = device.id;
+    data["title"] = (const char *)device.title;
+    data["type"] = (const char *)device.type;
+    data["gpioPin"] = device.gpioPin;
+    data["status"] = device.status;
+    data["level"] = device.level;
+    sendDocument(request, 200, response);
+}
+
+// DELETE /api/devices/{id}, done on the actuator task like any other change
+// to the registry. Inputs stay: the sampler keeps reading their pins.
+void handleDeleteDevice(AsyncWebServerRequest *request)
+{
+    int id;
+    Device device;
+    if (!checkAuthorization(request) || !readDeviceId(request, id))
+        return;
+
+    StaticJsonDocument<CONTROL_RESPONSE_SIZE> response;
+    int statusCode = 200;
+    Actuator::Result result;
+    uint32_t ticket = 0;
+    if (!deviceManager.copyDevice(id, device))
+    {
+        response["message"] = "Device not found";
+        response["status"] = false;
+        statusCode = 404;
+    }
+    else if (device.input)
+    {
+        response["message"] = "Input devices cannot be deleted";
+        response["status"] = false;
+        statusCode = 409;
+    }
+    else if ((ticket = actuator.submitRemoval(id)) == 0)
+    {
+        response["message"] = "Busy, try again";
+        response["status"] = false;
+        statusCode = 503;
+    }
+    else if (!actuator.wait(ticket, CONTROL_TIMEOUT_MS, result))
+    {
+        response["message"] = "Deletion queued";
+        response["status"] = true;
+        response["data"]["ticket"] = ticket;
+        statusCode = 202;
+    }
+    else if (result.applied)
+    {
+        response["message"] = "Device deleted";
+        response["status"] = true;
+    }
+    else
+    {
+        response["message"] = "Device not found";
+        response["status"] = false;
+        statusCode = 404;
+    }
+
+    size_t length;
+    AsyncWebServerResponse *resp = beginDocumentResponse(request, statusCode, response, length);
+    if (statusCode == 503)
+        resp->addHeader("Retry-After", "1");
+    sendResponse(request, resp, statusCode, length);
+}
+
+// GET /api/devices/{id}/samples?since=<seq>: what the sampler holds for an
+// input device after the given sample, streamed out of its ring
+void handleGetSamples(AsyncWebServerRequest *request)
+{
+    int id;
+    if (!checkAuthorization(request) || !readDeviceId(request, id))
+        return;
+
+    const SampleRing *ring = sampler.ring(id);
+    if (!ring)
+    {
+        sendNotFound(request, "Input device not found");
+        return;
+    }
+
+    const AsyncWebParameter *since = request->getParam("since");
+    bool msgPack = acceptsMsgPack(request);
+    SampleStream writer(*ring, id, since ? strtoul(since->value().c_str(), nullptr, 10) : 0,
+                        msgPack ? SampleStream::MSGPACK : SampleStream::JSON);
+    AsyncWebServerResponse *resp = new WriterResponse<SampleStream>(msgPack ? MSGPACK_TYPE : JSON_TYPE, writer, meteredCall.route);
+    resp->addHeader("Vary", "Accept");
+    sendResponse(request, resp, 200, 0);
+}
+
+// Reads a command's optional "level" (0-255, overriding "status") and
+// "fadeMs" into command; false if either is there but out of range
+bool readLevel(JsonVariantConst item, DeviceCommand &command)
+{
+    JsonVariantConst level = item["level"];
+    JsonVariantConst fadeMs = item["fadeMs"];
+    if (!level.isNull())
+    {
+        if (!level.is<uint8_t>())
+            return false;
+        command.level = level.as<uint8_t>();
+        command.status = command.level > 0;
+    }
+    if (!fadeMs.isNull())
+    {
+        if (!fadeMs.is<uint32_t>() || fadeMs.as<uint32_t>() > PWM_MAX_FADE_MS)
+            return false;
+        command.fadeMs = fadeMs.as<uint32_t>();
+    }
+    return true;
+}
+
+// Answers a whole control body: {device, status} or {device, level, fadeMs}
+// for /api/control, the same without device for the device given by
+// pathId, and only {status} with statusOnly
+void applyControl(AsyncWebServerRequest *request, char *body, size_t total, const int *pathId, bool statusOnly)
+{
+    StaticJsonDocument<CONTROL_RESPONSE_SIZE> response;
+
+    // Token is valid, process the request
+    StaticJsonDocument<CONTROL_REQUEST_SIZE> doc;
+    DeserializationError error = parseBody(request, doc, body, total);
+
+    int statusCode = 200;
+    if (error)
+    {
+        response["message"] = "Invalid JSON";
+        response["status"] = false;
+        statusCode = 400;
+    }
+    else
+    {
+        DeviceCommand command;
+        command.id = pathId ? *pathId : doc["device"].as<int>();
+        command.status = doc["status"];
+
+        // The actuator task drives the pin; normally it is done long before
+        // the timeout and the answer is the same as a direct write
+        Actuator::Result result;
+        uint32_t ticket = 0;
+        if (statusOnly && !doc["status"].is<bool>())
+        {
+            response["message"] = "status must be true or false";
+            response["status"] = false;
+            statusCode = 400;
+        }
+        else if (!statusOnly && !readLevel(doc, command))
+        {
+            response["message"] = "level must be 0-255 and fadeMs 0-30000";
+            response["status"] = false;
+            statusCode = 400;
+        }
+        else if ((ticket = actuator.submit(&command, 1)) == 0)
+        {
+            response["message"] = "Busy, try again";
+            response["status"] = false;
+            statusCode = 503;
+        }
+        else if (!actuator.wait(ticket, CONTROL_TIMEOUT_MS, result))
+        {
+            response["message"] = "Command queued";
+            response["status"] = true;
+            response["data"]["ticket"] = ticket;
+            statusCode = 202;
+        }
+        else if (result.applied)
+        {
+            response["message"] = "Device updated";
+            response["status"] = true;
+        }
+        else
+        {
+            response["message"] = "Device not found";
+            response["status"] = false;
+            statusCode = 404;
+        }
+    }
+
+    size_t length;
+    AsyncWebServerResponse *resp = beginDocumentResponse(request, statusCode, response, length);
+    if (statusCode == 503)
+        resp->addHeader("Retry-After", "1");
+    sendResponse(request, resp, statusCode, length);
+}
+
+void handleControl(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    // Only process the complete body, from a client with a valid token
+    char *body = collectBody(request, data, len, index, total, true);
+    if (body)
+        applyControl(request, body, total, nullptr, false);
+}
+
+// PUT /api/devices/{id}: {status} or {level, fadeMs}
+void handleUpdateDevice(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    int id;
+    char *body = collectBody(request, data, len, index, total, true);
+    if (body && readDeviceId(request, id))
+        applyControl(request, body, total, &id, false);
+}
+
+// PUT /api/devices/{id}/status: {status}
+void handleUpdateDeviceStatus(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    int id;
+    char *body = collectBody(request, data, len, index, total, true);
+    if (body && readDeviceId(request, id))
+        applyControl(request, body, total, &id, true);
+}
+
+// Batch control: validates every {device,status} or {device,level} command,
+// then applies them all with one GPIO register write so the outputs switch
+// together (dimmers start their fades in the same pass)
+void handleControlBatch(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    // Only process the complete body, from a client with a valid token
+    char *body = collectBody(request, data, len, index, total, true);
+    if (!body)
+        return;
+
+    // About 2.5 KB each on the ESP32, too much for the AsyncTCP task's stack;
+    // handlers run one at a time on that task, so one pair serves every call
+    static StaticJsonDocument<BATCH_REQUEST_SIZE> doc;
+    static StaticJsonDocument<BATCH_RESPONSE_SIZE> response;
+    DeserializationError error = parseBody(request, doc, body, total);
+    response.clear();
+    int statusCode = 200;
+
+    JsonArray items = doc.as<JsonArray>();
+    if (error == DeserializationError::NoMemory)
+    {
+        response["message"] = "Too many commands (max 32)";
+        response["status"] = false;
+        statusCode = 400;
+    }
+    else if (error)
+    {
+        response["message"] = "Invalid JSON";
+        response["status"] = false;
+        statusCode = 400;
+    }
+    else if (items.isNull() || items.size() == 0 || items.size() > MAX_BATCH_COMMANDS)
+    {
+        response["message"] = "Expected an array of 1 to 32 {device,status} commands";
+        response["status"] = false;
+        statusCode = 400;
+    }
+    else
+    {
+        DeviceCommand commands[MAX_BATCH_COMMANDS];
+        size_t count = 0;
+        bool wellFormed = true;
+
+        for (JsonObject item : items)
+        {
+            wellFormed = wellFormed && item["device"].is<int>() && (item["status"].is<bool>() || item["level"].is<uint8_t>());
+            commands[count].id = item["device"];
+            commands[count].status = item["status"];
+            wellFormed = readLevel(item, commands[count]) && wellFormed;
+            count++;
+        }
+
+        if (!wellFormed)
+        {
+            response["message"] = "Each command needs an integer device and a boolean status or a level of 0-255; fadeMs is 0-30000";
+            response["status"] = false;
+            statusCode = 400;
+        }
+        else
+        {
+            Actuator::Result outcome;
+            uint32_t ticket = actuator.submit(commands, count);
+            bool done = ticket != 0 && actuator.wait(ticket, CONTROL_TIMEOUT_MS, outcome);
+            if (ticket == 0)
+            {
+                response["message"] = "Busy, try again";
+                response["status"] = false;
+                statusCode = 503;
+            }
+            else if (!done)
+            {
+                response["message"] = "Commands queued";
+                response["status"] = true;
+                response["ticket"] = ticket;
+                statusCode = 202;
+            }
+            else if (outcome.applied)
+            {
+                response["message"] = "Devices updated";
+                response["status"] = true;
+            }
+            else
+            {
+                response["message"] = "Device not found";
+                response["status"] = false;
+                statusCode = 404;
+            }
+
+            if (ticket != 0)
+            {
+                JsonArray results = response.createNestedArray("data");
+                for (size_t i = 0; i < count; i++)
+                {
+                    JsonObject result = results.createNestedObject();
+                    result["device"] = commands[i].id;
+                    result["status"] = commands[i].status;
+                    if (commands[i].level != DeviceCommand::NO_LEVEL)
+                        result["level"] = commands[i].level;
+                    if (!done)
+                        result["result"] = "queued";
+                    else if (outcome.applied)
+                        result["result"] = "updated";
+                    else
+                        result["result"] = (outcome.found & (1UL << i)) ? "not_applied" : "not_found";
+                }
+            }
+        }
+    }
+
+    size_t length;
+    AsyncWebServerResponse *resp = beginDocumentResponse(request, statusCode, response, length);
+    if (statusCode == 503)
+        resp->addHeader("Retry-After", "1");
+    sendResponse(request, resp, statusCode, length);
+}
+
+void handleValidate(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    // Check authorization first
+    if (!checkAuthorization(request))
+    {
+        return;
+    }
+
+    StaticJsonDocument<MESSAGE_DOC_SIZE> response;
+
+    // If we got here, the token is valid
+    response["message"] = "Token valid";
+    response["status"] = true;
+
+    sendDocument(request, 200, response);
+}
+
+// Applies every schedule that came due as one actuator batch
+void runSchedules()
+{
+    TRACE_SPAN_OVER("runSchedules", LOOP_TRACE_MIN_US);
+    Scheduler::Timer fired[MAX_BATCH_COMMANDS];
+    uint32_t now = millis();
+    size_t count = scheduler.poll(now, fired, MAX_BATCH_COMMANDS);
+    if (count == 0)
+        return;
+
+    DeviceCommand commands[MAX_BATCH_COMMANDS];
+    // Per command, the timer it came from and, for a pulse, its off half
+    const Scheduler::Timer *sources[MAX_BATCH_COMMANDS];
+    uint32_t pulseOffs[MAX_BATCH_COMMANDS];
+    size_t commandCount = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const Scheduler::Timer &timer = fired[i];
+        Device device;
+        if (!deviceManager.copyDevice(timer.deviceId, device))
+            continue; // deleted since the schedule was made
+
+        // A pulse's off half is reserved before its on half goes out, so a
+        // full pool can never leave the device on for good
+        uint32_t off = 0;
+        if (timer.action == Scheduler::PULSE)
+        {
+            off = scheduler.arm(timer.deviceId, Scheduler::OFF, now, Scheduler::MAX_DELAY_MS);
+            if (off == 0)
+            {
+                Serial.println("No timer free for the end of a pulse, skipping it");
+                continue;
+            }
+        }
+
+        DeviceCommand &command = commands[commandCount];
+        command.id = timer.deviceId;
+        command.status = timer.action == Scheduler::TOGGLE ? !device.status : timer.action != Scheduler::OFF;
+        sources[commandCount] = &timer;
+        pulseOffs[commandCount++] = off;
+    }
+    if (commandCount == 0)
+        return;
+
+    if (actuator.submit(commands, commandCount) == 0)
+    {
+        Serial.println("Actuator busy, retrying schedules");
+        // A pulse is retried whole, so its off half still follows its on half
+        for (size_t i = 0; i < commandCount; i++)
+        {
+            if (pulseOffs[i])
+                scheduler.cancel(pulseOffs[i]);
+        }
+        for (size_t i = 0; i < commandCount; i++)
+        {
+            const Scheduler::Timer &source = *sources[i];
+            // A recurring timer is still pending and is only moved up; a
+            // one-shot gave its slot back when it fired, so it needs a new one
+            if (source.periodMs)
+                scheduler.reschedule(source.id, now, SCHEDULE_RETRY_MS);
+            else if (scheduler.arm(source.deviceId, source.action, now, SCHEDULE_RETRY_MS, 0, source.pulseMs) == 0)
+                Serial.println("No timer free to retry a schedule, dropping it");
+        }
+        return;
+    }
+
+    // The off half of a pulse counts from when its on half was handed over
+    uint32_t sent = millis();
+    for (size_t i = 0; i < commandCount; i++)
+    {
+        if (pulseOffs[i])
+            scheduler.reschedule(pulseOffs[i], sent, sources[i]->pulseMs);
+    }
+}
+
+bool parseScheduleAction(const char *name, Scheduler::Action &action)
+{
+    if (!name)
+        return false;
+    for (size_t i = 0; i < sizeof(Scheduler::ACTION_NAMES) / sizeof(Scheduler::ACTION_NAMES[0]); i++)
+    {
+        if (strcmp(name, Scheduler::ACTION_NAMES[i]) == 0)
+        {
+            action = (Scheduler::Action)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void writeSchedule(JsonObject out, const Scheduler::Timer &timer, uint32_t now)
+{
+    int32_t dueIn = (int32_t)(timer.due - now);
+    out["schedule"] = timer.id;
+    out["device"] = timer.deviceId;
+    out["action"] = Scheduler::ACTION_NAMES[timer.action];
+    out["dueInMs"] = dueIn > 0 ? dueIn : 0;
+    out["repeatMs"] = timer.periodMs;
+    out["pulseMs"] = timer.pulseMs;
+}
+
+// Creates a schedule: {device, action, delayMs, repeatMs?, pulseMs?}
+void handleCreateSchedule(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    // Only process the complete body, from a client with a valid token
+    char *body = collectBody(request, data, len, index, total, true);
+    if (!body)
+        return;
+
+    StaticJsonDocument<SCHEDULE_REQUEST_SIZE> doc;
+    DeserializationError error = parseBody(request, doc, body, total);
+
+    StaticJsonDocument<SCHEDULE_RESPONSE_SIZE> response;
+    int statusCode = 201;
+
+    Scheduler::Action action = Scheduler::OFF;
+    int deviceId = doc["device"];
+    uint32_t delayMs = doc["delayMs"];
+    uint32_t repeatMs = doc["repeatMs"];
+    uint32_t pulseMs = doc["pulseMs"];
+    Device device;
+
+    if (error)
+    {
+        response["message"] = "Invalid JSON";
+        response["status"] = false;
+        statusCode = 400;
+    }
+    else if (!parseScheduleAction(doc["action"], action))
+    {
+        response["message"] = "Invalid action. Use 'on', 'off', 'toggle' or 'pulse'";
+        response["status"] = false;
+        statusCode = 400;
+    }
+    else if (action == Scheduler::PULSE && (pulseMs == 0 || (repeatMs != 0 && pulseMs >= repeatMs)))
+    {
+        response["message"] = "A pulse needs pulseMs, shorter than repeatMs";
+        response["status"] = false;
+        statusCode = 400;
+    }
+    else if (!deviceManager.copyDevice(deviceId, device) || device.input)
+    {
+        response["message"] = "Device not found";
+        response["status"] = false;
+        statusCode = 404;
+    }
+    else
+    {
+        uint32_t now = millis();
+        uint32_t id = scheduler.arm(deviceId, action, now, delayMs, repeatMs, pulseMs);
+        if (id != 0)
+        {
+            Scheduler::Timer timer = {id, deviceId, action, now + delayMs, repeatMs, pulseMs};
+            response["message"] = "Schedule created";
+            response["status"] = true;
+            writeSchedule(response.createNestedObject("data"), timer, now);
+        }
+        else if (scheduler.size() >= scheduler.capacity())
+        {
+            response["message"] = "Too many schedules";
+            response["status"] = false;
+            statusCode = 503;
+        }
+        else
+        {
+            response["message"] = "delayMs, repeatMs or pulseMs out of range";
+            response["status"] = false;
+            statusCode = 400;
+        }
+    }
+
+    sendDocument(request, statusCode, response);
+}
+
+void handleListSchedules(AsyncWebServerRequest *request)
+{
+    // Check authorization first
+    if (!checkAuthorization(request))
+    {
+        return;
+    }
+
+    // Streamed a timer at a time, so no copy of the pool is made
+    bool msgPack = acceptsMsgPack(request);
+    ScheduleStream writer(scheduler, millis(), msgPack ? ScheduleStream::MSGPACK : ScheduleStream::JSON);
+    AsyncWebServerResponse *resp = new WriterResponse<ScheduleStream>(msgPack ? MSGPACK_TYPE : JSON_TYPE, writer, meteredCall.route);
+    resp->addHeader("Vary", "Accept");
+    sendResponse(request, resp, 200, 0);
+}
+
+// DELETE /api/schedules?schedule=<id>
+void handleCancelSchedule(AsyncWebServerRequest *request)
+{
+    // Check authorization first
+    if (!checkAuthorization(request))
+    {
+        return;
+    }
+
+    StaticJsonDocument<MESSAGE_DOC_SIZE> response;
+    int statusCode = 200;
+
+    const AsyncWebParameter *param = request->getParam("schedule");
+    if (!param)
+    {
+        response["message"] = "Schedule not specified";
+        response["status"] = false;
+        statusCode = 400;
+    }
+    else if (!scheduler.cancel(strtoul(param->value().c_str(), nullptr, 10)))
+    {
+        response["message"] = "Schedule not found";
+        response["status"] = false;
+        statusCode = 404;
+    }
+    else
+    {
+        response["message"] = "Schedule cancelled";
+        response["status"] = true;
+    }
+
+    sendDocument(request, statusCode, response);
+}
+
+// Request-only handler for /api/validate (handles POST requests without a body)
+void handleValidateRequest(AsyncWebServerRequest *request)
+{
+    // Reuse checkAuthorization which handles missing/invalid tokens and sends error responses
+    if (!checkAuthorization(request))
+    {
+        return;
+    }
+
+    StaticJsonDocument<MESSAGE_DOC_SIZE> response;
+    response["message"] = "Token valid";
+    response["status"] = true;
+
+    sendDocument(request, 200, response);
+}
+
+// Requests refused by AdmissionHandler so far, and the load it sees now
+void handleGetAdmission(AsyncWebServerRequest *request)
+{
+    if (!checkAuthorization(request))
+    {
+        return;
+    }
+
+    AdmissionControl::Stats stats = admission.getStats();
+    StaticJsonDocument<ADMISSION_RESPONSE_SIZE> response;
+    response["message"] = "Admission statistics retrieved";
+    response["status"] = true;
+    JsonObject data = response.createNestedObject("data");
+    data["admitted"] = stats.admitted;
+    data["rateLimited"] = stats.rateLimited;
+    data["shed"] = stats.shed;
+    data["evicted"] = stats.evicted;
+    data["inFlight"] = stats.inFlight;
+    data["maxInFlight"] = AdmissionControl::MAX_IN_FLIGHT;
+
+    sendDocument(request, 200, response);
+}
+
+// Everything `metrics` holds, plus heap, admission, actuator and sampler
+// figures read now, in the Prometheus text format
+void handleGetMetrics(AsyncWebServerRequest *request)
+{
+    if (!checkAuthorization(request))
+    {
+        return;
+    }
+
+    AdmissionControl::Stats admitted = admission.getStats();
+    Actuator::LatencyStats actuated = actuator.latency();
+    Sampler::Stats sampled = sampler.getStats();
+    const MetricsText::Value values[] = {
+        {"esp_heap_free_bytes", "Free heap", false, false, ESP.getFreeHeap()},
+        {"esp_heap_min_free_bytes", "Lowest free heap since boot", false, false, ESP.getMinFreeHeap()},
+        {"esp_heap_largest_free_block_bytes", "Largest block the heap can hand out", false, false, ESP.getMaxAllocHeap()},
+        {"admission_admitted_total", "Requests let through to the handlers", true, false, admitted.admitted},
+        {"admission_rate_limited_total", "Requests refused with 429", true, false, admitted.rateLimited},
+        {"admission_shed_total", "Requests refused with 503", true, false, admitted.shed},
+        {"admission_evicted_total", "Client slots handed to a new address", true, false, admitted.evicted},
+        {"admission_in_flight", "Admitted requests not finished yet", false, false, admitted.inFlight},
+        {"actuator_commands_total", "Commands applied by the actuator task", true, false, actuated.count},
+        {"actuator_latency_seconds_total", "Time from command submission to the pins being written", true, true, actuated.totalUs},
+        {"actuator_latency_max_seconds", "Longest time from submission to the pins", false, true, actuated.maxUs},
+        {"sampler_passes_total", "Sampling periods read", true, false, sampled.passes},
+        {"sampler_missed_total", "Sampling periods skipped after a late start", true, false, sampled.missed},
+        {"uptime_seconds", "Time since boot", false, true, (uint64_t)millis() * 1000},
+    };
+    MetricsText writer(metrics, values, sizeof(values) / sizeof(values[0]));
+    AsyncWebServerResponse *resp = new WriterResponse<MetricsText>("text/plain; version=0.0.4", writer, meteredCall.route);
+    sendResponse(request, resp, 200, 0);
+}
+
+#if TRACE_ENABLED
+// The spans the trace ring holds, in the Chrome trace-event format: save the
+// body to a file and open it in Perfetto or chrome://tracing
+void handleGetTrace(AsyncWebServerRequest *request)
+{
+    if (!checkAuthorization(request))
+    {
+        return;
+    }
+
+    TraceJson writer(traceRing, micros());
+    AsyncWebServerResponse *resp = new WriterResponse<TraceJson>(JSON_TYPE, writer, meteredCall.route);
+    sendResponse(request, resp, 200, 0);
+}
+#endif
+
+#if GATEWAY_ENABLED
+// Every peer's devices, from the gateway's merged list: nothing is asked of
+// the peers here, so the list is as fresh as the last poll of each
+void handleGetFleetDevices(AsyncWebServerRequest *request)
+{
+    if (!checkAuthorization(request))
+    {
+        return;
+    }
+
+    // The "f" keeps these tags apart from those of /api/devices
+    const FleetCache &fleet = gateway.cache();
+    char etag[28];
+    snprintf(etag, sizeof(etag), "\"%08x-f%u\"", (unsigned int)etagSalt, (unsigned int)fleet.getGeneration());
+
+    const AsyncWebHeader *ifNoneMatch = request->getHeader("If-None-Match");
+    if (ifNoneMatch && etagMatches(ifNoneMatch->value().c_str(), etag))
+    {
+        AsyncWebServerResponse *resp = request->beginResponse(304);
+        resp->addHeader("ETag", etag);
+        sendResponse(request, resp, 304, 0);
+        return;
+    }
+
+    FleetJson writer(fleet);
+    AsyncWebServerResponse *resp = new WriterResponse<FleetJson>(JSON_TYPE, writer, meteredCall.route, "FleetJson::read");
+    resp->addHeader("ETag", etag);
+    sendResponse(request, resp, 200, 0);
+}
+
+// Reads one {peer?, device, status | level, fadeMs?} command; false if it
+// is malformed or the peer name too long
+bool readFleetCommand(JsonVariantConst item, Gateway::Command &out)
+{
+    JsonVariantConst peer = item["peer"];
+    out = Gateway::Command();
+    if (!item["device"].is<int>() || !(item["status"].is<bool>() || item["level"].is<uint8_t>()))
+        return false;
+    if (!peer.isNull())
+    {
+        if (!peer.is<const char *>() || strlen(peer.as<const char *>()) > Gateway::NAME_MAX)
+            return false;
+        strcpy(out.peer, peer.as<const char *>());
+    }
+    out.command.id = item["device"];
+    out.command.status = item["status"];
+    return readLevel(item, out.command);
+}
+
+// {peer, device, code} per command of a fleet ticket, device only when the
+// commands are at hand; true if every code is a 2xx
+bool writeFleetResults(JsonArray out, const Gateway::Result &result, const Gateway::Command *commands)
+{
+    bool succeeded = true;
+    for (size_t i = 0; i < result.count; i++)
+    {
+        JsonObject item = out.createNestedObject();
+        Gateway::PeerStatus peer;
+        if (result.peers[i] != Gateway::NO_PEER && gateway.peerStatus(result.peers[i], peer))
+            item["peer"] = peer.name; // copied, as a char *
+        else
+            item["peer"] = nullptr;
+        if (commands)
+            item["device"] = commands[i].command.id;
+        item["code"] = result.codes[i];
+        succeeded = succeeded && result.codes[i] >= 200 && result.codes[i] < 300;
+    }
+    return succeeded;
+}
+
+// PUT /api/fleet/control: a command or an array of up to 16, each sent to
+// the peer it names or else to the one listing its device. The gateway
+// task asks all the peers involved at once; what has not come back within
+// FLEET_CONTROL_TIMEOUT_MS is answered 202 with a ticket.
+void handleFleetControl(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    char *body = collectBody(request, data, len, index, total, true);
+    if (!body)
+        return;
+
+    // Too large for the AsyncTCP task's stack, like handleControlBatch()'s
+    static StaticJsonDocument<FLEET_CONTROL_REQUEST_SIZE> doc;
+    static StaticJsonDocument<FLEET_CONTROL_RESPONSE_SIZE> response;
+    static Gateway::Command commands[Gateway::MAX_COMMANDS];
+    DeserializationError error = parseBody(request, doc, body, total);
+    response.clear();
+    int statusCode = 200;
+
+    // A lone command is a batch of one
+    size_t count = 0;
+    if (!error && doc.is<JsonArray>())
+    {
+        for (JsonVariantConst item : doc.as<JsonArrayConst>())
+        {
+            if (count == Gateway::MAX_COMMANDS || !readFleetCommand(item, commands[count]))
+            {
+                count = 0;
+                break;
+            }
+            count++;
+        }
+    }
+    else if (!error && readFleetCommand(doc.as<JsonVariantConst>(), commands[0]))
+    {
+        count = 1;
+    }
+
+    Gateway::Result result;
+    uint32_t ticket = 0;
+    if (error == DeserializationError::NoMemory)
+    {
+        response["message"] = "Too many commands (max 16)";
+        response["status"] = false;
+        statusCode = 400;
+    }
+    else if (error)
+    {
+        response["message"] = "Invalid JSON";
+        response["status"] = false;
+        statusCode = 400;
+    }
+    else if (count == 0)
+    {
+        response["message"] = "Expected 1 to 16 commands, each with an integer device and a boolean status or a level of 0-255; peer names a peer, fadeMs is 0-30000";
+        response["status"] = false;
+        statusCode = 400;
+    }
+    else if ((ticket = gateway.submit(commands, count)) == 0)
+    {
+        response["message"] = "Busy, try again";
+        response["status"] = false;
+        statusCode = 503;
+    }
+    else if (!gateway.wait(ticket, FLEET_CONTROL_TIMEOUT_MS, result))
+    {
+        response["message"] = "Commands sent to the peers";
+        response["status"] = true;
+        response["ticket"] = ticket;
+        statusCode = 202;
+    }
+    else
+    {
+        bool succeeded = writeFleetResults(response.createNestedArray("data"), result, commands);
+        response["message"] = succeeded ? "Devices updated" : "Not every command succeeded";
+        response["status"] = succeeded;
+    }
+
+    size_t length;
+    AsyncWebServerResponse *resp = beginDocumentResponse(request, statusCode, response, length);
+    if (statusCode == 503)
+        resp->addHeader("Retry-After", "1");
+    sendResponse(request, resp, statusCode, length);
+}
+
+// GET /api/fleet/control?ticket=<n>: how the commands of a 202 went
+void handleGetFleetControl(AsyncWebServerRequest *request)
+{
+    if (!checkAuthorization(request))
+    {
+        return;
+    }
+
+    static StaticJsonDocument<FLEET_CONTROL_RESPONSE_SIZE> response;
+    response.clear();
+    int statusCode = 200;
+
+    Gateway::Result result;
+    const AsyncWebParameter *param = request->getParam("ticket");
+    Gateway::TicketState state = param ? gateway.poll(strtoul(param->value().c_str(), nullptr, 10), result) : Gateway::UNKNOWN;
+    if (!param)
+    {
+        response["message"] = "Ticket not specified";
+        response["status"] = false;
+        statusCode = 400;
+    }
+    else if (state == Gateway::UNKNOWN)
+    {
+        response["message"] = "Ticket not found";
+        response["status"] = false;
+        statusCode = 404;
+    }
+    else if (state == Gateway::PENDING)
+    {
+        response["message"] = "Commands in progress";
+        response["status"] = true;
+        statusCode = 202;
+    }
+    else
+    {
+        bool succeeded = writeFleetResults(response.createNestedArray("data"), result, nullptr);
+        response["message"] = succeeded ? "Devices updated" : "Not every command succeeded";
+        response["status"] = succeeded;
+    }
+
+    sendDocument(request, statusCode, response);
+}
+
+// The gateway's peers, with the state of each one's connection
+void handleGetFleetPeers(AsyncWebServerRequest *request)
+{
+    if (!checkAuthorization(request))
+    {
+        return;
+    }
+
+    // Too large for the AsyncTCP task's stack, like handleControlBatch()'s
+    static StaticJsonDocument<FLEET_PEERS_RESPONSE_SIZE> response;
+    response.clear();
+    response["message"] = "Peers retrieved";
+    response["status"] = true;
+    JsonArray list = response.createNestedArray("data");
+    uint32_t now = millis();
+    Gateway::PeerStatus peer;
+    for (size_t i = 0; i < Gateway::MAX_PEERS; i++)
+    {
+        if (!gateway.peerStatus(i, peer))
+            continue;
+        IPAddress ip(peer.address);
+        char address[16];
+        snprintf(address, sizeof(address), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+
+        JsonObject out = list.createNestedObject();
+        out["name"] = (char *)peer.name;
+        out["address"] = (char *)address;
+        out["port"] = peer.port;
+        out["connected"] = peer.connected;
+        out["online"] = peer.online;
+        out["stale"] = peer.stale;
+        out["loginRefused"] = peer.loginRefused;
+        out["devices"] = peer.devices;
+        if (peer.seen)
+            out["lastSeenAgoMs"] = now - peer.lastSeenMs;
+        else
+            out["lastSeenAgoMs"] = nullptr;
+        out["connects"] = peer.connects;
+        out["requests"] = peer.requests;
+        out["notModified"] = peer.notModified;
+        out["failures"] = peer.failures;
+        out["pending"] = peer.pending;
+    }
+
+    sendDocument(request, 200, response);
+}
+
+// Reads a dotted IPv4 address as IPAddress converts it to a uint32_t
+bool readIPv4(const char *text, uint32_t &address)
+{
+    unsigned int octets[4];
+    char extra;
+    if (sscanf(text, "%u.%u.%u.%u%c", &octets[0], &octets[1], &octets[2], &octets[3], &extra) != 4)
+        return false;
+    for (unsigned int octet : octets)
+    {
+        if (octet > 255)
+            return false;
+    }
+    address = IPAddress(octets[0], octets[1], octets[2], octets[3]);
+    return true;
+}
+
+// POST /api/fleet/peers: {name, address, port?, password} adds a peer, or
+// changes the one of that name. The port defaults to 80.
+void handleAddFleetPeer(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    char *body = collectBody(request, data, len, index, total, true);
+    if (!body)
         return;
 
-    DynamicJsonDocument doc(200);
-    DeserializationError error = deserializeJson(doc, data);
+    StaticJsonDocument<FLEET_PEER_REQUEST_SIZE> doc;
+    DeserializationError error = parseBody(request, doc, body, total);
+    StaticJsonDocument<MESSAGE_DOC_SIZE> response;
+    int statusCode = 200;
+
+    Gateway::PeerConfig peer = {};
+    const char *name = doc["name"];
+    const char *address = doc["address"];
+    const char *password = doc["password"];
+    bool wellFormed = !error && name && address && password && strlen(name) <= Gateway::NAME_MAX &&
+                      strlen(password) <= Gateway::PASSWORD_MAX && readIPv4(address, peer.address) &&
+                      (doc["port"].isNull() || doc["port"].is<uint16_t>());
+    if (wellFormed)
+    {
+        strcpy(peer.name, name);
+        strcpy(peer.password, password);
+        peer.port = doc["port"].isNull() ? 80 : doc["port"].as<uint16_t>();
+    }
+
+    switch (wellFormed ? gateway.addPeer(peer) : Gateway::INVALID)
+    {
+    case Gateway::ADDED:
+        response["message"] = "Peer added";
+        response["status"] = true;
+        statusCode = 201;
+        break;
+    case Gateway::UPDATED:
+        response["message"] = "Peer updated";
+        response["status"] = true;
+        break;
+    case Gateway::FULL:
+        response["message"] = "No room for another peer";
+        response["status"] = false;
+        statusCode = 507;
+        break;
+    default:
+        response["message"] = error ? "Invalid JSON" : "Expected {name, address, port, password}: a name of 1-15 characters, a dotted IPv4 address and a port of 1-65535";
+        response["status"] = false;
+        statusCode = 400;
+        break;
+    }
+
+    sendDocument(request, statusCode, response);
+}
+
+// DELETE /api/fleet/peers?name=<name>
+void handleRemoveFleetPeer(AsyncWebServerRequest *request)
+{
+    if (!checkAuthorization(request))
+    {
+        return;
+    }
+
+    StaticJsonDocument<MESSAGE_DOC_SIZE> response;
+    int statusCode = 200;
+
+    const AsyncWebParameter *param = request->getParam("name");
+    if (!param)
+    {
+        response["message"] = "Peer not specified";
+        response["status"] = false;
+        statusCode = 400;
+    }
+    else if (!gateway.removePeer(param->value().c_str()))
+    {
+        response["message"] = "Peer not found";
+        response["status"] = false;
+        statusCode = 404;
+    }
+    else
+    {
+        response["message"] = "Peer removed";
+        response["status"] = true;
+    }
+
+    sendDocument(request, statusCode, response);
+}
+#endif
+
+// Handler for WiFi mode changes
+void handleWiFiMode(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    // Only process the complete body, from a client with a valid token
+    char *body = collectBody(request, data, len, index, total, true);
+    if (!body)
+        return;
 
-    DynamicJsonDocument response(200);
+    StaticJsonDocument<WIFI_MODE_REQUEST_SIZE> doc;
+    DeserializationError error = parseBody(request, doc, body, total);
+
+    StaticJsonDocument<MESSAGE_DOC_SIZE> response;
     int statusCode = 200;
 
     if (error)
@@ -569,17 +2429,21 @@ void handleWiFiMode(AsyncWebServerRequest *request, uint8_t *data, size_t len, s
             {
                 wifiMode = (strcmp(mode, "AP") == 0) ? AP : STA;
                 // Persist the mode so it survives reboot
-                saveWiFiMode(wifiMode);
-
-                response["message"] = String("Mode changed to ") + mode + ". Please restart the device manually to apply this change.";
+                settings.setWiFiMode((uint8_t)wifiMode);
+                if (!settings.commit())
+                {
+                    response["message"] = "Failed to save mode";
+                    response["status"] = false;
+                    sendDocument(request, 500, response);
+                    return;
+                }
+
+                response["message"] = wifiMode == AP ? "Mode changed to AP. Please restart the device manually to apply this change."
+                                                     : "Mode changed to STA. Please restart the device manually to apply this change.";
                 response["status"] = true;
 
                 // Send response; do NOT restart automatically (user requested)
-                String jsonResponse;
-                serializeJson(response, jsonResponse);
-                AsyncWebServerResponse *resp = request->beginResponse(statusCode, "application/json", jsonResponse);
-                addCorsHeaders(resp);
-                request->send(resp);
+                sendDocument(request, statusCode, response);
                 return;
             }
             else
@@ -597,30 +2461,21 @@ void handleWiFiMode(AsyncWebServerRequest *request, uint8_t *data, size_t len, s
         }
     }
 
-    String jsonResponse;
-    serializeJson(response, jsonResponse);
-    AsyncWebServerResponse *resp = request->beginResponse(statusCode, "application/json", jsonResponse);
-    addCorsHeaders(resp);
-    request->send(resp);
+    sendDocument(request, statusCode, response);
 }
 
 // Handler for WiFi setup endpoint
 void handleWiFiSetup(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
 {
-    // Require authorization
-    if (!checkAuthorization(request))
-    {
-        return;
-    }
-
-    // Only process the complete body
-    if (index + len != total)
+    // Only process the complete body, from a client with a valid token
+    char *body = collectBody(request, data, len, index, total, true);
+    if (!body)
         return;
 
-    DynamicJsonDocument doc(256);
-    DeserializationError error = deserializeJson(doc, data);
+    StaticJsonDocument<WIFI_SETUP_REQUEST_SIZE> doc;
+    DeserializationError error = parseBody(request, doc, body, total);
 
-    DynamicJsonDocument response(200);
+    StaticJsonDocument<MESSAGE_DOC_SIZE> response;
     int statusCode = 200;
 
     if (error)
@@ -634,25 +2489,31 @@ void handleWiFiSetup(AsyncWebServerRequest *request, uint8_t *data, size_t len,
         const char *ssid = doc["ssid"];
         const char *password = doc["password"];
 
-        if (ssid && password && strlen(ssid) > 0 && strlen(password) > 0)
+        if (!ssid || !password || strlen(ssid) == 0 || strlen(password) == 0)
         {
-            // Save the credentials only; do NOT attempt to connect here
-            saveWiFiCredentials(ssid, password);
-
-            response["message"] = "WiFi credentials saved please change Access mode";
-            response["status"] = true;
+            response["message"] = "Missing SSID or password";
+            response["status"] = false;
+            statusCode = 400;
         }
-        else
+        else if (!settings.setWiFiCredentials(ssid, password))
         {
-            response["message"] = "Missing SSID or password";
+            response["message"] = "SSID or password too long";
             response["status"] = false;
             statusCode = 400;
         }
+        else if (!settings.commit())
+        {
+            response["message"] = "Failed to save WiFi credentials";
+            response["status"] = false;
+            statusCode = 500;
+        }
+        else
+        {
+            // Save the credentials only; do NOT attempt to connect here
+            response["message"] = "WiFi credentials saved please change Access mode";
+            response["status"] = true;
+        }
     }
 
-    String jsonResponse;
-    serializeJson(response, jsonResponse);
-    AsyncWebServerResponse *resp = request->beginResponse(statusCode, "application/json", jsonResponse);
-    addCorsHeaders(resp);
-    request->send(resp);
+    sendDocument(request, statusCode, response);
 }
\ No newline at end of file
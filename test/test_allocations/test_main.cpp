@@ -0,0 +1,207 @@
+#include <Arduino.h>
+#include <DeviceManager.h>
+#include <ESPAsyncWebServer.h>
+#include <HostControl.h>
+#include <Sampler.h>
+#include <SessionTable.h>
+#if GATEWAY_ENABLED
+#include <Gateway.h>
+#endif
+#include <memory>
+#include <string.h>
+#include <unity.h>
+#include <vector>
+#include "../../bench/AllocCounter.h"
+
+// Firmware entry point, globals and handlers from src/main.cpp
+void setup();
+extern Sampler sampler;
+extern SessionTable sessions;
+void handleConnect(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleControl(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleControlBatch(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleCreateSchedule(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleGetDevices(AsyncWebServerRequest *request);
+void handleGetSamples(AsyncWebServerRequest *request);
+void handleGetDevice(AsyncWebServerRequest *request);
+void handleCancelSchedule(AsyncWebServerRequest *request);
+void handleValidateRequest(AsyncWebServerRequest *request);
+void handleGetAdmission(AsyncWebServerRequest *request);
+void handleListSchedules(AsyncWebServerRequest *request);
+void handleGetMetrics(AsyncWebServerRequest *request);
+#if TRACE_ENABLED
+void handleGetTrace(AsyncWebServerRequest *request);
+#endif
+#if GATEWAY_ENABLED
+extern Gateway gateway;
+void handleGetFleetDevices(AsyncWebServerRequest *request);
+void handleGetFleetPeers(AsyncWebServerRequest *request);
+#endif
+
+namespace {
+
+typedef void (*BodyHandler)(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+typedef void (*RequestHandler)(AsyncWebServerRequest *request);
+
+String bearer;
+
+uint64_t allocationsSince(const AllocSnapshot& before) {
+    return allocSnapshot().allocations - before.allocations;
+}
+
+// What the server itself spends on sending the response a handler built:
+// the same code, type and headers, from a constant body or with none
+uint64_t responseAllocations(const AsyncWebServerResponse& built) {
+    static const char BODY[] = "{}";
+    std::vector<AsyncWebHeader> headers = built.headers();
+    AsyncWebServerRequest request(HTTP_GET, "/");
+    AllocSnapshot before = allocSnapshot();
+    AsyncWebServerResponse* response =
+        built.contentType().length() == 0
+            ? request.beginResponse(built.code())
+            : request.beginResponse_P(built.code(), built.contentType().c_str(), reinterpret_cast<const uint8_t*>(BODY), 2);
+    for (const AsyncWebHeader& h : headers) response->addHeader(h.name().c_str(), h.value().c_str());
+    request.send(response);
+    return allocationsSince(before);
+}
+
+// A handler may allocate no more than sending its answer from a constant
+// body would: JSON documents, the serialized body and everything else it
+// does stay off the heap
+void expectNoMore(const char* name, AsyncWebServerRequest& request, uint64_t allocations) {
+    AsyncWebServerResponse* response = request.response();
+    TEST_ASSERT_NOT_NULL_MESSAGE(response, name);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(responseAllocations(*response), allocations, name);
+}
+
+void checkBody(const char* name, BodyHandler handler, WebRequestMethodComposite method, const char* url, const char* json) {
+    AsyncWebServerRequest request(method, url);
+    request.addHeader("Authorization", bearer);
+    request.addHeader("Content-Type", "application/json");
+    std::vector<uint8_t> body(json, json + strlen(json));
+    AllocSnapshot before = allocSnapshot();
+    handler(&request, body.data(), body.size(), 0, body.size());
+    expectNoMore(name, request, allocationsSince(before));
+}
+
+// The code the handler answered with
+int checkRequest(const char* name, RequestHandler handler, WebRequestMethodComposite method, const char* url,
+                 const char* ifNoneMatch = nullptr, const char* accept = nullptr) {
+    AsyncWebServerRequest request(method, url);
+    request.addHeader("Authorization", bearer);
+    if (ifNoneMatch) request.addHeader("If-None-Match", ifNoneMatch);
+    if (accept) request.addHeader("Accept", accept);
+    AllocSnapshot before = allocSnapshot();
+    handler(&request);
+    expectNoMore(name, request, allocationsSince(before));
+    return request.response()->code();
+}
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// Adding, switching and removing devices in the fixed registry never
+// allocates, and a full registry refuses the next device
+void test_fixed_registry() {
+    if (DEVICE_CAPACITY == 0) TEST_IGNORE_MESSAGE("DEVICE_CAPACITY is 0");
+    std::unique_ptr<DeviceManager> manager(new DeviceManager());
+    AllocSnapshot before = allocSnapshot();
+    for (int round = 0; round < 2; round++) {
+        for (size_t i = 1; i <= DEVICE_CAPACITY; i++) {
+            TEST_ASSERT_TRUE_MESSAGE(manager->addDevice(static_cast<int>(i), "Heap", "LED", 2, false),
+                                     "device refused below capacity");
+        }
+        TEST_ASSERT_FALSE_MESSAGE(manager->addDevice(DEVICE_CAPACITY + 1, "Heap", "LED", 2, false), "device taken past capacity");
+        for (size_t i = 1; i <= DEVICE_CAPACITY; i++) manager->updateDeviceStatus(static_cast<int>(i), true);
+        for (size_t i = 1; i <= DEVICE_CAPACITY; i++) manager->deleteDevice(static_cast<int>(i));
+    }
+    TEST_ASSERT_EQUAL_UINT64_MESSAGE(0, allocationsSince(before), "fixed registry allocated");
+}
+
+void test_body_handlers() {
+    checkBody("PUT /api/control", handleControl, HTTP_PUT, "/api/control", "{\"device\":1,\"status\":true}");
+    checkBody("PUT /api/control/batch", handleControlBatch, HTTP_PUT, "/api/control/batch",
+              "[{\"device\":1,\"status\":false},{\"device\":2,\"level\":40}]");
+    checkBody("POST /api/connect", handleConnect, HTTP_POST, "/api/connect", "{\"password\":\"wrong\"}");
+    checkBody("POST /api/schedules", handleCreateSchedule, HTTP_POST, "/api/schedules",
+              "{\"device\":1,\"action\":\"on\",\"delayMs\":60000}");
+}
+
+void test_request_handlers() {
+    checkRequest("GET /api/schedules", handleListSchedules, HTTP_GET, "/api/schedules");
+    checkRequest("DELETE /api/schedules", handleCancelSchedule, HTTP_DELETE, "/api/schedules?schedule=999");
+    checkRequest("POST /api/validate", handleValidateRequest, HTTP_POST, "/api/validate");
+    checkRequest("GET /api/admission", handleGetAdmission, HTTP_GET, "/api/admission");
+    checkRequest("GET /api/metrics", handleGetMetrics, HTTP_GET, "/api/metrics");
+    checkRequest("GET /api/devices/1", handleGetDevice, HTTP_GET, "/api/devices/1");
+    checkRequest("GET /api/devices/999/samples (404)", handleGetSamples, HTTP_GET, "/api/devices/999/samples");
+}
+
+// The device list from its cache, once it has been built
+void test_cached_device_list() {
+    AsyncWebServerRequest warm(HTTP_GET, "/api/devices");
+    warm.addHeader("Authorization", bearer);
+    handleGetDevices(&warm);
+    TEST_ASSERT_NOT_NULL_MESSAGE(warm.response(), "device list not served");
+    const AsyncWebHeader* etag = warm.response()->header("ETag");
+    TEST_ASSERT_NOT_NULL_MESSAGE(etag, "device list served without an ETag");
+    checkRequest("GET /api/devices (cached)", handleGetDevices, HTTP_GET, "/api/devices");
+    checkRequest("GET /api/devices (304)", handleGetDevices, HTTP_GET, "/api/devices", etag->value().c_str());
+}
+
+// Streamed bodies: the writer lives in the response
+void test_streamed_bodies() {
+    const int INPUT_ID = 50;
+    TEST_ASSERT_TRUE_MESSAGE(sampler.addInput(INPUT_ID, 32, false), "no room for an input");
+    for (uint32_t ms = 0; ms < 100; ms++) {
+        host::setPinLevel(32, ms < 40 ? HIGH : LOW);
+        sampler.sample(5000 + ms);
+    }
+
+    TEST_ASSERT_EQUAL(200, checkRequest("GET /api/devices?type=LED", handleGetDevices, HTTP_GET, "/api/devices?type=LED"));
+    TEST_ASSERT_EQUAL(200, checkRequest("GET /api/devices?type=LED (msgpack)", handleGetDevices, HTTP_GET,
+                                        "/api/devices?type=LED", nullptr, "application/msgpack"));
+    TEST_ASSERT_EQUAL(200, checkRequest("GET /api/devices/50/samples", handleGetSamples, HTTP_GET, "/api/devices/50/samples"));
+#if TRACE_ENABLED
+    TEST_ASSERT_EQUAL(200, checkRequest("GET /api/trace", handleGetTrace, HTTP_GET, "/api/trace"));
+#endif
+#if GATEWAY_ENABLED
+    TEST_ASSERT_EQUAL(200, checkRequest("GET /api/fleet/devices", handleGetFleetDevices, HTTP_GET, "/api/fleet/devices"));
+#endif
+}
+
+#if GATEWAY_ENABLED
+// With a peer registered, so its address is written too
+void test_fleet_peers() {
+    Gateway::PeerConfig peer = {};
+    strcpy(peer.name, "allocations");
+    peer.address = IPAddress(127, 0, 0, 1);
+    peer.port = 9;
+    strcpy(peer.password, "unused");
+    TEST_ASSERT_EQUAL_MESSAGE(Gateway::ADDED, gateway.addPeer(peer), "peer not registered");
+    TEST_ASSERT_EQUAL(200, checkRequest("GET /api/fleet/peers", handleGetFleetPeers, HTTP_GET, "/api/fleet/peers"));
+    gateway.removePeer(peer.name);
+}
+#endif
+
+int main() {
+    host::setSerialEnabled(false);
+    setup();
+    char token[SessionTable::TOKEN_LENGTH + 1];
+    sessions.issue(millis(), 3600000, token);
+    bearer = String("Bearer ") + token;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_fixed_registry);
+    RUN_TEST(test_body_handlers);
+    RUN_TEST(test_request_handlers);
+    RUN_TEST(test_cached_device_list);
+    RUN_TEST(test_streamed_bodies);
+#if GATEWAY_ENABLED
+    RUN_TEST(test_fleet_peers);
+#endif
+    return UNITY_END();
+}
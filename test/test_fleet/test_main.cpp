@@ -0,0 +1,495 @@
+#include <Arduino.h>
+#include <DeviceManager.h>
+#include <ESPAsyncWebServer.h>
+#include <FleetJson.h>
+#include <Gateway.h>
+#include <HostControl.h>
+#include <JsonScanner.h>
+#include <ResponseParser.h>
+#include <SessionTable.h>
+#include <chrono>
+#include <memory>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <unity.h>
+#include <vector>
+#include "../../bench/StandIn.h"
+
+// Firmware entry point and globals from src/main.cpp
+void setup();
+extern AsyncWebServer server;
+extern SessionTable sessions;
+
+namespace {
+
+// Devices per stand-in board; one board lists one more, and the gateway
+// must keep all of them
+const size_t BOARD_SIZE = Gateway::PEER_DEVICES <= 100 ? Gateway::PEER_DEVICES - 1 : 100;
+static_assert(3 * BOARD_SIZE + 1 <= FleetCache::CAPACITY, "the stand-ins' devices do not fit the merged list");
+static_assert(BOARD_SIZE >= 50, "the tests address devices up to the 50th of a board");
+const size_t TWO = 2 * BOARD_SIZE + 1;
+const size_t ALL = 3 * BOARD_SIZE + 1;
+
+typedef std::chrono::steady_clock Clock;
+
+// Three stand-in boards behind one gateway, shared by the gateway tests in
+// the order they run
+std::unique_ptr<StandIn> alphaBoard;
+std::unique_ptr<StandIn> betaBoard;
+std::unique_ptr<StandIn> gammaBoard;
+Gateway fleet("fleet-test");
+Gateway::Timing timing;
+
+double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Polls until done() or timeoutMs has passed
+template <typename Done>
+bool waitFor(Done done, uint32_t timeoutMs) {
+    Clock::time_point start = Clock::now();
+    while (!done()) {
+        if (msSince(start) > timeoutMs) return false;
+        usleep(1000);
+    }
+    return true;
+}
+
+struct Parsed {
+    std::string body;
+    size_t used = 0;
+};
+
+// Feeds text piece bytes at a time, stopping at the end of the response
+Parsed parse(ResponseParser& parser, const std::string& text, size_t piece) {
+    Parsed out;
+    while (out.used < text.size() && !parser.complete() && !parser.malformed()) {
+        size_t length = text.size() - out.used < piece ? text.size() - out.used : piece;
+        size_t done = 0;
+        while (done < length && !parser.complete() && !parser.malformed()) {
+            size_t used;
+            const char* body;
+            size_t bodyLength;
+            parser.feed(text.data() + out.used + done, length - done, used, body, bodyLength);
+            done += used;
+            out.body.append(body, bodyLength);
+        }
+        out.used += done;
+    }
+    return out;
+}
+
+uint8_t slotOf(const Gateway& gateway, const char* name) {
+    Gateway::PeerStatus status;
+    for (uint8_t i = 0; i < Gateway::MAX_PEERS; i++) {
+        if (gateway.peerStatus(i, status) && strcmp(status.name, name) == 0) return i;
+    }
+    return Gateway::NO_PEER;
+}
+
+Gateway::PeerStatus statusOf(const char* name) {
+    Gateway::PeerStatus status = {};
+    uint8_t slot = slotOf(fleet, name);
+    TEST_ASSERT_TRUE_MESSAGE(slot != Gateway::NO_PEER && fleet.peerStatus(slot, status), name);
+    return status;
+}
+
+bool cachedStatus(int id, bool& status) {
+    FleetCache::Entry entry;
+    for (size_t i = 0; fleet.cache().read(i, entry); i++) {
+        if (entry.id == id) {
+            status = entry.status;
+            return true;
+        }
+    }
+    return false;
+}
+
+Gateway::Command command(const char* peer, int id, bool status) {
+    Gateway::Command out = {};
+    strcpy(out.peer, peer);
+    out.command.id = id;
+    out.command.status = status;
+    return out;
+}
+
+// Submits and waits for the answer
+Gateway::Result control(const std::vector<Gateway::Command>& commands, uint32_t timeoutMs = 2000) {
+    Gateway::Result result;
+    uint32_t ticket = fleet.submit(commands.data(), commands.size());
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(0, ticket, "command not queued");
+    TEST_ASSERT_TRUE_MESSAGE(fleet.wait(ticket, timeoutMs, result), "command not answered");
+    return result;
+}
+
+void expectCodes(const Gateway::Result& result, std::initializer_list<int> codes, const char* what) {
+    TEST_ASSERT_EQUAL_MESSAGE(codes.size(), result.count, what);
+    size_t i = 0;
+    for (int code : codes) {
+        TEST_ASSERT_EQUAL_MESSAGE(code, result.codes[i++], what);
+    }
+}
+
+Gateway::PeerConfig peerConfig(const char* name, uint16_t port, const char* password = StandIn::PASSWORD) {
+    Gateway::PeerConfig config = {};
+    strcpy(config.name, name);
+    config.address = IPAddress(127, 0, 0, 1);
+    config.port = port;
+    strcpy(config.password, password);
+    return config;
+}
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// Piecewise input: the scanner must come out the same whatever the splits
+void test_scanner() {
+    static DeviceManager manager;
+    for (int i = 1; i <= 50; i++) manager.addDevice(i, i == 7 ? "Say \"hi\"\\" : "Scanned", "LED", 2, i % 2 == 0);
+    std::string list = StandIn::listOf(manager);
+
+    const size_t pieces[] = {1, 3, 64, list.size()};
+    for (size_t piece : pieces) {
+        JsonScanner scanner;
+        size_t entries = 0;
+        long idSum = 0;
+        size_t on = 0;
+        bool quoted = false;
+        for (size_t at = 0; at < list.size(); at += piece) {
+            size_t length = list.size() - at < piece ? list.size() - at : piece;
+            size_t done = 0;
+            while (done < length) {
+                size_t used;
+                JsonScanner::Event event = scanner.next(list.data() + at + done, length - done, used);
+                done += used;
+                TEST_ASSERT_NOT_EQUAL_MESSAGE(JsonScanner::FAILED, event, "device list not scanned");
+                if (event == JsonScanner::OBJECT_END && scanner.depth() == 2) entries++;
+                if (event != JsonScanner::VALUE || scanner.depth() != 3 || strcmp(scanner.keyAt(0), "data") != 0) continue;
+                if (strcmp(scanner.key(), "id") == 0) idSum += scanner.toInt();
+                if (strcmp(scanner.key(), "status") == 0) on += scanner.isTrue();
+                if (strcmp(scanner.key(), "title") == 0) quoted = quoted || strcmp(scanner.value(), "Say \"hi\"\\") == 0;
+            }
+        }
+        TEST_ASSERT_TRUE_MESSAGE(scanner.finished(), "device list not finished");
+        TEST_ASSERT_EQUAL(50, entries);
+        TEST_ASSERT_EQUAL(50 * 51 / 2, idSum);
+        TEST_ASSERT_EQUAL(25, on);
+        TEST_ASSERT_TRUE_MESSAGE(quoted, "escaped title misread");
+    }
+}
+
+void test_scanner_refuses_malformed() {
+    const char* broken[] = {"{\"a\":[1,}", "{\"a\" 1}", "[[[[[[[[[1]]]]]]]]]", "{\"a\":tru}"};
+    for (const char* text : broken) {
+        JsonScanner scanner;
+        size_t used;
+        size_t at = 0;
+        JsonScanner::Event event = JsonScanner::NONE;
+        while (at < strlen(text) && event != JsonScanner::FAILED) {
+            event = scanner.next(text + at, strlen(text) - at, used);
+            at += used;
+        }
+        TEST_ASSERT_TRUE_MESSAGE(event == JsonScanner::FAILED || !scanner.finished(), text);
+    }
+}
+
+void test_parser() {
+    const std::string chunked =
+        "HTTP/1.1 200 OK\r\nETag: \"00c0ffee-7\"\r\nTransfer-Encoding: chunked\r\nConnection: keep-alive\r\n\r\n"
+        "5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\nX-Trailer: 1\r\n\r\n";
+    const std::string notModified = "HTTP/1.1 304 Not Modified\r\nETag: \"00c0ffee-7\"\r\nContent-Length: 11\r\n\r\n";
+    const std::string sized = "HTTP/1.1 401 Unauthorized\r\ncontent-length: 5\r\n\r\nnope!";
+    const std::string toClose = "HTTP/1.0 200 OK\r\n\r\nuntil the end";
+
+    for (size_t piece : {size_t(1), size_t(7), size_t(4096)}) {
+        ResponseParser parser;
+        Parsed one = parse(parser, chunked + notModified + sized, piece);
+        TEST_ASSERT_TRUE_MESSAGE(parser.complete(), "chunked response not complete");
+        TEST_ASSERT_EQUAL(200, parser.status());
+        TEST_ASSERT_EQUAL_STRING("hello world", one.body.c_str());
+        TEST_ASSERT_EQUAL_STRING("\"00c0ffee-7\"", parser.etag());
+        TEST_ASSERT_TRUE_MESSAGE(parser.keepAlive(), "keep-alive missed");
+        TEST_ASSERT_EQUAL_MESSAGE(chunked.size(), one.used, "read past the chunked response");
+
+        // Pipelined: the rest is the next responses
+        parser.reset();
+        Parsed two = parse(parser, notModified + sized, piece);
+        TEST_ASSERT_TRUE_MESSAGE(parser.complete(), "304 not complete");
+        TEST_ASSERT_EQUAL(304, parser.status());
+        TEST_ASSERT_TRUE_MESSAGE(two.body.empty(), "304 with a body");
+        TEST_ASSERT_EQUAL_MESSAGE(notModified.size(), two.used, "read past the 304");
+        parser.reset();
+        Parsed three = parse(parser, sized, piece);
+        TEST_ASSERT_TRUE_MESSAGE(parser.complete(), "sized response not complete");
+        TEST_ASSERT_EQUAL(401, parser.status());
+        TEST_ASSERT_EQUAL_STRING("nope!", three.body.c_str());
+        TEST_ASSERT_EQUAL_STRING("", parser.etag());
+
+        parser.reset();
+        Parsed four = parse(parser, toClose, piece);
+        TEST_ASSERT_FALSE_MESSAGE(parser.complete(), "response to the close ended early");
+        TEST_ASSERT_EQUAL_STRING("until the end", four.body.c_str());
+        parser.closed();
+        TEST_ASSERT_TRUE_MESSAGE(parser.complete() && !parser.keepAlive(), "response to the close not ended by it");
+    }
+
+    const char* broken[] = {"SMTP ready\r\n\r\n", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n"};
+    for (const char* text : broken) {
+        ResponseParser parser;
+        parse(parser, text, 3);
+        TEST_ASSERT_TRUE_MESSAGE(parser.malformed(), text);
+    }
+}
+
+void test_fleet_json() {
+    static FleetCache cache;
+    cache.setPeer(0, "alpha");
+    cache.setPeer(2, "gamma");
+    FleetCache::Entry alphaList[2] = {{1, "Lamp", "LED", 0, true, 255}, {2, "Say \"hi\"", "DIMMER", 0, false, 40}};
+    FleetCache::Entry gammaList[1] = {{9, "Fan", "FAN", 2, false, 255}};
+    cache.replace(0, alphaList, 2);
+    cache.replace(2, gammaList, 1);
+    cache.setPeerState(0, true, false);
+    cache.setPeerState(2, false, true);
+
+    const std::string expected =
+        "{\"message\":\"Fleet devices retrieved\",\"status\":true,\"peers\":["
+        "{\"name\":\"alpha\",\"online\":true,\"stale\":false,\"truncated\":false,\"devices\":2},"
+        "{\"name\":\"gamma\",\"online\":false,\"stale\":true,\"truncated\":false,\"devices\":1}],\"data\":["
+        "{\"peer\":\"alpha\",\"id\":1,\"title\":\"Lamp\",\"type\":\"LED\",\"status\":true,\"level\":255,\"stale\":false},"
+        "{\"peer\":\"alpha\",\"id\":2,\"title\":\"Say \\\"hi\\\"\",\"type\":\"DIMMER\",\"status\":false,\"level\":40,\"stale\":false},"
+        "{\"peer\":\"gamma\",\"id\":9,\"title\":\"Fan\",\"type\":\"FAN\",\"status\":false,\"level\":255,\"stale\":true}]}";
+    for (size_t piece : {size_t(1), size_t(7), size_t(1024)}) {
+        FleetJson writer(cache);
+        std::string out;
+        std::vector<uint8_t> buffer(piece);
+        size_t n;
+        while ((n = writer.read(buffer.data(), piece)) > 0) out.append(reinterpret_cast<char*>(buffer.data()), n);
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), out.c_str());
+    }
+
+    // A dimmer command written through, and a peer's list cut short
+    TEST_ASSERT_TRUE_MESSAGE(cache.apply(0, 2, true, 90), "command not written through");
+    TEST_ASSERT_FALSE_MESSAGE(cache.apply(2, 1, true, DeviceCommand::NO_LEVEL), "command for a missing device written");
+    FleetCache::Entry lamp;
+    cache.read(1, lamp);
+    TEST_ASSERT_TRUE(lamp.status);
+    TEST_ASSERT_EQUAL(90, lamp.level);
+    uint8_t owner;
+    TEST_ASSERT_EQUAL(1, cache.owner(9, owner));
+    TEST_ASSERT_EQUAL(2, owner);
+    TEST_ASSERT_EQUAL(0, cache.owner(5, owner));
+    cache.replace(2, gammaList, 1, true);
+    FleetCache::Peer peer;
+    TEST_ASSERT_TRUE_MESSAGE(cache.readPeer(2, peer) && peer.truncated, "truncation not flagged");
+    cache.removePeer(2);
+    TEST_ASSERT_EQUAL(2, cache.size());
+    TEST_ASSERT_FALSE_MESSAGE(cache.readPeer(2, peer), "removed peer still listed");
+}
+
+// A refused login keeps the peer out until its password is fixed
+void test_gateway_merges_lists() {
+    TEST_ASSERT_EQUAL(Gateway::ADDED, fleet.addPeer(peerConfig("alpha", alphaBoard->port())));
+    TEST_ASSERT_EQUAL(Gateway::ADDED, fleet.addPeer(peerConfig("beta", betaBoard->port(), "wrong")));
+    TEST_ASSERT_EQUAL(Gateway::ADDED, fleet.addPeer(peerConfig("gamma", gammaBoard->port())));
+    TEST_ASSERT_EQUAL(Gateway::INVALID, fleet.addPeer(peerConfig("", 80)));
+    TEST_ASSERT_EQUAL(Gateway::INVALID, fleet.addPeer(peerConfig("nameless-port", 0)));
+
+    TEST_ASSERT_TRUE_MESSAGE(waitFor([] { return fleet.cache().size() == TWO; }, 3000), "peer lists not merged");
+    TEST_ASSERT_TRUE_MESSAGE(statusOf("beta").loginRefused, "refused login not reported");
+    TEST_ASSERT_EQUAL_MESSAGE(0, betaBoard->lists, "list asked for without a login");
+    TEST_ASSERT_EQUAL(Gateway::UPDATED, fleet.addPeer(peerConfig("beta", betaBoard->port())));
+    TEST_ASSERT_TRUE_MESSAGE(waitFor([] { return fleet.cache().size() == ALL && !statusOf("beta").loginRefused; }, 3000),
+                             "updated peer not merged");
+}
+
+// Unchanged lists cost a 304 each; a change comes in with the next poll
+void test_gateway_conditional_polls() {
+    uint32_t lists = alphaBoard->lists;
+    TEST_ASSERT_TRUE_MESSAGE(waitFor([] { return alphaBoard->unchanged >= 5; }, 2000), "lists not polled");
+    TEST_ASSERT_EQUAL_MESSAGE(lists, alphaBoard->lists, "unchanged list sent again");
+    DeviceCommand change;
+    change.id = 42;
+    change.status = true;
+    alphaBoard->change(change);
+    bool on = false;
+    TEST_ASSERT_TRUE_MESSAGE(waitFor([&] { return cachedStatus(42, on) && on; }, 1000), "change not picked up");
+    TEST_ASSERT_EQUAL_MESSAGE(lists + 1, alphaBoard->lists, "change not in one list");
+}
+
+// Routing by id, by peer name, and what neither can settle
+void test_gateway_routing() {
+    Gateway::Result result = control({command("", 150, true), command("", 1, true), command("alpha", 1, true), command("", 9999, true),
+                                      command("nobody", 1, true)});
+    expectCodes(result, {200, Gateway::AMBIGUOUS, 200, Gateway::NOT_FOUND, Gateway::NOT_FOUND}, "commands misrouted");
+    TEST_ASSERT_EQUAL(slotOf(fleet, "beta"), result.peers[0]);
+    TEST_ASSERT_EQUAL(slotOf(fleet, "alpha"), result.peers[2]);
+    TEST_ASSERT_EQUAL(Gateway::NO_PEER, result.peers[1]);
+    // Written through: the merged list has it before the next poll
+    bool on = false;
+    TEST_ASSERT_TRUE_MESSAGE(cachedStatus(150, on) && on, "command not written through");
+
+    // Several commands for a peer go in one batch; a missing device fails it
+    uint32_t batches = betaBoard->batches;
+    expectCodes(control({command("", 101, true), command("", 102, true), command("", 103, false)}), {200, 200, 200},
+                "batch not applied");
+    expectCodes(control({command("beta", 104, true), command("beta", 5000, true)}), {409, 404}, "batch failure not reported per command");
+    TEST_ASSERT_EQUAL_MESSAGE(batches + 2, betaBoard->batches, "commands for one peer not batched");
+}
+
+// The peers are asked at once: three slow boards take one delay
+void test_gateway_fan_out() {
+    const uint32_t DELAY_MS = 100;
+    alphaBoard->delayMs = betaBoard->delayMs = gammaBoard->delayMs = DELAY_MS;
+    Clock::time_point start = Clock::now();
+    Gateway::Result result = control({command("", 2, true), command("", 120, true), command("", 220, true)});
+    double fanOutMs = msSince(start);
+    alphaBoard->delayMs = betaBoard->delayMs = gammaBoard->delayMs = 0;
+    expectCodes(result, {200, 200, 200}, "fan-out failed");
+    TEST_ASSERT_TRUE_MESSAGE(fanOutMs >= DELAY_MS && fanOutMs <= 1.8 * DELAY_MS, "peers not asked in parallel");
+}
+
+// One peer past the deadline times out alone, and is back once its board
+// answers again
+void test_gateway_slow_peer() {
+    betaBoard->delayMs = 2 * timing.timeoutMs;
+    Clock::time_point start = Clock::now();
+    Gateway::Result result = control({command("", 3, true), command("", 130, true)});
+    double timedOutMs = msSince(start);
+    betaBoard->delayMs = 0;
+    expectCodes(result, {200, Gateway::TIMED_OUT}, "slow peer not timed out");
+    TEST_ASSERT_TRUE_MESSAGE(timedOutMs <= 2 * timing.timeoutMs, "timeout took too long");
+    TEST_ASSERT_TRUE_MESSAGE(waitFor([] { return statusOf("beta").online; }, 3000), "timed out peer not back");
+    expectCodes(control({command("", 131, true)}), {200}, "peer not reachable after a timeout");
+}
+
+// A session the board forgot is renewed on the spot, on the connection
+// everything with alpha has gone over so far
+void test_gateway_session() {
+    uint32_t logins = alphaBoard->logins;
+    alphaBoard->forgetSession();
+    expectCodes(control({command("", 4, true)}), {200}, "command lost to an expired session");
+    TEST_ASSERT_EQUAL_MESSAGE(logins + 1, alphaBoard->logins, "session not renewed");
+
+    Gateway::PeerStatus kept = statusOf("alpha");
+    TEST_ASSERT_EQUAL_MESSAGE(1, alphaBoard->accepted(), "connection not kept alive");
+    TEST_ASSERT_EQUAL_MESSAGE(1, kept.connects, "connection not kept alive");
+    TEST_ASSERT_TRUE(kept.connected);
+}
+
+// A board that goes away: 502 at once, its devices stale, then dropped,
+// then back once it is
+void test_gateway_vanished_peer() {
+    gammaBoard->stop();
+    uint32_t failures = statusOf("gamma").failures;
+    expectCodes(control({command("", 230, true), command("", 5, true)}), {Gateway::UNREACHABLE, 200}, "vanished peer not reported");
+    uint8_t gammaSlot = slotOf(fleet, "gamma");
+    FleetCache::Peer listed;
+    TEST_ASSERT_TRUE_MESSAGE(waitFor([&] { return fleet.cache().readPeer(gammaSlot, listed) && listed.stale; }, 2 * timing.staleMs),
+                             "vanished peer not flagged stale");
+    TEST_ASSERT_EQUAL_MESSAGE(ALL, fleet.cache().size(), "stale devices dropped early");
+    TEST_ASSERT_TRUE_MESSAGE(waitFor([] { return fleet.cache().size() == 2 * BOARD_SIZE; }, 2 * timing.dropMs),
+                             "vanished peer's devices not dropped");
+    TEST_ASSERT_GREATER_THAN_MESSAGE(failures, statusOf("gamma").failures, "failures not counted");
+    TEST_ASSERT_FALSE(statusOf("gamma").online);
+    TEST_ASSERT_TRUE_MESSAGE(gammaBoard->start(), "stand-in cannot listen again");
+    TEST_ASSERT_TRUE_MESSAGE(waitFor([] { return fleet.cache().size() == ALL; }, 2000), "returning peer not merged");
+}
+
+// A removed peer takes its devices and routes with it, and the registry
+// outlives a restart
+void test_gateway_registry() {
+    TEST_ASSERT_TRUE_MESSAGE(fleet.removePeer("beta"), "peer not removed");
+    TEST_ASSERT_FALSE_MESSAGE(fleet.removePeer("beta"), "peer removed twice");
+    TEST_ASSERT_TRUE_MESSAGE(waitFor([] { return fleet.cache().size() == TWO; }, 1000), "removed peer's devices kept");
+    expectCodes(control({command("beta", 150, true), command("", 150, true)}), {Gateway::NOT_FOUND, Gateway::NOT_FOUND},
+                "removed peer still routed to");
+
+    static Gateway restarted("fleet-test");
+    restarted.begin(timing);
+    Gateway::PeerStatus status;
+    TEST_ASSERT_NOT_EQUAL(Gateway::NO_PEER, slotOf(restarted, "gamma"));
+    TEST_ASSERT_EQUAL(Gateway::NO_PEER, slotOf(restarted, "beta"));
+    TEST_ASSERT_TRUE_MESSAGE(restarted.peerStatus(slotOf(restarted, "alpha"), status), "registry not restored");
+    TEST_ASSERT_EQUAL(alphaBoard->port(), status.port);
+}
+
+// The firmware's /api/fleet routes, answered from its own gateway; with the
+// gateway built out they are not there at all
+void test_routes() {
+    char token[SessionTable::TOKEN_LENGTH + 1];
+    sessions.issue(millis(), 3600000, token);
+    String bearer = String("Bearer ") + token;
+    static uint8_t host = 0;
+    auto get = [&](const char* url, const char* ifNoneMatch) {
+        std::unique_ptr<AsyncWebServerRequest> request(new AsyncWebServerRequest(HTTP_GET, url));
+        request->addHeader("Authorization", bearer);
+        if (ifNoneMatch) request->addHeader("If-None-Match", ifNoneMatch);
+        request->client()->setRemoteIP(IPAddress(10, 0, 6, ++host));
+        server.dispatch(request.get());
+        TEST_ASSERT_NOT_NULL_MESSAGE(request->response(), url);
+        return request;
+    };
+
+    const int ok = GATEWAY_ENABLED ? 200 : 404;
+    std::unique_ptr<AsyncWebServerRequest> list = get("/api/fleet/devices", nullptr);
+    TEST_ASSERT_EQUAL(ok, list->response()->code());
+    TEST_ASSERT_EQUAL(ok, get("/api/fleet/peers", nullptr)->response()->code());
+    TEST_ASSERT_EQUAL(404, get("/api/fleet/control?ticket=4000000", nullptr)->response()->code());
+#if GATEWAY_ENABLED
+    const AsyncWebHeader* etag = list->response()->header("ETag");
+    TEST_ASSERT_NOT_NULL_MESSAGE(etag, "fleet list not tagged");
+    TEST_ASSERT_EQUAL(304, get("/api/fleet/devices", etag->value().c_str())->response()->code());
+    String body = list->response()->readAll();
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(body.c_str(), "\"peers\":[],\"data\":[]"), "empty fleet listed wrong");
+#endif
+}
+
+// Last, as it moves the clock: past 2^31 ms of uptime, a peer that never
+// failed is still asked
+void test_gateway_past_2_31_ms() {
+    host::setVirtualClock(true);
+    host::advanceClock(0x80000000UL - millis() + 100);
+    host::setVirtualClock(false);
+    expectCodes(control({command("alpha", 6, true)}), {200}, "healthy peer refused past 2^31 ms");
+}
+
+int main() {
+    host::setSerialEnabled(false);
+    setup();
+
+    alphaBoard.reset(new StandIn(1, BOARD_SIZE, 0xa1));
+    betaBoard.reset(new StandIn(101, BOARD_SIZE, 0xb2));
+    // Also lists 1, so that id alone does not say which board it is on
+    gammaBoard.reset(new StandIn(201, BOARD_SIZE, 0xc3));
+    gammaBoard->devices->addDevice(1, "Gamma's own 1", "LED", 2, false);
+    if (!alphaBoard->serving() || !betaBoard->serving() || !gammaBoard->serving()) return 1;
+    timing.refreshMs = 40;
+    timing.timeoutMs = 250;
+    timing.staleMs = 500;
+    timing.dropMs = 1000;
+    timing.backoffMs = 20;
+    timing.maxBackoffMs = 100;
+    fleet.begin(timing);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_scanner);
+    RUN_TEST(test_scanner_refuses_malformed);
+    RUN_TEST(test_parser);
+    RUN_TEST(test_fleet_json);
+    RUN_TEST(test_gateway_merges_lists);
+    RUN_TEST(test_gateway_conditional_polls);
+    RUN_TEST(test_gateway_routing);
+    RUN_TEST(test_gateway_fan_out);
+    RUN_TEST(test_gateway_slow_peer);
+    RUN_TEST(test_gateway_session);
+    RUN_TEST(test_gateway_vanished_peer);
+    RUN_TEST(test_gateway_registry);
+    RUN_TEST(test_routes);
+    RUN_TEST(test_gateway_past_2_31_ms);
+    return UNITY_END();
+}
@@ -0,0 +1,233 @@
+#include <Arduino.h>
+#include <Device.h>
+#include <DeviceManager.h>
+#include <ESPAsyncWebServer.h>
+#include <HostControl.h>
+#include <Metrics.h>
+#include <Router.h>
+#include <SessionTable.h>
+#include <memory>
+#include <string.h>
+#include <strings.h>
+#include <unity.h>
+
+// Firmware entry point and globals from src/main.cpp
+void setup();
+extern AsyncWebServer server;
+extern DeviceManager deviceManager;
+extern Metrics metrics;
+extern SessionTable sessions;
+
+namespace {
+
+const int LAMP = 2000;
+const int DOOR = 2001;
+
+String bearer;
+
+int matchOf(const RouteTrie& trie, const char* path, PathParams& params) {
+    return trie.match(path, strlen(path), params);
+}
+
+// The patterns checked against, numbered in this order
+const char* const PATTERNS[] = {"/api/devices", "/api/devices/{id}", "/api/devices/{id}/status",
+                                "/api/devices/{id}/samples", "/api/devices/count", "/", "/a/{x}/{y}"};
+
+void addPatterns(RouteTrie& trie) {
+    for (size_t i = 0; i < sizeof(PATTERNS) / sizeof(PATTERNS[0]); i++) {
+        TEST_ASSERT_EQUAL_MESSAGE(static_cast<int>(i), trie.add(PATTERNS[i]), "pattern not numbered in order");
+    }
+}
+
+// Requests answered under a route in `metrics`, whatever their code
+uint32_t answered(const char* method, const char* path) {
+    uint32_t count = 0;
+    for (size_t i = 0; i < metrics.seriesSize(); i++) {
+        const Metrics::Series& series = metrics.seriesAt(i);
+        const Metrics::Route& route = metrics.route(series.route);
+        if (strcmp(route.method, method) == 0 && strcmp(route.path, path) == 0) count += series.latency.count;
+    }
+    return count;
+}
+
+size_t headerCount(const AsyncWebServerResponse& response, const char* name) {
+    size_t count = 0;
+    for (const AsyncWebHeader& header : response.headers()) count += strcasecmp(header.name().c_str(), name) == 0;
+    return count;
+}
+
+// Through the firmware's server, each from its own address so admission
+// control never steps in; answered once with one set of CORS headers
+std::unique_ptr<AsyncWebServerRequest> send(WebRequestMethodComposite method, const char* url, const char* body = nullptr) {
+    static uint8_t host = 0;
+    std::unique_ptr<AsyncWebServerRequest> request(new AsyncWebServerRequest(method, url));
+    request->addHeader("Authorization", bearer);
+    request->addHeader("Content-Type", "application/json");
+    request->client()->setRemoteIP(IPAddress(10, 0, 4, ++host));
+    server.dispatch(request.get(), reinterpret_cast<const uint8_t*>(body), body ? strlen(body) : 0, 4);
+    TEST_ASSERT_EQUAL_MESSAGE(1, request->sends(), url);
+    TEST_ASSERT_NOT_NULL_MESSAGE(request->response(), url);
+    TEST_ASSERT_EQUAL_MESSAGE(1, headerCount(*request->response(), "Access-Control-Allow-Origin"), "CORS headers missing or repeated");
+    return request;
+}
+
+int codeOf(WebRequestMethodComposite method, const char* url, const char* body = nullptr) {
+    return send(method, url, body)->response()->code();
+}
+
+} // namespace
+
+void setUp() {
+    TEST_ASSERT_TRUE_MESSAGE(deviceManager.addDevice(LAMP, "Router lamp", "LED", 2, false), "no room for the lamp");
+    TEST_ASSERT_TRUE_MESSAGE(deviceManager.addDevice(DOOR, "Router door", CONTACT_TYPE, 33, false), "no room for the door");
+}
+
+void tearDown() {
+    deviceManager.deleteDevice(LAMP);
+    deviceManager.deleteDevice(DOOR);
+}
+
+// Literal segments beat parameters, parameters are captured in place, and
+// anything the patterns do not spell out exactly is no match
+void test_trie_patterns() {
+    RouteTrie trie;
+    addPatterns(trie);
+    TEST_ASSERT_EQUAL_MESSAGE(1, trie.add("/api/devices/{other}"), "same shape not given the same index");
+    const char* refused[] = {"api", "/api//x", "/api/", "/{a}/{b}/{c}"};
+    for (const char* pattern : refused) {
+        TEST_ASSERT_EQUAL_MESSAGE(RouteTrie::NO_MATCH, trie.add(pattern), pattern);
+    }
+}
+
+void test_trie_match() {
+    RouteTrie trie;
+    addPatterns(trie);
+    struct Case {
+        const char* path;
+        int pattern;
+        const char* param; // first parameter, if any
+    };
+    const Case cases[] = {
+        {"/api/devices", 0, nullptr},
+        {"/api/devices/42", 1, "42"},
+        {"/api/devices/42/status", 2, "42"},
+        {"/api/devices/-7/samples", 3, "-7"},
+        {"/api/devices/count", 4, nullptr},
+        {"/", 5, nullptr},
+        {"/a/b/c", 6, "b"},
+        {"/api/devices/", RouteTrie::NO_MATCH, nullptr},
+        {"/api/devices/42/", RouteTrie::NO_MATCH, nullptr},
+        {"/api//devices", RouteTrie::NO_MATCH, nullptr},
+        {"/api/devices/42/level", RouteTrie::NO_MATCH, nullptr},
+        {"/api/devices/42/status/x", RouteTrie::NO_MATCH, nullptr},
+        {"/api", RouteTrie::NO_MATCH, nullptr},
+        {"api/devices", RouteTrie::NO_MATCH, nullptr},
+        {"", RouteTrie::NO_MATCH, nullptr},
+    };
+    for (const Case& c : cases) {
+        PathParams params;
+        TEST_ASSERT_EQUAL_MESSAGE(c.pattern, matchOf(trie, c.path, params), c.path);
+        if (!c.param) continue;
+        TEST_ASSERT_TRUE_MESSAGE(params.count > 0 && params.lengths[0] == strlen(c.param) &&
+                                     memcmp(params.values[0], c.param, params.lengths[0]) == 0,
+                                 c.path);
+    }
+
+    // The path is only read up to its length, as for a url() with a query cut off
+    PathParams params;
+    TEST_ASSERT_EQUAL_MESSAGE(1, trie.match("/api/devices/42/status", strlen("/api/devices/42"), params), "length not respected");
+}
+
+void test_trie_ids() {
+    RouteTrie trie;
+    addPatterns(trie);
+    PathParams params;
+    const char* ints[] = {"/api/devices/2147483647", "/api/devices/-2147483648", "/api/devices/007"};
+    const int expected[] = {2147483647, -2147483647 - 1, 7};
+    for (size_t i = 0; i < 3; i++) {
+        int id = 0;
+        TEST_ASSERT_EQUAL_MESSAGE(1, matchOf(trie, ints[i], params), ints[i]);
+        TEST_ASSERT_TRUE_MESSAGE(params.toInt(0, id), ints[i]);
+        TEST_ASSERT_EQUAL_MESSAGE(expected[i], id, ints[i]);
+    }
+    const char* notInts[] = {"/api/devices/2147483648", "/api/devices/12a", "/api/devices/-", "/api/devices/1.5"};
+    for (const char* path : notInts) {
+        int id;
+        TEST_ASSERT_EQUAL_MESSAGE(1, matchOf(trie, path, params), path);
+        TEST_ASSERT_FALSE_MESSAGE(params.toInt(0, id), path);
+    }
+}
+
+// Each request lands on its route and is metered under the pattern
+void test_device_route() {
+    uint32_t before = answered("GET", "/api/devices/{id}");
+    TEST_ASSERT_EQUAL_MESSAGE(200, codeOf(HTTP_GET, "/api/devices/2000"), "device not served");
+    TEST_ASSERT_EQUAL_MESSAGE(404, codeOf(HTTP_GET, "/api/devices/12345"), "unknown device served");
+    TEST_ASSERT_EQUAL_MESSAGE(404, codeOf(HTTP_GET, "/api/devices/lamp"), "non-numeric id served");
+    TEST_ASSERT_EQUAL_MESSAGE(before + 3, answered("GET", "/api/devices/{id}"), "device requests not metered under their route");
+    TEST_ASSERT_EQUAL_MESSAGE(404, codeOf(HTTP_GET, "/api/devices/2000/level"), "unknown sub-path served");
+    TEST_ASSERT_EQUAL_MESSAGE(404, codeOf(HTTP_GET, "/api/devices/"), "trailing slash served");
+}
+
+// Body routes get the body in chunks; what they answer depends on it, so
+// only the route taken is checked here
+void test_body_routes() {
+    const char* routes[][2] = {{"/api/devices/2000", "/api/devices/{id}"}, {"/api/devices/2000/status", "/api/devices/{id}/status"}};
+    for (const auto& route : routes) {
+        uint32_t before = answered("PUT", route[1]);
+        int code = codeOf(HTTP_PUT, route[0], "{\"status\":true}");
+        TEST_ASSERT_TRUE_MESSAGE(code != 404 && code != 405, route[0]);
+        TEST_ASSERT_EQUAL_MESSAGE(before + 1, answered("PUT", route[1]), route[0]);
+    }
+
+    // Without a body, onBody never runs: the router answers instead
+    uint32_t before = answered("PUT", "/api/devices/{id}/status");
+    TEST_ASSERT_EQUAL_MESSAGE(400, codeOf(HTTP_PUT, "/api/devices/2000/status"), "body route without a body not answered");
+    TEST_ASSERT_EQUAL_MESSAGE(before + 1, answered("PUT", "/api/devices/{id}/status"), "missing body not metered under its route");
+}
+
+// Paths the router knows get their preflight and 405 from it
+void test_preflight_and_405() {
+    std::unique_ptr<AsyncWebServerRequest> preflight = send(HTTP_OPTIONS, "/api/devices/2000");
+    TEST_ASSERT_EQUAL_MESSAGE(204, preflight->response()->code(), "preflight not answered");
+    const AsyncWebHeader* methods = preflight->response()->header("Access-Control-Allow-Methods");
+    TEST_ASSERT_NOT_NULL_MESSAGE(methods, "preflight without its methods");
+    TEST_ASSERT_EQUAL_STRING("GET, DELETE, PUT, OPTIONS", methods->value().c_str());
+
+    std::unique_ptr<AsyncWebServerRequest> refused = send(HTTP_POST, "/api/devices/2000");
+    TEST_ASSERT_EQUAL_MESSAGE(405, refused->response()->code(), "wrong method not refused");
+    const AsyncWebHeader* allow = refused->response()->header("Allow");
+    TEST_ASSERT_NOT_NULL_MESSAGE(allow, "405 without the path's methods");
+    TEST_ASSERT_EQUAL_STRING(methods->value().c_str(), allow->value().c_str());
+
+    TEST_ASSERT_EQUAL_MESSAGE(404, codeOf(HTTP_OPTIONS, "/api/nowhere"), "preflight of an unknown path answered");
+}
+
+// Deletion goes through the actuator task; inputs stay
+void test_delete() {
+    TEST_ASSERT_EQUAL_MESSAGE(409, codeOf(HTTP_DELETE, "/api/devices/2001"), "input deleted");
+    TEST_ASSERT_EQUAL_MESSAGE(200, codeOf(HTTP_DELETE, "/api/devices/2000"), "device not deleted");
+    Device device;
+    TEST_ASSERT_FALSE_MESSAGE(deviceManager.copyDevice(LAMP, device), "device still listed");
+    TEST_ASSERT_TRUE_MESSAGE(deviceManager.copyDevice(DOOR, device), "wrong device deleted");
+    TEST_ASSERT_EQUAL_MESSAGE(404, codeOf(HTTP_DELETE, "/api/devices/2000"), "deleted device deleted again");
+    TEST_ASSERT_EQUAL_MESSAGE(404, codeOf(HTTP_GET, "/api/devices/2000"), "deleted device served");
+}
+
+int main() {
+    host::setSerialEnabled(false);
+    setup();
+    char token[SessionTable::TOKEN_LENGTH + 1];
+    sessions.issue(millis(), 3600000, token);
+    bearer = String("Bearer ") + token;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_trie_patterns);
+    RUN_TEST(test_trie_match);
+    RUN_TEST(test_trie_ids);
+    RUN_TEST(test_device_route);
+    RUN_TEST(test_body_routes);
+    RUN_TEST(test_preflight_and_405);
+    RUN_TEST(test_delete);
+    return UNITY_END();
+}
@@ -0,0 +1,65 @@
+#include <ScheduleStream.h>
+#include <Scheduler.h>
+#include <string>
+#include <unity.h>
+
+namespace {
+
+std::string readStream(ScheduleStream& stream, size_t chunk) {
+    std::string body;
+    uint8_t buffer[64];
+    size_t n;
+    while ((n = stream.read(buffer, chunk < sizeof(buffer) ? chunk : sizeof(buffer))) > 0) body.append(reinterpret_cast<char*>(buffer), n);
+    return body;
+}
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// The list as ArduinoJson would write it
+void test_json() {
+    Scheduler timers(4);
+    timers.arm(7, Scheduler::ON, 1000, 500);
+    timers.arm(-40, Scheduler::PULSE, 1000, 2000, 0, 300);
+    timers.arm(300, Scheduler::TOGGLE, 1000, 100, 60000);
+
+    ScheduleStream json(timers, 1200);
+    const char* expected = "{\"message\":\"Schedules\",\"status\":true,\"data\":["
+                           "{\"schedule\":65536,\"device\":7,\"action\":\"on\",\"dueInMs\":300,\"repeatMs\":0,\"pulseMs\":0},"
+                           "{\"schedule\":65537,\"device\":-40,\"action\":\"pulse\",\"dueInMs\":1800,\"repeatMs\":0,\"pulseMs\":300},"
+                           "{\"schedule\":65538,\"device\":300,\"action\":\"toggle\",\"dueInMs\":0,\"repeatMs\":60000,\"pulseMs\":0}]}";
+    TEST_ASSERT_EQUAL_STRING(expected, readStream(json, 7).c_str());
+}
+
+// A MessagePack list keeps the length it announced when a timer goes
+// before it is reached
+void test_msgpack_keeps_its_length() {
+    Scheduler timers(4);
+    timers.arm(7, Scheduler::ON, 1000, 500);
+    uint32_t pulse = timers.arm(-40, Scheduler::PULSE, 1000, 2000, 0, 300);
+    timers.arm(300, Scheduler::TOGGLE, 1000, 100, 60000);
+
+    const std::string head("\x83\xa7message\xa9Schedules\xa6status\xc3\xa4" "data", 32);
+    const std::string first("\x86\xa8schedule\xce\x00\x01\x00\x00\xa6" "device\x07\xa6" "action\xa2on\xa7" "dueInMs\xcd\x01\x2c"
+                            "\xa8repeatMs\x00\xa7pulseMs\x00",
+                            63);
+    const std::string last("\x86\xa8schedule\xce\x00\x01\x00\x02\xa6" "device\xcd\x01\x2c\xa6" "action\xa6toggle\xa7" "dueInMs\x00"
+                           "\xa8repeatMs\xcd\xea\x60\xa7pulseMs\x00",
+                           69);
+    ScheduleStream msgPack(timers, 1200, ScheduleStream::MSGPACK);
+    uint8_t buffer[40];
+    std::string body(reinterpret_cast<char*>(buffer), msgPack.read(buffer, sizeof(buffer)));
+    timers.cancel(pulse);
+    body += readStream(msgPack, 64);
+    TEST_ASSERT_TRUE_MESSAGE(body == head + "\x93" + first + last + "\xc0", "msgpack schedule list not padded to its length");
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_json);
+    RUN_TEST(test_msgpack_keeps_its_length);
+    return UNITY_END();
+}
@@ -0,0 +1,159 @@
+#include <Arduino.h>
+#include <DeviceManager.h>
+#include <ESPAsyncWebServer.h>
+#include <HostControl.h>
+#include <Metrics.h>
+#include <SessionTable.h>
+#include <SocketServer.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <unity.h>
+#include "../../bench/LoopbackClient.h"
+
+// Firmware entry point, globals and handlers from src/main.cpp
+void setup();
+extern AsyncWebServer server;
+extern DeviceManager deviceManager;
+extern Metrics metrics;
+extern SessionTable sessions;
+void handleGetDevices(AsyncWebServerRequest *request);
+
+namespace {
+
+SocketServer transport(server);
+std::thread tcpTask;
+std::string bearer;
+std::string auth;
+std::string deviceUrl;
+
+uint32_t answered(const char* method, const char* path) {
+    uint32_t count = 0;
+    for (size_t i = 0; i < metrics.seriesSize(); i++) {
+        const Metrics::Series& series = metrics.seriesAt(i);
+        const Metrics::Route& route = metrics.route(series.route);
+        if (strcmp(route.method, method) == 0 && strcmp(route.path, path) == 0) count += series.latency.count;
+    }
+    return count;
+}
+
+bool hasHeader(const LoopbackResponse& response, const char* line) {
+    return response.head.find(line) != std::string::npos;
+}
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// Three requests in one write, answered in order on one connection
+void test_pipelining() {
+    LoopbackClient client(transport.port());
+    TEST_ASSERT_TRUE_MESSAGE(client.connected(), "cannot connect");
+    client.write("GET " + deviceUrl + " HTTP/1.1\r\n" + auth + "\r\n" + "OPTIONS " + deviceUrl + " HTTP/1.1\r\n\r\n" +
+                 "GET /api/devices?type=LED HTTP/1.1\r\n" + auth + "\r\n");
+    LoopbackResponse one = client.read();
+    LoopbackResponse two = client.read();
+    LoopbackResponse three = client.read();
+    TEST_ASSERT_EQUAL(200, one.code);
+    TEST_ASSERT_EQUAL(204, two.code);
+    TEST_ASSERT_EQUAL(200, three.code);
+    TEST_ASSERT_TRUE_MESSAGE(hasHeader(one, "Connection: keep-alive\r\n"), "keep-alive not announced");
+    TEST_ASSERT_TRUE_MESSAGE(hasHeader(one, "Access-Control-Allow-Origin: *\r\n"), "CORS header missing");
+    TEST_ASSERT_FALSE_MESSAGE(hasHeader(two, "Content-Length"), "204 with a length");
+
+    // A filtered list is streamed, and comes out chunked as the handler
+    // writes it
+    AsyncWebServerRequest direct(HTTP_GET, "/api/devices?type=LED");
+    direct.addHeader("Authorization", bearer.c_str());
+    handleGetDevices(&direct);
+    String expected = direct.response()->readAll();
+    TEST_ASSERT_TRUE_MESSAGE(three.chunked, "list not chunked");
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), three.body.c_str());
+}
+
+// A body split over two segments still reaches its route
+void test_split_body() {
+    uint32_t before = answered("PUT", "/api/devices/{id}/status");
+    LoopbackClient client(transport.port());
+    client.write("PUT " + deviceUrl + "/status HTTP/1.1\r\n" + auth +
+                 "Content-Type: application/json\r\nContent-Length: 15\r\n\r\n{\"stat");
+    usleep(2000);
+    client.write("us\":true}");
+    LoopbackResponse response = client.read();
+    TEST_ASSERT_TRUE_MESSAGE(response.code != 0 && response.code != 404 && response.code != 405, "split body not routed");
+    TEST_ASSERT_EQUAL_MESSAGE(before + 1, answered("PUT", "/api/devices/{id}/status"), "split body not metered under its route");
+}
+
+// Connection: close and HTTP/1.0 end the connection after the response
+void test_connection_close() {
+    const char* closing[] = {"GET /api/admission HTTP/1.1\r\nConnection: close\r\n", "GET /api/admission HTTP/1.0\r\n"};
+    for (const char* head : closing) {
+        LoopbackClient client(transport.port());
+        client.write(std::string(head) + auth + "\r\n");
+        LoopbackResponse response = client.read();
+        TEST_ASSERT_EQUAL_MESSAGE(200, response.code, head);
+        TEST_ASSERT_TRUE_MESSAGE(hasHeader(response, "Connection: close\r\n"), head);
+        TEST_ASSERT_TRUE_MESSAGE(client.closedByServer(), head);
+    }
+}
+
+// What the transport refuses itself, closing the connection
+void test_refusals() {
+    struct Refused {
+        std::string request;
+        int code;
+    };
+    const Refused refused[] = {
+        {"NONSENSE\r\n\r\n", 400},
+        {"GET /api/devices HTTP/2\r\n\r\n", 400},
+        {"HEAD /api/devices HTTP/1.1\r\n\r\n", 501},
+        {"PUT /api/control HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n", 501},
+        {"PUT /api/control HTTP/1.1\r\nContent-Length: 70000\r\n\r\n", 413},
+        {"GET /api/devices HTTP/1.1\r\nX-Padding: " + std::string(SocketServer::MAX_HEADER_BYTES, 'x') + "\r\n\r\n", 431},
+    };
+    for (const Refused& r : refused) {
+        LoopbackClient client(transport.port());
+        client.write(r.request);
+        std::string what = r.request.substr(0, 30);
+        TEST_ASSERT_EQUAL_MESSAGE(r.code, client.read().code, what.c_str());
+        TEST_ASSERT_TRUE_MESSAGE(client.closedByServer(), what.c_str());
+    }
+}
+
+// Last: stopping the transport closes whatever is still open
+void test_stop() {
+    transport.stop();
+    tcpTask.join();
+    TEST_ASSERT_EQUAL_MESSAGE(0, transport.getStats().open, "connections left open");
+}
+
+int main() {
+    host::setSerialEnabled(false);
+    setup();
+    char token[SessionTable::TOKEN_LENGTH + 1];
+    sessions.issue(millis(), 3600000, token);
+    bearer = std::string("Bearer ") + token;
+    auth = "Authorization: " + bearer + "\r\n";
+    Device device;
+    deviceManager.readDevice(0, device);
+    deviceUrl = "/api/devices/" + std::to_string(device.id);
+
+    if (!transport.listen(0)) return 1;
+    tcpTask = std::thread([] { transport.run(); });
+
+    UNITY_BEGIN();
+    RUN_TEST(test_pipelining);
+    RUN_TEST(test_split_body);
+    RUN_TEST(test_connection_close);
+    RUN_TEST(test_refusals);
+    RUN_TEST(test_stop);
+    int failures = UNITY_END();
+    if (tcpTask.joinable()) {
+        transport.stop();
+        tcpTask.join();
+    }
+    return failures;
+}
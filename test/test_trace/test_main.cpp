@@ -0,0 +1,235 @@
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <HostControl.h>
+#include <SessionTable.h>
+#include <Trace.h>
+#include <TraceJson.h>
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+// Firmware entry point and globals from src/main.cpp
+void setup();
+extern AsyncWebServer server;
+extern SessionTable sessions;
+
+namespace {
+
+const size_t WRITERS = 4;
+const char* const NAMES[WRITERS] = {"writer 0", "writer 1", "writer 2", "writer 3"};
+const uint32_t EXTRA = 10;
+const uint32_t TOTAL = TraceRing::CAPACITY + EXTRA;
+
+String bearer;
+
+// The whole document, read piece bytes at a time
+std::string readAll(TraceJson writer, size_t piece) {
+    std::string out;
+    std::vector<uint8_t> buffer(piece);
+    size_t n;
+    while ((n = writer.read(buffer.data(), piece)) > 0) out.append(reinterpret_cast<char*>(buffer.data()), n);
+    return out;
+}
+
+size_t occurrences(const std::string& text, const char* what) {
+    size_t count = 0;
+    for (size_t at = text.find(what); at != std::string::npos; at = text.find(what, at + 1)) count++;
+    return count;
+}
+
+bool contains(const std::string& text, const char* what) {
+    return text.find(what) != std::string::npos;
+}
+
+// A ring overwritten EXTRA spans past its capacity
+void fill(TraceRing& ring) {
+    for (uint32_t i = 0; i < TOTAL; i++) ring.record(NAMES[i % WRITERS], i * 10, i * 10 + i % 7);
+}
+
+// Through the firmware's server, each from its own address so admission
+// control never steps in
+std::unique_ptr<AsyncWebServerRequest> send(WebRequestMethodComposite method, const char* url, const char* body) {
+    static uint8_t host = 0;
+    std::unique_ptr<AsyncWebServerRequest> request(new AsyncWebServerRequest(method, url));
+    request->addHeader("Authorization", bearer);
+    request->addHeader("Content-Type", "application/json");
+    request->client()->setRemoteIP(IPAddress(10, 0, 5, ++host));
+    server.dispatch(request.get(), reinterpret_cast<const uint8_t*>(body), body ? strlen(body) : 0, 64);
+    TEST_ASSERT_NOT_NULL_MESSAGE(request->response(), url);
+    return request;
+}
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// Numbering and overwriting
+void test_ring() {
+    static TraceRing ring;
+    fill(ring);
+    TEST_ASSERT_EQUAL_MESSAGE(TOTAL, ring.latest(), "spans misnumbered");
+    TEST_ASSERT_EQUAL_MESSAGE(EXTRA + 1, ring.oldest(), "spans misnumbered");
+
+    TraceRing::Span span;
+    TEST_ASSERT_FALSE_MESSAGE(ring.get(EXTRA, span), "overwritten span read");
+    for (uint32_t seq = ring.oldest(); seq <= ring.latest(); seq++) {
+        uint32_t i = seq - 1;
+        TEST_ASSERT_TRUE_MESSAGE(ring.get(seq, span), "span not read back");
+        TEST_ASSERT_TRUE_MESSAGE(span.name == NAMES[i % WRITERS] && span.startUs == i * 10 && span.durationUs == i % 7 &&
+                                     span.thread == TraceRing::currentThread(),
+                                 "span read back wrong");
+    }
+}
+
+// The same document whatever the buffer size, each span once, times from
+// the oldest span
+void test_document() {
+    static TraceRing ring;
+    fill(ring);
+    TraceRing::nameThread("test");
+    TraceJson writer(ring, TOTAL * 10 + 100);
+    std::string whole = readAll(writer, 4096);
+    TEST_ASSERT_TRUE_MESSAGE(readAll(writer, 1) == whole && readAll(writer, 7) == whole, "document depends on the buffer size");
+
+    TEST_ASSERT_EQUAL_MESSAGE(0, whole.compare(0, 16, "{\"traceEvents\":["), "document not opened");
+    TEST_ASSERT_EQUAL_MESSAGE(TraceRing::CAPACITY, occurrences(whole, "\"ph\":\"X\""), "spans not written once each");
+    TEST_ASSERT_TRUE_MESSAGE(contains(whole, "{\"name\":\"writer 2\",\"ph\":\"X\",\"ts\":0,\"dur\":3,\"pid\":1,\"tid\":"),
+                             "oldest span not at time 0");
+    TEST_ASSERT_TRUE_MESSAGE(contains(whole, "\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":") &&
+                                 contains(whole, "\"args\":{\"name\":\"test\"}"),
+                             "thread not named");
+    char tail[64];
+    snprintf(tail, sizeof(tail), "\"otherData\":{\"recorded\":%u,\"skipped\":0}}", static_cast<unsigned int>(TOTAL));
+    TEST_ASSERT_EQUAL_MESSAGE(0, whole.compare(whole.size() - strlen(tail), strlen(tail), tail), "document closed wrong");
+}
+
+// Times across the micros() wrap, and names that need escaping
+void test_wrap_and_escapes() {
+    static TraceRing wrapped;
+    wrapped.record("say \"hi\"\\", 0xffffff00u, 0xffffff10u);
+    wrapped.record("after", 0x100, 0x180);
+    std::string text = readAll(TraceJson(wrapped, 0x200), 4096);
+    TEST_ASSERT_TRUE_MESSAGE(contains(text, "\"name\":\"say \\\"hi\\\"\\\\\",\"ph\":\"X\",\"ts\":0,\"dur\":16,"),
+                             "escaped span written wrong");
+    TEST_ASSERT_TRUE_MESSAGE(contains(text, "\"name\":\"after\",\"ph\":\"X\",\"ts\":512,\"dur\":128,"),
+                             "span after the wrap written wrong");
+
+    static TraceRing empty;
+    TEST_ASSERT_TRUE_MESSAGE(contains(readAll(TraceJson(empty, 0), 4096),
+                                      "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"recorded\":0,\"skipped\":0}}"),
+                             "empty ring written wrong");
+}
+
+// Writers on several threads at once, with a reader copying behind them:
+// every span read whole must be one a single writer wrote
+void test_concurrent_writers() {
+    static TraceRing ring;
+    const uint32_t PER_WRITER = 200000;
+    std::atomic<int> threadOf[WRITERS];
+    std::atomic<size_t> running{WRITERS};
+    std::vector<std::thread> writers;
+    for (size_t t = 0; t < WRITERS; t++) {
+        threadOf[t] = -1;
+        writers.emplace_back([&, t] {
+            threadOf[t] = TraceRing::currentThread();
+            for (uint32_t i = 0; i < PER_WRITER; i++) ring.record(NAMES[t], i, i + static_cast<uint32_t>(t));
+            running--;
+        });
+    }
+
+    bool torn = false;
+    TraceRing::Span span;
+    while (running > 0) {
+        for (uint32_t seq = ring.oldest(); seq <= ring.latest(); seq++) {
+            if (!ring.get(seq, span)) continue;
+            size_t t = span.durationUs;
+            torn |= t >= WRITERS || span.name != NAMES[t] || (threadOf[t] >= 0 && span.thread != threadOf[t]);
+        }
+    }
+    for (std::thread& writer : writers) writer.join();
+    TEST_ASSERT_FALSE_MESSAGE(torn, "torn span read");
+    TEST_ASSERT_EQUAL_MESSAGE(WRITERS * PER_WRITER, ring.latest(), "spans lost their numbers");
+}
+
+#if TRACE_ENABLED
+// What a traced request looks like from the firmware's own ring
+void test_traced_requests() {
+    uint32_t before = traceRing.latest();
+    send(HTTP_GET, "/api/devices/1", nullptr);
+    // Whether or not device 1 takes it, the command goes through the
+    // actuator task
+    send(HTTP_PUT, "/api/control", "{\"device\":1,\"status\":true}");
+
+    struct Expected {
+        const char* name;
+        bool onActuator;
+    };
+    const Expected expected[] = {
+        {"admission", false},
+        {"GET /api/devices/{id}", false},
+        {"checkAuthorization", false},
+        {"DeviceManager::copyDevice", false},
+        {"beginDocumentResponse", false},
+        {"sendResponse", false},
+        {"PUT /api/control", false},
+        {"collectBody", false},
+        {"parseBody", false},
+        {"Actuator::wait", false},
+        {"Actuator queue", true},
+        {"Actuator::apply", true},
+        {"DeviceManager::updateDevice", true},
+    };
+    int handlerThread = -1;
+    int actuatorThread = -1;
+    for (const Expected& e : expected) {
+        TraceRing::Span span;
+        bool found = false;
+        for (uint32_t seq = before + 1; seq <= traceRing.latest() && !found; seq++) {
+            found = traceRing.get(seq, span) && strcmp(span.name, e.name) == 0;
+        }
+        TEST_ASSERT_TRUE_MESSAGE(found, e.name);
+        int& thread = e.onActuator ? actuatorThread : handlerThread;
+        if (thread >= 0) TEST_ASSERT_EQUAL_MESSAGE(thread, span.thread, e.name);
+        thread = span.thread;
+    }
+    TEST_ASSERT_TRUE_MESSAGE(handlerThread != actuatorThread, "actuator spans on the handler's thread");
+
+    std::unique_ptr<AsyncWebServerRequest> dump = send(HTTP_GET, "/api/trace", nullptr);
+    std::string body = dump->response()->readAll().c_str();
+    TEST_ASSERT_EQUAL(200, dump->response()->code());
+    TEST_ASSERT_TRUE_MESSAGE(contains(body, "\"name\":\"GET /api/devices/{id}\",\"ph\":\"X\""), "/api/trace without the requests");
+    TEST_ASSERT_TRUE_MESSAGE(contains(body, "\"args\":{\"name\":\"actuator\"}"), "actuator thread not named");
+}
+#else
+// With tracing built out, /api/trace is not there at all
+void test_built_out() {
+    TEST_ASSERT_EQUAL(404, send(HTTP_GET, "/api/trace", nullptr)->response()->code());
+}
+#endif
+
+int main() {
+    host::setSerialEnabled(false);
+    setup();
+    char token[SessionTable::TOKEN_LENGTH + 1];
+    sessions.issue(millis(), 3600000, token);
+    bearer = String("Bearer ") + token;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_ring);
+    RUN_TEST(test_document);
+    RUN_TEST(test_wrap_and_escapes);
+    RUN_TEST(test_concurrent_writers);
+#if TRACE_ENABLED
+    RUN_TEST(test_traced_requests);
+#else
+    RUN_TEST(test_built_out);
+#endif
+    return UNITY_END();
+}